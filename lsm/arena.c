@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+/*
+ * void initArena(Arena *arena, size_t firstBlockSize)
+ *   Initializes an empty arena. No memory is allocated until the first call
+ *   to arenaAllocate.
+ * @param arena: The arena to initialize
+ * @param firstBlockSize: Size of the first block; sized so that a full
+ *   memtable normally fits in one block
+ */
+void initArena(Arena *arena, size_t firstBlockSize) {
+  arena->blocks = NULL;
+  arena->ptr = NULL;
+  arena->remaining = 0;
+  arena->used = 0;
+  arena->firstBlockSize = firstBlockSize;
+}
+
+/*
+ * static int addBlock(Arena *arena, size_t bytes)
+ *   Allocates a new block large enough for at least the given bytes and makes
+ *   it the current block. Whatever was left in the old block is wasted.
+ * @param arena: The arena to grow
+ * @param bytes: The size of the allocation that did not fit
+ * @return: 1 on success, 0 if malloc failed
+ */
+static int addBlock(Arena *arena, size_t bytes) {
+  size_t size =
+      arena->blocks == NULL ? arena->firstBlockSize : ARENA_OVERFLOW_BLOCK_SIZE;
+  if (size < bytes) {
+    size = bytes;
+  }
+
+  ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+  if (block == NULL) {
+    perror("Failed to allocate memory for arena block");
+    return 0;
+  }
+  block->next = arena->blocks;
+  arena->blocks = block;
+  arena->ptr = block->data;
+  arena->remaining = size;
+  return 1;
+}
+
+/*
+ * void *arenaAllocate(Arena *arena, size_t bytes)
+ *   Hands out the next bytes of the current block, rounded up so the next
+ *   allocation stays aligned.
+ * @param arena: The arena to allocate from
+ * @param bytes: The number of bytes needed
+ * @return: A pointer to the memory, or NULL if malloc failed
+ */
+void *arenaAllocate(Arena *arena, size_t bytes) {
+  size_t aligned = (bytes + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+  if (aligned > arena->remaining && !addBlock(arena, aligned)) {
+    return NULL;
+  }
+
+  void *result = arena->ptr;
+  arena->ptr += aligned;
+  arena->remaining -= aligned;
+  arena->used += aligned;
+  return result;
+}
+
+/*
+ * size_t arenaMemoryUsage(const Arena *arena)
+ *   Returns the number of bytes handed out by the arena.
+ * @param arena: The arena to check
+ */
+size_t arenaMemoryUsage(const Arena *arena) { return arena->used; }
+
+/*
+ * void freeArena(Arena *arena)
+ *   Frees every block of the arena. A memtable that stayed under the
+ *   threshold only has one block, so this is a single free.
+ * @param arena: The arena to free
+ */
+void freeArena(Arena *arena) {
+  ArenaBlock *block = arena->blocks;
+  while (block != NULL) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  initArena(arena, arena->firstBlockSize);
+}
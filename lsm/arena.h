@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Arena macros
+// Alignment of every allocation, enough for the pointers inside a Node
+#define ARENA_ALIGNMENT sizeof(void *)
+// Size of the extra blocks allocated once the first block is used up
+#define ARENA_OVERFLOW_BLOCK_SIZE 64 * 1024 // 64KB
+
+// A single malloc'd chunk of arena memory
+typedef struct ArenaBlock {
+  struct ArenaBlock *next; // Previously filled block, or NULL
+  char data[];             // Memory handed out by arenaAllocate
+} ArenaBlock;
+
+// Bump-pointer allocator: memory is handed out in order and only released all
+// at once by freeArena
+typedef struct {
+  ArenaBlock *blocks;    // Most recent block, linked to the older ones
+  char *ptr;             // Next free byte in the current block
+  size_t remaining;      // Bytes left in the current block
+  size_t used;           // Total bytes handed out, including alignment padding
+  size_t firstBlockSize; // Size of the first block, allocated lazily
+} Arena;
+
+// Function declarations
+// Initializes an empty arena whose first block will be firstBlockSize bytes
+void initArena(Arena *arena, size_t firstBlockSize);
+// Allocates bytes from the arena, returns NULL if malloc fails
+void *arenaAllocate(Arena *arena, size_t bytes);
+// Returns the number of bytes handed out by the arena
+size_t arenaMemoryUsage(const Arena *arena);
+// Frees every block of the arena and resets it to empty
+void freeArena(Arena *arena);
+
+#endif // ARENA_H
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "coding.h"
+#include "memtable.h"
+
+/*
+ * WriteBatch *createWriteBatch()
+ *   Public function to create an empty batch. Its buffer is allocated by
+ *   the first entry added.
+ * @return: The new batch
+ */
+WriteBatch *createWriteBatch() {
+  WriteBatch *batch = calloc(1, sizeof(WriteBatch));
+  if (batch == NULL) {
+    perror("Failed to allocate memory for write batch");
+    exit(EXIT_FAILURE);
+  }
+  return batch;
+}
+
+/*
+ * int addToWriteBatch(WriteBatch *batch, const char *key, const char *value)
+ *   Public function to add a write or a deletion to a batch. Nothing is
+ *   written until the batch is applied.
+ *   If the buffer is full, double it.
+ * @param batch: The batch
+ * @param key: The key written or deleted
+ * @param value: The value, or NULL for a deletion
+ * @return: 1 if the entry was added, 0 if the key or value is too long
+ */
+int addToWriteBatch(WriteBatch *batch, const char *key, const char *value) {
+  if (key == NULL) {
+    printf("Key cannot be null.\n");
+    return 0;
+  }
+  size_t keyLength = strlen(key);
+  size_t valueLength = value != NULL ? strlen(value) : 0;
+  if (keyLength > MAX_KEY_LENGTH || valueLength > MAX_VALUE_LENGTH) {
+    printf("Key or value exceeds maximum length of %d.\n", (int)MAX_KEY_LENGTH);
+    return 0;
+  }
+
+  size_t needed = BATCH_ENTRY_OVERHEAD + keyLength + valueLength;
+  if (batch->size + needed > batch->capacity) {
+    size_t capacity = batch->capacity == 0 ? 1024 : batch->capacity;
+    while (batch->size + needed > capacity) {
+      capacity *= 2;
+    }
+    char *temp = realloc(batch->data, capacity);
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for write batch");
+      exit(EXIT_FAILURE);
+    }
+    batch->data = temp;
+    batch->capacity = capacity;
+  }
+  batch->size += encodeBatchEntry(batch->data + batch->size, key, keyLength,
+                                  value, valueLength);
+  batch->count++;
+  return 1;
+}
+
+/*
+ * void clearWriteBatch(WriteBatch *batch)
+ *   Public function to drop every entry of a batch. The buffer is kept for
+ *   the next entries.
+ * @param batch: The batch
+ */
+void clearWriteBatch(WriteBatch *batch) {
+  batch->size = 0;
+  batch->count = 0;
+}
+
+/*
+ * void freeWriteBatch(WriteBatch *batch)
+ *   Public function to free a batch and its entries.
+ * @param batch: The batch to free
+ */
+void freeWriteBatch(WriteBatch *batch) {
+  free(batch->data);
+  free(batch);
+}
+
+/*
+ * size_t encodeBatchEntry(char *dst, const char *key, uint32_t keyLength,
+ *                         const char *value, uint32_t valueLength)
+ *   Public function to encode an entry in the batch layout, shared with the
+ *   log so a single write is logged like a batch of one.
+ * @param dst: Where to write, with room for BATCH_ENTRY_OVERHEAD more bytes
+ *   than the key and value
+ * @param key: The key, not terminated
+ * @param keyLength: The length of the key
+ * @param value: The value, not terminated, or NULL for a deletion
+ * @param valueLength: The length of the value
+ * @return: The number of bytes written
+ */
+size_t encodeBatchEntry(char *dst, const char *key, uint32_t keyLength,
+                        const char *value, uint32_t valueLength) {
+  char *ptr = dst;
+  *ptr++ = value != NULL ? BATCH_TYPE_VALUE : BATCH_TYPE_DELETION;
+  ptr += encodeVarint32(ptr, keyLength);
+  memcpy(ptr, key, keyLength);
+  ptr += keyLength;
+  ptr += encodeVarint32(ptr, valueLength);
+  if (value != NULL) {
+    memcpy(ptr, value, valueLength);
+    ptr += valueLength;
+  }
+  return ptr - dst;
+}
+
+/*
+ * int decodeBatchEntry(const char **ptr, const char *limit,
+ *                      BatchEntry *entry)
+ *   Public function to decode the next entry of a batch or log record.
+ * @param ptr: The entry to decode, moved past it on success
+ * @param limit: The end of the entries
+ * @param entry: Set to the entry, its key and value point into the input
+ * @return: 1 on success, 0 if the entry is not valid
+ */
+int decodeBatchEntry(const char **ptr, const char *limit, BatchEntry *entry) {
+  const char *p = *ptr;
+  if (p >= limit) {
+    return 0;
+  }
+  entry->type = (uint8_t)*p++;
+  if (entry->type != BATCH_TYPE_VALUE && entry->type != BATCH_TYPE_DELETION) {
+    return 0;
+  }
+  p = decodeVarint32(p, limit, &entry->keyLength);
+  if (p == NULL || entry->keyLength > (uint32_t)(limit - p)) {
+    return 0;
+  }
+  entry->key = p;
+  p += entry->keyLength;
+  p = decodeVarint32(p, limit, &entry->valueLength);
+  if (p == NULL || entry->valueLength > (uint32_t)(limit - p)) {
+    return 0;
+  }
+  entry->value = entry->type == BATCH_TYPE_VALUE ? p : NULL;
+  *ptr = p + entry->valueLength;
+  return 1;
+}
@@ -0,0 +1,55 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Batch layout
+// The entries of a batch one after the other, each
+//   [byte type][varint keyLength][key][varint valueLength][value]
+// A deletion has no value. The same layout follows the header of a log
+// record, so a whole batch is logged with one copy.
+#define BATCH_TYPE_DELETION 0
+#define BATCH_TYPE_VALUE 1
+// Largest encoded entry: the type and two 5 byte varints plus the key and
+// value
+#define BATCH_ENTRY_OVERHEAD 11
+
+// A group of writes and deletions applied atomically by applyWriteBatch
+// They all get consecutive sequence numbers in the order they were added,
+// are logged as a single record and become visible together.
+typedef struct {
+  char *data; // Encoded entries
+  size_t size;
+  size_t capacity;
+  uint32_t count; // Entries in data
+} WriteBatch;
+
+// An entry decoded from a batch, pointing into its data
+typedef struct {
+  uint8_t type;    // BATCH_TYPE_VALUE or BATCH_TYPE_DELETION
+  const char *key; // Not terminated
+  uint32_t keyLength;
+  const char *value; // Not terminated, NULL for a deletion
+  uint32_t valueLength;
+} BatchEntry;
+
+// Function declarations
+// Creates an empty batch
+WriteBatch *createWriteBatch();
+// Adds a write of a key to the batch, a NULL value adds a deletion
+// Returns 0 if the key or value is NULL or too long, the batch is unchanged
+int addToWriteBatch(WriteBatch *batch, const char *key, const char *value);
+// Empties a batch so it can be filled again, keeping its buffer
+void clearWriteBatch(WriteBatch *batch);
+// Frees a batch
+void freeWriteBatch(WriteBatch *batch);
+// Encodes one entry at dst, which must hold BATCH_ENTRY_OVERHEAD plus the
+// key and value bytes. Returns the number of bytes written
+size_t encodeBatchEntry(char *dst, const char *key, uint32_t keyLength,
+                        const char *value, uint32_t valueLength);
+// Decodes the entry at *ptr and moves *ptr past it
+// Returns 0 if the entry runs past limit or has an unknown type
+int decodeBatchEntry(const char **ptr, const char *limit, BatchEntry *entry);
+
+#endif // BATCH_H
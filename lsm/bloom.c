@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bloom.h"
+
+/*
+ * uint32_t bloomHash(const char *key, size_t length)
+ *   Murmur style hash of a key, 4 bytes at a time.
+ * @param key: The key bytes
+ * @param length: The number of key bytes
+ * @return: The 32-bit hash
+ */
+uint32_t bloomHash(const char *key, size_t length) {
+  const uint32_t m = 0xc6a4a793;
+  const unsigned char *data = (const unsigned char *)key;
+  uint32_t h = 0xbc9f1d34 ^ (uint32_t)(length * m);
+
+  while (length >= 4) {
+    uint32_t w = data[0] | (data[1] << 8) | (data[2] << 16) |
+                 ((uint32_t)data[3] << 24);
+    h += w;
+    h *= m;
+    h ^= h >> 16;
+    data += 4;
+    length -= 4;
+  }
+
+  // Pick up the remaining bytes
+  switch (length) {
+  case 3:
+    h += (uint32_t)data[2] << 16;
+    // fall through
+  case 2:
+    h += (uint32_t)data[1] << 8;
+    // fall through
+  case 1:
+    h += data[0];
+    h *= m;
+    h ^= h >> 24;
+    break;
+  }
+  return h;
+}
+
+/*
+ * char *createBloomFilter(const uint32_t *hashes, int count, int bitsPerKey,
+ *                         size_t *size)
+ *   Builds a Bloom filter for a set of key hashes. The probe positions come
+ *   from double hashing: each probe adds a rotated copy of the hash.
+ *   Layout: [bit array][1 byte number of probes]
+ * @param hashes: The bloomHash of every key
+ * @param count: The number of keys
+ * @param bitsPerKey: Filter bits per key, more bits means fewer false
+ *   positives
+ * @param size: Set to the size of the filter in bytes
+ * @return: The malloc'd filter
+ */
+char *createBloomFilter(const uint32_t *hashes, int count, int bitsPerKey,
+                        size_t *size) {
+  // k = bitsPerKey * ln(2) minimizes the false positive rate
+  int probes = (int)(bitsPerKey * 0.69);
+  if (probes < 1) {
+    probes = 1;
+  }
+  if (probes > 30) {
+    probes = 30;
+  }
+
+  size_t bits = (size_t)count * bitsPerKey;
+  if (bits < BLOOM_MIN_BITS) {
+    bits = BLOOM_MIN_BITS;
+  }
+  size_t bytes = (bits + 7) / 8;
+  bits = bytes * 8;
+
+  char *filter = calloc(bytes + 1, 1);
+  if (filter == NULL) {
+    perror("Failed to allocate memory for Bloom filter");
+    exit(EXIT_FAILURE);
+  }
+  filter[bytes] = (char)probes;
+
+  for (int i = 0; i < count; i++) {
+    uint32_t h = hashes[i];
+    uint32_t delta = (h >> 17) | (h << 15); // Rotate right 17 bits
+    for (int j = 0; j < probes; j++) {
+      uint32_t bit = h % bits;
+      filter[bit / 8] |= (char)(1 << (bit % 8));
+      h += delta;
+    }
+  }
+
+  *size = bytes + 1;
+  return filter;
+}
+
+/*
+ * int bloomMayContain(const char *filter, size_t size, const char *key,
+ *                     size_t length)
+ *   Checks the probe positions of a key. Any clear bit proves the key was
+ *   never added.
+ * @param filter: The filter built by createBloomFilter
+ * @param size: The size of the filter in bytes
+ * @param key: The key bytes
+ * @param length: The number of key bytes
+ * @return: 0 if the key is definitely absent, 1 if it may be present
+ */
+int bloomMayContain(const char *filter, size_t size, const char *key,
+                    size_t length) {
+  if (filter == NULL || size < 2) {
+    return 1; // No usable filter, the table has to be searched
+  }
+  size_t bits = (size - 1) * 8;
+  int probes = (unsigned char)filter[size - 1];
+  if (probes > 30) {
+    return 1; // Unknown encoding, err on the side of searching
+  }
+
+  uint32_t h = bloomHash(key, length);
+  uint32_t delta = (h >> 17) | (h << 15);
+  for (int j = 0; j < probes; j++) {
+    uint32_t bit = h % bits;
+    if ((filter[bit / 8] & (1 << (bit % 8))) == 0) {
+      return 0;
+    }
+    h += delta;
+  }
+  return 1;
+}
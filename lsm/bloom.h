@@ -0,0 +1,23 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bloom filter macros
+// Default number of filter bits per key, about a 1% false positive rate
+#define BLOOM_BITS_PER_KEY 10
+// Smallest filter, keeps the false positive rate sane for tiny tables
+#define BLOOM_MIN_BITS 64
+
+// Function declarations
+// Hashes a key for the Bloom filter
+uint32_t bloomHash(const char *key, size_t length);
+// Builds a filter from key hashes, returns a malloc'd filter of *size bytes
+char *createBloomFilter(const uint32_t *hashes, int count, int bitsPerKey,
+                        size_t *size);
+// Returns 0 if the key is definitely not in the filter, 1 if it might be
+int bloomMayContain(const char *filter, size_t size, const char *key,
+                    size_t length);
+
+#endif // BLOOM_H
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache.h"
+
+/*
+ * static uint32_t hashBlockKey(uint64_t fileId, uint64_t offset)
+ *   Mixes a (fileId, offset) pair into 32 bits. The top bits pick the shard,
+ *   the low bits the bucket inside it.
+ */
+static uint32_t hashBlockKey(uint64_t fileId, uint64_t offset) {
+  uint64_t h = fileId * 0x9E3779B97F4A7C15ULL ^ offset;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  return (uint32_t)h;
+}
+
+/*
+ * static CacheShard *getShard(BlockCache *cache, uint32_t hash)
+ *   Returns the shard responsible for a hash.
+ */
+static CacheShard *getShard(BlockCache *cache, uint32_t hash) {
+  return &cache->shards[hash >> (32 - BLOCK_CACHE_SHARD_BITS)];
+}
+
+/*
+ * static CacheEntry **findSlot(CacheShard *shard, uint64_t fileId,
+ *                              uint64_t offset, uint32_t hash)
+ *   Finds the bucket pointer that points at the entry for a block.
+ * @return: The slot, which holds NULL if the block is not cached
+ */
+static CacheEntry **findSlot(CacheShard *shard, uint64_t fileId,
+                             uint64_t offset, uint32_t hash) {
+  CacheEntry **slot = &shard->buckets[hash & (shard->bucketCount - 1)];
+  while (*slot != NULL &&
+         ((*slot)->fileId != fileId || (*slot)->offset != offset)) {
+    slot = &(*slot)->hashNext;
+  }
+  return slot;
+}
+
+/*
+ * static void growBuckets(CacheShard *shard)
+ *   Doubles the number of buckets and rehashes every entry.
+ */
+static void growBuckets(CacheShard *shard) {
+  int newCount = shard->bucketCount * 2;
+  CacheEntry **newBuckets = calloc(newCount, sizeof(CacheEntry *));
+  if (newBuckets == NULL) {
+    perror("Failed to reallocate memory for block cache buckets");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < shard->bucketCount; i++) {
+    CacheEntry *entry = shard->buckets[i];
+    while (entry != NULL) {
+      CacheEntry *next = entry->hashNext;
+      CacheEntry **bucket = &newBuckets[entry->hash & (newCount - 1)];
+      entry->hashNext = *bucket;
+      *bucket = entry;
+      entry = next;
+    }
+  }
+  free(shard->buckets);
+  shard->buckets = newBuckets;
+  shard->bucketCount = newCount;
+}
+
+/*
+ * static void lruRemove(CacheEntry *entry)
+ *   Unlinks an entry from its shard's LRU list.
+ */
+static void lruRemove(CacheEntry *entry) {
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+}
+
+/*
+ * static void lruPushFront(CacheShard *shard, CacheEntry *entry)
+ *   Links an entry as the most recently used of its shard.
+ */
+static void lruPushFront(CacheShard *shard, CacheEntry *entry) {
+  entry->next = shard->lru.next;
+  entry->prev = &shard->lru;
+  entry->next->prev = entry;
+  shard->lru.next = entry;
+}
+
+/*
+ * static void unrefEntry(CacheEntry *entry)
+ *   Drops a reference, freeing the entry with the last one.
+ *   Must be called with the shard mutex held.
+ */
+static void unrefEntry(CacheEntry *entry) {
+  if (--entry->refs == 0) {
+    free(entry->data);
+    free(entry);
+  }
+}
+
+/*
+ * static void removeEntry(CacheShard *shard, CacheEntry **slot)
+ *   Takes the entry in a slot out of the shard and drops the cache's
+ *   reference. Pinned entries stay alive until they are released.
+ */
+static void removeEntry(CacheShard *shard, CacheEntry **slot) {
+  CacheEntry *entry = *slot;
+  *slot = entry->hashNext;
+  lruRemove(entry);
+  shard->entryCount--;
+  shard->usage -= entry->size;
+  unrefEntry(entry);
+}
+
+/*
+ * static void evictEntries(CacheShard *shard)
+ *   Evicts least recently used entries until the shard is within capacity.
+ */
+static void evictEntries(CacheShard *shard) {
+  while (shard->usage > shard->capacity && shard->lru.prev != &shard->lru) {
+    CacheEntry *oldest = shard->lru.prev;
+    removeEntry(shard, findSlot(shard, oldest->fileId, oldest->offset,
+                                oldest->hash));
+  }
+}
+
+/*
+ * BlockCache *createBlockCache(size_t capacity)
+ *   Creates an empty block cache. The budget is split evenly between the
+ *   shards.
+ * @param capacity: The maximum number of bytes of blocks to keep
+ * @return: A pointer to the new cache
+ */
+BlockCache *createBlockCache(size_t capacity) {
+  BlockCache *cache = calloc(1, sizeof(BlockCache));
+  if (cache == NULL) {
+    perror("Failed to allocate memory for block cache");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+    CacheShard *shard = &cache->shards[i];
+    pthread_mutex_init(&shard->mutex, NULL);
+    shard->bucketCount = 16; // Initial capacity
+    shard->buckets = calloc(shard->bucketCount, sizeof(CacheEntry *));
+    if (shard->buckets == NULL) {
+      perror("Failed to allocate memory for block cache buckets");
+      exit(EXIT_FAILURE);
+    }
+    shard->lru.next = &shard->lru;
+    shard->lru.prev = &shard->lru;
+    shard->capacity = capacity / BLOCK_CACHE_SHARDS;
+  }
+  return cache;
+}
+
+/*
+ * void freeBlockCache(BlockCache *cache)
+ *   Frees every cached block and the cache itself.
+ * @param cache: The cache to free, no entry may still be pinned
+ */
+void freeBlockCache(BlockCache *cache) {
+  for (int i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+    CacheShard *shard = &cache->shards[i];
+    while (shard->lru.next != &shard->lru) {
+      CacheEntry *entry = shard->lru.next;
+      removeEntry(shard,
+                  findSlot(shard, entry->fileId, entry->offset, entry->hash));
+    }
+    free(shard->buckets);
+    pthread_mutex_destroy(&shard->mutex);
+  }
+  free(cache);
+}
+
+/*
+ * void setBlockCacheCapacity(BlockCache *cache, size_t capacity)
+ *   Changes the byte budget of the cache.
+ * @param cache: The cache to resize
+ * @param capacity: The new maximum number of bytes of blocks to keep
+ */
+void setBlockCacheCapacity(BlockCache *cache, size_t capacity) {
+  for (int i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+    CacheShard *shard = &cache->shards[i];
+    pthread_mutex_lock(&shard->mutex);
+    shard->capacity = capacity / BLOCK_CACHE_SHARDS;
+    evictEntries(shard);
+    pthread_mutex_unlock(&shard->mutex);
+  }
+}
+
+/*
+ * CacheEntry *lookupBlockCache(BlockCache *cache, uint64_t fileId,
+ *                              uint64_t offset)
+ *   Looks up a block and marks it as the most recently used.
+ * @param cache: The cache to search
+ * @param fileId: The identity of the SSTable the block belongs to
+ * @param offset: The offset of the block in the SSTable
+ * @return: The pinned entry, or NULL if the block is not cached
+ */
+CacheEntry *lookupBlockCache(BlockCache *cache, uint64_t fileId,
+                             uint64_t offset) {
+  uint32_t hash = hashBlockKey(fileId, offset);
+  CacheShard *shard = getShard(cache, hash);
+  pthread_mutex_lock(&shard->mutex);
+  CacheEntry *entry = *findSlot(shard, fileId, offset, hash);
+  if (entry != NULL) {
+    entry->refs++;
+    lruRemove(entry);
+    lruPushFront(shard, entry);
+    shard->hits++;
+  } else {
+    shard->misses++;
+  }
+  pthread_mutex_unlock(&shard->mutex);
+  return entry;
+}
+
+/*
+ * CacheEntry *insertBlockCache(BlockCache *cache, uint64_t fileId,
+ *                              uint64_t offset, char *data, size_t size)
+ *   Adds a block to the cache, replacing any entry for the same block, and
+ *   evicts least recently used blocks if the shard is over budget.
+ *   If the array of buckets is full, double it.
+ * @param cache: The cache to add to
+ * @param fileId: The identity of the SSTable the block belongs to
+ * @param offset: The offset of the block in the SSTable
+ * @param data: The malloc'd block, owned by the cache from now on
+ * @param size: The size of the block in bytes
+ * @return: The pinned entry
+ */
+CacheEntry *insertBlockCache(BlockCache *cache, uint64_t fileId,
+                             uint64_t offset, char *data, size_t size) {
+  CacheEntry *entry = malloc(sizeof(CacheEntry));
+  if (entry == NULL) {
+    perror("Failed to allocate memory for block cache entry");
+    exit(EXIT_FAILURE);
+  }
+  entry->fileId = fileId;
+  entry->offset = offset;
+  entry->data = data;
+  entry->size = size;
+  entry->hash = hashBlockKey(fileId, offset);
+  entry->refs = 2; // One for the cache, one for the caller
+
+  CacheShard *shard = getShard(cache, entry->hash);
+  pthread_mutex_lock(&shard->mutex);
+  CacheEntry **slot = findSlot(shard, fileId, offset, entry->hash);
+  if (*slot != NULL) {
+    // Another reader loaded the same block first
+    removeEntry(shard, slot);
+  }
+  entry->hashNext = *slot;
+  *slot = entry;
+  lruPushFront(shard, entry);
+  shard->entryCount++;
+  shard->usage += size;
+  if (shard->entryCount > shard->bucketCount) {
+    growBuckets(shard);
+  }
+  evictEntries(shard);
+  pthread_mutex_unlock(&shard->mutex);
+  return entry;
+}
+
+/*
+ * void releaseBlockCache(BlockCache *cache, CacheEntry *entry)
+ *   Unpins an entry. Its data must not be used afterwards.
+ * @param cache: The cache the entry came from
+ * @param entry: The entry to release
+ */
+void releaseBlockCache(BlockCache *cache, CacheEntry *entry) {
+  CacheShard *shard = getShard(cache, entry->hash);
+  pthread_mutex_lock(&shard->mutex);
+  unrefEntry(entry);
+  pthread_mutex_unlock(&shard->mutex);
+}
+
+/*
+ * void getBlockCacheStats(BlockCache *cache, long *hits, long *misses,
+ *                         size_t *usage)
+ *   Adds up the counters of every shard.
+ * @param cache: The cache to inspect
+ * @param hits: Set to the number of lookups that found their block
+ * @param misses: Set to the number of lookups that did not
+ * @param usage: Set to the number of bytes of blocks held
+ */
+void getBlockCacheStats(BlockCache *cache, long *hits, long *misses,
+                        size_t *usage) {
+  *hits = 0;
+  *misses = 0;
+  *usage = 0;
+  for (int i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+    CacheShard *shard = &cache->shards[i];
+    pthread_mutex_lock(&shard->mutex);
+    *hits += shard->hits;
+    *misses += shard->misses;
+    *usage += shard->usage;
+    pthread_mutex_unlock(&shard->mutex);
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Block cache macros
+// Default byte budget shared by all shards
+#define BLOCK_CACHE_CAPACITY 8 * 1024 * 1024 // 8MB
+// Each shard has its own lock, so readers of different blocks rarely contend
+#define BLOCK_CACHE_SHARD_BITS 4
+#define BLOCK_CACHE_SHARDS (1 << BLOCK_CACHE_SHARD_BITS)
+
+// A cached SSTable data block, keyed by (fileId, offset)
+// The cache holds one reference while the entry is in its table, every
+// lookup or insert hands out another that must be released. An evicted entry
+// is freed once the last pinned reference is released.
+typedef struct CacheEntry {
+  uint64_t fileId;
+  uint64_t offset;
+  char *data;
+  size_t size;
+  uint32_t hash;
+  int refs;                    // Guarded by the shard mutex
+  struct CacheEntry *hashNext; // Next entry in the same bucket
+  struct CacheEntry *prev;     // LRU list neighbors, most recent first
+  struct CacheEntry *next;
+} CacheEntry;
+
+// One independently locked part of the cache
+typedef struct {
+  pthread_mutex_t mutex;
+  CacheEntry **buckets;
+  int bucketCount; // Always a power of two
+  int entryCount;
+  CacheEntry lru; // Sentinel, lru.next is the most recently used entry
+  size_t usage;   // Bytes of block data held by the shard
+  size_t capacity;
+  long hits;
+  long misses;
+} CacheShard;
+
+typedef struct {
+  CacheShard shards[BLOCK_CACHE_SHARDS];
+} BlockCache;
+
+// Function declarations
+// Creates an empty cache holding up to capacity bytes of blocks
+BlockCache *createBlockCache(size_t capacity);
+// Frees the cache, no entry may still be pinned
+void freeBlockCache(BlockCache *cache);
+// Changes the byte budget, evicting least recently used blocks if needed
+void setBlockCacheCapacity(BlockCache *cache, size_t capacity);
+// Returns a pinned entry for the block, or NULL on a miss
+CacheEntry *lookupBlockCache(BlockCache *cache, uint64_t fileId,
+                             uint64_t offset);
+// Adds a malloc'd block the cache takes ownership of, returns it pinned
+CacheEntry *insertBlockCache(BlockCache *cache, uint64_t fileId,
+                             uint64_t offset, char *data, size_t size);
+// Releases an entry returned by lookupBlockCache or insertBlockCache
+void releaseBlockCache(BlockCache *cache, CacheEntry *entry);
+// Sums the hit and miss counters and the memory usage of all shards
+void getBlockCacheStats(BlockCache *cache, long *hits, long *misses,
+                        size_t *usage);
+
+#endif // CACHE_H
@@ -0,0 +1,91 @@
+#ifndef CODING_H
+#define CODING_H
+
+#include <stdint.h>
+
+/*
+ * Encoding helpers for the binary SSTable format
+ * Fixed width integers are little-endian, varints use 7 bits per byte with the
+ * high bit set on every byte but the last.
+ */
+
+/*
+ * static void encodeFixed32(char *dst, uint32_t value)
+ *   Writes a 32-bit integer as 4 little-endian bytes
+ */
+static inline void encodeFixed32(char *dst, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    dst[i] = (char)((value >> (8 * i)) & 0xff);
+  }
+}
+
+/*
+ * static void encodeFixed64(char *dst, uint64_t value)
+ *   Writes a 64-bit integer as 8 little-endian bytes
+ */
+static inline void encodeFixed64(char *dst, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    dst[i] = (char)((value >> (8 * i)) & 0xff);
+  }
+}
+
+/*
+ * static uint32_t decodeFixed32(const char *src)
+ *   Reads 4 little-endian bytes
+ */
+static inline uint32_t decodeFixed32(const char *src) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    value |= (uint32_t)(unsigned char)src[i] << (8 * i);
+  }
+  return value;
+}
+
+/*
+ * static uint64_t decodeFixed64(const char *src)
+ *   Reads 8 little-endian bytes
+ */
+static inline uint64_t decodeFixed64(const char *src) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value |= (uint64_t)(unsigned char)src[i] << (8 * i);
+  }
+  return value;
+}
+
+/*
+ * static int encodeVarint32(char *dst, uint32_t value)
+ *   Writes a varint, which takes at most 5 bytes
+ * @return: The number of bytes written
+ */
+static inline int encodeVarint32(char *dst, uint32_t value) {
+  int length = 0;
+  while (value >= 0x80) {
+    dst[length++] = (char)(value | 0x80);
+    value >>= 7;
+  }
+  dst[length++] = (char)value;
+  return length;
+}
+
+/*
+ * static const char *decodeVarint32(const char *src, const char *limit,
+ *                                   uint32_t *value)
+ *   Reads a varint without reading past limit
+ * @return: A pointer past the varint, or NULL if it is truncated or corrupt
+ */
+static inline const char *decodeVarint32(const char *src, const char *limit,
+                                         uint32_t *value) {
+  uint32_t result = 0;
+  for (int shift = 0; shift <= 28 && src < limit; shift += 7) {
+    uint32_t byte = (unsigned char)*src++;
+    result |= (byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return src;
+    }
+  }
+  return NULL;
+}
+
+#endif // CODING_H
@@ -0,0 +1,905 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compaction.h"
+
+// One input table of a merge, positioned at its next entry
+typedef struct {
+  SSTableReader *reader;
+  SSTableIterator iterator;
+  int rank; // Position in the input list, lower is newer
+} MergeInput;
+
+// The output table being written
+typedef struct {
+  SSTableBuilder *builder;
+  uint64_t number;
+  char filepath[MAX_PATH_LENGTH];
+  char tempPath[MAX_PATH_LENGTH + sizeof(TEMP_SUFFIX)];
+  uint64_t charged; // Bytes already paid to the rate limiter
+} MergeOutput;
+
+// One key range of a merge, run on its own thread
+// Every range reads the same open inputs through its own iterators, and
+// writes its own outputs, which no other range overlaps.
+typedef struct {
+  VersionSet *versions;
+  const Compaction *compaction;
+  SSTableReader **readers; // Inputs in the order of compaction->inputs
+  int readerCount;
+  const char *start;       // First key of the range, NULL for no bound
+  const char *end;         // First key past the range, NULL for no bound
+  VersionEdit outputs;     // Tables written for the range
+  CompactionStats stats;
+  int ok;
+  pthread_t thread;
+  int threadStarted;
+} Subcompaction;
+
+/*
+ * ######################
+ * Merge heap
+ * ######################
+ */
+
+/*
+ * static int inputLess(const MergeInput *a, const MergeInput *b)
+ *   Orders inputs by their current key, then newest entry first, so the
+ *   entries of a key leave the heap by decreasing sequence number.
+ * @return: 1 if a comes before b
+ */
+static int inputLess(const MergeInput *a, const MergeInput *b) {
+  int cmp = strcmp(a->iterator.key, b->iterator.key);
+  if (cmp != 0) {
+    return cmp < 0;
+  }
+  if (a->iterator.sequence != b->iterator.sequence) {
+    return a->iterator.sequence > b->iterator.sequence;
+  }
+  return a->rank < b->rank;
+}
+
+/*
+ * static void siftDown(MergeInput **heap, int count, int index)
+ *   Moves an input down a min-heap until both children come after it.
+ */
+static void siftDown(MergeInput **heap, int count, int index) {
+  while (1) {
+    int smallest = index;
+    int left = 2 * index + 1;
+    int right = left + 1;
+    if (left < count && inputLess(heap[left], heap[smallest])) {
+      smallest = left;
+    }
+    if (right < count && inputLess(heap[right], heap[smallest])) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      return;
+    }
+    MergeInput *temp = heap[index];
+    heap[index] = heap[smallest];
+    heap[smallest] = temp;
+    index = smallest;
+  }
+}
+
+/*
+ * ######################
+ * Output tables
+ * ######################
+ */
+
+/*
+ * static int startOutput(VersionSet *versions, const Compaction *compaction,
+ *                        MergeOutput *output)
+ *   Starts a new output table under a temporary name.
+ * @return: 1 on success, 0 if the file could not be created
+ */
+static int startOutput(VersionSet *versions, const Compaction *compaction,
+                       MergeOutput *output) {
+  output->number = newFileNumber(versions);
+  output->charged = 0;
+  tableFilePath(output->filepath, sizeof(output->filepath),
+                versions->directory, output->number);
+  snprintf(output->tempPath, sizeof(output->tempPath), "%s" TEMP_SUFFIX,
+           output->filepath);
+  output->builder = createSSTableBuilder(
+      output->tempPath, compaction->bitsPerKey, compaction->prefixLength);
+  if (output->builder == NULL) {
+    perror("Failed to create compaction output");
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * static void chargeOutput(const Compaction *compaction, MergeOutput *output,
+ *                          uint64_t written)
+ *   Pays the rate limiter for the bytes of the output written since the
+ *   last charge, which may put the compaction to sleep.
+ */
+static void chargeOutput(const Compaction *compaction, MergeOutput *output,
+                         uint64_t written) {
+  if (written > output->charged) {
+    requestBytes(compaction->rateLimiter, written - output->charged);
+    output->charged = written;
+  }
+}
+
+/*
+ * static int finishOutput(const Compaction *compaction, MergeOutput *output,
+ *                         VersionEdit *outputs, CompactionStats *stats)
+ *   Completes the current output table, renames it to its final name and
+ *   records it in the list of outputs.
+ * @return: 1 on success, 0 on a write error
+ */
+static int finishOutput(const Compaction *compaction, MergeOutput *output,
+                        VersionEdit *outputs, CompactionStats *stats) {
+  SSTableInfo info;
+  int ok = finishSSTable(output->builder, &info);
+  output->builder = NULL;
+  if (!ok || rename(output->tempPath, output->filepath) != 0) {
+    perror("Failed to write compaction output");
+    remove(output->tempPath);
+    return 0;
+  }
+  // The filter, index and footer are written too
+  chargeOutput(compaction, output, info.fileSize);
+  addFileToEdit(outputs, output->number, compaction->outputLevel,
+                info.fileSize, info.smallestKey, info.largestKey);
+  stats->bytesWritten += info.fileSize;
+  stats->filesWritten++;
+  printf("Compaction wrote SSTable file: %s\n", output->filepath);
+  return 1;
+}
+
+/*
+ * static uint64_t outputSize(const MergeOutput *output)
+ *   Estimates the size of the output table written so far.
+ */
+static uint64_t outputSize(const MergeOutput *output) {
+  return output->builder->offset + output->builder->blockSize;
+}
+
+/*
+ * ######################
+ * Leveled policy
+ * ######################
+ */
+
+/*
+ * void freeLeveledPolicy(LeveledPolicy *policy)
+ *   Frees the compact pointers of a policy.
+ * @param policy: The policy to free
+ */
+void freeLeveledPolicy(LeveledPolicy *policy) {
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    free(policy->compactPointers[level]);
+    policy->compactPointers[level] = NULL;
+  }
+}
+
+/*
+ * static uint64_t maxBytesForLevel(const LeveledPolicy *policy, int level)
+ *   Computes the byte budget of a level past 0.
+ */
+static uint64_t maxBytesForLevel(const LeveledPolicy *policy, int level) {
+  uint64_t bytes = policy->level1MaxBytes;
+  for (int i = 1; i < level; i++) {
+    bytes *= policy->sizeRatio;
+  }
+  return bytes;
+}
+
+/*
+ * double levelScore(const LeveledPolicy *policy, const Version *version,
+ *                   int level)
+ *   Public function to measure how far a level is over its budget. Level 0
+ *   is measured in tables, every read may have to search all of them, the
+ *   others in bytes.
+ * @param policy: The leveled policy
+ * @param version: The version holding the level
+ * @param level: The level to measure
+ * @return: The score, 1 or more if the level needs a compaction
+ */
+double levelScore(const LeveledPolicy *policy, const Version *version,
+                  int level) {
+  const FileList *files = &version->levels[level];
+  if (level == 0) {
+    return (double)files->count / L0_COMPACTION_TRIGGER;
+  }
+  uint64_t bytes = 0;
+  for (int i = 0; i < files->count; i++) {
+    bytes += files->files[i]->fileSize;
+  }
+  return (double)bytes / maxBytesForLevel(policy, level);
+}
+
+/*
+ * static void addInput(Compaction *compaction, FileMetaData *file)
+ *   Adds a table to the inputs of a compaction.
+ *   If the array is full, double it.
+ */
+static void addInput(Compaction *compaction, FileMetaData *file) {
+  if (compaction->inputCount >= compaction->inputCapacity) {
+    compaction->inputCapacity =
+        compaction->inputCapacity == 0 ? 8 : compaction->inputCapacity * 2;
+    FileMetaData **temp = realloc(
+        compaction->inputs, compaction->inputCapacity * sizeof(FileMetaData *));
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for compaction inputs");
+      exit(EXIT_FAILURE);
+    }
+    compaction->inputs = temp;
+  }
+  compaction->inputs[compaction->inputCount++] = file;
+}
+
+/*
+ * static int fileOverlaps(const FileMetaData *file, const char *smallestKey,
+ *                         const char *largestKey)
+ *   Checks if the key range of a table overlaps a range.
+ */
+static int fileOverlaps(const FileMetaData *file, const char *smallestKey,
+                        const char *largestKey) {
+  return strcmp(file->smallestKey, largestKey) <= 0 &&
+         strcmp(file->largestKey, smallestKey) >= 0;
+}
+
+/*
+ * static void inputRange(const Compaction *compaction, int count,
+ *                        const char **smallestKey, const char **largestKey)
+ *   Finds the key range covered by the first count inputs.
+ */
+static void inputRange(const Compaction *compaction, int count,
+                       const char **smallestKey, const char **largestKey) {
+  *smallestKey = compaction->inputs[0]->smallestKey;
+  *largestKey = compaction->inputs[0]->largestKey;
+  for (int i = 1; i < count; i++) {
+    FileMetaData *file = compaction->inputs[i];
+    if (strcmp(file->smallestKey, *smallestKey) < 0) {
+      *smallestKey = file->smallestKey;
+    }
+    if (strcmp(file->largestKey, *largestKey) > 0) {
+      *largestKey = file->largestKey;
+    }
+  }
+}
+
+/*
+ * static int overlapsBusyFile(const FileList *files, const char *smallestKey,
+ *                             const char *largestKey)
+ *   Checks if a table of a level that overlaps a range is already an input
+ *   of a running compaction.
+ */
+static int overlapsBusyFile(const FileList *files, const char *smallestKey,
+                            const char *largestKey) {
+  for (int i = 0; i < files->count; i++) {
+    if (files->files[i]->beingCompacted &&
+        fileOverlaps(files->files[i], smallestKey, largestKey)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * static int deeperFilesOverlap(const Version *version, int level,
+ *                               const char *smallestKey,
+ *                               const char *largestKey)
+ *   Checks if a table below a level overlaps a range, in which case the
+ *   deletion records of the range are still needed.
+ */
+static int deeperFilesOverlap(const Version *version, int level,
+                              const char *smallestKey,
+                              const char *largestKey) {
+  for (int i = level + 1; i < NUM_LEVELS; i++) {
+    const FileList *files = &version->levels[i];
+    for (int j = 0; j < files->count; j++) {
+      if (fileOverlaps(files->files[j], smallestKey, largestKey)) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+ * static int setupLevelCompaction(LeveledPolicy *policy,
+ *                                 const Version *version, int level,
+ *                                 Compaction *compaction)
+ *   Fills a compaction of a level into the next one, avoiding tables that
+ *   running compactions already use:
+ *     Level 0 tables may overlap and are all newer than level 1, so all of
+ *     them go at once, or an older one would be left above newer data.
+ *     Deeper levels give the first free table after their compact pointer.
+ *   Every table of the next level overlapping those inputs is merged too, so
+ *   the outputs fit in the next level without overlapping what is left.
+ * @return: 1 on success, 0 if every candidate is in use
+ */
+static int setupLevelCompaction(LeveledPolicy *policy, const Version *version,
+                                int level, Compaction *compaction) {
+  const FileList *files = &version->levels[level];
+  const FileList *next = &version->levels[level + 1];
+  compaction->level = level;
+  compaction->outputLevel = level + 1;
+  compaction->targetFileSize = policy->targetFileSize;
+  if (level == 0) {
+    // Already newest first
+    for (int i = 0; i < files->count; i++) {
+      if (files->files[i]->beingCompacted) {
+        compaction->inputCount = 0;
+        return 0;
+      }
+      addInput(compaction, files->files[i]);
+    }
+  } else {
+    // Start past the compact pointer and wrap around
+    int first = 0;
+    const char *pointer = policy->compactPointers[level];
+    while (pointer != NULL && first < files->count &&
+           strcmp(files->files[first]->smallestKey, pointer) <= 0) {
+      first++;
+    }
+    for (int i = 0; i < files->count; i++) {
+      FileMetaData *file = files->files[(first + i) % files->count];
+      if (!file->beingCompacted &&
+          !overlapsBusyFile(next, file->smallestKey, file->largestKey)) {
+        addInput(compaction, file);
+        break;
+      }
+    }
+  }
+  if (compaction->inputCount == 0) {
+    return 0;
+  }
+  compaction->baseInputCount = compaction->inputCount;
+
+  const char *smallestKey, *largestKey;
+  inputRange(compaction, compaction->baseInputCount, &smallestKey,
+             &largestKey);
+  if (overlapsBusyFile(next, smallestKey, largestKey)) {
+    compaction->inputCount = 0;
+    return 0;
+  }
+  free(policy->compactPointers[level]);
+  policy->compactPointers[level] = strdup(largestKey);
+
+  // The next level is older, its tables go after the base inputs
+  for (int i = 0; i < next->count; i++) {
+    if (fileOverlaps(next->files[i], smallestKey, largestKey)) {
+      addInput(compaction, next->files[i]);
+    }
+  }
+
+  // Deletion records are only needed while a deeper table may hold the key
+  inputRange(compaction, compaction->inputCount, &smallestKey, &largestKey);
+  compaction->dropDeletions = !deeperFilesOverlap(
+      version, compaction->outputLevel, smallestKey, largestKey);
+  return 1;
+}
+
+/*
+ * int pickLeveledCompaction(LeveledPolicy *policy, const Version *version,
+ *                           Compaction *compaction)
+ *   Public function to choose the next compaction. Levels with a score of
+ *   at least 1 are tried from the highest score down, the first one with
+ *   tables no running compaction uses is merged into the next level.
+ *   Must be called with the lock guarding beingCompacted held.
+ * @param policy: The leveled policy, its compact pointer moves on
+ * @param version: The version to pick from
+ * @param compaction: Filled with the inputs and levels, free with
+ *    freeCompaction
+ * @return: 1 if a compaction was picked, 0 if every level is within budget
+ *    or busy
+ */
+int pickLeveledCompaction(LeveledPolicy *policy, const Version *version,
+                          Compaction *compaction) {
+  memset(compaction, 0, sizeof(Compaction));
+  // The last level has nowhere to go
+  double scores[NUM_LEVELS - 1];
+  for (int i = 0; i < NUM_LEVELS - 1; i++) {
+    scores[i] = levelScore(policy, version, i);
+  }
+  while (1) {
+    int level = -1;
+    for (int i = 0; i < NUM_LEVELS - 1; i++) {
+      if (scores[i] >= 1.0 && (level < 0 || scores[i] > scores[level])) {
+        level = i;
+      }
+    }
+    if (level < 0) {
+      freeCompaction(compaction);
+      return 0;
+    }
+    if (setupLevelCompaction(policy, version, level, compaction)) {
+      return 1;
+    }
+    scores[level] = 0;
+  }
+}
+
+/*
+ * ######################
+ * Tiered policy
+ * ######################
+ */
+
+/*
+ * int countSortedRuns(const Version *version)
+ *   Public function to count the sorted runs of level 0. Its tables are
+ *   newest first by flush number, so the tables of a run are neighbours.
+ * @param version: The version to count
+ * @return: The number of runs
+ */
+int countSortedRuns(const Version *version) {
+  const FileList *files = &version->levels[0];
+  int runs = 0;
+  for (int i = 0; i < files->count; i++) {
+    if (i == 0 ||
+        files->files[i]->flushNumber != files->files[i - 1]->flushNumber) {
+      runs++;
+    }
+  }
+  return runs;
+}
+
+/*
+ * int pickTieredCompaction(const TieredPolicy *policy,
+ *                          const Version *version, Compaction *compaction)
+ *   Public function to choose the next merge of sorted runs. Once there are
+ *   at least runTrigger runs, the newest window of two or more neighbouring
+ *   runs is taken where each run is at most sizeRatio percent larger than
+ *   all the newer runs of the window together. If no runs are that similar,
+ *   the newest runs are merged, as many as it takes to get back under the
+ *   trigger. The merged tables stay in level 0 as a single run.
+ *   Must be called with the lock guarding beingCompacted held.
+ * @param policy: The tiered settings
+ * @param version: The version to pick from
+ * @param compaction: Filled with the inputs, free with freeCompaction
+ * @return: 1 if a compaction was picked, 0 if there are too few runs
+ */
+int pickTieredCompaction(const TieredPolicy *policy, const Version *version,
+                         Compaction *compaction) {
+  memset(compaction, 0, sizeof(Compaction));
+  const FileList *files = &version->levels[0];
+  int runCount = countSortedRuns(version);
+  if (runCount < policy->runTrigger || runCount < 2) {
+    return 0;
+  }
+  // Merges of level 0 run one at a time
+  for (int i = 0; i < files->count; i++) {
+    if (files->files[i]->beingCompacted) {
+      return 0;
+    }
+  }
+
+  // Index of the first table and byte size of every run, newest first
+  int *runStarts = malloc((runCount + 1) * sizeof(int));
+  uint64_t *runBytes = calloc(runCount, sizeof(uint64_t));
+  if (runStarts == NULL || runBytes == NULL) {
+    perror("Failed to allocate memory for sorted runs");
+    exit(EXIT_FAILURE);
+  }
+  int run = -1;
+  for (int i = 0; i < files->count; i++) {
+    if (i == 0 ||
+        files->files[i]->flushNumber != files->files[i - 1]->flushNumber) {
+      runStarts[++run] = i;
+    }
+    runBytes[run] += files->files[i]->fileSize;
+  }
+  runStarts[runCount] = files->count;
+
+  int start = 0;
+  int width = 0;
+  for (int first = 0; first < runCount - 1 && width < 2; first++) {
+    uint64_t accumulated = runBytes[first];
+    width = 1;
+    while (first + width < runCount &&
+           runBytes[first + width] * 100 <=
+               accumulated * (100 + policy->sizeRatio)) {
+      accumulated += runBytes[first + width];
+      width++;
+    }
+    start = first;
+  }
+  if (width < 2) {
+    start = 0;
+    width = runCount - policy->runTrigger + 2;
+    if (width > runCount) {
+      width = runCount;
+    }
+  }
+
+  compaction->level = 0;
+  compaction->outputLevel = 0;
+  compaction->targetFileSize = TARGET_FILE_SIZE;
+  for (int i = runStarts[start]; i < runStarts[start + width]; i++) {
+    addInput(compaction, files->files[i]);
+  }
+  compaction->baseInputCount = compaction->inputCount;
+  int olderRuns = start + width < runCount;
+  free(runStarts);
+  free(runBytes);
+
+  // Deletion records are only needed while an older table may hold the key
+  const char *smallestKey, *largestKey;
+  inputRange(compaction, compaction->inputCount, &smallestKey, &largestKey);
+  compaction->dropDeletions =
+      !olderRuns && !deeperFilesOverlap(version, 0, smallestKey, largestKey);
+  return 1;
+}
+
+/*
+ * void freeCompaction(Compaction *compaction)
+ *   Public function to free the input list of a compaction.
+ * @param compaction: The compaction to free
+ */
+void freeCompaction(Compaction *compaction) {
+  free(compaction->inputs);
+  compaction->inputs = NULL;
+  compaction->inputCount = 0;
+  compaction->inputCapacity = 0;
+}
+
+/*
+ * ######################
+ * Compaction
+ * ######################
+ */
+
+/*
+ * static int mergeInputs(VersionSet *versions, const Compaction *compaction,
+ *                        MergeInput **heap, int count, const char *end,
+ *                        VersionEdit *outputs, CompactionStats *stats)
+ *   Streams the entries of the inputs in order into output tables, stopping
+ *   at end. An entry is dropped once a newer entry of its key is visible to
+ *   the oldest snapshot, since no read can reach it anymore, so without
+ *   snapshots only the newest entry of each key is kept. Deletion records
+ *   are dropped when every read sees them and nothing older can be hidden by
+ *   them. Outputs are cut at the target size, between two keys. Output
+ *   blocks are paced by the rate limiter of the compaction.
+ * @return: 1 on success, 0 on a write error
+ */
+static int mergeInputs(VersionSet *versions, const Compaction *compaction,
+                       MergeInput **heap, int count, const char *end,
+                       VersionEdit *outputs, CompactionStats *stats) {
+  MergeOutput output = {0};
+  char lastKey[MAX_KEY_LENGTH + 1];
+  int hasLastKey = 0;
+  // Sequence of the previous entry of the current key
+  uint64_t lastSequence = MAX_SEQUENCE;
+  char value[MAX_VALUE_LENGTH + 1];
+  int ok = 1;
+
+  for (int i = count / 2 - 1; i >= 0; i--) {
+    siftDown(heap, count, i);
+  }
+  while (count > 0 && ok) {
+    MergeInput *input = heap[0];
+    SSTableIterator *iterator = &input->iterator;
+    if (end != NULL && strcmp(iterator->key, end) >= 0) {
+      // The smallest key left belongs to the next range
+      break;
+    }
+
+    int newKey = !hasLastKey || strcmp(iterator->key, lastKey) != 0;
+    if (newKey) {
+      snprintf(lastKey, sizeof(lastKey), "%s", iterator->key);
+      hasLastKey = 1;
+      lastSequence = MAX_SEQUENCE;
+    }
+    int drop = 0;
+    if (lastSequence <= compaction->smallestSnapshot) {
+      // A newer entry of the key hides this one from every read
+      drop = 1;
+    } else if (iterator->type == SSTABLE_TYPE_DELETION &&
+               iterator->sequence <= compaction->smallestSnapshot &&
+               compaction->dropDeletions) {
+      drop = 1;
+    }
+    lastSequence = iterator->sequence;
+
+    if (drop) {
+      stats->entriesDropped++;
+    } else {
+      // Cut a full output before a new key, the entries of a key stay in
+      // one table
+      if (output.builder != NULL && newKey &&
+          outputSize(&output) >= compaction->targetFileSize) {
+        ok = finishOutput(compaction, &output, outputs, stats);
+      }
+      if (ok && output.builder == NULL) {
+        ok = startOutput(versions, compaction, &output);
+      }
+      if (ok) {
+        const char *entryValue = NULL;
+        if (iterator->type == SSTABLE_TYPE_VALUE) {
+          snprintf(value, sizeof(value), "%.*s", (int)iterator->valueLength,
+                   iterator->value);
+          entryValue = value;
+        }
+        ok = addToSSTable(output.builder, iterator->key, iterator->sequence,
+                          entryValue);
+        stats->entriesWritten++;
+        // Data blocks reach the file as they fill up
+        chargeOutput(compaction, &output, output.builder->offset);
+      }
+    }
+
+    // Move the input past the entry, it leaves the heap once exhausted
+    nextSSTableIterator(iterator);
+    if (!iterator->valid) {
+      heap[0] = heap[--count];
+    }
+    siftDown(heap, count, 0);
+  }
+
+  if (output.builder != NULL) {
+    if (ok) {
+      ok = finishOutput(compaction, &output, outputs, stats);
+    } else {
+      finishSSTable(output.builder, NULL);
+      remove(output.tempPath);
+    }
+  }
+  return ok;
+}
+
+/*
+ * static void runSubcompaction(Subcompaction *sub)
+ *   Positions an iterator over every input at the start of the range and
+ *   merges the range into its own outputs. Sets sub->ok.
+ */
+static void runSubcompaction(Subcompaction *sub) {
+  MergeInput *inputs = calloc(sub->readerCount, sizeof(MergeInput));
+  MergeInput **heap = malloc(sub->readerCount * sizeof(MergeInput *));
+  if (inputs == NULL || heap == NULL) {
+    perror("Failed to allocate memory for compaction inputs");
+    exit(EXIT_FAILURE);
+  }
+  int count = 0;
+  for (int i = 0; i < sub->readerCount; i++) {
+    MergeInput *input = &inputs[i];
+    input->reader = sub->readers[i];
+    input->rank = i;
+    if (sub->start == NULL) {
+      initSSTableIterator(&input->iterator, input->reader);
+    } else {
+      seekSSTableIterator(&input->iterator, input->reader, sub->start);
+    }
+    if (input->iterator.valid) {
+      heap[count++] = input;
+    }
+  }
+
+  sub->ok = mergeInputs(sub->versions, sub->compaction, heap, count, sub->end,
+                        &sub->outputs, &sub->stats);
+
+  for (int i = 0; i < sub->readerCount; i++) {
+    freeSSTableIterator(&inputs[i].iterator);
+  }
+  free(heap);
+  free(inputs);
+}
+
+/*
+ * static void *subcompactionWorker(void *arg)
+ *   Thread running one key range of a merge.
+ * @param arg: The Subcompaction
+ */
+static void *subcompactionWorker(void *arg) {
+  runSubcompaction(arg);
+  return NULL;
+}
+
+/*
+ * static int compareKeys(const void *a, const void *b)
+ *   Orders key pointers for qsort.
+ */
+static int compareKeys(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/*
+ * static int splitKeyRange(const Compaction *compaction,
+ *                          SSTableReader **readers, int count,
+ *                          uint64_t bytes, const char ***boundaries)
+ *   Chooses where a merge is split. Every input gives the last key of each
+ *   of its data blocks from the index in memory, and the keys are cut into
+ *   ranges holding about the same number of blocks, so about the same bytes
+ *   to read. A range gets at least SUBCOMPACTION_MIN_BYTES of input.
+ * @param boundaries: Set to the malloc'd first keys of every range but the
+ *   first, pointing into the readers' indexes
+ * @return: The number of ranges, 1 if the merge is not worth splitting
+ */
+static int splitKeyRange(const Compaction *compaction, SSTableReader **readers,
+                         int count, uint64_t bytes,
+                         const char ***boundaries) {
+  *boundaries = NULL;
+  int ranges = (int)(bytes / SUBCOMPACTION_MIN_BYTES);
+  if (ranges > compaction->maxSubcompactions) {
+    ranges = compaction->maxSubcompactions;
+  }
+  int blockCount = 0;
+  for (int i = 0; i < count; i++) {
+    blockCount += readers[i]->blockCount;
+  }
+  if (ranges < 2 || blockCount < ranges) {
+    return 1;
+  }
+
+  const char **keys = malloc(blockCount * sizeof(char *));
+  *boundaries = malloc((ranges - 1) * sizeof(char *));
+  if (keys == NULL || *boundaries == NULL) {
+    perror("Failed to allocate memory for subcompaction boundaries");
+    exit(EXIT_FAILURE);
+  }
+  int keyCount = 0;
+  for (int i = 0; i < count; i++) {
+    for (int j = 0; j < readers[i]->blockCount; j++) {
+      keys[keyCount++] = readers[i]->handles[j].lastKey;
+    }
+  }
+  qsort(keys, keyCount, sizeof(char *), compareKeys);
+
+  // Tables sharing block boundaries could give the same key twice
+  int boundaryCount = 0;
+  for (int i = 1; i < ranges; i++) {
+    const char *key = keys[(long)i * keyCount / ranges];
+    if (boundaryCount == 0 ||
+        strcmp(key, (*boundaries)[boundaryCount - 1]) > 0) {
+      (*boundaries)[boundaryCount++] = key;
+    }
+  }
+  free(keys);
+  return boundaryCount + 1;
+}
+
+/*
+ * int runCompaction(VersionSet *versions, const Compaction *compaction,
+ *                   VersionEdit *edit, CompactionStats *stats)
+ *   Public function to merge SSTables. Every input is read once, in order,
+ *   with a heap picking the next key across them, so only one block per
+ *   input is in memory at a time. Large merges are split into up to
+ *   maxSubcompactions disjoint key ranges, each merged by its own thread
+ *   into its own tables, so the outputs never overlap. They all go into the
+ *   one edit, or none do if any range fails. The outputs are sorted tables
+ *   with their own index and filter, and they get the newest flush number
+ *   of the inputs so they keep their place in level 0. The outputs and
+ *   the directory are synced before returning, so the edit may be applied
+ *   and the inputs deleted right away. A table that is the only input of a
+ *   compaction into a deeper level is moved instead.
+ * @param versions: The version set the output numbers come from
+ * @param compaction: The inputs and where the outputs go
+ * @param edit: Receives the outputs and the removal of the inputs
+ * @param stats: Filled with the bytes read and written
+ * @return: 1 on success, 0 if the merge failed
+ */
+int runCompaction(VersionSet *versions, const Compaction *compaction,
+                  VersionEdit *edit, CompactionStats *stats) {
+  memset(stats, 0, sizeof(CompactionStats));
+  if (compaction->inputCount == 1 &&
+      compaction->outputLevel != compaction->level) {
+    // Nothing to merge with, the table moves down without being rewritten
+    FileMetaData *file = compaction->inputs[0];
+    removeFileFromEdit(edit, file->number);
+    addFileToEdit(edit, file->number, compaction->outputLevel, file->fileSize,
+                  file->smallestKey, file->largestKey)
+        ->flushNumber = file->flushNumber;
+    return 1;
+  }
+  SSTableReader **readers =
+      malloc(compaction->inputCount * sizeof(SSTableReader *));
+  if (readers == NULL) {
+    perror("Failed to allocate memory for compaction inputs");
+    exit(EXIT_FAILURE);
+  }
+
+  // Open every input, the key ranges share them
+  int ok = 1;
+  int opened = 0;
+  uint64_t flushNumber = 0;
+  char filepath[MAX_PATH_LENGTH];
+  for (; opened < compaction->inputCount; opened++) {
+    FileMetaData *file = compaction->inputs[opened];
+    tableFilePath(filepath, sizeof(filepath), versions->directory,
+                  file->number);
+    readers[opened] = openSSTableReader(filepath, compaction->useMmap);
+    if (readers[opened] == NULL) {
+      perror("Failed to open SSTable file for compaction");
+      ok = 0;
+      break;
+    }
+    stats->bytesRead += file->fileSize;
+    if (file->flushNumber > flushNumber) {
+      flushNumber = file->flushNumber;
+    }
+  }
+
+  const char **boundaries = NULL;
+  int ranges = 0;
+  Subcompaction *subs = NULL;
+  if (ok) {
+    ranges = splitKeyRange(compaction, readers, opened, stats->bytesRead,
+                           &boundaries);
+    subs = calloc(ranges, sizeof(Subcompaction));
+    if (subs == NULL) {
+      perror("Failed to allocate memory for subcompactions");
+      exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < ranges; i++) {
+      Subcompaction *sub = &subs[i];
+      sub->versions = versions;
+      sub->compaction = compaction;
+      sub->readers = readers;
+      sub->readerCount = opened;
+      sub->start = i > 0 ? boundaries[i - 1] : NULL;
+      sub->end = i < ranges - 1 ? boundaries[i] : NULL;
+      initVersionEdit(&sub->outputs);
+    }
+    // The calling thread takes the first range, a range whose thread does
+    // not start runs inline
+    for (int i = 1; i < ranges; i++) {
+      subs[i].threadStarted = pthread_create(&subs[i].thread, NULL,
+                                             subcompactionWorker,
+                                             &subs[i]) == 0;
+      if (!subs[i].threadStarted) {
+        runSubcompaction(&subs[i]);
+      }
+    }
+    runSubcompaction(&subs[0]);
+    for (int i = 1; i < ranges; i++) {
+      if (subs[i].threadStarted) {
+        pthread_join(subs[i].thread, NULL);
+      }
+    }
+    for (int i = 0; i < ranges; i++) {
+      ok = ok && subs[i].ok;
+      stats->bytesWritten += subs[i].stats.bytesWritten;
+      stats->filesWritten += subs[i].stats.filesWritten;
+      stats->entriesWritten += subs[i].stats.entriesWritten;
+      stats->entriesDropped += subs[i].stats.entriesDropped;
+    }
+    stats->subcompactions = ranges;
+    // Every output is synced by finishSSTable, their names are synced once
+    // here, before the edit makes them live and the inputs are deleted
+    if (ok && stats->filesWritten > 0) {
+      ok = syncDirectory(versions->directory);
+    }
+  }
+
+  for (int i = 0; i < ranges; i++) {
+    VersionEdit *outputs = &subs[i].outputs;
+    for (int j = 0; j < outputs->addedCount; j++) {
+      FileMetaData *file = &outputs->added[j];
+      if (ok) {
+        addFileToEdit(edit, file->number, file->level, file->fileSize,
+                      file->smallestKey, file->largestKey)
+            ->flushNumber = flushNumber;
+      } else {
+        // Nothing refers to the outputs yet
+        tableFilePath(filepath, sizeof(filepath), versions->directory,
+                      file->number);
+        remove(filepath);
+      }
+    }
+    freeVersionEdit(outputs);
+  }
+  if (ok) {
+    for (int i = 0; i < compaction->inputCount; i++) {
+      removeFileFromEdit(edit, compaction->inputs[i]->number);
+    }
+  }
+  free(subs);
+  free(boundaries);
+  for (int i = 0; i < opened; i++) {
+    closeSSTableReader(readers[i]);
+  }
+  free(readers);
+  return ok;
+}
@@ -0,0 +1,120 @@
+#ifndef COMPACTION_H
+#define COMPACTION_H
+
+#include <stdint.h>
+
+#include "ratelimiter.h"
+#include "version.h"
+
+// Compaction styles
+#define COMPACTION_LEVELED 0 // Sorted levels of growing size, fewer reads
+#define COMPACTION_TIERED 1  // Merges similar sized runs, fewer rewrites
+
+// Leveled compaction macros
+#define L0_COMPACTION_TRIGGER 4             // Level 0 files that need a merge
+#define LEVEL1_MAX_BYTES (10 * 1024 * 1024) // 10MB
+#define LEVEL_SIZE_RATIO 10                 // Each level holds 10x the last
+#define TARGET_FILE_SIZE (2 * 1024 * 1024)  // 2MB
+
+// Background compaction macros
+#define COMPACTION_THREADS 2                     // Workers in the pool
+#define COMPACTION_RATE_LIMIT (64 * 1024 * 1024) // 64MB/s of writes
+
+// Subcompaction macros
+#define MAX_SUBCOMPACTIONS 4                  // Key ranges a merge may use
+#define SUBCOMPACTION_MIN_BYTES (1024 * 1024) // 1MB of input per key range
+
+// Tiered compaction macros
+#define TIERED_RUN_TRIGGER 4 // Sorted runs that need a merge
+#define TIERED_SIZE_RATIO 20 // Percent a run may outgrow the newer ones it
+                             // is merged with
+
+// A set of SSTables to merge into one level
+// The inputs are ordered newest first. Entries of a key are merged newest
+// first by sequence number, and an older entry is only kept while a
+// snapshot may still read it.
+typedef struct {
+  int level; // Level the first inputs come from
+  FileMetaData **inputs;
+  int inputCount;
+  int inputCapacity;
+  int baseInputCount; // Inputs from level, the others are from outputLevel
+  int outputLevel;
+  int dropDeletions;         // Set if no table outside the inputs may hold
+                             // an older value of their keys
+  uint64_t targetFileSize;   // Output tables are cut once they reach it
+  int bitsPerKey;            // Bloom filter bits per key of the outputs
+  int prefixLength;          // Prefix filter prefix length of the outputs
+  int useMmap;               // How the inputs are read
+  RateLimiter *rateLimiter;  // Paces output writes, NULL for no limit
+  int maxSubcompactions;     // Key ranges merged in parallel, 1 for none
+  uint64_t smallestSnapshot; // Oldest sequence a read may still use, every
+                             // entry it sees is kept
+} Compaction;
+
+// What a compaction read and wrote
+typedef struct {
+  uint64_t bytesRead;
+  uint64_t bytesWritten;
+  int filesWritten;
+  long entriesWritten;
+  long entriesDropped; // Hidden entries and deletion records left out
+  int subcompactions;  // Key ranges the merge was split into
+} CompactionStats;
+
+// State of the leveled policy
+// Every level past 0 is a sorted run of disjoint tables with a byte budget
+// sizeRatio times the one of the level above. The level furthest over its
+// budget is compacted into the next one, a table at a time, taken round
+// robin through the key space so every part of the level gets its turn.
+typedef struct {
+  uint64_t level1MaxBytes;
+  int sizeRatio;
+  uint64_t targetFileSize;
+  char *compactPointers[NUM_LEVELS]; // Largest key last compacted per level
+} LeveledPolicy;
+
+// Settings of the tiered policy
+// Every table stays in level 0. A flush adds a sorted run, and the tables
+// written by one merge form a single run, with disjoint keys and one flush
+// number. Runs of similar size are merged together, so each entry is only
+// rewritten once the data behind it has grown by about the run count, and
+// when no runs are similar the newest are merged to keep their number
+// under the trigger.
+typedef struct {
+  int runTrigger; // Sorted runs that need a merge
+  int sizeRatio;  // Percent a run may outgrow the newer runs it joins
+} TieredPolicy;
+
+// Function declarations
+// Frees the compact pointers of a policy
+void freeLeveledPolicy(LeveledPolicy *policy);
+// Returns how far a level is over its budget, 1 or more needs a compaction
+double levelScore(const LeveledPolicy *policy, const Version *version,
+                  int level);
+// Picks the compaction of the level with the highest score, leaving out
+// tables marked as being compacted
+// Returns 0 if no level needs one. The inputs point into the version, which
+// must stay pinned until the compaction is done.
+int pickLeveledCompaction(LeveledPolicy *policy, const Version *version,
+                          Compaction *compaction);
+// Counts the sorted runs of level 0, a run being the tables of one flush or
+// one merge
+int countSortedRuns(const Version *version);
+// Picks a merge of neighbouring sorted runs of level 0
+// Returns 0 if there are fewer runs than the trigger or a merge of level 0
+// is running. The inputs point into the version, which must stay pinned
+// until the compaction is done.
+int pickTieredCompaction(const TieredPolicy *policy, const Version *version,
+                         Compaction *compaction);
+// Frees the input list of a compaction
+void freeCompaction(Compaction *compaction);
+// Merges the inputs into new sorted SSTables and records the swap in an edit
+// Large merges are split into disjoint key ranges merged on their own
+// threads. A single table with nothing to merge with is moved down instead.
+// The caller applies the edit. Returns 0 if the merge failed, in which case
+// nothing was added to the edit and no output is left behind.
+int runCompaction(VersionSet *versions, const Compaction *compaction,
+                  VersionEdit *edit, CompactionStats *stats);
+
+#endif // COMPACTION_H
@@ -0,0 +1,814 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iterator.h"
+
+/*
+ * #################################
+ * Source iterators
+ * #################################
+ */
+
+/*
+ * static void setMemtableEntry(SourceIterator *source)
+ *   Copies the node a memtable source is at into its current entry.
+ */
+static void setMemtableEntry(SourceIterator *source) {
+  Node *node = source->node;
+  source->valid = node != NULL;
+  if (node != NULL) {
+    source->key = node->key;
+    source->sequence = node->sequence;
+    source->value = node->value;
+    source->valueLength = node->value != NULL ? strlen(node->value) : 0;
+  }
+}
+
+/*
+ * static void setTableEntry(SourceIterator *source)
+ *   Copies the entry the open table of a source is at into its current
+ *   entry.
+ */
+static void setTableEntry(SourceIterator *source) {
+  SSTableIterator *tableIterator = &source->tableIterator;
+  source->valid = tableIterator->valid;
+  if (tableIterator->valid) {
+    source->key = tableIterator->key;
+    source->sequence = tableIterator->sequence;
+    source->value = tableIterator->type == SSTABLE_TYPE_VALUE
+                        ? tableIterator->value
+                        : NULL;
+    source->valueLength = tableIterator->valueLength;
+  }
+}
+
+/*
+ * static void setShardEntry(SourceIterator *source)
+ *   Copies the key a shard source is at into its current entry. A shard
+ *   only returns live keys, so the entry is visible to any sequence and is
+ *   never a deletion record.
+ */
+static void setShardEntry(SourceIterator *source) {
+  source->valid = iteratorValid(source->shard);
+  if (source->valid) {
+    size_t size;
+    source->key = iteratorKey(source->shard);
+    source->sequence = 0;
+    source->value = iteratorValue(source->shard, &size);
+    source->valueLength = size;
+  }
+}
+
+/*
+ * static void closeSourceTable(SourceIterator *source)
+ *   Releases the table a source has open, if any.
+ */
+static void closeSourceTable(SourceIterator *source) {
+  if (source->table != NULL) {
+    freeSSTableIterator(&source->tableIterator);
+    releaseTable(source->tableCache, source->table);
+    source->table = NULL;
+  }
+}
+
+/*
+ * static int openSourceTable(SourceIterator *source, int fileIndex)
+ *   Switches a source to another of its tables, taken from the table cache.
+ *   Bounded by a prefix, the table's prefix filter is checked before any of
+ *   its data blocks is read.
+ * @param fileIndex: The table to open
+ * @return: 1 on success, 0 if the table could not be opened or holds no key
+ *   with the prefix
+ */
+static int openSourceTable(SourceIterator *source, int fileIndex) {
+  closeSourceTable(source);
+  source->fileIndex = fileIndex;
+  char filepath[MAX_PATH_LENGTH];
+  tableFilePath(filepath, sizeof(filepath), source->directory,
+                source->files[fileIndex]->number);
+  source->table = findTable(source->tableCache, filepath);
+  if (source->table == NULL) {
+    perror("Failed to open SSTable file for reading");
+    return 0;
+  }
+  return source->prefix == NULL ||
+         sstablePrefixMayMatch(source->table->reader, source->prefix,
+                               source->prefixLength);
+}
+
+/*
+ * static void seekTablesForward(SourceIterator *source, int fileIndex)
+ *   Positions a source at the first entry of its tables from fileIndex on,
+ *   skipping tables that are empty or cannot be opened.
+ */
+static void seekTablesForward(SourceIterator *source, int fileIndex) {
+  for (; fileIndex < source->fileCount; fileIndex++) {
+    if (openSourceTable(source, fileIndex)) {
+      initSSTableIterator(&source->tableIterator, source->table->reader);
+      if (source->tableIterator.valid) {
+        setTableEntry(source);
+        return;
+      }
+    }
+  }
+  closeSourceTable(source);
+  source->valid = 0;
+}
+
+/*
+ * static void seekTablesBackward(SourceIterator *source, int fileIndex)
+ *   Positions a source at the last entry of its tables from fileIndex down,
+ *   skipping tables that are empty or cannot be opened.
+ */
+static void seekTablesBackward(SourceIterator *source, int fileIndex) {
+  for (; fileIndex >= 0; fileIndex--) {
+    if (openSourceTable(source, fileIndex)) {
+      seekSSTableIteratorToLast(&source->tableIterator, source->table->reader);
+      if (source->tableIterator.valid) {
+        setTableEntry(source);
+        return;
+      }
+    }
+  }
+  closeSourceTable(source);
+  source->valid = 0;
+}
+
+/*
+ * static int findFirstFile(FileMetaData **files, int count, const char *key)
+ *   Binary searches tables sorted by key range for the first one whose
+ *   largest key is >= key, the only one that can hold the key.
+ * @return: The index of the table, or count if the key is past them all
+ */
+static int findFirstFile(FileMetaData **files, int count, const char *key) {
+  int low = 0;
+  int high = count;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (strcmp(files[mid]->largestKey, key) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+/*
+ * static void seekSource(SourceIterator *source, const char *key)
+ *   Positions a source at the newest entry of the first key >= key. Of a
+ *   run of tables only the one whose range can hold the key is searched.
+ */
+static void seekSource(SourceIterator *source, const char *key) {
+  if (source->type == SOURCE_SHARD) {
+    seekIterator(source->shard, key);
+    setShardEntry(source);
+    return;
+  }
+  if (source->type == SOURCE_MEMTABLE) {
+    source->node = seekMemtableNode(source->memtable, key);
+    setMemtableEntry(source);
+    return;
+  }
+  int low = findFirstFile(source->files, source->fileCount, key);
+  if (low < source->fileCount && openSourceTable(source, low)) {
+    seekSSTableIterator(&source->tableIterator, source->table->reader, key);
+    if (source->tableIterator.valid) {
+      setTableEntry(source);
+      return;
+    }
+  }
+  seekTablesForward(source, low + 1);
+}
+
+/*
+ * static void seekSourceToFirst(SourceIterator *source)
+ *   Positions a source at its first entry.
+ */
+static void seekSourceToFirst(SourceIterator *source) {
+  if (source->type == SOURCE_SHARD) {
+    seekIteratorToFirst(source->shard);
+    setShardEntry(source);
+  } else if (source->type == SOURCE_MEMTABLE) {
+    source->node = firstMemtableNode(source->memtable);
+    setMemtableEntry(source);
+  } else {
+    seekTablesForward(source, 0);
+  }
+}
+
+/*
+ * static void seekSourceToLast(SourceIterator *source)
+ *   Positions a source at its last entry.
+ */
+static void seekSourceToLast(SourceIterator *source) {
+  if (source->type == SOURCE_SHARD) {
+    seekIteratorToLast(source->shard);
+    setShardEntry(source);
+  } else if (source->type == SOURCE_MEMTABLE) {
+    source->node = lastMemtableNode(source->memtable);
+    setMemtableEntry(source);
+  } else {
+    seekTablesBackward(source, source->fileCount - 1);
+  }
+}
+
+/*
+ * static void nextSource(SourceIterator *source)
+ *   Moves a valid source to its next entry, opening its next table when the
+ *   current one is done.
+ */
+static void nextSource(SourceIterator *source) {
+  if (source->type == SOURCE_SHARD) {
+    nextIterator(source->shard);
+    setShardEntry(source);
+    return;
+  }
+  if (source->type == SOURCE_MEMTABLE) {
+    source->node = nextMemtableNode(source->node);
+    setMemtableEntry(source);
+    return;
+  }
+  nextSSTableIterator(&source->tableIterator);
+  if (source->tableIterator.valid) {
+    setTableEntry(source);
+  } else {
+    seekTablesForward(source, source->fileIndex + 1);
+  }
+}
+
+/*
+ * static void prevSource(SourceIterator *source)
+ *   Moves a valid source to its previous entry, opening its previous table
+ *   when the current one is done.
+ */
+static void prevSource(SourceIterator *source) {
+  if (source->type == SOURCE_SHARD) {
+    prevIterator(source->shard);
+    setShardEntry(source);
+    return;
+  }
+  if (source->type == SOURCE_MEMTABLE) {
+    source->node = prevMemtableNode(source->memtable, source->node);
+    setMemtableEntry(source);
+    return;
+  }
+  prevSSTableIterator(&source->tableIterator);
+  if (source->tableIterator.valid) {
+    setTableEntry(source);
+  } else {
+    seekTablesBackward(source, source->fileIndex - 1);
+  }
+}
+
+/*
+ * static int compareEntries(const SourceIterator *a, const SourceIterator *b)
+ *   Orders the current entries of two sources by key, then newest first.
+ * @return: < 0, 0 or > 0 like strcmp
+ */
+static int compareEntries(const SourceIterator *a, const SourceIterator *b) {
+  int cmp = strcmp(a->key, b->key);
+  if (cmp == 0) {
+    cmp = (a->sequence < b->sequence) - (a->sequence > b->sequence);
+  }
+  return cmp;
+}
+
+/*
+ * #################################
+ * Merging heap
+ * #################################
+ */
+
+/*
+ * static int heapBefore(const Iterator *iterator, int a, int b)
+ *   Checks if source a belongs above source b in the heap: the smaller entry
+ *   moving forward, the larger one moving backward.
+ */
+static int heapBefore(const Iterator *iterator, int a, int b) {
+  int cmp = compareEntries(&iterator->sources[a], &iterator->sources[b]);
+  return iterator->direction == ITERATOR_FORWARD ? cmp < 0 : cmp > 0;
+}
+
+/*
+ * static void siftDown(Iterator *iterator, int position)
+ *   Moves a heap slot down until both of its children come after it.
+ */
+static void siftDown(Iterator *iterator, int position) {
+  int *heap = iterator->heap;
+  while (1) {
+    int best = position;
+    int left = 2 * position + 1;
+    int right = left + 1;
+    if (left < iterator->heapSize &&
+        heapBefore(iterator, heap[left], heap[best])) {
+      best = left;
+    }
+    if (right < iterator->heapSize &&
+        heapBefore(iterator, heap[right], heap[best])) {
+      best = right;
+    }
+    if (best == position) {
+      return;
+    }
+    int temp = heap[position];
+    heap[position] = heap[best];
+    heap[best] = temp;
+    position = best;
+  }
+}
+
+/*
+ * static void buildHeap(Iterator *iterator)
+ *   Rebuilds the heap from every valid source, for the current direction.
+ */
+static void buildHeap(Iterator *iterator) {
+  iterator->heapSize = 0;
+  for (int i = 0; i < iterator->sourceCount; i++) {
+    if (iterator->sources[i].valid) {
+      iterator->heap[iterator->heapSize++] = i;
+    }
+  }
+  for (int i = iterator->heapSize / 2 - 1; i >= 0; i--) {
+    siftDown(iterator, i);
+  }
+}
+
+/*
+ * static void fixTop(Iterator *iterator)
+ *   Restores the heap after its top source moved, dropping it if it ran out.
+ */
+static void fixTop(Iterator *iterator) {
+  if (!iterator->sources[iterator->heap[0]].valid) {
+    iterator->heap[0] = iterator->heap[--iterator->heapSize];
+  }
+  if (iterator->heapSize > 0) {
+    siftDown(iterator, 0);
+  }
+}
+
+/*
+ * static SourceIterator *mergedEntry(const Iterator *iterator)
+ *   Returns the source holding the current entry of the merge, or NULL if
+ *   every source ran out.
+ */
+static SourceIterator *mergedEntry(const Iterator *iterator) {
+  return iterator->heapSize > 0 ? &iterator->sources[iterator->heap[0]]
+                                : NULL;
+}
+
+/*
+ * static void mergedSeekToFirst(Iterator *iterator)
+ *   Positions the merge at the first entry of every source, or the first
+ *   entry with the prefix of the iterator.
+ */
+static void mergedSeekToFirst(Iterator *iterator) {
+  for (int i = 0; i < iterator->sourceCount; i++) {
+    if (iterator->prefixLength > 0) {
+      seekSource(&iterator->sources[i], iterator->prefix);
+    } else {
+      seekSourceToFirst(&iterator->sources[i]);
+    }
+  }
+  iterator->direction = ITERATOR_FORWARD;
+  buildHeap(iterator);
+}
+
+/*
+ * static void mergedNext(Iterator *iterator)
+ *   Moves the merge to the next entry of every source. After moving
+ *   backward, the other sources sit before the current entry: each is first
+ *   sought past it, then the heap is rebuilt as a min-heap.
+ */
+static void mergedNext(Iterator *iterator) {
+  SourceIterator *current = mergedEntry(iterator);
+  if (iterator->direction == ITERATOR_BACKWARD) {
+    for (int i = 0; i < iterator->sourceCount; i++) {
+      SourceIterator *source = &iterator->sources[i];
+      if (source == current) {
+        continue;
+      }
+      seekSource(source, current->key);
+      while (source->valid && compareEntries(source, current) <= 0) {
+        nextSource(source);
+      }
+    }
+    iterator->direction = ITERATOR_FORWARD;
+    nextSource(current);
+    buildHeap(iterator);
+    return;
+  }
+  nextSource(current);
+  fixTop(iterator);
+}
+
+/*
+ * static void mergedPrev(Iterator *iterator)
+ *   Moves the merge to the previous entry of every source. After moving
+ *   forward, the other sources sit after the current entry: each is put at
+ *   its last entry before it, then the heap is rebuilt as a max-heap.
+ */
+static void mergedPrev(Iterator *iterator) {
+  SourceIterator *current = mergedEntry(iterator);
+  if (iterator->direction == ITERATOR_FORWARD) {
+    for (int i = 0; i < iterator->sourceCount; i++) {
+      SourceIterator *source = &iterator->sources[i];
+      if (source == current) {
+        continue;
+      }
+      seekSource(source, current->key);
+      while (source->valid && compareEntries(source, current) < 0) {
+        nextSource(source);
+      }
+      if (source->valid) {
+        prevSource(source);
+      } else {
+        seekSourceToLast(source);
+      }
+    }
+    iterator->direction = ITERATOR_BACKWARD;
+    prevSource(current);
+    buildHeap(iterator);
+    return;
+  }
+  prevSource(current);
+  fixTop(iterator);
+}
+
+/*
+ * #################################
+ * Iterator over live keys
+ * #################################
+ */
+
+/*
+ * static int hasPrefix(const Iterator *iterator, const char *key)
+ *   Checks if a key starts with the prefix of an iterator, any key does if
+ *   it has none.
+ */
+static int hasPrefix(const Iterator *iterator, const char *key) {
+  return strncmp(key, iterator->prefix, iterator->prefixLength) == 0;
+}
+
+/*
+ * static void findNextLiveEntry(Iterator *iterator, int skipping)
+ *   Moves the merge forward to the newest visible entry of the next live
+ *   key. Entries newer than the sequence are invisible, a deletion record
+ *   hides its key, and the older entries of a key are skipped. It stops at
+ *   the first entry past the prefix of the iterator.
+ * @param skipping: Set to skip every entry of a key <= savedKey
+ */
+static void findNextLiveEntry(Iterator *iterator, int skipping) {
+  SourceIterator *current;
+  while ((current = mergedEntry(iterator)) != NULL &&
+         hasPrefix(iterator, current->key)) {
+    if (current->sequence <= iterator->sequence) {
+      if (current->value == NULL) {
+        strcpy(iterator->savedKey, current->key);
+        skipping = 1;
+      } else if (!skipping || strcmp(current->key, iterator->savedKey) > 0) {
+        iterator->valid = 1;
+        return;
+      }
+    }
+    mergedNext(iterator);
+  }
+  iterator->valid = 0;
+}
+
+/*
+ * static void findPrevLiveEntry(Iterator *iterator)
+ *   Moves the merge backward past every entry of the previous live key,
+ *   keeping its key and value. Moving backward the entries of a key come
+ *   oldest first, so the last visible one seen before reaching a smaller
+ *   key is the one to return, unless it is a deletion record. It stops at
+ *   the first entry before the prefix of the iterator.
+ */
+static void findPrevLiveEntry(Iterator *iterator) {
+  int live = 0;
+  SourceIterator *current;
+  while ((current = mergedEntry(iterator)) != NULL &&
+         hasPrefix(iterator, current->key)) {
+    if (current->sequence <= iterator->sequence) {
+      if (live && strcmp(current->key, iterator->savedKey) < 0) {
+        // The saved key is done
+        break;
+      }
+      live = current->value != NULL;
+      if (live) {
+        uint32_t length = current->valueLength < MAX_VALUE_LENGTH
+                              ? current->valueLength
+                              : MAX_VALUE_LENGTH;
+        strcpy(iterator->savedKey, current->key);
+        memcpy(iterator->savedValue, current->value, length);
+        iterator->savedValueLength = length;
+      }
+    }
+    mergedPrev(iterator);
+  }
+  iterator->valid = live;
+}
+
+/*
+ * static int fileMayHoldPrefix(const FileMetaData *file, const char *prefix,
+ *                              size_t length)
+ *   Checks if the key range of a table overlaps the keys starting with a
+ *   prefix, without opening it.
+ */
+static int fileMayHoldPrefix(const FileMetaData *file, const char *prefix,
+                             size_t length) {
+  return strcmp(file->largestKey, prefix) >= 0 &&
+         strncmp(file->smallestKey, prefix, length) <= 0;
+}
+
+/*
+ * Iterator *createMergingIterator(Memtable *active, Memtable *immutable,
+ *                                 Version *version, TableCache *tableCache,
+ *                                 uint64_t sequence, const char *prefix)
+ *   Public function to create an iterator over the memtables and the
+ *   SSTables of a version. Every level 0 table is a source of its own since
+ *   their ranges overlap, each deeper level is a single source walked one
+ *   table after the other. Nothing is read until the iterator is positioned.
+ *   Bounded by a prefix, the tables whose key range misses it are left out,
+ *   in a deeper level they are the ones before and after a run of tables.
+ * @param active: The active memtable, its reference is taken over
+ * @param immutable: The immutable memtable or NULL, likewise
+ * @param version: The version whose SSTables are merged, likewise
+ * @param tableCache: Where the SSTables are opened
+ * @param sequence: The sequence number of the reads
+ * @param prefix: The prefix of every key returned, or NULL for none
+ * @return: The new iterator
+ */
+Iterator *createMergingIterator(Memtable *active, Memtable *immutable,
+                                Version *version, TableCache *tableCache,
+                                uint64_t sequence, const char *prefix) {
+  Iterator *iterator = calloc(1, sizeof(Iterator));
+  int capacity = 2 + version->levels[0].count + NUM_LEVELS - 1;
+  if (iterator != NULL) {
+    iterator->sources = calloc(capacity, sizeof(SourceIterator));
+    iterator->heap = malloc(capacity * sizeof(int));
+  }
+  if (iterator == NULL || iterator->sources == NULL || iterator->heap == NULL) {
+    perror("Failed to allocate memory for iterator");
+    exit(EXIT_FAILURE);
+  }
+  iterator->sequence = sequence;
+  iterator->memtables[0] = active;
+  iterator->memtables[1] = immutable;
+  iterator->version = version;
+  iterator->tableCache = tableCache;
+  if (prefix != NULL) {
+    snprintf(iterator->prefix, sizeof(iterator->prefix), "%s", prefix);
+    iterator->prefixLength = strlen(iterator->prefix);
+  }
+  const char *bound = iterator->prefixLength > 0 ? iterator->prefix : NULL;
+
+  for (int i = 0; i < 2; i++) {
+    if (iterator->memtables[i] != NULL) {
+      SourceIterator *source = &iterator->sources[iterator->sourceCount++];
+      source->type = SOURCE_MEMTABLE;
+      source->memtable = iterator->memtables[i];
+    }
+  }
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    FileList *files = &version->levels[level];
+    // Level 0 tables overlap, a run of one each
+    int runs = level == 0 ? files->count : files->count > 0;
+    for (int i = 0; i < runs; i++) {
+      int first = level == 0 ? i : 0;
+      int count = level == 0 ? 1 : files->count;
+      if (bound != NULL) {
+        if (level > 0) {
+          first = findFirstFile(files->files, files->count, bound);
+        }
+        int end = first;
+        while (end < first + count && end < files->count &&
+               fileMayHoldPrefix(files->files[end], bound,
+                                 iterator->prefixLength)) {
+          end++;
+        }
+        count = end - first;
+      }
+      if (count == 0) {
+        continue;
+      }
+      SourceIterator *source = &iterator->sources[iterator->sourceCount++];
+      source->type = SOURCE_TABLES;
+      source->files = files->files + first;
+      source->fileCount = count;
+      source->tableCache = tableCache;
+      source->directory = version->set->directory;
+      source->prefix = bound;
+      source->prefixLength = iterator->prefixLength;
+    }
+  }
+  return iterator;
+}
+
+/*
+ * Iterator *createShardIterator(Iterator **shards, int count)
+ *   Public function to create an iterator over the shards of a sharded
+ *   database. Each shard iterator is a source of its own, and since no key
+ *   lives in two shards the merge never has to pick between their entries,
+ *   so every shard keeps reading as of its own sequence number and prefix.
+ * @param shards: The iterators of the shards, each taken over
+ * @param count: The number of shards
+ * @return: The new iterator
+ */
+Iterator *createShardIterator(Iterator **shards, int count) {
+  Iterator *iterator = calloc(1, sizeof(Iterator));
+  if (iterator != NULL) {
+    iterator->sources = calloc(count, sizeof(SourceIterator));
+    iterator->heap = malloc(count * sizeof(int));
+  }
+  if (iterator == NULL || iterator->sources == NULL || iterator->heap == NULL) {
+    perror("Failed to allocate memory for iterator");
+    exit(EXIT_FAILURE);
+  }
+  // The shards hide what their sequence numbers do not see
+  iterator->sequence = UINT64_MAX;
+  for (int i = 0; i < count; i++) {
+    SourceIterator *source = &iterator->sources[iterator->sourceCount++];
+    source->type = SOURCE_SHARD;
+    source->shard = shards[i];
+  }
+  return iterator;
+}
+
+/*
+ * void seekIterator(Iterator *iterator, const char *key)
+ *   Public function to position an iterator at the first live key >= key.
+ *   Every source seeks on its own, reading at most the one block that can
+ *   hold the key in each run of tables. Bounded by a prefix, a key before
+ *   the prefix seeks to the first key with it.
+ * @param iterator: The iterator
+ * @param key: The key to start at
+ */
+void seekIterator(Iterator *iterator, const char *key) {
+  if (strcmp(key, iterator->prefix) < 0) {
+    key = iterator->prefix;
+  }
+  for (int i = 0; i < iterator->sourceCount; i++) {
+    seekSource(&iterator->sources[i], key);
+  }
+  iterator->direction = ITERATOR_FORWARD;
+  buildHeap(iterator);
+  findNextLiveEntry(iterator, 0);
+}
+
+/*
+ * void seekIteratorToFirst(Iterator *iterator)
+ *   Public function to position an iterator at the first live key, or the
+ *   first one with the prefix of the iterator.
+ * @param iterator: The iterator
+ */
+void seekIteratorToFirst(Iterator *iterator) {
+  mergedSeekToFirst(iterator);
+  findNextLiveEntry(iterator, 0);
+}
+
+/*
+ * void seekIteratorToLast(Iterator *iterator)
+ *   Public function to position an iterator at the last live key. Bounded
+ *   by a prefix, the sources are put before the smallest key past every key
+ *   with the prefix, the prefix with its last byte that is not 0xff
+ *   incremented.
+ * @param iterator: The iterator
+ */
+void seekIteratorToLast(Iterator *iterator) {
+  char limit[MAX_KEY_LENGTH + 1];
+  size_t length = iterator->prefixLength;
+  memcpy(limit, iterator->prefix, length);
+  while (length > 0 && (unsigned char)limit[length - 1] == 0xff) {
+    length--;
+  }
+  if (length > 0) {
+    limit[length - 1]++;
+  }
+  limit[length] = '\0';
+
+  for (int i = 0; i < iterator->sourceCount; i++) {
+    SourceIterator *source = &iterator->sources[i];
+    if (length == 0) {
+      seekSourceToLast(source);
+      continue;
+    }
+    seekSource(source, limit);
+    if (source->valid) {
+      prevSource(source);
+    } else {
+      seekSourceToLast(source);
+    }
+  }
+  iterator->direction = ITERATOR_BACKWARD;
+  buildHeap(iterator);
+  findPrevLiveEntry(iterator);
+}
+
+/*
+ * void nextIterator(Iterator *iterator)
+ *   Public function to move an iterator to the next live key. Moving
+ *   backward the merge sits before the entries of the current key, so it
+ *   turns around first and skips them.
+ * @param iterator: The iterator, which must be valid
+ */
+void nextIterator(Iterator *iterator) {
+  if (iterator->direction == ITERATOR_BACKWARD) {
+    // savedKey is the current key
+    if (mergedEntry(iterator) == NULL) {
+      mergedSeekToFirst(iterator);
+    } else {
+      mergedNext(iterator);
+    }
+  } else {
+    strcpy(iterator->savedKey, mergedEntry(iterator)->key);
+    mergedNext(iterator);
+  }
+  findNextLiveEntry(iterator, 1);
+}
+
+/*
+ * void prevIterator(Iterator *iterator)
+ *   Public function to move an iterator to the previous live key. Moving
+ *   forward the merge sits at the current key, so it first moves back past
+ *   every entry of it.
+ * @param iterator: The iterator, which must be valid
+ */
+void prevIterator(Iterator *iterator) {
+  if (iterator->direction == ITERATOR_FORWARD) {
+    strcpy(iterator->savedKey, mergedEntry(iterator)->key);
+    do {
+      mergedPrev(iterator);
+      if (mergedEntry(iterator) == NULL) {
+        iterator->valid = 0;
+        return;
+      }
+    } while (strcmp(mergedEntry(iterator)->key, iterator->savedKey) >= 0);
+  }
+  findPrevLiveEntry(iterator);
+}
+
+/*
+ * int iteratorValid(const Iterator *iterator)
+ *   Public function to check if an iterator is at a key.
+ * @param iterator: The iterator
+ * @return: 1 if it is at a key, 0 if it moved past either end
+ */
+int iteratorValid(const Iterator *iterator) { return iterator->valid; }
+
+/*
+ * const char *iteratorKey(const Iterator *iterator)
+ *   Public function to get the key an iterator is at.
+ * @param iterator: The iterator, which must be valid
+ * @return: The key, terminated, valid until the iterator moves
+ */
+const char *iteratorKey(const Iterator *iterator) {
+  return iterator->direction == ITERATOR_FORWARD ? mergedEntry(iterator)->key
+                                                 : iterator->savedKey;
+}
+
+/*
+ * const char *iteratorValue(const Iterator *iterator, size_t *size)
+ *   Public function to get the value of the key an iterator is at. It is
+ *   not copied: it points into a memtable, an SSTable block or the
+ *   iterator.
+ * @param iterator: The iterator, which must be valid
+ * @param size: Set to the length of the value
+ * @return: The value, not terminated, valid until the iterator moves
+ */
+const char *iteratorValue(const Iterator *iterator, size_t *size) {
+  if (iterator->direction == ITERATOR_FORWARD) {
+    SourceIterator *current = mergedEntry(iterator);
+    *size = current->valueLength;
+    return current->value;
+  }
+  *size = iterator->savedValueLength;
+  return iterator->savedValue;
+}
+
+/*
+ * void freeIterator(Iterator *iterator)
+ *   Public function to free an iterator, releasing its tables, memtables
+ *   and version, or the iterators of its shards.
+ * @param iterator: The iterator to free
+ */
+void freeIterator(Iterator *iterator) {
+  for (int i = 0; i < iterator->sourceCount; i++) {
+    closeSourceTable(&iterator->sources[i]);
+    if (iterator->sources[i].shard != NULL) {
+      freeIterator(iterator->sources[i].shard);
+    }
+  }
+  for (int i = 0; i < 2; i++) {
+    if (iterator->memtables[i] != NULL) {
+      unrefMemtable(iterator->memtables[i]);
+    }
+  }
+  if (iterator->version != NULL) {
+    unrefVersion(iterator->version);
+  }
+  free(iterator->sources);
+  free(iterator->heap);
+  free(iterator);
+}
@@ -0,0 +1,105 @@
+#ifndef ITERATOR_H
+#define ITERATOR_H
+
+#include <stdint.h>
+
+#include "memtable.h"
+#include "sstable.h"
+#include "tablecache.h"
+#include "version.h"
+
+// Kinds of sources merged by an iterator
+#define SOURCE_MEMTABLE 0 // A memtable, walked through its skiplist
+#define SOURCE_TABLES 1   // SSTables with disjoint key ranges, in key order
+#define SOURCE_SHARD 2    // The iterator of a shard, live keys only
+
+// Directions of an iterator
+#define ITERATOR_FORWARD 0
+#define ITERATOR_BACKWARD 1
+
+// Walks the entries of one source in order, every version of a key newest
+// first, deletion records included
+// A run of SSTables only has one table open and one block in memory at a
+// time: a level 0 table is a run of its own, every deeper level is one run.
+typedef struct {
+  int type; // SOURCE_MEMTABLE, SOURCE_TABLES or SOURCE_SHARD
+  int valid;
+  const char *key;      // Current entry, terminated
+  uint64_t sequence;
+  const char *value;    // Not terminated, NULL for a deletion record
+  uint32_t valueLength;
+  Memtable *memtable;   // SOURCE_MEMTABLE
+  Node *node;
+  FileMetaData **files; // SOURCE_TABLES, sorted by key range
+  int fileCount;
+  int fileIndex;        // Table currently open
+  TableHandle *table;   // Pinned in the table cache, NULL if none is open
+  TableCache *tableCache;
+  const char *directory; // Where the tables live
+  SSTableIterator tableIterator;
+  const char *prefix;   // Tables whose prefix filter rules it out are
+  size_t prefixLength;  // skipped, NULL for none
+  struct Iterator *shard; // SOURCE_SHARD, owned by the source
+} SourceIterator;
+
+// Walks the live keys of the LSM in order, as of one sequence number
+// The sources are merged with a heap on (key, newest sequence first): a
+// min-heap moving forward, a max-heap moving backward. Of every key only the
+// newest entry the sequence sees is returned, and keys whose entry is a
+// deletion record are skipped. The memtables and the version stay pinned
+// until the iterator is freed, so flushes and compactions do not change
+// what it sees.
+// An iterator bounded by a prefix only merges the tables that may hold keys
+// starting with it, and is no longer valid once it moves past them.
+// An iterator over shards merges the iterators of databases holding
+// disjoint keys instead, each already as of its own sequence number.
+typedef struct Iterator {
+  SourceIterator *sources;
+  int sourceCount;
+  int *heap;           // Indices of the valid sources, best on top
+  int heapSize;
+  int direction;       // ITERATOR_FORWARD or ITERATOR_BACKWARD
+  uint64_t sequence;   // Entries numbered higher are invisible
+  int valid;
+  // Moving backward the sources are already past the current key, which is
+  // kept here
+  char savedKey[MAX_KEY_LENGTH + 1];
+  char savedValue[MAX_VALUE_LENGTH + 1];
+  uint32_t savedValueLength;
+  Memtable *memtables[2]; // Pinned memtables, NULL if unused
+  Version *version;       // Pinned version, NULL over shards
+  TableCache *tableCache; // Where tables are opened
+  char prefix[MAX_KEY_LENGTH + 1]; // Every key returned starts with it
+  size_t prefixLength;    // 0 for an iterator over every key
+} Iterator;
+
+// Function declarations
+// Creates an iterator over memtables and a version, taking over the caller's
+// references to them. immutable may be NULL, prefix NULL for every key. It
+// is not positioned yet.
+Iterator *createMergingIterator(Memtable *active, Memtable *immutable,
+                                Version *version, TableCache *tableCache,
+                                uint64_t sequence, const char *prefix);
+// Creates an iterator merging the iterators of shards, which must hold
+// disjoint keys, taking them over. It is not positioned yet.
+Iterator *createShardIterator(Iterator **shards, int count);
+// Positions the iterator at the first key >= key
+void seekIterator(Iterator *iterator, const char *key);
+// Positions the iterator at the first key, or the first with its prefix
+void seekIteratorToFirst(Iterator *iterator);
+// Positions the iterator at the last key, or the last with its prefix
+void seekIteratorToLast(Iterator *iterator);
+// Moves to the next key, the iterator must be valid
+void nextIterator(Iterator *iterator);
+// Moves to the previous key, the iterator must be valid
+void prevIterator(Iterator *iterator);
+// Returns 1 while the iterator is at a key, 0 past either end
+int iteratorValid(const Iterator *iterator);
+// Returns the current key, valid until the iterator moves
+const char *iteratorKey(const Iterator *iterator);
+// Returns the current value, not terminated, valid until the iterator moves
+const char *iteratorValue(const Iterator *iterator, size_t *size);
+// Frees an iterator and releases what it pinned
+void freeIterator(Iterator *iterator);
+
+#endif // ITERATOR_H
@@ -1,4 +1,7 @@
+#define _GNU_SOURCE // pthread_setaffinity_np
 #include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,715 +9,2509 @@
 #include <time.h>
 
 #include "memtable.h"
+#include "compaction.h"
 #include "lsm.h"
+#include "shard.h"
+#include "sstable.h"
+#include "tablecache.h"
 #include "util.h"
+#include "version.h"
+#include "wal.h"
+
+// Write path
+// Writers queue up, and the one at the head of the queue leads: it takes
+// the whole queue, appends its records to the log with one write and at
+// most one sync, inserts them into the active memtable and wakes the
+// others. The memtable keeps a single inserting thread, and concurrent
+// writers share the cost of the log. A writer holds a single key or a
+// whole batch, logged as one record either way.
+typedef struct Writer {
+  char *key;
+  char *value;              // NULL for a deletion
+  const WriteBatch *batch;  // Written instead of the key if not NULL
+  uint64_t sequence;        // Assigned by the leader, first of the batch
+  int deleted;              // Set if the deletion hid a value of the memtable
+  int ok;                   // Set if the record was logged and inserted
+  int done;                 // Set once a leader committed the record
+  struct Writer *next;
+} Writer;
+
+// An open database
+// Everything it owns lives here, so databases in different directories share
+// nothing but the process.
+struct DB {
+  char *directory; // Holds the SSTables, the logs and the manifest
+  int lockFd;      // Holds the lock of the directory
+
+  // Memtable state
+  // Writes go to the active memtable. Once it is full it is frozen into the
+  // immutable slot and a background thread writes it to an SSTable, while
+  // reads check active, then immutable, then disk.
+  Memtable *activeMemtable;
+  Memtable *immutableMemtable;
+  // Guards the two memtable pointers and the flush thread state
+  pthread_mutex_t memtableMutex;
+  // Signalled when a memtable is frozen or on shutdown
+  pthread_cond_t flushPendingCond;
+  // Signalled when the flush thread empties the immutable slot
+  pthread_cond_t flushDoneCond;
+  pthread_t flushThread;
+  int flushThreadRunning;
+  int flushThreadStopping;
+  // Flushes of the immutable memtable that failed, reset once one succeeds
+  int flushFailures;
+
+  // Write path, see Writer
+  // Guards the queue, logBusy and the log sync settings
+  pthread_mutex_t writeMutex;
+  // Signalled when a group is committed or the log is released
+  pthread_cond_t writeCond;
+  Writer *writeQueueHead;
+  Writer *writeQueueTail;
+  // Set while a leader, the sync thread or clearMemtable uses the active log
+  // and memtable, only its owner may append, sync or switch them
+  int logBusy;
+  // Logs of the active and immutable memtables, switched along with them
+  // under memtableMutex. A log is deleted once its memtable is in an
+  // SSTable.
+  WriteAheadLog *activeLog;
+  WriteAheadLog *immutableLog;
+  // WAL_SYNC_ALWAYS, WAL_SYNC_INTERVAL or WAL_SYNC_NEVER
+  int logSyncMode;
+  int logSyncInterval;
+  // Syncs the active log every logSyncInterval ms in WAL_SYNC_INTERVAL mode
+  pthread_t logSyncThread;
+  int logSyncThreadRunning;
+  int logSyncThreadStopping;
+  // Signalled when the sync settings change or on shutdown
+  pthread_cond_t logSyncCond;
+  // Records logged, group commits and log syncs since startup
+  _Atomic long logRecords;
+  _Atomic long logCommits;
+  _Atomic long logSyncs;
+
+  // Sequence numbers
+  // The leader numbers the records of its group, and publishes the last one
+  // once they are all in the memtable. A read sees the entries numbered up
+  // to the sequence it started at, so it never sees half a group.
+  _Atomic uint64_t lastSequence;
+  // Live snapshots, oldest first, around a sentinel. Flushes and
+  // compactions keep every entry the oldest of them can read.
+  pthread_mutex_t snapshotMutex;
+  Snapshot snapshotList;
+  int snapshotCount;
+
+  // Settings of new SSTables, guarded by compactionMutex since the flush
+  // thread and the compaction workers read them
+  // Bloom filter bits per key for new SSTables, 0 writes no filter
+  int bloomBitsPerKey;
+  // Length of the key prefixes new SSTables keep a prefix filter of, 0 for
+  // none. Prefix iterators skip the tables whose filter rules their prefix
+  // out.
+  int keyPrefixLength;
+
+  // Data blocks recently read by lookups, shared by every SSTable
+  BlockCache *blockCache;
+  // SSTables kept open with their index and filter parsed
+  TableCache *tableCache;
+  // Whether SSTables are mapped (1) or read with pread through the block
+  // cache, guarded by compactionMutex
+  int mmapReads;
+
+  // The live SSTables and the manifest recording them
+  // Reads pin the current version while they search, flushes and compaction
+  // install a new one, so reads never list the directory and never wait.
+  VersionSet *versions;
+
+  // Compaction scheduler
+  // Flushes and finished compactions wake a pool of workers, each picking a
+  // compaction that shares no table with the running ones. compactionMutex
+  // guards this state, the policies below and beingCompacted of every
+  // table.
+  pthread_mutex_t compactionMutex;
+  // Signalled when a compaction may be needed, one finished, or on shutdown
+  pthread_cond_t compactionCond;
+  pthread_t compactionThreads[COMPACTION_THREADS];
+  int compactionThreadCount;
+  int compactionThreadsStopping;
+  int compactionsRunning;
+  // Set once a compaction failed, compactions stop until the next startup
+  // rather than retrying the same failure
+  int compactionError;
+  // Paces the writes of every compaction, so reads keep their share of the
+  // disk
+  RateLimiter *compactionRateLimiter;
+  // Key ranges a large compaction is split into, each merged on its own
+  // thread
+  int maxSubcompactions;
+
+  // How SSTables are compacted, COMPACTION_LEVELED or COMPACTION_TIERED
+  int compactionStyle;
+  // Level sizes and compact pointers of the leveled compaction policy
+  LeveledPolicy leveledPolicy;
+  // Run trigger and size ratio of the tiered compaction policy
+  TieredPolicy tieredPolicy;
+  // Bytes of SSTables written by flushes and by compactions since startup
+  // Their ratio is the write amplification of the compaction style
+  _Atomic uint64_t bytesFlushed;
+  _Atomic uint64_t bytesCompacted;
+};
+
+// The database behind write, read, delete and the other functions without a
+// handle, opened in DIR_NAME by initializeSSTable
+static ShardedDB *defaultDB = NULL;
+// Shards of the default database and whether their threads are pinned,
+// see setShardCount
+static int defaultShardCount = 1;
+static int defaultPinThreads = 0;
 
 /*
- * static void sortFilenames(char **filenames, int count)
- *   Sorts an array of filenames in descending order.
- *   Used to find the most recent SSTable file.
- * @param filenames: The array of filenames
- * @param count: The number of filenames in the array
+ * static int searchFile(DB *db, const FileMetaData *file, char *key,
+ *                       uint64_t sequence, PinnedValue *pinned)
+ *   Searches one SSTable for a key. The table comes open from the table
+ *   cache, its Bloom filter may rule the key out without touching a data
+ *   block, otherwise only one block is read through its index. On a hit the
+ *   table stays pinned along with the value.
+ * @param file: The SSTable, whose key range holds the key
+ * @param key: The key to read
+ * @param sequence: The sequence number of the read
+ * @param pinned: Set to the value when found
+ * @return: LOOKUP_FOUND, LOOKUP_DELETED or LOOKUP_NOT_FOUND
  */
-static void sortFilenames(char **filenames, int count) {
-  qsort(filenames, count, sizeof(char *), filenameComparator);
+static int searchFile(DB *db, const FileMetaData *file, char *key,
+                      uint64_t sequence, PinnedValue *pinned) {
+  char filepath[MAX_PATH_LENGTH];
+  tableFilePath(filepath, sizeof(filepath), db->directory, file->number);
+  TableHandle *table = findTable(db->tableCache, filepath);
+  if (table == NULL) {
+    perror("Failed to open SSTable file for reading");
+    return LOOKUP_NOT_FOUND;
+  }
+  int result = LOOKUP_NOT_FOUND;
+  if (sstableMayContain(table->reader, key)) {
+    result =
+        getSSTableValue(table->reader, key, sequence, &pinned->tableValue);
+    if (result == LOOKUP_FOUND) {
+      pinned->data = pinned->tableValue.data;
+      pinned->size = pinned->tableValue.size;
+      pinned->table = table;
+      pinned->tableCache = db->tableCache;
+      return result;
+    }
+  }
+  releaseTable(db->tableCache, table);
+  return result;
 }
 
 /*
- * static char *readFromSSTables(char *key)
+ * static int readFromSSTables(DB *db, Version *version, char *key,
+ *                             uint64_t sequence, PinnedValue *pinned)
  *   Attempts to read a key from SSTable files.
- *   First checks a tombstone file for deletion markers, then searches through
- *   sorted SSTable files. Reads the value for a given key and returns it. If a
- *   tombstone or no match is found, returns NULL.
+ *   Searches a version. Every level 0 table whose key range holds the key is
+ *   searched, newest first, then at most one table per deeper level, found
+ *   by binary search since their ranges do not overlap. Key ranges come
+ *   from the version, so tables that cannot hold the key are never opened.
+ *   Newer tables only hold newer entries of a key, so the search stops at
+ *   the first entry the sequence sees, and a deletion record hides the
+ *   older values.
+ * @param version: The version to search
  * @param key: The key to read
- * @return: The value assigned to the key, or NULL if not found
- */
-static char *readFromSSTables(char *key) {
-  // Check the tombstone file first
-  // If the key is found in the tombstone file, return NULL
-  FILE *tombstoneFile = fopen(TOMBSTONE_PATH, "r");
-  if (tombstoneFile != NULL) {
-    char line[256], tombstoneKey[MAX_KEY_LENGTH];
-    while (fgets(line, sizeof(line), tombstoneFile)) {
-      sscanf(line, "%s", tombstoneKey);
-      if (strcmp(key, tombstoneKey) == 0) {
-        fclose(tombstoneFile);
-        return NULL; // Key has a tombstone, treat as deleted
-      }
+ * @param sequence: The sequence number of the read
+ * @param pinned: Set to the value when found
+ * @return: 1 if the key was found, 0 if it was deleted or never written
+ */
+static int readFromSSTables(DB *db, Version *version, char *key,
+                            uint64_t sequence, PinnedValue *pinned) {
+  int result = LOOKUP_NOT_FOUND;
+  // Level 0 tables may overlap, check each of them, newest first
+  FileList *files = &version->levels[0];
+  for (int i = 0; i < files->count && result == LOOKUP_NOT_FOUND; i++) {
+    FileMetaData *file = files->files[i];
+    if (strcmp(key, file->smallestKey) >= 0 &&
+        strcmp(key, file->largestKey) <= 0) {
+      result = searchFile(db, file, key, sequence, pinned);
     }
-    fclose(tombstoneFile);
-  }
-
-  // Not found in tombstone file, so continue searching in SSTable files
-  // Open the data directory
-  DIR *dir = opendir(DIR_NAME);
-  // dirent (cool):
-  // https://pubs.opengroup.org/onlinepubs/009695399/basedefs/dirent.h.html
-  // Likely removes support for Windows though
-  struct dirent *entry;
-  // Array to store filenames
-  // 100 is a bit arbitrary, but more than that exceeds the scope of this
-  // project
-  char *filenames[100];
-  // Count of filenames, used to later sort the array
-  int count = 0;
-
-  if (dir == NULL) {
-    // Directory could not be opened or does not exist
-    perror("Failed to open data directory for reading");
-    return NULL;
   }
-
-  while ((entry = readdir(dir)) != NULL) {
-    // Add the filename to the array if it is a regular data file
-    if (entry->d_type == DT_REG && strcmp(entry->d_name, TOMBSTONE_FILE) != 0) {
-      filenames[count++] = strdup(entry->d_name); // Store filename
+  // Deeper levels hold one candidate each
+  for (int level = 1; level < NUM_LEVELS && result == LOOKUP_NOT_FOUND;
+       level++) {
+    FileMetaData *file = findFileInLevel(&version->levels[level], key);
+    if (file != NULL) {
+      result = searchFile(db, file, key, sequence, pinned);
     }
   }
-  // We are done with the directory at this point
-  closedir(dir);
-
-  // Sort filenames in descending order
-  sortFilenames(filenames, count);
-
-  // Variables for reading from SSTable files
-  char filepath[256], line[256], fileKey[MAX_KEY_LENGTH],
-      fileValue[MAX_VALUE_LENGTH];
-  char *foundValue = NULL;
-
-  // Iterate through sorted SSTable files
-  for (int i = 0; i < count; i++) {
-    snprintf(filepath, sizeof(filepath), "%s/%s", DIR_NAME, filenames[i]);
-    printf("Reading from SSTable file: %s\n", filepath);
-    FILE *file = fopen(filepath, "r");
-    if (file == NULL) {
-      perror("Failed to open SSTable file for reading");
-      // TODO: Since this is unexpected, maybe we should just break?
-      continue;
-    }
+  return result == LOOKUP_FOUND;
+}
 
-    // Read each line of the file
-    while (fgets(line, sizeof(line), file)) {
-      sscanf(line, "%s %s", fileKey, fileValue);
-      // Check if the key matches
-      if (strcmp(key, fileKey) == 0) {
-        foundValue = strdup(fileValue);
-        break;
-      }
-    }
-    fclose(file);
-    if (foundValue != NULL) {
-      break;
-    }
+/*
+ * static void getMemtables(DB *db, Memtable **active, Memtable **immutable)
+ *   Takes a reference to the current memtables so they can be searched
+ *   without holding the mutex. The caller must unref both (immutable may be
+ *   NULL).
+ * @param active: Set to the active memtable
+ * @param immutable: Set to the immutable memtable, or NULL
+ */
+static void getMemtables(DB *db, Memtable **active, Memtable **immutable) {
+  pthread_mutex_lock(&db->memtableMutex);
+  *active = db->activeMemtable;
+  refMemtable(*active);
+  *immutable = db->immutableMemtable;
+  if (*immutable != NULL) {
+    refMemtable(*immutable);
   }
+  pthread_mutex_unlock(&db->memtableMutex);
+}
 
-  // Free allocated filenames
-  for (int i = 0; i < count; i++) {
-    free(filenames[i]);
+/*
+ * static int searchMemtableValue(Memtable *table, char *key,
+ *                                uint64_t sequence, PinnedValue *pinned)
+ *   Looks up the entry of a key a read at the given sequence sees in a
+ *   memtable. On a hit the value is pinned by taking a reference to the
+ *   memtable, nodes are never changed in its arena.
+ * @return: LOOKUP_FOUND, LOOKUP_DELETED or LOOKUP_NOT_FOUND
+ */
+static int searchMemtableValue(Memtable *table, char *key, uint64_t sequence,
+                               PinnedValue *pinned) {
+  Node *node = findMemtableEntry(table, key, sequence);
+  if (node == NULL) {
+    return LOOKUP_NOT_FOUND;
   }
-
-  return foundValue; // Returns NULL if key is not found
+  if (node->value == NULL) {
+    return LOOKUP_DELETED;
+  }
+  refMemtable(table);
+  pinned->memtable = table;
+  pinned->data = node->value;
+  pinned->size = strlen(node->value);
+  return LOOKUP_FOUND;
 }
 
 /*
- * char *read(char *key)
- *   Public function to read a key from the memtable or SSTable files.
+ * int dbReadPinnedAt(DB *db, char *key, const Snapshot *snapshot,
+ *                    PinnedValue *pinned)
+ *   Public function to read a key as of a snapshot without copying its
+ *   value.
+ *   Checks the active memtable, then the immutable one, then disk, skipping
+ *   every entry newer than the snapshot. Without a snapshot the read uses
+ *   the last published sequence, loaded once the memtables and the version
+ *   are pinned: an entry the sequence sees was either in them or flushed
+ *   into the version, and no compaction of that version dropped an entry
+ *   the sequence needs. The value points into the memtable arena, a cached
+ *   block or a mapped SSTable, and stays valid until releasePinnedValue,
+ *   whatever flushes or compactions happen in the meantime.
  * @param key: The key to read
- * @return: The value assigned to the key, or NULL if not found
- */
-char *read(char *key) {
-  // First, check the memtable
-  Node *node = searchMemtable(key);
-  if (node != NULL) {
-    // Key found in memtable, nice!
-    return node->value;
-  } else {
-    // Key not found in memtable, now we check SSTable files
-    char *value = readFromSSTables(key);
-    // If value is NULL, it was either deleted or not found
-    if (value != NULL) {
-      return value;
-    } else {
-      return NULL;
-    }
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @param pinned: Set to the value when found, must be released either way
+ * @return: 1 if the key was found, 0 otherwise
+ */
+int dbReadPinnedAt(DB *db, char *key, const Snapshot *snapshot,
+                   PinnedValue *pinned) {
+  memset(pinned, 0, sizeof(PinnedValue));
+  Memtable *active, *immutable;
+  getMemtables(db, &active, &immutable);
+  Version *version = getCurrentVersion(db->versions);
+  uint64_t sequence = snapshot != NULL
+                          ? snapshot->sequence
+                          : atomic_load_explicit(&db->lastSequence,
+                                                 memory_order_acquire);
+
+  // First, check the memtables
+  int result = searchMemtableValue(active, key, sequence, pinned);
+  if (result == LOOKUP_NOT_FOUND && immutable != NULL) {
+    result = searchMemtableValue(immutable, key, sequence, pinned);
+  }
+  unrefMemtable(active);
+  if (immutable != NULL) {
+    unrefMemtable(immutable);
   }
+
+  // Key found or deleted in a memtable, nice! Otherwise check SSTable
+  // files, if nothing is found it was either deleted or never written
+  int found = result == LOOKUP_FOUND;
+  if (result == LOOKUP_NOT_FOUND) {
+    found = readFromSSTables(db, version, key, sequence, pinned);
+  }
+  // The pinned table keeps the file readable even if it leaves the version
+  unrefVersion(version);
+  return found;
 }
 
 /*
- * static void initializeDataDirectory()
- *   Creates the data directory if it does not exist
+ * int dbReadPinned(DB *db, char *key, PinnedValue *pinned)
+ *   Public function to read the newest value of a key without copying it.
+ *   See dbReadPinnedAt.
+ * @param key: The key to read
+ * @param pinned: Set to the value when found, must be released either way
+ * @return: 1 if the key was found, 0 otherwise
  */
-static void initializeDataDirectory() {
-  const char *dirName = "data";
-  struct stat st = {0};
+int dbReadPinned(DB *db, char *key, PinnedValue *pinned) {
+  return dbReadPinnedAt(db, key, NULL, pinned);
+}
 
-  if (stat(dirName, &st) == -1) {
-    // Data directory does not exist, create it with read/write permissions
-    mkdir(dirName, 0700);
+/*
+ * void releasePinnedValue(PinnedValue *pinned)
+ *   Public function to release a value returned by dbReadPinned.
+ * @param pinned: The value to release, its data must not be used afterwards
+ */
+void releasePinnedValue(PinnedValue *pinned) {
+  if (pinned->memtable != NULL) {
+    unrefMemtable(pinned->memtable);
+  }
+  if (pinned->table != NULL) {
+    releaseSSTableValue(pinned->table->reader, &pinned->tableValue);
+    releaseTable(pinned->tableCache, pinned->table);
   }
+  memset(pinned, 0, sizeof(PinnedValue));
 }
 
 /*
- * static char *generateUniqueFilename()
- *   Generates a unique filename for an SSTable file.
- *   The filename is based on the current time in nanoseconds.
- * @return: The dynamically allocated filename
+ * char *dbReadAt(DB *db, char *key, const Snapshot *snapshot)
+ *   Public function to read a key as of a snapshot from the memtables or
+ *   SSTable files. Copies the value found by dbReadPinnedAt.
+ * @param key: The key to read
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @return: A malloc'd copy of the value, or NULL if not found
  */
-static char *generateUniqueFilename() {
-  char *filename = malloc(256 * sizeof(char));
-  if (filename == NULL) {
-    perror("Failed to allocate memory for filename");
-    return NULL;
+char *dbReadAt(DB *db, char *key, const Snapshot *snapshot) {
+  PinnedValue pinned;
+  char *value = NULL;
+  if (dbReadPinnedAt(db, key, snapshot, &pinned)) {
+    value = strndup(pinned.data, pinned.size);
   }
+  releasePinnedValue(&pinned);
+  return value;
+}
 
-  struct timespec ts;
-  clock_gettime(CLOCK_REALTIME, &ts);
-  // Normal time() function is not precise enough, I imagine nanoseconds are...
-  // https://ftp.gnu.org/old-gnu/Manuals/glibc-2.2.3/html_node/libc_418.html
-  long long now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+/*
+ * char *dbRead(DB *db, char *key)
+ *   Public function to read the newest value of a key from the memtables or
+ *   SSTable files.
+ * @param key: The key to read
+ * @return: A malloc'd copy of the value, or NULL if not found
+ */
+char *dbRead(DB *db, char *key) { return dbReadAt(db, key, NULL); }
 
-  // Format the filename
-  snprintf(filename, 256, FILENAME_FORMAT, now);
+// A key of a multiGet, sorted along with where its value goes
+typedef struct {
+  char *key;
+  int index; // Position of the key in the caller's array
+} MultiGetKey;
 
-  return filename;
+/*
+ * static int compareMultiGetKeys(const void *a, const void *b)
+ *   Orders the keys of a multiGet for qsort.
+ */
+static int compareMultiGetKeys(const void *a, const void *b) {
+  return strcmp(((const MultiGetKey *)a)->key, ((const MultiGetKey *)b)->key);
 }
 
 /*
- * static void serializeMemtableToFile(Node *root, FILE *file)
- *    Recursively prints the memtable to a file in-order.
- *    Could live in memtable.c??
- * @param root: The root of the memtable
- * @param file: The file to write to
+ * static void searchMemtableKeys(Memtable *table, MultiGetKey *keys,
+ *                                int count, uint64_t sequence, int *results,
+ *                                char **values)
+ *   Looks up sorted keys in a memtable in one ordered pass, skipping the
+ *   keys a newer source already settled.
  */
-static void serializeMemtableToFile(Node *root, FILE *file) {
-  if (root == NULL) {
-    return;
+static void searchMemtableKeys(Memtable *table, MultiGetKey *keys, int count,
+                               uint64_t sequence, int *results,
+                               char **values) {
+  MemtableCursor cursor;
+  initMemtableCursor(&cursor, table);
+  for (int i = 0; i < count; i++) {
+    int index = keys[i].index;
+    if (results[index] != LOOKUP_NOT_FOUND) {
+      continue;
+    }
+    Node *node = seekMemtableCursor(&cursor, keys[i].key, sequence);
+    if (node == NULL) {
+      continue;
+    }
+    if (node->value == NULL) {
+      results[index] = LOOKUP_DELETED;
+      continue;
+    }
+    values[index] = strdup(node->value);
+    if (values[index] == NULL) {
+      perror("Failed to allocate memory for value");
+      exit(EXIT_FAILURE);
+    }
+    results[index] = LOOKUP_FOUND;
   }
-
-  serializeMemtableToFile(root->left, file);
-  fprintf(file, "%s %s\n", root->key, root->value);
-  serializeMemtableToFile(root->right, file);
 }
 
 /*
- * static void writeMemtableToSSTable()
- *   Writes the memtable to an SSTable file.
+ * static void searchFileKeys(DB *db, const FileMetaData *file,
+ *                            MultiGetKey *keys, int count,
+ *                            uint64_t sequence, int *results, char **values)
+ *   Looks up sorted keys in one SSTable with a single visit: the table is
+ *   taken from the table cache once and each of its data blocks is read at
+ *   most once, see getSSTableValues.
+ * @param file: The SSTable, whose key range holds every key
+ * @param keys: The keys still unsettled
  */
-void writeMemtableToSSTable() {
-  // Check if the data directory exists
-  if (!directoryExists(DIR_NAME)) {
-    // We could initialize here, but it not existing is not expected
-    perror("Data directory does not exist, could not write SSTable file");
+static void searchFileKeys(DB *db, const FileMetaData *file,
+                           MultiGetKey *keys, int count, uint64_t sequence,
+                           int *results, char **values) {
+  char filepath[MAX_PATH_LENGTH];
+  tableFilePath(filepath, sizeof(filepath), db->directory, file->number);
+  TableHandle *table = findTable(db->tableCache, filepath);
+  if (table == NULL) {
+    perror("Failed to open SSTable file for reading");
     return;
   }
-
-  // Generate a timestamped filename
-  char *filename = generateUniqueFilename();
-
-  if (filename == NULL) {
-    perror("Failed to generate unique filename");
-    return;
+  char **tableKeys = malloc(count * sizeof(char *));
+  int *tableResults = malloc(count * sizeof(int));
+  char **tableValues = malloc(count * sizeof(char *));
+  if (tableKeys == NULL || tableResults == NULL || tableValues == NULL) {
+    perror("Failed to allocate memory for SSTable lookups");
+    exit(EXIT_FAILURE);
   }
-
-  // Open the new file for writing
-  FILE *file = fopen(filename, "w");
-  if (file == NULL) {
-    perror("Failed to open SSTable file for writing");
-    return;
+  for (int i = 0; i < count; i++) {
+    tableKeys[i] = keys[i].key;
   }
+  getSSTableValues(table->reader, tableKeys, count, sequence, tableResults,
+                   tableValues);
+  for (int i = 0; i < count; i++) {
+    results[keys[i].index] = tableResults[i];
+    if (tableResults[i] == LOOKUP_FOUND) {
+      values[keys[i].index] = tableValues[i];
+    }
+  }
+  releaseTable(db->tableCache, table);
+  free(tableKeys);
+  free(tableResults);
+  free(tableValues);
+}
 
-  // Write the memtable to the file
-  serializeMemtableToFile(memtableRoot, file);
-
-  printf("Memtable written to SSTable file: %s\n", filename);
-
-  free(filename);
-  fclose(file);
+/*
+ * static int settleKeys(MultiGetKey *keys, int count, const int *results)
+ *   Drops the keys found or deleted from a sorted list, keeping the order.
+ * @return: The number of keys left
+ */
+static int settleKeys(MultiGetKey *keys, int count, const int *results) {
+  int left = 0;
+  for (int i = 0; i < count; i++) {
+    if (results[keys[i].index] == LOOKUP_NOT_FOUND) {
+      keys[left++] = keys[i];
+    }
+  }
+  return left;
 }
 
 /*
- * void write(char *key, char *value)
- *   Public function to write a key-value pair to the system.
- *   Will first write to the memtable, then check if the memory usage is above
- *   the threshold. If so, the memtable will be written to an SSTable file
- * @param key: The key to be written
- * @param value: The value to be written
+ * int dbMultiGetAt(DB *db, char **keys, int count, const Snapshot *snapshot,
+ *                  char **values)
+ *   Public function to read many keys at once as of a snapshot.
+ *   The keys are sorted once, the memtables and the version are pinned once
+ *   and every key is read at the same sequence, so the values are
+ *   consistent with each other. Each memtable is searched in one ordered
+ *   pass. The keys left go down the levels together: each SSTable whose key
+ *   range holds some of them is visited once for all of them, loading each
+ *   of its data blocks once, rather than once per key.
+ * @param keys: The keys to read, in any order, duplicates allowed
+ * @param count: The number of keys
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @param values: Set to a malloc'd copy of the value of every key, NULL if
+ *   it is not found, owned by the caller
+ * @return: The number of keys found
  */
-void write(char *key, char *value) {
-  // Check if key or value is null
-  if (key == NULL || value == NULL) {
-    printf("Key or value cannot be null.\n");
-    return;
+int dbMultiGetAt(DB *db, char **keys, int count, const Snapshot *snapshot,
+                 char **values) {
+  if (count <= 0) {
+    return 0;
   }
-  // Check if key or value exceeds the maximum length
-  if (strlen(key) > MAX_KEY_LENGTH || strlen(value) > MAX_VALUE_LENGTH) {
-    printf("Key or value exceeds maximum length of %d.\n", (int)MAX_KEY_LENGTH);
-    return;
+  MultiGetKey *sorted = malloc(count * sizeof(MultiGetKey));
+  int *results = malloc(count * sizeof(int));
+  if (sorted == NULL || results == NULL) {
+    perror("Failed to allocate memory for multiGet");
+    exit(EXIT_FAILURE);
   }
-  insertNodeIntoMemtable(key, value);
-  // Check if the memory usage is above the memtable threshold
-  if (globalMemoryUsage > MEMORY_THRESHOLD) {
-    // Write the memtable to an SSTable file and clear the memtable
-    writeMemtableToSSTable();
-    clearMemtable();
+  for (int i = 0; i < count; i++) {
+    sorted[i].key = keys[i];
+    sorted[i].index = i;
+    results[i] = LOOKUP_NOT_FOUND;
+    values[i] = NULL;
+  }
+  qsort(sorted, count, sizeof(MultiGetKey), compareMultiGetKeys);
+
+  // Same order as dbReadPinnedAt, see there
+  Memtable *active, *immutable;
+  getMemtables(db, &active, &immutable);
+  Version *version = getCurrentVersion(db->versions);
+  uint64_t sequence = snapshot != NULL
+                          ? snapshot->sequence
+                          : atomic_load_explicit(&db->lastSequence,
+                                                 memory_order_acquire);
+
+  searchMemtableKeys(active, sorted, count, sequence, results, values);
+  if (immutable != NULL) {
+    searchMemtableKeys(immutable, sorted, count, sequence, results, values);
+  }
+  unrefMemtable(active);
+  if (immutable != NULL) {
+    unrefMemtable(immutable);
+  }
+  int left = settleKeys(sorted, count, results);
+
+  // Level 0 tables may overlap, each gets the keys in its range, newest first
+  FileList *files = &version->levels[0];
+  for (int i = 0; i < files->count && left > 0; i++) {
+    FileMetaData *file = files->files[i];
+    int first = 0;
+    while (first < left && strcmp(sorted[first].key, file->smallestKey) < 0) {
+      first++;
+    }
+    int last = first;
+    while (last < left && strcmp(sorted[last].key, file->largestKey) <= 0) {
+      last++;
+    }
+    if (last > first) {
+      searchFileKeys(db, file, sorted + first, last - first, sequence, results,
+                     values);
+      left = settleKeys(sorted, left, results);
+    }
+  }
+  // Deeper levels split the keys into runs, one per table
+  for (int level = 1; level < NUM_LEVELS && left > 0; level++) {
+    int first = 0;
+    while (first < left) {
+      FileMetaData *file =
+          findFileInLevel(&version->levels[level], sorted[first].key);
+      if (file == NULL) {
+        first++;
+        continue;
+      }
+      int last = first + 1;
+      while (last < left && strcmp(sorted[last].key, file->largestKey) <= 0) {
+        last++;
+      }
+      searchFileKeys(db, file, sorted + first, last - first, sequence, results,
+                     values);
+      first = last;
+    }
+    left = settleKeys(sorted, left, results);
+  }
+  unrefVersion(version);
+
+  int found = 0;
+  for (int i = 0; i < count; i++) {
+    found += results[i] == LOOKUP_FOUND;
   }
+  free(sorted);
+  free(results);
+  return found;
 }
 
 /*
- * static void initializeTombstoneFile()
- *   Creates the tombstone file if it does not exist
+ * int dbMultiGet(DB *db, char **keys, int count, char **values)
+ *   Public function to read the newest values of many keys at once. See
+ *   dbMultiGetAt.
+ * @param keys: The keys to read
+ * @param count: The number of keys
+ * @param values: Set to a malloc'd copy of the value of every key, or NULL
+ * @return: The number of keys found
  */
-static void initializeTombstoneFile() {
-  FILE *file = fopen(TOMBSTONE_PATH, "w");
-  if (file == NULL) {
-    perror("Failed to open tombstone file for writing");
-    return;
-  }
-  fclose(file);
+int dbMultiGet(DB *db, char **keys, int count, char **values) {
+  return dbMultiGetAt(db, keys, count, NULL, values);
 }
 
 /*
- * static void writeTombstone(char *key)
- *   Writes a single tombstone to the tombstone file.
- * @param key: The key to be marked as deleted
+ * Iterator *dbCreateIterator(DB *db, const Snapshot *snapshot)
+ *   Public function to create an iterator for ordered range scans as of a
+ *   snapshot. It pins the memtables and the version like a read, see
+ *   dbReadPinnedAt, and merges them entry by entry: a scan streams through
+ *   the skiplists and one data block per SSTable at a time, never a whole
+ *   table. Position it with seekIterator, seekIteratorToFirst or
+ *   seekIteratorToLast.
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @return: The iterator, freed with freeIterator
  */
-static void writeTombstone(char *key) {
-  FILE *file = fopen(TOMBSTONE_PATH, "a"); // Open for appending
-
-  if (file == NULL) {
-    perror("Failed to open tombstone file for writing");
-    return;
-  }
-
-  fprintf(file, "%s\n", key);
-  fclose(file);
+Iterator *dbCreateIterator(DB *db, const Snapshot *snapshot) {
+  return dbCreatePrefixIterator(db, NULL, snapshot);
 }
 
 /*
- * void delete(char *key)
- *   Public function to delete a key from the system.
- *   Will first attempt to delete from the memtable, and if not found in the
- *   memtable, create a tombstone for the key.
- * @param key: The key to be deleted
+ * Iterator *dbCreatePrefixIterator(DB *db, const char *prefix,
+ *                                  const Snapshot *snapshot)
+ *   Public function to create an iterator over the keys starting with a
+ *   prefix, like createIterator. Only the SSTables whose key range overlaps
+ *   the prefix are merged, and of those the tables whose prefix filter rules
+ *   it out are skipped without reading a data block. The iterator is no
+ *   longer valid at the first key past the prefix, seekIteratorToFirst and
+ *   seekIteratorToLast go to the first and last key with the prefix.
+ * @param prefix: The prefix of the keys, or NULL for every key
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @return: The iterator, freed with freeIterator
  */
-void delete(char *key) {
-  // Try to delete from the memtable
-  if (!deleteMemtableKey(key)) {
-    // Key was not in the memtable, create a tombstone
-    writeTombstone(key);
-  } else {
-    printf("Key deleted from memtable: %s\n", key);
-  }
+Iterator *dbCreatePrefixIterator(DB *db, const char *prefix,
+                                 const Snapshot *snapshot) {
+  Memtable *active, *immutable;
+  getMemtables(db, &active, &immutable);
+  Version *version = getCurrentVersion(db->versions);
+  uint64_t sequence = snapshot != NULL
+                          ? snapshot->sequence
+                          : atomic_load_explicit(&db->lastSequence,
+                                                 memory_order_acquire);
+  return createMergingIterator(active, immutable, version, db->tableCache,
+                               sequence, prefix);
 }
 
 /*
- * static void initializeTombstoneArray(TombstoneArray *array)
- *   Allocates memory for the tombstone array
- * @param array: Pointer to the tombstone array
+ * const Snapshot *dbGetSnapshot(DB *db)
+ *   Public function to take a snapshot of the data as of the last committed
+ *   write. Writers and the flush thread never wait for it: entries are
+ *   never changed in place, flushes and compactions only keep the ones it
+ *   can still read until it is released.
+ * @return: The snapshot, to be released with releaseSnapshot
  */
-void initializeTombstoneArray(TombstoneArray *array) {
-  array->size = 0;
-  array->capacity = 10; // Initial capacity
-  array->keys = malloc(array->capacity * sizeof(char *));
-  if (array->keys == NULL) {
-    perror("Failed to allocate memory for tombstone array");
+const Snapshot *dbGetSnapshot(DB *db) {
+  Snapshot *snapshot = malloc(sizeof(Snapshot));
+  if (snapshot == NULL) {
+    perror("Failed to allocate memory for snapshot");
     exit(EXIT_FAILURE);
   }
+  pthread_mutex_lock(&db->snapshotMutex);
+  // Sequences only grow, so the list stays oldest first
+  snapshot->sequence =
+      atomic_load_explicit(&db->lastSequence, memory_order_acquire);
+  snapshot->prev = db->snapshotList.prev;
+  snapshot->next = &db->snapshotList;
+  snapshot->shards = NULL;
+  db->snapshotList.prev->next = snapshot;
+  db->snapshotList.prev = snapshot;
+  db->snapshotCount++;
+  pthread_mutex_unlock(&db->snapshotMutex);
+  return snapshot;
 }
 
 /*
- * static void addTombstone(TombstoneArray *array, const char *key)
- *   Adds a tombstone to the tombstone array.
- *   If the array is full, double it in true C fashion.
- * @param array: Pointer to the tombstone array
- * @param key: The key to be added to the array
+ * void dbReleaseSnapshot(DB *db, const Snapshot *snapshot)
+ *   Public function to release a snapshot. The entries only it could read
+ *   are dropped by the next compactions.
+ * @param snapshot: The snapshot to release, it must not be used afterwards
  */
-void addTombstone(TombstoneArray *array, const char *key) {
-  // Check if the array is full
-  if (array->size >= array->capacity) {
-    // If so, double it
-    array->capacity *= 2;
-    char **temp = realloc(array->keys, array->capacity * sizeof(char *));
-    if (temp == NULL) {
-      perror("Failed to reallocate memory for tombstone array");
-      exit(EXIT_FAILURE);
-    }
-    array->keys = temp;
-  }
-  // Add the key to the array
-  array->keys[array->size++] = strdup(key);
+void dbReleaseSnapshot(DB *db, const Snapshot *snapshot) {
+  Snapshot *node = (Snapshot *)snapshot;
+  pthread_mutex_lock(&db->snapshotMutex);
+  node->prev->next = node->next;
+  node->next->prev = node->prev;
+  db->snapshotCount--;
+  pthread_mutex_unlock(&db->snapshotMutex);
+  free(node);
 }
 
 /*
- * static void loadTombstones(TombstoneArray *array, const char
- * *tombstoneFilename) Loads tombstones from the tombstone file into the
- * tombstone array. Also clears the tombstone file.
- * @param tombstones: Pointer to the tombstone array
- * @param tombstoneFilename: The filename of the tombstone file
+ * static uint64_t smallestSnapshot(DB *db)
+ *   Finds the oldest sequence number a read may still use: the oldest live
+ *   snapshot, or the last published sequence if there is none, since a
+ *   snapshot taken later cannot be older.
+ * @return: The sequence number
  */
-void loadTombstones(TombstoneArray *tombstones, const char *tombstoneFilename) {
-  FILE *file = fopen(tombstoneFilename, "r");
-  char line[256];
-
-  if (file == NULL) {
-    perror("Failed to open tombstone file");
-    return;
-  }
+static uint64_t smallestSnapshot(DB *db) {
+  pthread_mutex_lock(&db->snapshotMutex);
+  uint64_t sequence =
+      db->snapshotList.next != &db->snapshotList
+          ? db->snapshotList.next->sequence
+          : atomic_load_explicit(&db->lastSequence, memory_order_acquire);
+  pthread_mutex_unlock(&db->snapshotMutex);
+  return sequence;
+}
 
-  // Read the tombstone file
-  while (fgets(line, sizeof(line), file)) {
-    char *newline = strchr(line, '\n');
-    if (newline) {
-      *newline = '\0';
-    }
-    // Add the key to the tombstone array
-    addTombstone(tombstones, line);
-  }
+/*
+ * uint64_t dbGetLastSequence(DB *db)
+ *   Public function to get the sequence number of the last committed write.
+ * @return: The sequence number, 0 if nothing was ever written
+ */
+uint64_t dbGetLastSequence(DB *db) {
+  return atomic_load_explicit(&db->lastSequence, memory_order_acquire);
+}
 
-  // Clear the tombstone file
-  freopen(tombstoneFilename, "w", file);
+/*
+ * static void initializeDataDirectory(const char *dirName)
+ *   Creates the data directory if it does not exist
+ * @param dirName: The directory of the database
+ */
+static void initializeDataDirectory(const char *dirName) {
+  struct stat st = {0};
 
-  fclose(file);
+  if (stat(dirName, &st) == -1) {
+    // Data directory does not exist, create it with read/write permissions
+    mkdir(dirName, 0700);
+  }
 }
 
 /*
- * static int containsTombstone(...)
- *   Checks the tombstone array to see if the given key exists.
- *   Note: Linear search is gross, replacing the array with a hash table would
- *   be ideal, but time constraints...
- * @param tombstones: Pointer to the tombstone array
- * @param key: The key to be checked
+ * static int serializeMemtableToFile(DB *db, Memtable *table,
+ *                                    const char *filepath, SSTableInfo *info)
+ *    Writes the memtable to an SSTable file in-order by walking the bottom
+ *    level of the skiplist. An older entry of a key is left out once a
+ *    newer one is visible to the oldest snapshot.
+ *    Could live in memtable.c??
+ * @param table: The memtable to write
+ * @param filepath: The file to write to
+ * @param info: Filled with the size and key range of the file
+ * @return: 1 on success, 0 on a write error
  */
-int containsTombstone(const TombstoneArray *tombstones, const char *key) {
-  for (int i = 0; i < tombstones->size; i++) {
-    if (strcmp(tombstones->keys[i], key) == 0) {
-      // Key found in tombstone array
-      return 1;
+static int serializeMemtableToFile(DB *db, Memtable *table,
+                                   const char *filepath, SSTableInfo *info) {
+  pthread_mutex_lock(&db->compactionMutex);
+  int bitsPerKey = db->bloomBitsPerKey;
+  int prefixLength = db->keyPrefixLength;
+  pthread_mutex_unlock(&db->compactionMutex);
+  SSTableBuilder *builder =
+      createSSTableBuilder(filepath, bitsPerKey, prefixLength);
+  if (builder == NULL) {
+    return 0;
+  }
+  uint64_t oldest = smallestSnapshot(db);
+  int ok = 1;
+  Node *previous = NULL;
+  // Deletion records are written too, they hide older values of their key
+  for (Node *node = firstMemtableNode(table); node != NULL && ok;
+       node = nextMemtableNode(node)) {
+    if (previous != NULL && previous->sequence <= oldest &&
+        strcmp(previous->key, node->key) == 0) {
+      continue; // Hidden from every read by previous
     }
+    previous = node;
+    ok = addToSSTable(builder, node->key, node->sequence, node->value);
   }
-  // Key not found in tombstone array
-  return 0;
+  return finishSSTable(builder, info) && ok;
 }
 
 /*
- * static void applyTombstonesToFile(...)
- *   Applies tombstones to an SSTable file.
- *   Reads the SSTable file line by line, and if the key is found in the
- *   tombstone array, the line is not written to the temporary file.
- * @param filepath: The filepath of the SSTable file
- * @param tombstones: Pointer to the tombstone array
+ * static int writeTableToSSTable(DB *db, Memtable *table, VersionEdit *edit)
+ *   Writes a memtable to a new SSTable file and records it in an edit as a
+ *   level 0 table. An empty memtable writes nothing.
+ *   The file is written under a temporary name, synced and renamed once
+ *   complete, then the directory is synced, so no partial SSTable is ever
+ *   adopted at startup and the table survives a power loss once the edit
+ *   names it. It only becomes visible to
+ *   reads once the caller applies the edit.
+ * @param table: The memtable to write
+ * @param edit: The edit the new file is added to
+ * @return: 1 on success, 0 if the file could not be written
  */
-void applyTombstonesToFile(const char *filepath,
-                           const TombstoneArray *tombstones) {
-  // Open the SSTable file for reading
-  FILE *file = fopen(filepath, "r");
-  if (file == NULL) {
-    perror("Failed to open SSTable file for reading");
-    return;
+static int writeTableToSSTable(DB *db, Memtable *table, VersionEdit *edit) {
+  // Check if the data directory exists
+  if (!directoryExists(db->directory)) {
+    // We could initialize here, but it not existing is not expected
+    perror("Data directory does not exist, could not write SSTable file");
+    return 0;
   }
 
-  // Create a temporarly named file to write updated entries
-  char tempFilepath[256];
-  snprintf(tempFilepath, sizeof(tempFilepath), "%s.temp", filepath);
-  FILE *tempFile = fopen(tempFilepath, "w");
-  if (tempFile == NULL) {
-    perror("Failed to open temporary file for writing");
-    fclose(file);
-    return;
+  // Numbers only grow, so a higher number is always a newer table
+  uint64_t number = newFileNumber(db->versions);
+  char filename[MAX_PATH_LENGTH];
+  tableFilePath(filename, sizeof(filename), db->directory, number);
+
+  // Write the memtable to a temporary file
+  char tempFilename[sizeof(filename) + sizeof(TEMP_SUFFIX)];
+  SSTableInfo info;
+  snprintf(tempFilename, sizeof(tempFilename), "%s" TEMP_SUFFIX, filename);
+  if (!serializeMemtableToFile(db, table, tempFilename, &info)) {
+    perror("Failed to write SSTable file");
+    remove(tempFilename);
+    return 0;
   }
-
-  // Variables for reading from the SSTable file
-  char line[256], key[MAX_KEY_LENGTH], value[MAX_VALUE_LENGTH];
-
-  // Process each entry in the SSTable file
-  while (fgets(line, sizeof(line), file)) {
-    sscanf(line, "%s %s", key, value);
-    if (!containsTombstone(tombstones, key)) {
-      // Key not found in tombstone array, so write the entry
-      fputs(line, tempFile);
-    } else {
-      // printf("Key deleted from SSTable via tombstone: %s\n", key);
-    }
+  if (info.entryCount == 0) {
+    remove(tempFilename);
+    return 1;
   }
 
-  fclose(file);
-  fclose(tempFile);
+  // Publish the finished file, synced with its name before the manifest
+  // names it and the log of the memtable is deleted
+  if (rename(tempFilename, filename) != 0) {
+    perror("Failed to rename SSTable file");
+    remove(tempFilename);
+    return 0;
+  }
+  if (!syncDirectory(db->directory)) {
+    remove(filename);
+    return 0;
+  }
+  addFileToEdit(edit, number, 0, info.fileSize, info.smallestKey,
+                info.largestKey);
+  // The manifest remembers the sequence numbers used, the log goes next
+  edit->lastSequence = info.largestSequence;
+  printf("Memtable written to SSTable file: %s\n", filename);
+  return 1;
+}
 
-  // Replace the temporary name with the original name
-  remove(filepath);
-  rename(tempFilepath, filepath);
+/*
+ * static void scheduleCompaction(DB *db)
+ *   Wakes the compaction workers to check if a compaction is needed.
+ */
+static void scheduleCompaction(DB *db) {
+  pthread_mutex_lock(&db->compactionMutex);
+  pthread_cond_broadcast(&db->compactionCond);
+  pthread_mutex_unlock(&db->compactionMutex);
 }
 
 /*
- * static void freeTombstoneArray(TombstoneArray *array)
- *   Frees the tombstone array when it is no longer needed.
- * @param array: Pointer to the tombstone array
+ * static int flushMemtable(DB *db, Memtable *table)
+ *   Writes a memtable to a new SSTable and adds it to the current version,
+ *   then wakes the compaction workers.
+ * @param table: The memtable to write
+ * @return: 1 once the memtable is in the version or had nothing to write,
+ *   0 if the SSTable or the manifest could not be written
  */
-void freeTombstoneArray(TombstoneArray *array) {
-  for (int i = 0; i < array->size; i++) {
-    free(array->keys[i]);
+static int flushMemtable(DB *db, Memtable *table) {
+  VersionEdit edit;
+  initVersionEdit(&edit);
+  int ok = writeTableToSSTable(db, table, &edit);
+  if (ok && edit.addedCount > 0) {
+    ok = applyVersionEdit(db->versions, &edit);
+    if (ok) {
+      atomic_fetch_add(&db->bytesFlushed, edit.added[0].fileSize);
+      // Level 0 grew, it may need a compaction
+      scheduleCompaction(db);
+    } else {
+      // Nothing refers to the table, a retry writes a new one
+      char filepath[MAX_PATH_LENGTH];
+      tableFilePath(filepath, sizeof(filepath), db->directory,
+                    edit.added[0].number);
+      remove(filepath);
+    }
   }
-  free(array->keys);
-  array->keys = NULL;
-  array->size = 0;
-  array->capacity = 0;
+  freeVersionEdit(&edit);
+  return ok;
 }
 
 /*
- * static void initializeList(FilePathList *list)
- *   Allocates memory for the list of filepaths.
- * @param list: Pointer to the list of filepaths
+ * static WriteAheadLog *createLogFile(DB *db)
+ *   Starts the log of a new memtable, numbered like the SSTables.
+ * @return: The new log, or NULL if it could not be created, in which case
+ *   the memtable is only kept in memory
  */
-static void initializeList(FilePathList *list) {
-  list->size = 0;
-  // Initial capacity of 10
-  list->capacity = 10;
-  list->filePaths = malloc(list->capacity * sizeof(char *));
-  if (list->filePaths == NULL) {
-    perror("Failed to allocate memory for list");
-    exit(EXIT_FAILURE);
-  }
+static WriteAheadLog *createLogFile(DB *db) {
+  char filepath[MAX_PATH_LENGTH];
+  uint64_t number = newFileNumber(db->versions);
+  logFilePath(filepath, sizeof(filepath), db->directory, number);
+  return createWriteAheadLog(filepath, number);
 }
 
 /*
- * static void addToList(...)
- *   Adds a filepath to the list of filepaths.
- *   If the list is full, double it
- * @param list: Pointer to the list of filepaths
- * @param filepath: The filepath to be added to the list
+ * static void deleteLogFile(DB *db, WriteAheadLog *log)
+ *   Closes a log whose records are no longer needed and deletes its file.
  */
-static void addToList(FilePathList *list, const char *filepath) {
-  if (list->size >= list->capacity) {
-    // Resize the array when capacity is reached
-    list->capacity *= 2;
-    char **temp = realloc(list->filePaths, list->capacity * sizeof(char *));
-    if (temp == NULL) {
-      perror("Failed to reallocate memory for list");
-      exit(EXIT_FAILURE);
-    }
-    list->filePaths = temp;
-  }
-  // Add the filepath to the list
-  list->filePaths[list->size] = strdup(filepath);
-  if (list->filePaths[list->size] == NULL) {
-    perror("Failed to duplicate filepath");
-    exit(EXIT_FAILURE);
-  }
-  list->size++;
+static void deleteLogFile(DB *db, WriteAheadLog *log) {
+  char filepath[MAX_PATH_LENGTH];
+  logFilePath(filepath, sizeof(filepath), db->directory, log->number);
+  closeWriteAheadLog(log);
+  remove(filepath);
 }
 
 /*
- * static void deleteMergedFile(const char *filePath)
- *   Deletes a merged file.
- * @param filePath: The filepath of the merged file
+ * static int compareLogRecords(const void *a, const void *b)
+ *   Orders replayed records by key, then by sequence number, so the newest
+ *   record of a key comes last.
  */
-static void deleteMergedFile(const char *filePath) {
-  if (remove(filePath) != 0) {
-    perror("Failed to delete the original small SSTable file");
+static int compareLogRecords(const void *a, const void *b) {
+  const LogRecord *recordA = a;
+  const LogRecord *recordB = b;
+  uint32_t length = recordA->keyLength < recordB->keyLength
+                        ? recordA->keyLength
+                        : recordB->keyLength;
+  int cmp = memcmp(recordA->key, recordB->key, length);
+  if (cmp == 0) {
+    cmp = (recordA->keyLength > recordB->keyLength) -
+          (recordA->keyLength < recordB->keyLength);
+  }
+  if (cmp == 0) {
+    cmp = (recordA->sequence > recordB->sequence) -
+          (recordA->sequence < recordB->sequence);
   }
+  return cmp;
 }
 
 /*
- * static void mergeSmallFiles(FilePathList *list)
- *   Merges small SSTable files into larger SSTable files.
- *   Will merge as many files as possible into a single file, as long as the
- *   upper threshold is not exceeded.
- *   TODO: Check if same key exists in merging files and keep the most recent
- * @param list: Pointer to the list of filepaths of small SSTable files
- *    (files that are below the lower threshold)
+ * static int replayLog(DB *db, uint64_t number, long *recovered)
+ *   Rebuilds the memtable of a log left by an earlier run, writes it to a
+ *   level 0 SSTable and deletes the log. The log is mapped and its records
+ *   decoded in place. They are sorted by key, ties broken by sequence
+ *   number, so the memtable is built in a single pass of appends keeping
+ *   the newest record of every key, rather than searching the skiplist once
+ *   per record. No snapshot outlives a restart, so older records are not
+ *   needed. Writes go on numbering from the last replayed record. Replay
+ *   ends at a torn record at the tail.
+ * @param number: The number of the log
+ * @param recovered: Set to the number of records replayed
+ * @return: 1 on success, 0 if the log could not be read or flushed, in
+ *   which case it is kept
  */
-static void mergeSmallFiles(FilePathList *list) {
-  if (list->size < 2) {
-    // Not enough files to merge
-    return;
+static int replayLog(DB *db, uint64_t number, long *recovered) {
+  char filepath[MAX_PATH_LENGTH];
+  logFilePath(filepath, sizeof(filepath), db->directory, number);
+  LogReader reader;
+  if (!openLogReader(&reader, filepath)) {
+    return 0;
   }
 
-  // Variables for merging files
-  long mergedFileSize = 0;
-  int filesMerged = 0;
-  char *filename = generateUniqueFilename();
-  FILE *mergedFile = fopen(filename, "w");
-
-  // Iterate through the list of filepaths
-  for (int i = 0; i < list->size; i++) {
-    // Get the size of the file
-    struct stat st;
-    if (stat(list->filePaths[i], &st) != 0) {
-      // Cannot get file info, skip this file
-      // TODO: error?
+  LogRecord *records = NULL;
+  long count = 0;
+  long capacity = 0;
+  LogRecord record;
+  while (nextLogRecord(&reader, &record)) {
+    if (record.keyLength > MAX_KEY_LENGTH ||
+        record.valueLength > MAX_VALUE_LENGTH) {
+      fprintf(stderr, "Skipping oversized record in %s\n", filepath);
       continue;
     }
-
-    // Check if the upper threshold will be exceeded
-    if (mergedFileSize + st.st_size > UPPER_MERGE_THRESHOLD) {
-      // Close current merged file and start a new one, but only if at least
-      // one file was merged
-      if (filesMerged > 0) {
-        fclose(mergedFile);
-        filename = generateUniqueFilename();
-        mergedFile = fopen(filename, "w");
-        mergedFileSize = 0;
-        filesMerged = 0;
+    // If the array is full, double it
+    if (count >= capacity) {
+      capacity = capacity == 0 ? 1024 : capacity * 2;
+      LogRecord *temp = realloc(records, capacity * sizeof(LogRecord));
+      if (temp == NULL) {
+        perror("Failed to reallocate memory for log records");
+        exit(EXIT_FAILURE);
       }
+      records = temp;
     }
-
-    // Open the small SSTable file for reading
-    FILE *smallFile = fopen(list->filePaths[i], "r");
-    if (!smallFile) {
-      perror("Failed to open small SSTable file for merging");
-      continue;
+    records[count++] = record;
+    if (record.sequence > atomic_load(&db->lastSequence)) {
+      atomic_store(&db->lastSequence, record.sequence);
     }
+  }
+  if (reader.corrupt) {
+    fprintf(stderr, "Ignoring torn tail of %s at offset %zu\n", filepath,
+            reader.offset);
+  }
+  if (count > 0) {
+    qsort(records, count, sizeof(LogRecord), compareLogRecords);
+  }
 
-    // Write each line of the small SSTable file to the merged file
-    char line[256];
-    while (fgets(line, sizeof(line), smallFile)) {
-      fputs(line, mergedFile);
-      mergedFileSize += strlen(line);
+  Memtable *table = createMemtable();
+  MemtableBuilder builder;
+  initMemtableBuilder(&builder, table);
+  int ok = 1;
+  for (long i = 0; i < count && ok; i++) {
+    LogRecord *current = &records[i];
+    // Only the last record of a key is kept
+    if (i + 1 < count && records[i + 1].keyLength == current->keyLength &&
+        memcmp(records[i + 1].key, current->key, current->keyLength) == 0) {
+      continue;
     }
-    fclose(smallFile);
-
-    // Call the function to delete the merged file
-    deleteMergedFile(list->filePaths[i]);
-
-    filesMerged++;
+    ok = appendToMemtable(&builder, current->key, current->keyLength,
+                          current->sequence, current->value,
+                          current->valueLength);
   }
-
-  // Close the last merged file if any merging was done
-  if (filesMerged > 0) {
-    fclose(mergedFile);
+  // The memtable holds copies, the mapping can go
+  closeLogReader(&reader);
+  free(records);
+
+  ok = ok && flushMemtable(db, table);
+  unrefMemtable(table);
+  if (ok) {
+    remove(filepath);
+    *recovered = count;
   }
+  return ok;
 }
 
 /*
- * static void clearList(FilePathList *list)
- *   Frees the list of filepaths when it is no longer needed.
- * @param list: Pointer to the list of filepaths
+ * static int compareNumbers(const void *a, const void *b)
+ *   Orders file numbers for qsort.
  */
-static void clearList(FilePathList *list) {
-  for (int i = 0; i < list->size; i++) {
-    free(list->filePaths[i]);
-  }
-  free(list->filePaths);
-  list->filePaths = NULL;
-  list->size = 0;
-  list->capacity = 0;
+static int compareNumbers(const void *a, const void *b) {
+  uint64_t numberA = *(const uint64_t *)a;
+  uint64_t numberB = *(const uint64_t *)b;
+  return (numberA > numberB) - (numberA < numberB);
 }
 
 /*
- * static void removeOldFiles(FilePathList *list)
- *   Removes the old SSTable files that were merged.
- * @param list: Pointer to the list of filepaths
+ * static void recoverLogs(DB *db)
+ *   Replays every log left in the data directory, oldest first, so the
+ *   writes that had not reached an SSTable when the last run stopped,
+ *   cleanly or not, are readable again. Each log becomes a level 0 SSTable
+ *   newer than every table already there. Stops at the first log that
+ *   cannot be replayed, so no newer log is replayed before it.
  */
-static void removeOldFiles(FilePathList *list) {
-  for (int i = 0; i < list->size; i++) {
-    if (remove(list->filePaths[i]) != 0) {
-      perror("Error removing file");
-    } else {
-      printf("Removed file: %s\n", list->filePaths[i]);
+static void recoverLogs(DB *db) {
+  DIR *dir = opendir(db->directory);
+  if (dir == NULL) {
+    perror("Failed to open data directory for reading");
+    return;
+  }
+  uint64_t *numbers = NULL;
+  int count = 0;
+  int capacity = 0;
+  struct dirent *entry;
+  char filepath[MAX_PATH_LENGTH], expected[MAX_PATH_LENGTH];
+  while ((entry = readdir(dir)) != NULL) {
+    long long number;
+    if (sscanf(entry->d_name, LOG_PREFIX "%lld", &number) != 1) {
+      continue;
+    }
+    snprintf(filepath, sizeof(filepath), "%s/%s", db->directory,
+             entry->d_name);
+    logFilePath(expected, sizeof(expected), db->directory, number);
+    if (strcmp(filepath, expected) != 0) {
+      continue;
+    }
+    // If the array is full, double it
+    if (count >= capacity) {
+      capacity = capacity == 0 ? 8 : capacity * 2;
+      uint64_t *temp = realloc(numbers, capacity * sizeof(uint64_t));
+      if (temp == NULL) {
+        perror("Failed to reallocate memory for log numbers");
+        exit(EXIT_FAILURE);
+      }
+      numbers = temp;
+    }
+    numbers[count++] = number;
+    // Logs may be newer than the last manifest record
+    markFileNumberUsed(db->versions, number);
+  }
+  closedir(dir);
+  if (count > 0) {
+    qsort(numbers, count, sizeof(uint64_t), compareNumbers);
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  long total = 0;
+  int replayed = 0;
+  for (; replayed < count; replayed++) {
+    long recovered = 0;
+    if (!replayLog(db, numbers[replayed], &recovered)) {
+      fprintf(stderr, "Failed to replay write-ahead log %llu, kept for the "
+                      "next start\n",
+              (unsigned long long)numbers[replayed]);
+      break;
     }
+    total += recovered;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (replayed > 0) {
+    printf("Recovered %ld writes from %d write-ahead logs in %.3f seconds\n",
+           total, replayed,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
   }
+  free(numbers);
 }
 
 /*
- * static int isFileBelowThreshold(...)
- *   Checks if a file is below a set threshold size.
- * @param filepath: The filepath of the file to check
+ * static void waitForFlush(DB *db)
+ *   Blocks until the flush thread has emptied the immutable slot.
+ *   Expects memtableMutex to be held.
  */
-static int isFileBelowThreshold(const char *filepath) {
-  struct stat st;
-  if (stat(filepath, &st) != 0) {
-    perror("Failed to get file info");
-    return 0;
+static void waitForFlush(DB *db) {
+  while (db->immutableMemtable != NULL) {
+    pthread_cond_wait(&db->flushDoneCond, &db->memtableMutex);
   }
-  return st.st_size < SMALL_FILE_THRESHOLD;
 }
 
 /*
- * void compactSSTables()
- *   Public function to compact SSTable files.
- *   Two main purposes:
- *     1. Identify small SSTable files and merge them into larger files
- *     2. Apply tombstones to SSTable files
- *   Improvements:
- *     1. Delete duplicate keys that exist in multiple SSTable files
- */
-void compactSSTables() {
-  DIR *dir = opendir(DIR_NAME);
-  struct dirent *entry;
-  char filepath[256];
-
-  if (dir == NULL) {
-    perror("Failed to open data directory for compaction");
-    return;
+ * static void waitToRetryFlush(DB *db)
+ *   Sleeps before the next attempt at a flush that failed, twice as long
+ *   after every failure in a row, up to FLUSH_RETRY_MAX_MS. Returns early on
+ *   shutdown. Expects memtableMutex to be held.
+ */
+static void waitToRetryFlush(DB *db) {
+  long delay = FLUSH_RETRY_MS;
+  for (int i = 1; i < db->flushFailures && delay < FLUSH_RETRY_MAX_MS; i++) {
+    delay *= 2;
+  }
+  if (delay > FLUSH_RETRY_MAX_MS) {
+    delay = FLUSH_RETRY_MAX_MS;
   }
+  fprintf(stderr, "Failed to flush memtable, retrying in %ld ms\n", delay);
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  long nanos = deadline.tv_nsec + delay * 1000000L;
+  deadline.tv_sec += nanos / 1000000000L;
+  deadline.tv_nsec = nanos % 1000000000L;
+  if (!db->flushThreadStopping) {
+    pthread_cond_timedwait(&db->flushPendingCond, &db->memtableMutex,
+                           &deadline);
+  }
+}
 
-  // List to store file paths of small SSTables for merging
-  FilePathList smallFilesList;
-  initializeList(&smallFilesList);
+/*
+ * static void *flushWorker(void *arg)
+ *   Background thread that writes the immutable memtable to an SSTable.
+ *   The file I/O is done without holding the mutex, so writers and readers
+ *   keep going while it runs. A memtable that could not be written stays
+ *   in the immutable slot, readable, and is retried after a growing delay,
+ *   while writers wait once the active memtable fills up too. On shutdown
+ *   a failed memtable is given up after one more attempt: its log keeps
+ *   its writes for the next start, and without a log they are lost.
+ * @param arg: The database
+ */
+static void *flushWorker(void *arg) {
+  DB *db = arg;
+  pthread_mutex_lock(&db->memtableMutex);
+  while (1) {
+    while (db->immutableMemtable == NULL && !db->flushThreadStopping) {
+      pthread_cond_wait(&db->flushPendingCond, &db->memtableMutex);
+    }
+    if (db->immutableMemtable == NULL) {
+      // Stopping and nothing left to flush
+      break;
+    }
 
-  // Initialize and load tombstones
-  TombstoneArray tombstones;
-  initializeTombstoneArray(&tombstones);
-  loadTombstones(&tombstones, TOMBSTONE_PATH);
+    Memtable *table = db->immutableMemtable;
+    WriteAheadLog *log = db->immutableLog;
+    pthread_mutex_unlock(&db->memtableMutex);
+    int ok = flushMemtable(db, table);
+    if (log != NULL && ok) {
+      deleteLogFile(db, log);
+    }
+    pthread_mutex_lock(&db->memtableMutex);
 
-  // Step 1: Identify small SSTable files
-  while ((entry = readdir(dir)) != NULL) {
-    if (entry->d_type == DT_REG) {
-      if (strcmp(entry->d_name, TOMBSTONE_FILE) == 0) {
-        printf("Skipping %s\n", entry->d_name);
-        continue; // Skip tombstone file
-      }
-      snprintf(filepath, sizeof(filepath), "%s/%s", DIR_NAME, entry->d_name);
-      // Apply tombstones to the SSTable file
-      applyTombstonesToFile(filepath, &tombstones);
-      // If the file is below the threshold after applying tombstones, add it to
-      // smallFilesList
-      if (isFileBelowThreshold(filepath)) {
-        addToList(&smallFilesList, filepath);
+    if (!ok && !db->flushThreadStopping) {
+      db->flushFailures++;
+      waitToRetryFlush(db);
+      continue;
+    }
+    if (!ok) {
+      if (log != NULL) {
+        // The log still holds the records the SSTable could not
+        closeWriteAheadLog(log);
+      } else {
+        fprintf(stderr, "Dropped a memtable that had no log and could not "
+                        "be flushed\n");
       }
     }
+    // The SSTable and its directory entry are synced to disk, or the flush
+    // was given up on shutdown, readers can stop checking the memtable
+    db->flushFailures = 0;
+    db->immutableMemtable = NULL;
+    db->immutableLog = NULL;
+    unrefMemtable(table);
+    pthread_cond_broadcast(&db->flushDoneCond);
   }
-  closedir(dir);
-
-  // Step 2: Merge small SSTable files
-  mergeSmallFiles(&smallFilesList);
-
-  // Clean up
-  removeOldFiles(&smallFilesList);
-  clearList(&smallFilesList);
+  pthread_mutex_unlock(&db->memtableMutex);
+  return NULL;
 }
 
 /*
- * void clearSSTables()
- *   Public function to clear all SSTable files.
+ * static void freezeActiveMemtable(DB *db)
+ *   Moves the full active memtable and its log into the immutable slot and
+ *   swaps in an empty memtable with a new log, then wakes the flush thread.
+ *   Only waits if the previous memtable is still being flushed. The old log
+ *   is synced first unless syncs are off, it stays needed until the flush.
+ *   Expects logBusy to be held.
  */
-void clearSSTables() {
-  DIR *dir = opendir(DIR_NAME);
-  struct dirent *entry;
-  char filepath[256];
+static void freezeActiveMemtable(DB *db) {
+  if (db->activeLog != NULL && db->logSyncMode != WAL_SYNC_NEVER &&
+      db->activeLog->syncedSize != db->activeLog->size &&
+      syncLog(db->activeLog)) {
+    atomic_fetch_add(&db->logSyncs, 1);
+  }
+  WriteAheadLog *log = createLogFile(db);
+  pthread_mutex_lock(&db->memtableMutex);
+  waitForFlush(db);
+  db->immutableMemtable = db->activeMemtable;
+  db->immutableLog = db->activeLog;
+  db->activeMemtable = createMemtable();
+  db->activeLog = log;
+  pthread_cond_signal(&db->flushPendingCond);
+  pthread_mutex_unlock(&db->memtableMutex);
+}
 
-  if (dir == NULL) {
-    return;
+/*
+ * static void acquireLog(DB *db)
+ *   Waits until no leader is committing a group, then takes the active log
+ *   and memtable for the caller.
+ */
+static void acquireLog(DB *db) {
+  pthread_mutex_lock(&db->writeMutex);
+  while (db->logBusy) {
+    pthread_cond_wait(&db->writeCond, &db->writeMutex);
   }
+  db->logBusy = 1;
+  pthread_mutex_unlock(&db->writeMutex);
+}
 
-  while ((entry = readdir(dir)) != NULL) {
-    // Remove all files
-    if (entry->d_type == DT_REG) {
-      snprintf(filepath, sizeof(filepath), "%s/%s", DIR_NAME, entry->d_name);
+/*
+ * static void releaseLog(DB *db)
+ *   Hands the active log back to the queued writers.
+ */
+static void releaseLog(DB *db) {
+  pthread_mutex_lock(&db->writeMutex);
+  db->logBusy = 0;
+  pthread_cond_broadcast(&db->writeCond);
+  pthread_mutex_unlock(&db->writeMutex);
+}
+
+/*
+ * void dbWriteMemtableToSSTable(DB *db)
+ *   Writes the active memtable to an SSTable file.
+ *   The memtable is frozen like a full one and handed to the flush thread,
+ *   which deletes its log once the SSTable is in the version, so no write
+ *   is flushed twice or lost. Returns once the flush is done.
+ */
+void dbWriteMemtableToSSTable(DB *db) {
+  acquireLog(db);
+  freezeActiveMemtable(db);
+  releaseLog(db);
+  pthread_mutex_lock(&db->memtableMutex);
+  waitForFlush(db);
+  pthread_mutex_unlock(&db->memtableMutex);
+}
+
+/*
+ * static void insertBatch(DB *db, const WriteBatch *batch, uint64_t sequence)
+ *   Inserts every entry of a batch into the active memtable in a single
+ *   pass, numbered from sequence on. Expects logBusy to be held.
+ * @param batch: The batch
+ * @param sequence: The sequence number of its first entry
+ */
+static void insertBatch(DB *db, const WriteBatch *batch, uint64_t sequence) {
+  char key[MAX_KEY_LENGTH + 1];
+  char value[MAX_VALUE_LENGTH + 1];
+  const char *ptr = batch->data;
+  const char *limit = batch->data + batch->size;
+  BatchEntry entry;
+  // Entries were checked by addToWriteBatch
+  while (decodeBatchEntry(&ptr, limit, &entry)) {
+    memcpy(key, entry.key, entry.keyLength);
+    key[entry.keyLength] = '\0';
+    if (entry.value != NULL) {
+      memcpy(value, entry.value, entry.valueLength);
+      value[entry.valueLength] = '\0';
+    }
+    insertNodeIntoMemtable(db->activeMemtable, key, sequence++,
+                           entry.value != NULL ? value : NULL);
+  }
+}
+
+/*
+ * static int commitWrite(DB *db, char *key, char *value,
+ *                        const WriteBatch *batch, int *deleted)
+ *   Queues a record and waits for it to be committed. If it reaches the head
+ *   of the queue first, the writer leads: every record queued so far gets
+ *   the next sequence numbers, one per write of a batch, is appended to the
+ *   log in one write, synced
+ *   once if syncs are WAL_SYNC_ALWAYS, and only then inserted into the
+ *   active memtable. The last sequence of the group is published once every
+ *   record is in, so a write is never visible before it is logged. A full
+ *   memtable is frozen before the leader hands over. If the log cannot be
+ *   written the group is dropped and its sequence numbers are reused.
+ * @param key: The key written or deleted, unused with a batch
+ * @param value: The value, or NULL for a deletion
+ * @param batch: The batch to write instead of the key, or NULL
+ * @param deleted: If not NULL, set to 1 if a deletion hid a value of the
+ *   memtable
+ * @return: 1 if the record was committed, 0 if its group was dropped
+ */
+static int commitWrite(DB *db, char *key, char *value,
+                       const WriteBatch *batch, int *deleted) {
+  Writer writer = {key, value, batch, 0, 0, 0, 0, NULL};
+  pthread_mutex_lock(&db->writeMutex);
+  if (db->writeQueueTail != NULL) {
+    db->writeQueueTail->next = &writer;
+  } else {
+    db->writeQueueHead = &writer;
+  }
+  db->writeQueueTail = &writer;
+  while (!writer.done && (db->writeQueueHead != &writer || db->logBusy)) {
+    pthread_cond_wait(&db->writeCond, &db->writeMutex);
+  }
+  if (writer.done) {
+    // A leader committed it
+    pthread_mutex_unlock(&db->writeMutex);
+    if (deleted != NULL) {
+      *deleted = writer.deleted;
+    }
+    return writer.ok;
+  }
+  // Lead every writer queued up to now, later ones wait for the next group
+  db->logBusy = 1;
+  Writer *last = db->writeQueueTail;
+  pthread_mutex_unlock(&db->writeMutex);
+
+  // Only the leader numbers writes
+  uint64_t sequence =
+      atomic_load_explicit(&db->lastSequence, memory_order_relaxed);
+  for (Writer *w = &writer;; w = w->next) {
+    w->sequence = sequence + 1;
+    sequence += w->batch != NULL ? w->batch->count : 1;
+    if (w == last) {
+      break;
+    }
+  }
+  int ok = 1;
+  if (db->activeLog != NULL) {
+    long count = 0;
+    for (Writer *w = &writer;; w = w->next) {
+      if (w->batch != NULL) {
+        addLogBatch(db->activeLog, w->sequence, w->batch);
+      } else {
+        addLogRecord(db->activeLog, w->sequence, w->key, w->value);
+      }
+      count++;
+      if (w == last) {
+        break;
+      }
+    }
+    ok = commitLog(db->activeLog, db->logSyncMode == WAL_SYNC_ALWAYS);
+    if (ok) {
+      atomic_fetch_add(&db->logRecords, count);
+      atomic_fetch_add(&db->logCommits, 1);
+      if (db->logSyncMode == WAL_SYNC_ALWAYS) {
+        atomic_fetch_add(&db->logSyncs, 1);
+      }
+    } else {
+      fprintf(stderr, "Dropped %ld writes the log could not hold\n", count);
+    }
+  }
+  for (Writer *w = &writer; ok; w = w->next) {
+    if (w->batch != NULL) {
+      insertBatch(db, w->batch, w->sequence);
+    } else if (w->value != NULL) {
+      insertNodeIntoMemtable(db->activeMemtable, w->key, w->sequence, w->value);
+    } else {
+      w->deleted = deleteMemtableKey(db->activeMemtable, w->key, w->sequence);
+    }
+    if (w == last) {
+      break;
+    }
+  }
+  if (ok) {
+    // The whole group becomes visible at once
+    atomic_store_explicit(&db->lastSequence, sequence, memory_order_release);
+  }
+  // Check if the memory usage is above the memtable threshold, deletion
+  // records take space too
+  if (getMemtableMemoryUsage(db->activeMemtable) > MEMORY_THRESHOLD) {
+    // Hand the memtable to the flush thread
+    freezeActiveMemtable(db);
+  }
+
+  pthread_mutex_lock(&db->writeMutex);
+  Writer *w = db->writeQueueHead;
+  while (1) {
+    Writer *next = w->next;
+    w->ok = ok;
+    w->done = 1;
+    if (w == last) {
+      db->writeQueueHead = next;
+      break;
+    }
+    w = next;
+  }
+  if (db->writeQueueHead == NULL) {
+    db->writeQueueTail = NULL;
+  }
+  db->logBusy = 0;
+  pthread_cond_broadcast(&db->writeCond);
+  pthread_mutex_unlock(&db->writeMutex);
+  if (deleted != NULL) {
+    *deleted = writer.deleted;
+  }
+  return ok;
+}
+
+/*
+ * int dbWrite(DB *db, char *key, char *value)
+ *   Public function to write a key-value pair to the system.
+ *   The pair is appended to the write-ahead log, then inserted into the
+ *   memtable, together with the writes of other threads arriving at the same
+ *   time. If the memory usage is then above the threshold, the memtable is
+ *   frozen and handed to the flush thread.
+ * @param key: The key to be written
+ * @param value: The value to be written
+ * @return: 1 once the write is committed, 0 if the key or value is invalid
+ *   or the log could not be written, in which case nothing is written
+ */
+int dbWrite(DB *db, char *key, char *value) {
+  // Check if key or value is null
+  if (key == NULL || value == NULL) {
+    printf("Key or value cannot be null.\n");
+    return 0;
+  }
+  // Check if key or value exceeds the maximum length
+  if (strlen(key) > MAX_KEY_LENGTH || strlen(value) > MAX_VALUE_LENGTH) {
+    printf("Key or value exceeds maximum length of %d.\n", (int)MAX_KEY_LENGTH);
+    return 0;
+  }
+  return commitWrite(db, key, value, NULL, NULL);
+}
+
+/*
+ * int dbDelete(DB *db, char *key)
+ *   Public function to delete a key from the system.
+ *   Records a deletion in the log and the memtable like any other write. It
+ *   is flushed to an SSTable with the memtable and hides every older value
+ *   of the key, so reads find it as part of the normal lookup.
+ * @param key: The key to be deleted
+ * @return: 1 once the deletion is committed, 0 if the key is invalid or the
+ *   log could not be written, in which case nothing is deleted
+ */
+int dbDelete(DB *db, char *key) {
+  if (key == NULL || strlen(key) > MAX_KEY_LENGTH) {
+    printf("Key cannot be null or exceed the maximum length of %d.\n",
+           (int)MAX_KEY_LENGTH);
+    return 0;
+  }
+  int deleted = 0;
+  int ok = commitWrite(db, key, NULL, NULL, &deleted);
+  if (deleted) {
+    printf("Key deleted from memtable: %s\n", key);
+  }
+  return ok;
+}
+
+/*
+ * int dbApplyWriteBatch(DB *db, WriteBatch *batch)
+ *   Public function to apply every write and deletion of a batch atomically.
+ *   The batch is logged as a single record and inserted into the memtable in
+ *   one pass under one hand-off of the log, with consecutive sequence
+ *   numbers that become visible together: no read sees part of it, and after
+ *   a crash it is replayed whole or not at all. Entries of a key added later
+ *   win over earlier ones. The batch is not changed and may be reused.
+ * @param batch: The batch to apply
+ * @return: 1 once the batch is committed or if it is empty, 0 if the log
+ *   could not be written, in which case none of it is applied
+ */
+int dbApplyWriteBatch(DB *db, WriteBatch *batch) {
+  if (batch == NULL || batch->count == 0) {
+    return 1;
+  }
+  return commitWrite(db, NULL, NULL, batch, NULL);
+}
+
+/*
+ * static void *logSyncWorker(void *arg)
+ *   Background thread syncing the active log every logSyncInterval ms while
+ *   syncs are WAL_SYNC_INTERVAL, so a write is on disk at most that long
+ *   after it returned. It takes the log between two groups.
+ * @param arg: The database
+ */
+static void *logSyncWorker(void *arg) {
+  DB *db = arg;
+  pthread_mutex_lock(&db->writeMutex);
+  while (!db->logSyncThreadStopping) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    long nanos = deadline.tv_nsec + (long)db->logSyncInterval * 1000000L;
+    deadline.tv_sec += nanos / 1000000000L;
+    deadline.tv_nsec = nanos % 1000000000L;
+    pthread_cond_timedwait(&db->logSyncCond, &db->writeMutex, &deadline);
+    if (db->logSyncThreadStopping || db->logSyncMode != WAL_SYNC_INTERVAL) {
+      continue;
+    }
+    while (db->logBusy) {
+      pthread_cond_wait(&db->writeCond, &db->writeMutex);
+    }
+    db->logBusy = 1;
+    pthread_mutex_unlock(&db->writeMutex);
+    if (db->activeLog != NULL &&
+        db->activeLog->syncedSize != db->activeLog->size &&
+        syncLog(db->activeLog)) {
+      atomic_fetch_add(&db->logSyncs, 1);
+    }
+    pthread_mutex_lock(&db->writeMutex);
+    db->logBusy = 0;
+    pthread_cond_broadcast(&db->writeCond);
+  }
+  pthread_mutex_unlock(&db->writeMutex);
+  return NULL;
+}
+
+/*
+ * static void markInputs(const Compaction *compaction, int busy)
+ *   Marks or unmarks the inputs of a compaction as being compacted, so no
+ *   other compaction picks them. Expects compactionMutex to be held.
+ */
+static void markInputs(const Compaction *compaction, int busy) {
+  for (int i = 0; i < compaction->inputCount; i++) {
+    compaction->inputs[i]->beingCompacted = busy;
+  }
+}
+
+/*
+ * static void removeCompactionOutputs(DB *db, const Compaction *compaction,
+ *                                     const VersionEdit *edit)
+ *   Deletes the files a compaction wrote when its edit could not be
+ *   applied. Nothing refers to them, and left on disk they would only be
+ *   deleted at the next startup. A table moved down a level is one of the
+ *   inputs and still live, it is kept.
+ * @param compaction: The compaction
+ * @param edit: The edit holding its outputs
+ */
+static void removeCompactionOutputs(DB *db, const Compaction *compaction,
+                                    const VersionEdit *edit) {
+  char filepath[MAX_PATH_LENGTH];
+  for (int i = 0; i < edit->addedCount; i++) {
+    int input = 0;
+    for (int j = 0; j < compaction->inputCount && !input; j++) {
+      input = compaction->inputs[j]->number == edit->added[i].number;
+    }
+    if (!input) {
+      tableFilePath(filepath, sizeof(filepath), db->directory,
+                    edit->added[i].number);
       remove(filepath);
     }
   }
+}
 
-  closedir(dir);
+/*
+ * static int runNextCompaction(DB *db)
+ *   Runs the compaction the policy of the compaction style picks for the
+ *   current version and installs its result. The inputs are marked while
+ *   the merge runs without compactionMutex, which is held on entry and on
+ *   return.
+ * @return: 1 if a compaction was done, 0 if none is needed or it failed
+ */
+static int runNextCompaction(DB *db) {
+  if (db->compactionError || db->versions == NULL) {
+    return 0;
+  }
+  // The inputs are deleted once the version is released
+  Version *version = getCurrentVersion(db->versions);
+  Compaction compaction;
+  int picked;
+  if (db->compactionStyle == COMPACTION_TIERED) {
+    picked = pickTieredCompaction(&db->tieredPolicy, version, &compaction);
+  } else {
+    picked = pickLeveledCompaction(&db->leveledPolicy, version, &compaction);
+  }
+  if (!picked) {
+    unrefVersion(version);
+    return 0;
+  }
+  compaction.bitsPerKey = db->bloomBitsPerKey;
+  compaction.prefixLength = db->keyPrefixLength;
+  compaction.useMmap = db->mmapReads;
+  compaction.rateLimiter = db->compactionRateLimiter;
+  compaction.maxSubcompactions = db->maxSubcompactions;
+  compaction.smallestSnapshot = smallestSnapshot(db);
+  markInputs(&compaction, 1);
+  db->compactionsRunning++;
+  pthread_mutex_unlock(&db->compactionMutex);
+
+  VersionEdit edit;
+  initVersionEdit(&edit);
+  CompactionStats stats;
+  int compacted = runCompaction(db->versions, &compaction, &edit, &stats);
+  int ok = compacted && applyVersionEdit(db->versions, &edit);
+  if (compacted && !ok) {
+    removeCompactionOutputs(db, &compaction, &edit);
+  }
+  if (ok) {
+    atomic_fetch_add(&db->bytesCompacted, stats.bytesWritten);
+  }
+  if (ok && compaction.inputCount == 1) {
+    printf("Moved SSTable %lld from level %d to level %d\n",
+           (long long)compaction.inputs[0]->number, compaction.level,
+           compaction.outputLevel);
+  } else if (ok) {
+    printf("Compacted %d SSTables from level %d (%llu bytes) into %d in "
+           "level %d (%llu bytes) over %d key ranges, dropped %ld entries\n",
+           compaction.inputCount, compaction.level,
+           (unsigned long long)stats.bytesRead, stats.filesWritten,
+           compaction.outputLevel, (unsigned long long)stats.bytesWritten,
+           stats.subcompactions, stats.entriesDropped);
+  }
+  freeVersionEdit(&edit);
+
+  pthread_mutex_lock(&db->compactionMutex);
+  markInputs(&compaction, 0);
+  db->compactionsRunning--;
+  if (!ok) {
+    fprintf(stderr, "Compaction failed, no more compactions will run\n");
+    db->compactionError = 1;
+  }
+  // The result may call for another compaction, or free tables another
+  // worker was waiting for
+  pthread_cond_broadcast(&db->compactionCond);
+  freeCompaction(&compaction);
+  unrefVersion(version);
+  return ok;
+}
+
+/*
+ * static void *compactionWorker(void *arg)
+ *   Background thread of the compaction pool. Runs compactions as long as
+ *   the policy picks one, then sleeps until a flush or another compaction
+ *   changes the picture.
+ * @param arg: The database
+ */
+static void *compactionWorker(void *arg) {
+  DB *db = arg;
+  pthread_mutex_lock(&db->compactionMutex);
+  while (!db->compactionThreadsStopping) {
+    if (!runNextCompaction(db)) {
+      pthread_cond_wait(&db->compactionCond, &db->compactionMutex);
+    }
+  }
+  pthread_mutex_unlock(&db->compactionMutex);
+  return NULL;
+}
+
+/*
+ * void dbCompactSSTables(DB *db)
+ *   Public function to compact SSTable files now, rather than waiting for
+ *   the background workers. Runs compactions in the calling thread
+ *   alongside them, and returns once none is needed and none is running.
+ *   With the leveled style, every level is then within its budget: level 0
+ *   under L0_COMPACTION_TRIGGER tables, and every deeper level under its
+ *   byte budget. A point lookup then searches at most that many level 0
+ *   tables plus one table per deeper level.
+ *   With the tiered style, there are then fewer sorted runs than the run
+ *   trigger, rewriting less data for more tables per lookup.
+ *   The files come from the current version, so the directory is never
+ *   listed.
+ */
+void dbCompactSSTables(DB *db) {
+  pthread_mutex_lock(&db->compactionMutex);
+  while (1) {
+    if (runNextCompaction(db)) {
+      continue;
+    }
+    if (db->compactionsRunning == 0) {
+      break;
+    }
+    pthread_cond_wait(&db->compactionCond, &db->compactionMutex);
+  }
+  pthread_mutex_unlock(&db->compactionMutex);
+}
+
+/*
+ * void dbClearSSTables(DB *db)
+ *   Public function to clear all SSTable files.
+ *   Waits for any pending flush so its file is not written afterwards, and
+ *   for running compactions so their outputs are not installed afterwards.
+ *   Every file leaves the version in one edit and is deleted once no read
+ *   uses it.
+ */
+void dbClearSSTables(DB *db) {
+  pthread_mutex_lock(&db->memtableMutex);
+  waitForFlush(db);
+  pthread_mutex_unlock(&db->memtableMutex);
+
+  // No compaction starts while the mutex is held
+  pthread_mutex_lock(&db->compactionMutex);
+  while (db->compactionsRunning > 0) {
+    pthread_cond_wait(&db->compactionCond, &db->compactionMutex);
+  }
+  Version *version = getCurrentVersion(db->versions);
+  VersionEdit edit;
+  initVersionEdit(&edit);
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    FileList *files = &version->levels[level];
+    for (int i = 0; i < files->count; i++) {
+      removeFileFromEdit(&edit, files->files[i]->number);
+    }
+  }
+  unrefVersion(version);
+  applyVersionEdit(db->versions, &edit);
+  freeVersionEdit(&edit);
+  pthread_mutex_unlock(&db->compactionMutex);
+}
+
+/*
+ * void dbSetBloomBitsPerKey(DB *db, int bitsPerKey)
+ *   Public function to set the Bloom filter size of new SSTables.
+ *   Existing SSTables keep the filter they were written with. Prefix
+ *   filters use the same size, or BLOOM_BITS_PER_KEY if key filters are
+ *   off, they are only turned off by dbSetPrefixLength.
+ * @param bitsPerKey: Filter bits per key, 0 disables key filters
+ */
+void dbSetBloomBitsPerKey(DB *db, int bitsPerKey) {
+  pthread_mutex_lock(&db->compactionMutex);
+  db->bloomBitsPerKey = bitsPerKey > 0 ? bitsPerKey : 0;
+  pthread_mutex_unlock(&db->compactionMutex);
+}
+
+/*
+ * void dbSetPrefixLength(DB *db, int length)
+ *   Public function to set the prefix extractor of new SSTables: the first
+ *   length bytes of a key are its prefix, and keys shorter than that have
+ *   none. Flushes and compactions then write a Bloom filter of the prefixes
+ *   next to the key filter. Existing SSTables keep the filter they were
+ *   written with, a prefix iterator only trusts it for prefixes at least as
+ *   long.
+ * @param length: Prefix length in bytes, 0 disables prefix filters
+ */
+void dbSetPrefixLength(DB *db, int length) {
+  pthread_mutex_lock(&db->compactionMutex);
+  db->keyPrefixLength = length > 0 && length <= MAX_KEY_LENGTH ? length : 0;
+  pthread_mutex_unlock(&db->compactionMutex);
+}
+
+/*
+ * void dbSetBlockCacheSize(DB *db, size_t bytes)
+ *   Public function to change the byte budget of the block cache.
+ * @param bytes: The maximum number of bytes of data blocks to keep
+ */
+void dbSetBlockCacheSize(DB *db, size_t bytes) {
+  if (db->blockCache != NULL) {
+    setBlockCacheCapacity(db->blockCache, bytes);
+  }
+}
+
+/*
+ * void dbSetMaxOpenFiles(DB *db, int maxOpenFiles)
+ *   Public function to change how many SSTables the table cache keeps open.
+ * @param maxOpenFiles: The maximum number of open SSTables
+ */
+void dbSetMaxOpenFiles(DB *db, int maxOpenFiles) {
+  if (db->tableCache != NULL) {
+    setTableCacheCapacity(db->tableCache, maxOpenFiles);
+  }
+}
+
+/*
+ * void dbSetLevelSizeTargets(DB *db, size_t level1MaxBytes, int sizeRatio)
+ *   Public function to change the byte budgets of the levels used by
+ *   compaction. They take effect on the next compaction.
+ * @param level1MaxBytes: The byte budget of level 1
+ * @param sizeRatio: How many times larger each level is than the last
+ */
+void dbSetLevelSizeTargets(DB *db, size_t level1MaxBytes, int sizeRatio) {
+  pthread_mutex_lock(&db->compactionMutex);
+  db->leveledPolicy.level1MaxBytes = level1MaxBytes > 0 ? level1MaxBytes : 1;
+  db->leveledPolicy.sizeRatio = sizeRatio > 1 ? sizeRatio : 2;
+  pthread_mutex_unlock(&db->compactionMutex);
+  scheduleCompaction(db);
+}
+
+/*
+ * void dbSetCompactionStyle(DB *db, int style)
+ *   Public function to choose how SSTables are compacted. Switching from
+ *   tiered to leveled moves the runs of level 0 down on the next compaction,
+ *   switching the other way leaves the deeper levels as they are, older than
+ *   every run.
+ * @param style: COMPACTION_LEVELED or COMPACTION_TIERED
+ */
+void dbSetCompactionStyle(DB *db, int style) {
+  pthread_mutex_lock(&db->compactionMutex);
+  db->compactionStyle =
+      style == COMPACTION_TIERED ? COMPACTION_TIERED : COMPACTION_LEVELED;
+  pthread_mutex_unlock(&db->compactionMutex);
+  scheduleCompaction(db);
+}
+
+/*
+ * void dbSetTieredOptions(DB *db, int runTrigger, int sizeRatio)
+ *   Public function to change when the tiered style merges runs.
+ * @param runTrigger: The number of sorted runs that needs a merge
+ * @param sizeRatio: The percent a run may outgrow the newer runs it is
+ *    merged with
+ */
+void dbSetTieredOptions(DB *db, int runTrigger, int sizeRatio) {
+  pthread_mutex_lock(&db->compactionMutex);
+  db->tieredPolicy.runTrigger = runTrigger > 1 ? runTrigger : 2;
+  db->tieredPolicy.sizeRatio = sizeRatio > 0 ? sizeRatio : 0;
+  pthread_mutex_unlock(&db->compactionMutex);
+  scheduleCompaction(db);
+}
+
+/*
+ * void dbSetCompactionRateLimit(DB *db, int64_t bytesPerSecond)
+ *   Public function to change how fast compactions may write.
+ * @param bytesPerSecond: The write rate shared by all compactions, 0 for no
+ *    limit
+ */
+void dbSetCompactionRateLimit(DB *db, int64_t bytesPerSecond) {
+  if (db->compactionRateLimiter != NULL) {
+    setRateLimit(db->compactionRateLimiter, bytesPerSecond);
+  }
+}
+
+/*
+ * void dbSetMaxSubcompactions(DB *db, int count)
+ *   Public function to change how many key ranges, merged on their own
+ *   threads, a large compaction may be split into.
+ * @param count: The most key ranges per compaction, 1 merges on one thread
+ */
+void dbSetMaxSubcompactions(DB *db, int count) {
+  pthread_mutex_lock(&db->compactionMutex);
+  db->maxSubcompactions = count > 1 ? count : 1;
+  pthread_mutex_unlock(&db->compactionMutex);
+}
+
+/*
+ * void dbSetLogSyncMode(DB *db, int mode, int intervalMs)
+ *   Public function to choose when the write-ahead log is forced to disk.
+ * @param mode: WAL_SYNC_ALWAYS, WAL_SYNC_INTERVAL or WAL_SYNC_NEVER
+ * @param intervalMs: The time between syncs in WAL_SYNC_INTERVAL mode
+ */
+void dbSetLogSyncMode(DB *db, int mode, int intervalMs) {
+  pthread_mutex_lock(&db->writeMutex);
+  db->logSyncMode = mode == WAL_SYNC_ALWAYS || mode == WAL_SYNC_NEVER
+                    ? mode
+                    : WAL_SYNC_INTERVAL;
+  db->logSyncInterval = intervalMs > 0 ? intervalMs : 1;
+  pthread_cond_signal(&db->logSyncCond);
+  pthread_mutex_unlock(&db->writeMutex);
+}
+
+/*
+ * void dbGetLogStats(DB *db, long *records, long *commits, long *syncs)
+ *   Public function to read the write-ahead log counters since startup.
+ *   records / commits is the average size of a commit group.
+ * @param records: Set to the records logged
+ * @param commits: Set to the appends, one per group of writers
+ * @param syncs: Set to the times a log was forced to disk
+ */
+void dbGetLogStats(DB *db, long *records, long *commits, long *syncs) {
+  *records = atomic_load(&db->logRecords);
+  *commits = atomic_load(&db->logCommits);
+  *syncs = atomic_load(&db->logSyncs);
+}
+
+/*
+ * void dbGetWriteStats(DB *db, uint64_t *flushed, uint64_t *compacted)
+ *   Public function to read the SSTable bytes written since startup.
+ *   (flushed + compacted) / flushed is the write amplification.
+ * @param flushed: Set to the bytes written by flushes
+ * @param compacted: Set to the bytes written by compactions
+ */
+void dbGetWriteStats(DB *db, uint64_t *flushed, uint64_t *compacted) {
+  *flushed = atomic_load(&db->bytesFlushed);
+  *compacted = atomic_load(&db->bytesCompacted);
+}
+
+/*
+ * void dbSetMmapReads(DB *db, int enabled)
+ *   Public function to choose how SSTables are read. Mapped tables are
+ *   searched in place, the others are read with pread through the block
+ *   cache. Open tables are closed so the choice applies to every read.
+ * @param enabled: 1 to map SSTables, 0 to read them
+ */
+void dbSetMmapReads(DB *db, int enabled) {
+  pthread_mutex_lock(&db->compactionMutex);
+  db->mmapReads = enabled != 0;
+  pthread_mutex_unlock(&db->compactionMutex);
+  if (db->tableCache != NULL) {
+    pthread_mutex_lock(&db->tableCache->mutex);
+    db->tableCache->useMmap = enabled != 0;
+    pthread_mutex_unlock(&db->tableCache->mutex);
+    evictAllTables(db->tableCache);
+  }
+}
+
+/*
+ * void dbPrintStats(DB *db)
+ *   Public function to print the live SSTables, the compaction score of every
+ *   level or the sorted run count, the write amplification, the last
+ *   sequence number and the live snapshots, the hit and miss counters of the
+ *   block cache and the number of open SSTables.
+ */
+void dbPrintStats(DB *db) {
+  if (db->blockCache == NULL || db->tableCache == NULL ||
+      db->versions == NULL || db->compactionRateLimiter == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&db->compactionMutex);
+  Version *version = getCurrentVersion(db->versions);
+  printf("Version: %d SSTables\n", versionFileCount(version));
+  printVersion(version);
+  printf("Compactions: %d running on %d threads, up to %d key ranges "
+         "each%s\n",
+         db->compactionsRunning, db->compactionThreadCount,
+         db->maxSubcompactions,
+         db->compactionError ? ", stopped by an error" : "");
+  if (db->compactionStyle == COMPACTION_TIERED) {
+    printf("Tiered compaction: %d sorted runs, merged at %d\n",
+           countSortedRuns(version), db->tieredPolicy.runTrigger);
+  } else {
+    for (int level = 0; level < NUM_LEVELS - 1; level++) {
+      if (version->levels[level].count > 0) {
+        printf("Level %d compaction score: %.2f\n", level,
+               levelScore(&db->leveledPolicy, version, level));
+      }
+    }
+  }
+  unrefVersion(version);
+  pthread_mutex_unlock(&db->compactionMutex);
+
+  uint64_t flushed, compacted;
+  dbGetWriteStats(db, &flushed, &compacted);
+  printf("Write amplification: %.2f (%llu bytes flushed, %llu bytes "
+         "compacted)\n",
+         flushed > 0 ? (double)(flushed + compacted) / flushed : 0.0,
+         (unsigned long long)flushed, (unsigned long long)compacted);
+  pthread_mutex_lock(&db->compactionRateLimiter->mutex);
+  printf("Compaction rate limit: %lld bytes/s, %ld writes throttled\n",
+         (long long)db->compactionRateLimiter->bytesPerSecond,
+         db->compactionRateLimiter->throttled);
+  pthread_mutex_unlock(&db->compactionRateLimiter->mutex);
+  static const char *syncModes[] = {"every write", "every interval",
+                                    "never"};
+  long records, commits, syncs;
+  dbGetLogStats(db, &records, &commits, &syncs);
+  printf("Write-ahead log: %ld records in %ld group commits, %ld syncs "
+         "(synced %s)\n",
+         records, commits, syncs, syncModes[db->logSyncMode]);
+  pthread_mutex_lock(&db->snapshotMutex);
+  printf("Sequence: %llu, %d snapshots live",
+         (unsigned long long)dbGetLastSequence(db), db->snapshotCount);
+  if (db->snapshotCount > 0) {
+    printf(", oldest at %llu",
+           (unsigned long long)db->snapshotList.next->sequence);
+  }
+  printf("\n");
+  pthread_mutex_unlock(&db->snapshotMutex);
+
+  long hits, misses;
+  size_t usage;
+  getBlockCacheStats(db->blockCache, &hits, &misses, &usage);
+  long lookups = hits + misses;
+  printf("Block cache: %ld hits, %ld misses (%.1f%% hit rate), %zu bytes\n",
+         hits, misses, lookups > 0 ? 100.0 * hits / lookups : 0.0, usage);
+  pthread_mutex_lock(&db->tableCache->mutex);
+  printf("Table cache: %d of %d SSTables open (%s)\n",
+         db->tableCache->tableCount, db->tableCache->maxOpenFiles,
+         db->tableCache->useMmap ? "mapped" : "pread");
+  pthread_mutex_unlock(&db->tableCache->mutex);
+}
+
+/*
+ * int dbGetLevelFileCount(DB *db, int level)
+ *   Public function to count the SSTables of a level.
+ * @param level: The level to count
+ * @return: The number of SSTables in the level of the current version
+ */
+int dbGetLevelFileCount(DB *db, int level) {
+  if (db->versions == NULL || level < 0 || level >= NUM_LEVELS) {
+    return 0;
+  }
+  Version *version = getCurrentVersion(db->versions);
+  int count = version->levels[level].count;
+  unrefVersion(version);
+  return count;
+}
+
+/*
+ * void dbClearMemtable(DB *db)
+ *   Public function to discard the active memtable and start an empty one.
+ *   Its log is deleted too, so the discarded writes are gone for good.
+ */
+void dbClearMemtable(DB *db) {
+  WriteAheadLog *log = db->versions != NULL ? createLogFile(db) : NULL;
+  acquireLog(db);
+  pthread_mutex_lock(&db->memtableMutex);
+  Memtable *old = db->activeMemtable;
+  WriteAheadLog *oldLog = db->activeLog;
+  db->activeMemtable = createMemtable();
+  db->activeLog = log;
+  pthread_mutex_unlock(&db->memtableMutex);
+  releaseLog(db);
+  unrefMemtable(old);
+  if (oldLog != NULL) {
+    deleteLogFile(db, oldLog);
+  }
+}
+
+/*
+ * Memtable *dbGetActiveMemtable(DB *db)
+ *   Public function to get the memtable currently taking writes.
+ * @return: The active memtable
+ */
+Memtable *dbGetActiveMemtable(DB *db) { return db->activeMemtable; }
+
+/*
+ * int dbSetThreadAffinity(DB *db, int cpu)
+ *   Public function to pin the background threads of a database to one
+ *   CPU, so the flushes and compactions of shards pinned to different CPUs
+ *   do not compete for the same core or its caches.
+ * @param cpu: The CPU to run on
+ * @return: 1 if every thread was pinned, 0 otherwise
+ */
+int dbSetThreadAffinity(DB *db, int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int ok = pthread_setaffinity_np(db->flushThread, sizeof(set), &set) == 0 &&
+           pthread_setaffinity_np(db->logSyncThread, sizeof(set), &set) == 0;
+  for (int i = 0; i < db->compactionThreadCount; i++) {
+    ok = pthread_setaffinity_np(db->compactionThreads[i], sizeof(set),
+                                &set) == 0 &&
+         ok;
+  }
+  return ok;
+#else
+  return 0;
+#endif
+}
+
+/*
+ * DB *openDB(const char *directory)
+ *   Public function to open the database in a directory.
+ *   Creates the directory if it does not exist and locks it, loads the live
+ *   SSTables from the manifest, replays the write-ahead logs left by the
+ *   last run into SSTables, starts a log for the empty memtable, and starts
+ *   the caches, the flush thread, the log sync thread and the compaction
+ *   workers, which catch up on any compaction already due. Settings start
+ *   at their defaults.
+ * @param directory: The directory holding the database
+ * @return: The database, or NULL if the directory is open elsewhere, its
+ *    path is longer than MAX_DIRECTORY_LENGTH or its manifest cannot be
+ *    written
+ */
+DB *openDB(const char *directory) {
+  if (strlen(directory) > MAX_DIRECTORY_LENGTH) {
+    fprintf(stderr, "Database directory path is too long: %s\n", directory);
+    return NULL;
+  }
+  initializeDataDirectory(directory);
+  int lockFd = lockDirectory(directory);
+  if (lockFd < 0) {
+    return NULL;
+  }
+
+  DB *db = calloc(1, sizeof(DB));
+  if (db == NULL) {
+    perror("Failed to allocate memory for database");
+    exit(EXIT_FAILURE);
+  }
+  db->directory = strdup(directory);
+  if (db->directory == NULL) {
+    perror("Failed to allocate memory for database directory");
+    exit(EXIT_FAILURE);
+  }
+  db->lockFd = lockFd;
+  pthread_mutex_init(&db->memtableMutex, NULL);
+  pthread_cond_init(&db->flushPendingCond, NULL);
+  pthread_cond_init(&db->flushDoneCond, NULL);
+  pthread_mutex_init(&db->writeMutex, NULL);
+  pthread_cond_init(&db->writeCond, NULL);
+  pthread_cond_init(&db->logSyncCond, NULL);
+  pthread_mutex_init(&db->snapshotMutex, NULL);
+  pthread_mutex_init(&db->compactionMutex, NULL);
+  pthread_cond_init(&db->compactionCond, NULL);
+  db->snapshotList.prev = &db->snapshotList;
+  db->snapshotList.next = &db->snapshotList;
+  db->logSyncMode = WAL_SYNC_INTERVAL;
+  db->logSyncInterval = WAL_SYNC_INTERVAL_MS;
+  db->bloomBitsPerKey = BLOOM_BITS_PER_KEY;
+  db->mmapReads = 1;
+  db->maxSubcompactions = MAX_SUBCOMPACTIONS;
+  db->compactionStyle = COMPACTION_LEVELED;
+  db->leveledPolicy.level1MaxBytes = LEVEL1_MAX_BYTES;
+  db->leveledPolicy.sizeRatio = LEVEL_SIZE_RATIO;
+  db->leveledPolicy.targetFileSize = TARGET_FILE_SIZE;
+  db->tieredPolicy.runTrigger = TIERED_RUN_TRIGGER;
+  db->tieredPolicy.sizeRatio = TIERED_SIZE_RATIO;
+
+  db->blockCache = createBlockCache(BLOCK_CACHE_CAPACITY);
+  db->tableCache =
+      createTableCache(MAX_OPEN_FILES, db->mmapReads, db->blockCache);
+  db->versions = openVersionSet(directory, db->tableCache);
+  if (db->versions == NULL) {
+    closeDB(db);
+    return NULL;
+  }
+  // Numbering resumes after the newest flushed entry, replayed logs may hold
+  // newer ones
+  atomic_store(&db->lastSequence, db->versions->lastSequence);
+  recoverLogs(db);
+  db->activeMemtable = createMemtable();
+  db->activeLog = createLogFile(db);
+  db->compactionRateLimiter = createRateLimiter(COMPACTION_RATE_LIMIT);
+
+  // The threads get the database as their argument
+  for (int i = 0; i < COMPACTION_THREADS; i++) {
+    if (pthread_create(&db->compactionThreads[i], NULL, compactionWorker,
+                       db) != 0) {
+      perror("Failed to start compaction thread");
+      exit(EXIT_FAILURE);
+    }
+  }
+  db->compactionThreadCount = COMPACTION_THREADS;
+  if (pthread_create(&db->flushThread, NULL, flushWorker, db) != 0) {
+    perror("Failed to start flush thread");
+    exit(EXIT_FAILURE);
+  }
+  db->flushThreadRunning = 1;
+  if (pthread_create(&db->logSyncThread, NULL, logSyncWorker, db) != 0) {
+    perror("Failed to start log sync thread");
+    exit(EXIT_FAILURE);
+  }
+  db->logSyncThreadRunning = 1;
+  return db;
+}
+
+/*
+ * void closeDB(DB *db)
+ *   Public function to close a database.
+ *   Syncs and closes the log of the active memtable and drops the memtable,
+ *   which the next open rebuilds from the log. A memtable without a log is
+ *   frozen instead. Lets the flush thread finish any frozen memtable, then
+ *   stops it and the compaction workers once their running compactions are
+ *   done, closes the manifest and every SSTable, frees the caches and
+ *   unlocks the directory.
+ * @param db: The database, not used afterwards
+ */
+void closeDB(DB *db) {
+  if (db->logSyncThreadRunning) {
+    pthread_mutex_lock(&db->writeMutex);
+    db->logSyncThreadStopping = 1;
+    pthread_cond_signal(&db->logSyncCond);
+    pthread_mutex_unlock(&db->writeMutex);
+    pthread_join(db->logSyncThread, NULL);
+    db->logSyncThreadRunning = 0;
+  }
+  if (db->activeMemtable != NULL) {
+    acquireLog(db);
+    if (db->activeLog != NULL) {
+      // The active memtable is not flushed, its log keeps its writes until
+      // the next start replays them
+      syncLog(db->activeLog);
+      closeWriteAheadLog(db->activeLog);
+    } else {
+      // Its log could not be created, so the writes are only in memory.
+      // The flush thread writes the memtable before it stops, and the
+      // memtable swapped in is empty.
+      freezeActiveMemtable(db);
+      if (db->activeLog != NULL) {
+        deleteLogFile(db, db->activeLog);
+      }
+    }
+    pthread_mutex_lock(&db->memtableMutex);
+    Memtable *old = db->activeMemtable;
+    db->activeMemtable = NULL;
+    db->activeLog = NULL;
+    pthread_mutex_unlock(&db->memtableMutex);
+    releaseLog(db);
+    unrefMemtable(old);
+  }
+  if (db->flushThreadRunning) {
+    pthread_mutex_lock(&db->memtableMutex);
+    db->flushThreadStopping = 1;
+    pthread_cond_signal(&db->flushPendingCond);
+    pthread_mutex_unlock(&db->memtableMutex);
+    pthread_join(db->flushThread, NULL);
+    db->flushThreadRunning = 0;
+  }
+  // Running compactions finish, no new one starts
+  if (db->compactionThreadCount > 0) {
+    pthread_mutex_lock(&db->compactionMutex);
+    db->compactionThreadsStopping = 1;
+    pthread_cond_broadcast(&db->compactionCond);
+    pthread_mutex_unlock(&db->compactionMutex);
+    for (int i = 0; i < db->compactionThreadCount; i++) {
+      pthread_join(db->compactionThreads[i], NULL);
+    }
+    db->compactionThreadCount = 0;
+  }
+  if (db->versions != NULL) {
+    closeVersionSet(db->versions);
+    db->versions = NULL;
+  }
+  freeLeveledPolicy(&db->leveledPolicy);
+  if (db->compactionRateLimiter != NULL) {
+    freeRateLimiter(db->compactionRateLimiter);
+    db->compactionRateLimiter = NULL;
+  }
+  if (db->tableCache != NULL) {
+    freeTableCache(db->tableCache);
+    db->tableCache = NULL;
+  }
+  if (db->blockCache != NULL) {
+    freeBlockCache(db->blockCache);
+    db->blockCache = NULL;
+  }
+  unlockDirectory(db->lockFd);
+  pthread_mutex_destroy(&db->memtableMutex);
+  pthread_cond_destroy(&db->flushPendingCond);
+  pthread_cond_destroy(&db->flushDoneCond);
+  pthread_mutex_destroy(&db->writeMutex);
+  pthread_cond_destroy(&db->writeCond);
+  pthread_cond_destroy(&db->logSyncCond);
+  pthread_mutex_destroy(&db->snapshotMutex);
+  pthread_mutex_destroy(&db->compactionMutex);
+  pthread_cond_destroy(&db->compactionCond);
+  free(db->directory);
+  free(db);
+}
+
+/*
+ * void setShardCount(int count, int pinThreads)
+ *   Public function to split the default database into shards, each a
+ *   database of its own holding the keys that hash to it. Writes to
+ *   different shards commit in parallel. A directory keeps the shard count
+ *   it was created with, see openShardedDB.
+ * @param count: The number of shards, 1 for a single database
+ * @param pinThreads: 1 to pin the threads of every shard to a CPU
+ */
+void setShardCount(int count, int pinThreads) {
+  defaultShardCount = count;
+  defaultPinThreads = pinThreads;
 }
 
 /*
  * void initializeSSTable()
- *   Public function to initialize the SSTable system.
- *   Creates the data directory if it does not exist, and creates the tombstone
- *   file if it does not exist.
+ *   Public function to open the default database in DIR_NAME, which write,
+ *   read, delete and the other functions without a handle work on. Does
+ *   nothing if it is already open.
  */
 void initializeSSTable() {
-  initializeDataDirectory();
-  initializeTombstoneFile();
-}
\ No newline at end of file
+  if (defaultDB != NULL) {
+    return;
+  }
+  defaultDB = openShardedDB(DIR_NAME, defaultShardCount, defaultPinThreads);
+  if (defaultDB == NULL) {
+    fprintf(stderr, "Failed to open the database in %s\n", DIR_NAME);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*
+ * void closeSSTable()
+ *   Public function to close the default database, see closeShardedDB.
+ */
+void closeSSTable() {
+  if (defaultDB != NULL) {
+    closeShardedDB(defaultDB);
+    defaultDB = NULL;
+  }
+}
+
+/*
+ * void writeMemtableToSSTable()
+ *   Runs shardedWriteMemtableToSSTable on the default database.
+ */
+void writeMemtableToSSTable() { shardedWriteMemtableToSSTable(defaultDB); }
+
+/*
+ * int write(char *key, char *value)
+ *   Runs shardedWrite on the default database.
+ */
+int write(char *key, char *value) {
+  return shardedWrite(defaultDB, key, value);
+}
+
+/*
+ * char *read(char *key)
+ *   Runs shardedRead on the default database.
+ */
+char *read(char *key) { return shardedRead(defaultDB, key); }
+
+/*
+ * char *readAt(char *key, const Snapshot *snapshot)
+ *   Runs shardedReadAt on the default database.
+ */
+char *readAt(char *key, const Snapshot *snapshot) {
+  return shardedReadAt(defaultDB, key, snapshot);
+}
+
+/*
+ * int multiGet(char **keys, int count, char **values)
+ *   Runs shardedMultiGet on the default database.
+ */
+int multiGet(char **keys, int count, char **values) {
+  return shardedMultiGet(defaultDB, keys, count, values);
+}
+
+/*
+ * int multiGetAt(char **keys, int count, const Snapshot *snapshot,
+ *                char **values)
+ *   Runs shardedMultiGetAt on the default database.
+ */
+int multiGetAt(char **keys, int count, const Snapshot *snapshot,
+               char **values) {
+  return shardedMultiGetAt(defaultDB, keys, count, snapshot, values);
+}
+
+/*
+ * int readPinned(char *key, PinnedValue *pinned)
+ *   Runs shardedReadPinned on the default database.
+ */
+int readPinned(char *key, PinnedValue *pinned) {
+  return shardedReadPinned(defaultDB, key, pinned);
+}
+
+/*
+ * int readPinnedAt(char *key, const Snapshot *snapshot, PinnedValue *pinned)
+ *   Runs shardedReadPinnedAt on the default database.
+ */
+int readPinnedAt(char *key, const Snapshot *snapshot, PinnedValue *pinned) {
+  return shardedReadPinnedAt(defaultDB, key, snapshot, pinned);
+}
+
+/*
+ * int delete(char *key)
+ *   Runs shardedDelete on the default database.
+ */
+int delete(char *key) { return shardedDelete(defaultDB, key); }
+
+/*
+ * int applyWriteBatch(WriteBatch *batch)
+ *   Runs shardedApplyWriteBatch on the default database.
+ */
+int applyWriteBatch(WriteBatch *batch) {
+  return shardedApplyWriteBatch(defaultDB, batch);
+}
+
+/*
+ * Iterator *createIterator(const Snapshot *snapshot)
+ *   Runs shardedCreateIterator on the default database.
+ */
+Iterator *createIterator(const Snapshot *snapshot) {
+  return shardedCreateIterator(defaultDB, snapshot);
+}
+
+/*
+ * Iterator *createPrefixIterator(const char *prefix, const Snapshot *snapshot)
+ *   Runs shardedCreatePrefixIterator on the default database.
+ */
+Iterator *createPrefixIterator(const char *prefix, const Snapshot *snapshot) {
+  return shardedCreatePrefixIterator(defaultDB, prefix, snapshot);
+}
+
+/*
+ * const Snapshot *getSnapshot()
+ *   Runs shardedGetSnapshot on the default database.
+ */
+const Snapshot *getSnapshot() { return shardedGetSnapshot(defaultDB); }
+
+/*
+ * void releaseSnapshot(const Snapshot *snapshot)
+ *   Runs shardedReleaseSnapshot on the default database.
+ */
+void releaseSnapshot(const Snapshot *snapshot) {
+  shardedReleaseSnapshot(defaultDB, snapshot);
+}
+
+/*
+ * uint64_t getLastSequence()
+ *   Runs shardedGetLastSequence on the default database.
+ */
+uint64_t getLastSequence() { return shardedGetLastSequence(defaultDB); }
+
+/*
+ * void compactSSTables()
+ *   Runs shardedCompactSSTables on the default database.
+ */
+void compactSSTables() { shardedCompactSSTables(defaultDB); }
+
+/*
+ * void clearSSTables()
+ *   Runs shardedClearSSTables on the default database.
+ */
+void clearSSTables() { shardedClearSSTables(defaultDB); }
+
+/*
+ * void setBloomBitsPerKey(int bitsPerKey)
+ *   Runs shardedSetBloomBitsPerKey on the default database.
+ */
+void setBloomBitsPerKey(int bitsPerKey) {
+  shardedSetBloomBitsPerKey(defaultDB, bitsPerKey);
+}
+
+/*
+ * void setPrefixLength(int length)
+ *   Runs shardedSetPrefixLength on the default database.
+ */
+void setPrefixLength(int length) { shardedSetPrefixLength(defaultDB, length); }
+
+/*
+ * void setBlockCacheSize(size_t bytes)
+ *   Runs shardedSetBlockCacheSize on the default database.
+ */
+void setBlockCacheSize(size_t bytes) {
+  shardedSetBlockCacheSize(defaultDB, bytes);
+}
+
+/*
+ * void setMaxOpenFiles(int maxOpenFiles)
+ *   Runs shardedSetMaxOpenFiles on the default database.
+ */
+void setMaxOpenFiles(int maxOpenFiles) {
+  shardedSetMaxOpenFiles(defaultDB, maxOpenFiles);
+}
+
+/*
+ * void setLevelSizeTargets(size_t level1MaxBytes, int sizeRatio)
+ *   Runs shardedSetLevelSizeTargets on the default database.
+ */
+void setLevelSizeTargets(size_t level1MaxBytes, int sizeRatio) {
+  shardedSetLevelSizeTargets(defaultDB, level1MaxBytes, sizeRatio);
+}
+
+/*
+ * void setCompactionStyle(int style)
+ *   Runs shardedSetCompactionStyle on the default database.
+ */
+void setCompactionStyle(int style) {
+  shardedSetCompactionStyle(defaultDB, style);
+}
+
+/*
+ * void setTieredOptions(int runTrigger, int sizeRatio)
+ *   Runs shardedSetTieredOptions on the default database.
+ */
+void setTieredOptions(int runTrigger, int sizeRatio) {
+  shardedSetTieredOptions(defaultDB, runTrigger, sizeRatio);
+}
+
+/*
+ * void setCompactionRateLimit(int64_t bytesPerSecond)
+ *   Runs shardedSetCompactionRateLimit on the default database.
+ */
+void setCompactionRateLimit(int64_t bytesPerSecond) {
+  shardedSetCompactionRateLimit(defaultDB, bytesPerSecond);
+}
+
+/*
+ * void setMaxSubcompactions(int count)
+ *   Runs shardedSetMaxSubcompactions on the default database.
+ */
+void setMaxSubcompactions(int count) {
+  shardedSetMaxSubcompactions(defaultDB, count);
+}
+
+/*
+ * void setLogSyncMode(int mode, int intervalMs)
+ *   Runs shardedSetLogSyncMode on the default database.
+ */
+void setLogSyncMode(int mode, int intervalMs) {
+  shardedSetLogSyncMode(defaultDB, mode, intervalMs);
+}
+
+/*
+ * void getLogStats(long *records, long *commits, long *syncs)
+ *   Runs shardedGetLogStats on the default database.
+ */
+void getLogStats(long *records, long *commits, long *syncs) {
+  shardedGetLogStats(defaultDB, records, commits, syncs);
+}
+
+/*
+ * void getWriteStats(uint64_t *flushed, uint64_t *compacted)
+ *   Runs shardedGetWriteStats on the default database.
+ */
+void getWriteStats(uint64_t *flushed, uint64_t *compacted) {
+  shardedGetWriteStats(defaultDB, flushed, compacted);
+}
+
+/*
+ * int getLevelFileCount(int level)
+ *   Runs shardedGetLevelFileCount on the default database.
+ */
+int getLevelFileCount(int level) {
+  return shardedGetLevelFileCount(defaultDB, level);
+}
+
+/*
+ * void setMmapReads(int enabled)
+ *   Runs shardedSetMmapReads on the default database.
+ */
+void setMmapReads(int enabled) { shardedSetMmapReads(defaultDB, enabled); }
+
+/*
+ * void printStats()
+ *   Runs shardedPrintStats on the default database.
+ */
+void printStats() { shardedPrintStats(defaultDB); }
+
+/*
+ * void clearMemtable()
+ *   Runs shardedClearMemtable on the default database.
+ */
+void clearMemtable() { shardedClearMemtable(defaultDB); }
+
+/*
+ * Memtable *getActiveMemtable()
+ *   Runs shardedGetActiveMemtable on the default database.
+ */
+Memtable *getActiveMemtable() { return shardedGetActiveMemtable(defaultDB); }
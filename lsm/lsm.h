@@ -1,47 +1,203 @@
 #ifndef SSTABLE_H
 #define SSTABLE_H
 
-// Directory name that will contain all SSTables and tombstone file
-#define DIR_NAME "data"
+#include "memtable.h"
+#include "compaction.h"
+#include "iterator.h"
+#include "version.h"
+#include "wal.h"
 
 // SSTable macros
-#define FILENAME_FORMAT DIR_NAME "/sstable_%lld.dat"
+// File names live in version.h
 #define MEMORY_THRESHOLD 1000 * 1024 // 1MB
+// The memtable arena's first block covers the threshold plus the entry that
+// crosses it, so a full memtable is a single allocation
+#define MEMTABLE_ARENA_SIZE (MEMORY_THRESHOLD + 4 * 1024)
 #define DELIMITER " "                // key[delimiter]value
+// A failed flush is retried after FLUSH_RETRY_MS, doubled after every failure
+// up to FLUSH_RETRY_MAX_MS. Writers wait for the frozen memtable meanwhile.
+#define FLUSH_RETRY_MS 100
+#define FLUSH_RETRY_MAX_MS 10000
 
-// Compaction macros and structs
-#define TOMBSTONE_FILE "tombstones.dat"
-#define TOMBSTONE_PATH DIR_NAME "/" TOMBSTONE_FILE
-#define SMALL_FILE_THRESHOLD 200 * 1024  // 200KB
-#define UPPER_MERGE_THRESHOLD 400 * 1024 // 400KB
-// Struct for tombstone array
+// A value returned by dbReadPinned, not copied
+// Whatever holds the value is pinned until releasePinnedValue: the memtable
+// it was found in, or the SSTable and the cached block it was found in.
 typedef struct {
-  char **keys;
-  int size;
-  int capacity;
-} TombstoneArray;
-// Struct for file path list
-typedef struct {
-  char **filePaths;
-  int size;
-  int capacity;
-} FilePathList;
+  const char *data; // Not terminated
+  size_t size;
+  Memtable *memtable;      // Memtable holding the value, or NULL
+  TableHandle *table;      // SSTable holding the value, or NULL
+  TableCache *tableCache;  // Cache the SSTable is pinned in
+  SSTableValue tableValue; // Block holding the value within the SSTable
+} PinnedValue;
+
+// A consistent view of the data as of one sequence number
+// Reads at a snapshot see every write committed before it was taken and none
+// after, whatever flushes and compactions happen in the meantime.
+typedef struct Snapshot {
+  uint64_t sequence;     // Last write the snapshot sees
+  struct Snapshot *prev; // Neighbours in the list of live snapshots
+  struct Snapshot *next;
+  // Snapshot of every shard of a sharded database, NULL otherwise
+  const struct Snapshot **shards;
+} Snapshot;
+
+// An open database, see openDB
+// Every function taking one may be called from any number of threads at
+// once, and databases opened in different directories share nothing.
+typedef struct DB DB;
 
 // Function declarations
-// Writes the memtable to an SSTable
+// Opens the database in a directory, creating it if needed: loads the
+// SSTables, replays the write-ahead logs left by the last run and starts the
+// flush and compaction threads
+// Returns NULL if the directory is already open or cannot be used
+DB *openDB(const char *directory);
+// Flushes any frozen memtable, keeps the active one in its log or flushes it
+// too if it has none, stops the threads and frees the handle
+void closeDB(DB *db);
+// Writes the active memtable to an SSTable and starts an empty one
+void dbWriteMemtableToSSTable(DB *db);
+// Writes a single entry to the write-ahead log and the Memtable, hands it to
+// the flush thread if the memory threshold is exceeded
+// Returns 1 once committed, 0 if the entry is invalid or the log could not be
+// written, in which case nothing is written
+int dbWrite(DB *db, char *key, char *value);
+// Reads a value from the memtables or SSTables
+// The returned copy is owned by the caller
+char *dbRead(DB *db, char *key);
+// Reads a value as of a snapshot, NULL reads the newest data
+// The returned copy is owned by the caller
+char *dbReadAt(DB *db, char *key, const Snapshot *snapshot);
+// Reads many keys at once, each memtable and SSTable is searched once for
+// all of them. values[i] is set to a copy of the value of keys[i] owned by
+// the caller, or NULL. Returns the number of keys found
+int dbMultiGet(DB *db, char **keys, int count, char **values);
+// Reads many keys at once as of a snapshot, NULL reads the newest data
+int dbMultiGetAt(DB *db, char **keys, int count, const Snapshot *snapshot,
+                 char **values);
+// Reads a value without copying it, returns 0 if the key is not found or
+// deleted
+// The value must be released with releasePinnedValue, found or not
+int dbReadPinned(DB *db, char *key, PinnedValue *pinned);
+// Reads a value as of a snapshot without copying it, like dbReadPinned
+int dbReadPinnedAt(DB *db, char *key, const Snapshot *snapshot,
+                   PinnedValue *pinned);
+// Releases a value returned by dbReadPinned
+void releasePinnedValue(PinnedValue *pinned);
+// Deletes a key by recording a deletion in the memtable
+// Returns 1 once committed, 0 like dbWrite
+int dbDelete(DB *db, char *key);
+// Applies the writes and deletions of a batch atomically, with one log record
+// and one pass over the memtable
+// Returns 1 once committed, 0 if the log could not be written, in which case
+// none of the batch is applied
+int dbApplyWriteBatch(DB *db, WriteBatch *batch);
+// Creates an iterator over the keys as of a snapshot, NULL for the newest
+// data. It sees nothing written after it was created
+Iterator *dbCreateIterator(DB *db, const Snapshot *snapshot);
+// Creates an iterator over the keys starting with prefix as of a snapshot,
+// skipping the SSTables that cannot hold any of them
+Iterator *dbCreatePrefixIterator(DB *db, const char *prefix,
+                                 const Snapshot *snapshot);
+// Takes a snapshot of the data as of the last committed write
+const Snapshot *dbGetSnapshot(DB *db);
+// Releases a snapshot, so compactions may drop what only it could read
+void dbReleaseSnapshot(DB *db, const Snapshot *snapshot);
+// Returns the sequence number of the last committed write
+uint64_t dbGetLastSequence(DB *db);
+// Runs compactions until none is needed, they otherwise run in the
+// background after flushes
+void dbCompactSSTables(DB *db);
+// Clears all SSTables
+void dbClearSSTables(DB *db);
+// Sets the Bloom filter bits per key of new SSTables, 0 disables key filters
+// but not prefix filters
+void dbSetBloomBitsPerKey(DB *db, int bitsPerKey);
+// Sets the length of the key prefixes new SSTables keep a Bloom filter of,
+// 0 disables prefix filters
+void dbSetPrefixLength(DB *db, int length);
+// Sets the byte budget of the block cache
+void dbSetBlockCacheSize(DB *db, size_t bytes);
+// Sets how many SSTables are kept open at once
+void dbSetMaxOpenFiles(DB *db, int maxOpenFiles);
+// Sets the byte budget of level 1 and the size ratio between levels
+void dbSetLevelSizeTargets(DB *db, size_t level1MaxBytes, int sizeRatio);
+// Chooses between COMPACTION_LEVELED and COMPACTION_TIERED
+void dbSetCompactionStyle(DB *db, int style);
+// Sets the sorted run count and size ratio that trigger a tiered merge
+void dbSetTieredOptions(DB *db, int runTrigger, int sizeRatio);
+// Sets the bytes per second compactions may write, 0 for no limit
+void dbSetCompactionRateLimit(DB *db, int64_t bytesPerSecond);
+// Sets how many key ranges a large compaction is split into and merged on
+// their own threads, 1 for none
+void dbSetMaxSubcompactions(DB *db, int count);
+// Chooses when the write-ahead log is synced: WAL_SYNC_ALWAYS,
+// WAL_SYNC_INTERVAL every intervalMs, or WAL_SYNC_NEVER
+void dbSetLogSyncMode(DB *db, int mode, int intervalMs);
+// Reads the records logged, the group commits and the syncs of the log
+void dbGetLogStats(DB *db, long *records, long *commits, long *syncs);
+// Reads the SSTable bytes written by flushes and by compactions
+void dbGetWriteStats(DB *db, uint64_t *flushed, uint64_t *compacted);
+// Returns the number of SSTables in a level
+int dbGetLevelFileCount(DB *db, int level);
+// Chooses between mapped SSTables (1) and pread through the block cache (0)
+void dbSetMmapReads(DB *db, int enabled);
+// Prints the live SSTables and the block and table cache counters
+void dbPrintStats(DB *db);
+// Discards the active memtable
+void dbClearMemtable(DB *db);
+// Returns the memtable currently taking writes
+Memtable *dbGetActiveMemtable(DB *db);
+// Runs the flush, log sync and compaction threads on one CPU only
+// Returns 0 if they could not be pinned
+int dbSetThreadAffinity(DB *db, int cpu);
+
+// The default database
+// The functions below work like their db counterparts on a database opened
+// in DIR_NAME by initializeSSTable, split into shards by setShardCount.
 void writeMemtableToSSTable();
-// Writes a single entry to the Memtable, writes to SSTable if memory threshold
-// is exceeded
-void write(char *key, char *value);
-// Reads a value from the memtable or SSTable
+int write(char *key, char *value);
 char *read(char *key);
-// Deletes a key from the memtable or SSTable
-void delete(char *key);
-// Runs compaction process on SSTables
+char *readAt(char *key, const Snapshot *snapshot);
+int multiGet(char **keys, int count, char **values);
+int multiGetAt(char **keys, int count, const Snapshot *snapshot,
+               char **values);
+int readPinned(char *key, PinnedValue *pinned);
+int readPinnedAt(char *key, const Snapshot *snapshot, PinnedValue *pinned);
+int delete(char *key);
+int applyWriteBatch(WriteBatch *batch);
+Iterator *createIterator(const Snapshot *snapshot);
+Iterator *createPrefixIterator(const char *prefix, const Snapshot *snapshot);
+const Snapshot *getSnapshot();
+void releaseSnapshot(const Snapshot *snapshot);
+uint64_t getLastSequence();
 void compactSSTables();
-// Clears all SSTables and tombstone file
 void clearSSTables();
-// Initializes the SSTable system
+void setBloomBitsPerKey(int bitsPerKey);
+void setPrefixLength(int length);
+void setBlockCacheSize(size_t bytes);
+void setMaxOpenFiles(int maxOpenFiles);
+void setLevelSizeTargets(size_t level1MaxBytes, int sizeRatio);
+void setCompactionStyle(int style);
+void setTieredOptions(int runTrigger, int sizeRatio);
+void setCompactionRateLimit(int64_t bytesPerSecond);
+void setMaxSubcompactions(int count);
+void setLogSyncMode(int mode, int intervalMs);
+void getLogStats(long *records, long *commits, long *syncs);
+void getWriteStats(uint64_t *flushed, uint64_t *compacted);
+int getLevelFileCount(int level);
+void setMmapReads(int enabled);
+void printStats();
+void clearMemtable();
+Memtable *getActiveMemtable();
+// Sets how many shards the default database is split into, and whether
+// their threads are pinned to CPUs. Takes effect on the next
+// initializeSSTable
+void setShardCount(int count, int pinThreads);
+// Opens the default database, exits if it cannot be opened
 void initializeSSTable();
+// Closes the default database
+void closeSSTable();
 
 #endif // SSTABLE_H
\ No newline at end of file
@@ -13,8 +13,6 @@ void testUI();
 // Main function; acts as a UI
 int main(int argc, char *argv[]) {
   initializeSSTable();
-  clearMemtable();
-  clearSSTables();
   // runAllTests(100000);
 
   char command[100];
@@ -23,8 +21,9 @@ int main(int argc, char *argv[]) {
   char inputBuffer[200];
 
   while (1) {
-    printf("Enter command (write [w], read [r], delete [d], dump [dump], "
-           "print memtable [p], test [t], compact [comp]): ");
+    printf("Enter command (write [w], read [r], delete [d], scan [sc], "
+           "dump [dump], print memtable [p], test [t], compact [comp], "
+           "stats [s]): ");
     fgets(command, sizeof(command), stdin);
     command[strcspn(command, "\n")] = 0; // Remove newline character
 
@@ -37,22 +36,40 @@ int main(int argc, char *argv[]) {
       printf("Enter key: ");
       fgets(key, sizeof(key), stdin);
       key[strcspn(key, "\n")] = 0;
-      char *value = read(key);
-      if (value != NULL) {
-        printf("Value: %s\n", value);
+      // Printed straight from where it is stored, no copy needed
+      PinnedValue pinned;
+      if (readPinned(key, &pinned)) {
+        printf("Value: %.*s\n", (int)pinned.size, pinned.data);
       } else {
         printf("Key not found.\n");
       }
+      releasePinnedValue(&pinned);
     } else if (strcmp(command, "delete") == 0 || strcmp(command, "d") == 0) {
       printf("Enter key: ");
       fgets(key, sizeof(key), stdin);
       key[strcspn(key, "\n")] = 0;
       delete (key);
+    } else if (strcmp(command, "scan") == 0 || strcmp(command, "sc") == 0) {
+      char endKey[MAX_KEY_LENGTH];
+      printf("Enter first and last key, separated by a space: ");
+      fgets(inputBuffer, sizeof(inputBuffer), stdin);
+      if (sscanf(inputBuffer, "%s %s", key, endKey) == 2) {
+        // Streams the range in key order, values are printed in place
+        Iterator *iterator = createIterator(NULL);
+        for (seekIterator(iterator, key);
+             iteratorValid(iterator) &&
+             strcmp(iteratorKey(iterator), endKey) <= 0;
+             nextIterator(iterator)) {
+          size_t size;
+          const char *data = iteratorValue(iterator, &size);
+          printf("%s %.*s\n", iteratorKey(iterator), (int)size, data);
+        }
+        freeIterator(iterator);
+      }
     } else if (strcmp(command, "dump") == 0) {
       writeMemtableToSSTable();
-      clearMemtable();
     } else if (strcmp(command, "print") == 0 || strcmp(command, "p") == 0) {
-      printMemtable();
+      printMemtable(getActiveMemtable());
     } else if (strcmp(command, "clear") == 0 || strcmp(command, "c") == 0) {
       clearSSTables();
       clearMemtable();
@@ -61,7 +78,10 @@ int main(int argc, char *argv[]) {
     } else if (strcmp(command, "compact") == 0 ||
                strcmp(command, "comp") == 0) {
       compactSSTables();
+    } else if (strcmp(command, "stats") == 0 || strcmp(command, "s") == 0) {
+      printStats();
     } else if (strcmp(command, "q") == 0) {
+      closeSSTable();
       break;
     } else {
       printf("Unknown command.\n");
@@ -83,10 +103,36 @@ void testUI() {
   // void testLSMRandomInsert(int iterations);
   // void testLSMRandomSearch(int iterations);
   // void testLSMRandomDeletion(int iterations);
+  // void testSSTableWriteAndSearch(int iterations);
+  // void testBlockCache(int iterations);
+  // void testTableCache(int iterations);
+  // void testLSMReopen(int iterations);
+  // void testLSMPinnedRead(int iterations);
+  // void testLSMCompaction(int iterations);
+  // void testRateLimiter(int iterations);
+  // void testLSMSubcompaction(int iterations);
+  // void testLSMWriteAheadLog(int iterations);
+  // void testLSMRecovery(int iterations);
+  // void testLSMSnapshot(int iterations);
+  // void testLSMWriteBatch(int iterations);
+  // void testLSMMultiGet(int iterations);
+  // void testLSMIterator(int iterations);
+  // void testLSMPrefixScan(int iterations);
+  // void testLSMMultipleDatabases(int iterations);
+  // void testLSMSharding(int iterations);
   printf("Enter test (testMemtableInsertAndSearch [1], "
          "testMemtableRandomInsertAndSearch [2], testMemtableRandomDeletion "
          "[3], testLSMInsertAndSearch [4], testLSMRandomInsert [5], "
-         "testLSMRandomSearch [6], testLSMRandomDeletion [7]): ");
+         "testLSMRandomSearch [6], testLSMRandomDeletion [7], "
+         "testSSTableWriteAndSearch [8], testBlockCache [9], "
+         "testTableCache [10], testLSMReopen [11], "
+         "testLSMPinnedRead [12], testLSMCompaction [13], "
+         "testRateLimiter [14], testLSMSubcompaction [15], "
+         "testLSMWriteAheadLog [16], testLSMRecovery [17], "
+         "testLSMSnapshot [18], testLSMWriteBatch [19], "
+         "testLSMMultiGet [20], testLSMIterator [21], "
+         "testLSMPrefixScan [22], testLSMMultipleDatabases [23], "
+         "testLSMSharding [24]): ");
   char inputBuffer[200]; // Buffer for fgets
   fgets(inputBuffer, sizeof(inputBuffer), stdin);
   int testNumber;
@@ -117,6 +163,57 @@ void testUI() {
   case 7:
     testLSMRandomDeletion(iterations);
     break;
+  case 8:
+    testSSTableWriteAndSearch(iterations);
+    break;
+  case 9:
+    testBlockCache(iterations);
+    break;
+  case 10:
+    testTableCache(iterations);
+    break;
+  case 11:
+    testLSMReopen(iterations);
+    break;
+  case 12:
+    testLSMPinnedRead(iterations);
+    break;
+  case 13:
+    testLSMCompaction(iterations);
+    break;
+  case 14:
+    testRateLimiter(iterations);
+    break;
+  case 15:
+    testLSMSubcompaction(iterations);
+    break;
+  case 16:
+    testLSMWriteAheadLog(iterations);
+    break;
+  case 17:
+    testLSMRecovery(iterations);
+    break;
+  case 18:
+    testLSMSnapshot(iterations);
+    break;
+  case 19:
+    testLSMWriteBatch(iterations);
+    break;
+  case 20:
+    testLSMMultiGet(iterations);
+    break;
+  case 21:
+    testLSMIterator(iterations);
+    break;
+  case 22:
+    testLSMPrefixScan(iterations);
+    break;
+  case 23:
+    testLSMMultipleDatabases(iterations);
+    break;
+  case 24:
+    testLSMSharding(iterations);
+    break;
   default:
     printf("Unknown test.\n");
     break;
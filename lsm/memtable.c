@@ -2,291 +2,550 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
+#include "lsm.h"
 #include "memtable.h"
 
-// Global variables initialization
-Node *memtableRoot = NULL;
-int globalMemoryUsage = 0;
+/*
+ * Memtable *createMemtable()
+ *   Creates an empty memtable. The caller owns the single reference.
+ *   The sentinel head is the first allocation of the arena.
+ * @return: A pointer to the new memtable
+ */
+Memtable *createMemtable() {
+  Memtable *table = malloc(sizeof(Memtable));
+  if (table == NULL) {
+    perror("Failed to allocate memory for memtable");
+    exit(EXIT_FAILURE);
+  }
+  initArena(&table->arena, MEMTABLE_ARENA_SIZE);
+  atomic_init(&table->height, 1);
+  atomic_init(&table->refs, 1);
+  table->seed = 0x9E3779B9;
+
+  table->head =
+      arenaAllocate(&table->arena, sizeof(Node) + MAX_HEIGHT * sizeof(Node *));
+  if (table->head == NULL) {
+    perror("Failed to allocate memory for memtable head");
+    exit(EXIT_FAILURE);
+  }
+  table->head->key = NULL;
+  table->head->value = NULL;
+  table->head->sequence = 0;
+  table->head->height = MAX_HEIGHT;
+  for (int i = 0; i < MAX_HEIGHT; i++) {
+    atomic_init(&table->head->next[i], NULL);
+  }
+  return table;
+}
 
 /*
- * Node *createNode(char *key, char *value)
- *   Creates a new node with the given key and value
- * @param key: The key of the new node
- * @param value: The value of the new node
- * @return: A pointer to the new node
+ * void refMemtable(Memtable *table)
+ *   Takes a reference so the memtable stays alive while it is searched.
+ * @param table: The memtable to reference
+ */
+void refMemtable(Memtable *table) {
+  atomic_fetch_add_explicit(&table->refs, 1, memory_order_relaxed);
+}
+
+/*
+ * void unrefMemtable(Memtable *table)
+ *   Drops a reference. The last one releases the arena, which frees every
+ *   node at once.
+ * @param table: The memtable to release
  */
-Node *createNode(char *key, char *value) {
-  // Allocate memory for the new node
-  Node *newNode = (Node *)malloc(sizeof(Node));
+void unrefMemtable(Memtable *table) {
+  if (atomic_fetch_sub_explicit(&table->refs, 1, memory_order_acq_rel) == 1) {
+    freeArena(&table->arena);
+    free(table);
+  }
+}
+
+/*
+ * static Node *allocateNode(Memtable *table, const char *key,
+ *                           size_t keyLength, uint64_t sequence,
+ *                           const char *value, size_t valueLength,
+ *                           int height)
+ *   Creates a node from a key and value that need not be terminated.
+ *   The node, its forward pointers, key and value are one arena allocation.
+ * @return: A pointer to the new node, or NULL if allocation fails
+ */
+static Node *allocateNode(Memtable *table, const char *key, size_t keyLength,
+                          uint64_t sequence, const char *value,
+                          size_t valueLength, int height) {
+  size_t pointersSize = sizeof(Node) + height * sizeof(Node *);
+  size_t keySize = keyLength + 1;
+  size_t valueSize = value != NULL ? valueLength + 1 : 0;
+
+  // Allocate memory for the new node with the key and value after it
+  Node *newNode =
+      arenaAllocate(&table->arena, pointersSize + keySize + valueSize);
   // If allocation fails, print error message and return NULL
   if (!newNode) {
     perror("Failed to allocate memory for new node");
     return NULL;
   }
 
-  // Allocate memory for the key and value of the new node
-  newNode->key = strdup(key);
-  newNode->value = strdup(value);
+  // Copy the key and value next to the node
+  newNode->key = (char *)newNode + pointersSize;
+  memcpy(newNode->key, key, keyLength);
+  newNode->key[keyLength] = '\0';
+  char *newValue = NULL;
+  if (value != NULL) {
+    newValue = newNode->key + keySize;
+    memcpy(newValue, value, valueLength);
+    newValue[valueLength] = '\0';
+  }
 
-  // If allocation fails, print error message and free memory
-  if (!newNode->key || !newNode->value) {
-    perror("Failed to allocate memory for key or value");
-    free(newNode->key);
-    free(newNode->value);
-    free(newNode);
-    return NULL;
+  newNode->value = newValue;
+  newNode->sequence = sequence;
+  newNode->height = height;
+  // Set all forward pointers to NULL
+  for (int i = 0; i < height; i++) {
+    atomic_init(&newNode->next[i], NULL);
   }
 
-  // Set the left and right child nodes to NULL
-  newNode->left = newNode->right = NULL;
+  return newNode;
+}
+
+/*
+ * Node *createNode(Memtable *table, char *key, uint64_t sequence,
+ *                  char *value, int height)
+ *   Creates a new node with the given key and value.
+ *   The node, its forward pointers, key and value are one arena allocation.
+ * @param table: The memtable whose arena is used
+ * @param key: The key of the new node
+ * @param sequence: The sequence number of the write
+ * @param value: The value of the new node, NULL for a deletion record
+ * @param height: The number of levels the node will be linked into
+ * @return: A pointer to the new node
+ */
+Node *createNode(Memtable *table, char *key, uint64_t sequence, char *value,
+                 int height) {
+  return allocateNode(table, key, strlen(key), sequence, value,
+                      value != NULL ? strlen(value) : 0, height);
+}
+
+/*
+ * static int randomHeight(Memtable *table)
+ *   Picks the height of a new node. Each level is kept with probability
+ *   1/BRANCHING_FACTOR, which gives the expected O(log n) search cost.
+ *   Uses a xorshift generator so the writer does not touch rand()'s state.
+ *   The state is the memtable's own, so memtables of different databases
+ *   can take inserts at the same time.
+ * @param table: The memtable the node goes into
+ * @return: A height between 1 and MAX_HEIGHT
+ */
+static int randomHeight(Memtable *table) {
+  int height = 1;
+  while (height < MAX_HEIGHT) {
+    table->seed ^= table->seed << 13;
+    table->seed ^= table->seed >> 17;
+    table->seed ^= table->seed << 5;
+    if (table->seed % BRANCHING_FACTOR != 0) {
+      break;
+    }
+    height++;
+  }
+  return height;
+}
 
-  // Update the global memory usage
-  // We have to manually add the size of the key and value
-  INCREASE_MEMORY_USAGE(key, value);
+/*
+ * static Node *loadNext(Node *node, int level)
+ *   Reads a forward pointer. The acquire pairs with the writer's release so
+ *   the node we land on is fully initialized.
+ */
+static Node *loadNext(Node *node, int level) {
+  return atomic_load_explicit(&node->next[level], memory_order_acquire);
+}
 
-  return newNode;
+/*
+ * static int nodeBefore(const Node *node, const char *key, uint64_t sequence)
+ *   Checks if a node comes before the entry (key, sequence): it has a
+ *   smaller key, or the same key and a higher sequence, since the entries
+ *   of a key are ordered newest first.
+ */
+static int nodeBefore(const Node *node, const char *key, uint64_t sequence) {
+  int cmp = strcmp(node->key, key);
+  return cmp < 0 || (cmp == 0 && node->sequence > sequence);
 }
 
 /*
- * static void insertHelper(Node **node, char *key, char *value)
- *   A recursive helper function that finds the correct position to insert a new
- *   node into the BST, or updates the value if the key already exists.
- * @param node: A double pointer to the current node (or root for the first
- *   call).
- * @param key: The key of the new node or existing node to be updated.
- * @param value: The value of the new node or updated value for existing node.
+ * static Node *findGreaterOrEqual(Memtable *table, char *key,
+ *                                 uint64_t sequence, Node **prev)
+ *   Walks the skiplist from the top level down, stopping at the first node
+ *   that does not come before (key, sequence). For an existing key, that is
+ *   its newest entry numbered sequence or less.
+ * @param table: The memtable to search
+ * @param key: The key to search for
+ * @param sequence: The highest sequence number to stop at
+ * @param prev: If not NULL, filled with the last node before the entry at
+ *   every level (needed by the writer to link a new node)
+ * @return: The first node at or after (key, sequence), or NULL
  */
-static void insertHelper(Node **node, char *key, char *value) {
-  if (*node == NULL) {
-    // Node doesn't exist, create a new one
-    *node = createNode(key, value);
-  } else if (strcmp(key, (*node)->key) == 0) {
-    // Key already exists, update the node's value
-
-    // Free the old value and decrease memory usage
-    DECREASE_MEMORY_USAGE((*node)->key, (*node)->value);
-    free((*node)->value);
-    // Allocate memory for the new value and update memory usage
-    (*node)->value = strdup(value);
-    INCREASE_MEMORY_USAGE(key, value);
-    // printf("Memory usage post-update: %d\n", globalMemoryUsage);
-  } else if (strcmp(key, (*node)->key) < 0) {
-    // Continue searching in the left subtree
-    insertHelper(&((*node)->left), key, value);
-  } else {
-    // Continue searching in the right subtree
-    insertHelper(&((*node)->right), key, value);
+static Node *findGreaterOrEqual(Memtable *table, char *key, uint64_t sequence,
+                                Node **prev) {
+  Node *node = table->head;
+  int level = atomic_load_explicit(&table->height, memory_order_relaxed) - 1;
+  while (1) {
+    Node *next = loadNext(node, level);
+    if (next != NULL && nodeBefore(next, key, sequence)) {
+      // Keep moving forward on this level
+      node = next;
+    } else {
+      if (prev != NULL) {
+        prev[level] = node;
+      }
+      if (level == 0) {
+        return next;
+      }
+      // Drop down a level
+      level--;
+    }
   }
 }
 
 /*
- * void insertNodeIntoMemtable(char *key, char *value)
- *   Public function to insert a new key-value pair into the memtable.
+ * void insertNodeIntoMemtable(Memtable *table, char *key, uint64_t sequence,
+ *                             char *value)
+ *   Public function to insert a new entry into the memtable.
+ *   A new node is linked in from the bottom level up so readers never see a
+ *   half-linked node. If the key already exists its older entries stay
+ *   behind the new one, readers at their sequence numbers still need them.
+ * @param table: The memtable to insert into
  * @param key: The key to be inserted into the memtable.
- * @param value: The value associated with the key.
+ * @param sequence: The sequence number of the write, higher than every
+ *   entry of the key already in the memtable
+ * @param value: The value associated with the key, NULL to record a deletion
  */
-void insertNodeIntoMemtable(char *key, char *value) {
+void insertNodeIntoMemtable(Memtable *table, char *key, uint64_t sequence,
+                            char *value) {
   // Check if key or value exceeds the maximum length
   // TODO: Handle key and value separately?
-  if (strlen(key) > MAX_KEY_LENGTH || strlen(value) > MAX_VALUE_LENGTH) {
+  if (strlen(key) > MAX_KEY_LENGTH ||
+      (value != NULL && strlen(value) > MAX_VALUE_LENGTH)) {
     printf("Key or value exceeds maximum length of %d.\n", (int)MAX_KEY_LENGTH);
     return;
   }
-  insertHelper(&memtableRoot, key, value);
+
+  Node *prev[MAX_HEIGHT];
+  findGreaterOrEqual(table, key, sequence, prev);
+
+  int height = randomHeight(table);
+  int currentHeight =
+      atomic_load_explicit(&table->height, memory_order_relaxed);
+  if (height > currentHeight) {
+    // New levels start from the head
+    for (int i = currentHeight; i < height; i++) {
+      prev[i] = table->head;
+    }
+    // Readers that see the new height before the node is linked simply find
+    // NULL at the new levels and drop down
+    atomic_store_explicit(&table->height, height, memory_order_relaxed);
+  }
+
+  Node *node = createNode(table, key, sequence, value, height);
+  if (node == NULL) {
+    return;
+  }
+  for (int i = 0; i < height; i++) {
+    atomic_store_explicit(&node->next[i],
+                          atomic_load_explicit(&prev[i]->next[i],
+                                               memory_order_relaxed),
+                          memory_order_relaxed);
+    // Publish the node on this level
+    atomic_store_explicit(&prev[i]->next[i], node, memory_order_release);
+  }
 }
 
 /*
- * static Node *search(Node *root, char *key)
- *   Recursively searches for a key in the BST.
- * @param root: The root node (or current node for recursive calls)
- * @param key: The key to be searched for.
+ * void initMemtableBuilder(MemtableBuilder *builder, Memtable *table)
+ *   Public function to start filling an empty memtable in key order.
+ * @param builder: The builder to initialize
+ * @param table: The empty memtable to fill
  */
-static Node *search(Node *root, char *key) {
-  // Base cases: root is null or key is present at root
-  if (root == NULL || strcmp(root->key, key) == 0) {
-    return root;
+void initMemtableBuilder(MemtableBuilder *builder, Memtable *table) {
+  builder->table = table;
+  for (int i = 0; i < MAX_HEIGHT; i++) {
+    builder->tails[i] = table->head;
   }
+}
 
-  // Value is greater than root's key
-  if (strcmp(root->key, key) < 0) {
-    return search(root->right, key);
+/*
+ * int appendToMemtable(MemtableBuilder *builder, const char *key,
+ *                      size_t keyLength, uint64_t sequence,
+ *                      const char *value, size_t valueLength)
+ *   Public function to add an entry after every entry added so far.
+ *   The node goes after the last node of each of its levels, so building a
+ *   memtable of n sorted entries takes O(n) with no key comparison.
+ * @param builder: The builder
+ * @param key: The key, not terminated
+ * @param keyLength: The length of the key
+ * @param sequence: The sequence number of the entry
+ * @param value: The value, not terminated, or NULL to record a deletion
+ * @param valueLength: The length of the value
+ * @return: 1 on success, 0 if the node could not be allocated
+ */
+int appendToMemtable(MemtableBuilder *builder, const char *key,
+                     size_t keyLength, uint64_t sequence, const char *value,
+                     size_t valueLength) {
+  Memtable *table = builder->table;
+  int height = randomHeight(table);
+  Node *node = allocateNode(table, key, keyLength, sequence, value,
+                            valueLength, height);
+  if (node == NULL) {
+    return 0;
   }
-
-  // Value is smaller than root's key
-  return search(root->left, key);
+  if (height > atomic_load_explicit(&table->height, memory_order_relaxed)) {
+    atomic_store_explicit(&table->height, height, memory_order_relaxed);
+  }
+  for (int i = 0; i < height; i++) {
+    atomic_store_explicit(&builder->tails[i]->next[i], node,
+                          memory_order_release);
+    builder->tails[i] = node;
+  }
+  return 1;
 }
 
 /*
- * Node *searchMemtable(char *key)
- *   Public function to search for a key in the memtable.
+ * Node *searchMemtable(Memtable *table, char *key)
+ *   Public function to search for the newest entry of a key in the
+ *   memtable.
+ * @param table: The memtable to search
  * @param key: The key to be searched for.
- * @return: A pointer to the node containing the key, or NULL if not found.
+ * @return: A pointer to the node containing the key, or NULL if not found
+ *   or deleted.
  */
-Node *searchMemtable(char *key) { return search(memtableRoot, key); }
+Node *searchMemtable(Memtable *table, char *key) {
+  Node *node = findMemtableEntry(table, key, MAX_SEQUENCE);
+  return node != NULL && node->value != NULL ? node : NULL;
+}
 
 /*
- * static Node *minValueNode(Node *node)
- *   A utility function to find the node with the minimum key value in the given
- *   subtree. It traverses the tree to the leftmost node which is the node with
- *   the minimum key.
- * @param node: A pointer to the root node of the subtree.
- * @return: A pointer to the node with the minimum key value in the given
- *   subtree.
+ * Node *findMemtableEntry(Memtable *table, char *key, uint64_t sequence)
+ *   Public function to find the entry of a key a read at the given sequence
+ *   sees, live or deleted. A deleted node hides any older value of the key
+ *   in SSTables. Entries written after the sequence are skipped.
+ * @param table: The memtable to search
+ * @param key: The key to be searched for.
+ * @param sequence: The sequence number of the read
+ * @return: The newest node of the key numbered sequence or less, whose value
+ *   is NULL if it was deleted, or NULL if the memtable has no such entry.
  */
-static Node *minValueNode(Node *node) {
-  Node *current = node;
-
-  // Find the leftmost leaf
-  while (current && current->left != NULL)
-    current = current->left;
-
-  return current;
+Node *findMemtableEntry(Memtable *table, char *key, uint64_t sequence) {
+  Node *node = findGreaterOrEqual(table, key, sequence, NULL);
+  if (node != NULL && strcmp(node->key, key) == 0) {
+    return node;
+  }
+  return NULL;
 }
 
 /*
- * static int deleteNodeHelper(Node **node, char *key)
- *   A recursive helper function to delete a node with a given key from the BST.
- *   It finds the node and performs deletion according to BST rules.
- * @param node: A double pointer to the root node of the BST.
- * @param key: The key of the node to be deleted.
- * @return: 1 if deletion is successful, 0 if the key is not found in the tree.
+ * void initMemtableCursor(MemtableCursor *cursor, Memtable *table)
+ *   Public function to start a walk of lookups in increasing key order. The
+ *   first lookup starts at the head like any other.
+ * @param cursor: The cursor to initialize
+ * @param table: The memtable to search
  */
-static int deleteNodeHelper(Node **node, char *key) {
-  if (*node == NULL) {
-    return 0; // Node not found, return 0
+void initMemtableCursor(MemtableCursor *cursor, Memtable *table) {
+  cursor->table = table;
+  for (int i = 0; i < MAX_HEIGHT; i++) {
+    cursor->fingers[i] = table->head;
   }
+}
 
-  // Recur(is that a word?) down the tree
-  if (strcmp(key, (*node)->key) < 0) {
-    return deleteNodeHelper(&((*node)->left), key);
-  } else if (strcmp(key, (*node)->key) > 0) {
-    return deleteNodeHelper(&((*node)->right), key);
-  } else {
-    // Node with the key found; perform deletion
-
-    Node *temp = *node; // Temporary pointer to the node to be deleted
-
-    // Node with only one child or no child
-    if ((*node)->left == NULL || (*node)->right == NULL) {
-      *node = ((*node)->left) ? (*node)->left : (*node)->right;
-    } else {
-      // Node with two children: Get the inorder successor (smallest in the
-      // right subtree)
-      Node *minNode = minValueNode((*node)->right);
-
-      // Free the old key/value and replace with inorder successor's key/value
-      free((*node)->key);
-      free((*node)->value);
-      (*node)->key = strdup(minNode->key);
-      (*node)->value = strdup(minNode->value);
-
-      // Delete the inorder successor
-      deleteNodeHelper(&((*node)->right), minNode->key);
+/*
+ * Node *seekMemtableCursor(MemtableCursor *cursor, const char *key,
+ *                          uint64_t sequence)
+ *   Public function to find the entry of a key a read at the given sequence
+ *   sees, like findMemtableEntry, starting from where the previous lookup
+ *   of the cursor stopped. Every finger comes before the key, so the search
+ *   climbs from the bottom level only while the next node on the level above
+ *   is still before it, then walks down from there as usual. Keys close to
+ *   each other cost a few steps instead of a walk from the head.
+ *   Nodes are never unlinked, so the fingers stay valid while the writer
+ *   inserts.
+ * @param cursor: The cursor, whose previous key is not larger than key
+ * @param key: The key to be searched for
+ * @param sequence: The sequence number of the read
+ * @return: The newest node of the key numbered sequence or less, whose value
+ *   is NULL if it was deleted, or NULL if the memtable has no such entry.
+ */
+Node *seekMemtableCursor(MemtableCursor *cursor, const char *key,
+                         uint64_t sequence) {
+  Node **fingers = cursor->fingers;
+  Node *head = cursor->table->head;
+  int height =
+      atomic_load_explicit(&cursor->table->height, memory_order_relaxed);
+  int level = 0;
+  while (level + 1 < height) {
+    Node *next = loadNext(fingers[level + 1], level + 1);
+    if (next == NULL || !nodeBefore(next, key, sequence)) {
+      break;
     }
+    level++;
+  }
 
-    // If the deleted node is different from the temporary node, update memory
-    // usage
-    if (temp != *node) {
-      DECREASE_MEMORY_USAGE(temp->key, temp->value);
-      // Free the memory of the temporary node
-      free(temp->key);
-      free(temp->value);
-      free(temp);
+  Node *node = fingers[level];
+  Node *next = NULL;
+  for (; level >= 0; level--) {
+    // The finger of a lower level may be further along than the walk above
+    Node *finger = fingers[level];
+    if (finger != head &&
+        (node == head || nodeBefore(node, finger->key, finger->sequence))) {
+      node = finger;
+    }
+    next = loadNext(node, level);
+    while (next != NULL && nodeBefore(next, key, sequence)) {
+      node = next;
+      next = loadNext(node, level);
     }
-    return 1; // Deletion successful
+    fingers[level] = node;
+  }
+  if (next != NULL && strcmp(next->key, key) == 0) {
+    return next;
   }
+  return NULL;
 }
 
 /*
- * int deleteMemtableKey(char *key)
+ * int deleteMemtableKey(Memtable *table, char *key, uint64_t sequence)
  *   Public function to delete a key from the memtable.
- *   It uses the deleteNodeHelper function to perform the deletion on the
- *   memtable.
+ *   The key is kept as a deletion record, a node whose value is NULL, so
+ *   searches no longer find it and the deletion reaches the SSTables when
+ *   the memtable is flushed. Older entries stay linked (unlinking would
+ *   race with readers), reads at older sequences still see them.
+ * @param table: The memtable to delete from
  * @param key: The key to be deleted.
- * @return: 1 if the deletion is successful, 0 if the key is not found in the
- *   memtable. (needed for SSTable deletion)
+ * @param sequence: The sequence number of the deletion
+ * @return: 1 if the key had a value in the memtable, 0 otherwise
  */
-int deleteMemtableKey(char *key) {
-  return deleteNodeHelper(&memtableRoot, key);
+int deleteMemtableKey(Memtable *table, char *key, uint64_t sequence) {
+  int wasLive = searchMemtable(table, key) != NULL;
+  insertNodeIntoMemtable(table, key, sequence, NULL);
+  return wasLive;
 }
 
 /*
- * static Node *clearTree(Node *root)
- *   Recursively clears the entire tree, freeing all the memory used by
- *   nodes. It traverses the tree post-order and frees each node along with
- *   its key and value.
- * @param root: A pointer to the root node of the tree.
- * @return: NULL (hopefully), as the tree is cleared and there are no nodes
- * left.
+ * Node *firstMemtableNode(Memtable *table)
+ *   Public function to start an in-order walk of the memtable.
+ *   The walk includes deletion records, whose value is NULL, and every older
+ *   entry of a key right after its newest one.
+ * @param table: The memtable to walk
+ * @return: The newest node of the smallest key, or NULL if empty
+ */
+Node *firstMemtableNode(Memtable *table) { return loadNext(table->head, 0); }
+
+/*
+ * Node *nextMemtableNode(Node *node)
+ *   Public function to continue an in-order walk of the memtable.
+ * @param node: The current node
+ * @return: The next node, or NULL at the end of the memtable
+ */
+Node *nextMemtableNode(Node *node) { return loadNext(node, 0); }
+
+/*
+ * static Node *findLessThan(Memtable *table, const char *key,
+ *                           uint64_t sequence)
+ *   Walks the skiplist from the top level down to the last node that comes
+ *   before (key, sequence). A NULL key finds the last node of the memtable.
+ * @return: That node, or NULL if there is none
  */
-static Node *clearTree(Node *root) {
-  if (root != NULL) {
-    clearTree(root->left);  // Clear left subtree
-    clearTree(root->right); // Clear right subtree
-
-    // Update global memory usage
-    // Note: we could set this to 0, but I like to do it manually
-    // so we can detect memory leaks
-    DECREASE_MEMORY_USAGE(root->key, root->value);
-
-    // Free the memory!
-    free(root->key);
-    free(root->value);
-    free(root);
+static Node *findLessThan(Memtable *table, const char *key,
+                          uint64_t sequence) {
+  Node *node = table->head;
+  int level = atomic_load_explicit(&table->height, memory_order_relaxed) - 1;
+  for (; level >= 0; level--) {
+    Node *next = loadNext(node, level);
+    while (next != NULL && (key == NULL || nodeBefore(next, key, sequence))) {
+      node = next;
+      next = loadNext(node, level);
+    }
   }
-  return NULL;
+  return node == table->head ? NULL : node;
 }
 
 /*
- * void clearMemtable()
- *   Clears the entire memtable using clearTree.
+ * Node *seekMemtableNode(Memtable *table, const char *key)
+ *   Public function to start an in-order walk of the memtable at a key.
+ * @param table: The memtable to walk
+ * @param key: The key to start at
+ * @return: The newest node of the first key >= key, or NULL if there is none
  */
-void clearMemtable() {
-  memtableRoot = clearTree(memtableRoot); // Clear the entire memtable
+Node *seekMemtableNode(Memtable *table, const char *key) {
+  Node *node = findLessThan(table, key, MAX_SEQUENCE);
+  return loadNext(node != NULL ? node : table->head, 0);
+}
 
-  // Check for memory leaks
-  if (globalMemoryUsage != 0) {
-    printf("Memory leak detected. Memory usage: %d\n", globalMemoryUsage);
-  }
+/*
+ * Node *lastMemtableNode(Memtable *table)
+ *   Public function to start a backward walk of the memtable.
+ * @param table: The memtable to walk
+ * @return: The oldest node of the largest key, or NULL if empty
+ */
+Node *lastMemtableNode(Memtable *table) {
+  return findLessThan(table, NULL, 0);
+}
 
-  // Reset global memory usage
-  globalMemoryUsage = 0;
+/*
+ * Node *prevMemtableNode(Memtable *table, Node *node)
+ *   Public function to continue a backward walk of the memtable. Nodes only
+ *   link forward, so this searches from the top level for the node before.
+ * @param table: The memtable being walked
+ * @param node: The current node
+ * @return: The previous node, or NULL at the start of the memtable
+ */
+Node *prevMemtableNode(Memtable *table, Node *node) {
+  return findLessThan(table, node->key, node->sequence);
 }
 
 /*
- * void inorderTraversal(Node *root)
- *   Recursively performs an in-order traversal of the BST.
- *   Prints the key and value of each node.
- * @param root: A pointer to the root node (or current node for recursive calls)
+ * size_t getMemtableMemoryUsage(Memtable *table)
+ *   Public function to get the memory usage of the memtable, which is the
+ *   number of bytes handed out by its arena.
+ * @param table: The memtable to check
+ * @return: The memory usage in bytes
  */
-void inorderTraversal(Node *root) {
-  if (root != NULL) {
-    inorderTraversal(root->left);
-    printf("%s, %s \n", root->key, root->value);
-    inorderTraversal(root->right);
-  }
+size_t getMemtableMemoryUsage(Memtable *table) {
+  return arenaMemoryUsage(&table->arena);
 }
 
 /*
- * void inorderTraversalMemtable()
- *   Performs an in-order traversal of the memtable using the inorderTraversal
- *   function
+ * void inorderTraversalMemtable(Memtable *table)
+ *   Walks the bottom level of the skiplist, which is already in key order.
+ *   Prints the key and value of the newest node of each key, skipping
+ *   deletion records.
+ * @param table: The memtable to print
  */
-void inorderTraversalMemtable() { inorderTraversal(memtableRoot); }
+void inorderTraversalMemtable(Memtable *table) {
+  const char *lastKey = NULL;
+  for (Node *node = firstMemtableNode(table); node != NULL;
+       node = nextMemtableNode(node)) {
+    if (lastKey != NULL && strcmp(node->key, lastKey) == 0) {
+      continue; // An older entry of the key just printed
+    }
+    lastKey = node->key;
+    if (node->value != NULL) {
+      printf("%s, %s \n", node->key, node->value);
+    }
+  }
+}
 
 /*
- * void printMemtable()
+ * void printMemtable(Memtable *table)
  *   Prints an in-order traversal of the memtable and its memory usage.
+ * @param table: The memtable to print
  */
-void printMemtable() {
-  inorderTraversalMemtable();
-  printMemoryUsage();
+void printMemtable(Memtable *table) {
+  inorderTraversalMemtable(table);
+  printMemoryUsage(table);
 }
 
 /*
- * void printMemoryUsage()
+ * void printMemoryUsage(Memtable *table)
  *   Prints the current memory usage of the memtable.
+ * @param table: The memtable to check
  */
-void printMemoryUsage() {
-  printf("Memory usage: %d bytes\n", globalMemoryUsage);
-}
\ No newline at end of file
+void printMemoryUsage(Memtable *table) {
+  printf("Memory usage: %zu bytes\n", getMemtableMemoryUsage(table));
+}
@@ -1,49 +1,133 @@
 #ifndef MEMTABLE_H
 #define MEMTABLE_H
 
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
 // Define macros for the maximum lengths of keys and values
 #define MAX_KEY_LENGTH 100
 #define MAX_VALUE_LENGTH 100
 
-// Memory usage macros
-// Macro to calculate the memory usage of a node
-#define NODE_MEMORY_USAGE(key, value) (sizeof(Node) + strlen(key) + 1 + strlen(value) + 1)
-// Macro to increase global memory usage
-#define INCREASE_MEMORY_USAGE(key, value) (globalMemoryUsage += NODE_MEMORY_USAGE(key, value))
-// Macro to decrease global memory usage
-#define DECREASE_MEMORY_USAGE(key, value) (globalMemoryUsage -= NODE_MEMORY_USAGE(key, value))
-// Tracks the current memory usage of the memtable
-extern int globalMemoryUsage; 
+// Sequence numbers
+// Every write is stamped with the next sequence number, starting at 1. A read
+// at sequence s sees the newest entry of each key numbered s or less.
+#define MAX_SEQUENCE UINT64_MAX // Sees every entry written so far
+
+// Results of a point lookup in a memtable or an SSTable
+#define LOOKUP_NOT_FOUND 0 // No entry, older data must be searched
+#define LOOKUP_FOUND 1
+#define LOOKUP_DELETED 2 // A deletion record hides any older value
 
+// Skiplist macros
+#define MAX_HEIGHT 12      // Maximum number of levels in the skiplist
+#define BRANCHING_FACTOR 4 // 1 in BRANCHING_FACTOR nodes is promoted a level
 
-// Node structure for the Binary Search Tree (BST)
+// Node structure for the skiplist
+// Every write adds a node, nodes are never changed once linked: an
+// overwrite is a new node with a higher sequence number, so a reader at an
+// older sequence still finds the value it should see. Nodes are ordered by
+// key, then newest first. Readers never take a lock: the forward pointers
+// are atomics that the single writer publishes with release stores, so a
+// reader either misses a node or sees it fully initialized.
+// Nodes live in the memtable arena with the key and value bytes stored right
+// after the forward pointers.
+// A node whose value is NULL is a deletion record: it stays in the skiplist
+// and is flushed like any other entry, so it hides older values of its key
+// in the SSTables.
 typedef struct Node {
-  char *key;          // Pointer to the key of the node
-  char *value;        // Pointer to the value associated with the key
-  struct Node *left;  // Pointer to the left child node
-  struct Node *right; // Pointer to the right child node
+  char *key;                     // Pointer to the inline key of the node
+  char *value;                   // Pointer to the value, NULL for a deletion
+  uint64_t sequence;             // Sequence number of the write
+  int height;                    // Number of levels this node is linked into
+  _Atomic(struct Node *) next[]; // Forward pointers, one per level
 } Node;
 
-// For purposes of this project, we will use a global memtable
-// All external functions will only use this global memtable
-extern Node *memtableRoot; 
+// A memtable: a skiplist plus the arena its nodes live in
+// The LSM keeps an active memtable for writes and, while it is being flushed,
+// a read-only immutable one. Readers hold a reference so the flush thread
+// cannot free a memtable they are still searching.
+typedef struct Memtable {
+  Node *head;        // Sentinel node of MAX_HEIGHT with no key
+  atomic_int height; // Current height, read by searchers without a lock
+  atomic_int refs;   // Reference count, freed when it drops to 0
+  Arena arena;       // Holds every node, key and value of the memtable
+  unsigned int seed; // Node heights, only touched by the inserting thread
+} Memtable;
+
+// Fills an empty memtable with entries in increasing order
+// Every node is linked after the last node of its levels, no search needed.
+typedef struct {
+  Memtable *table;
+  Node *tails[MAX_HEIGHT]; // Last node linked on every level
+} MemtableBuilder;
+
+// Looks up keys of a memtable in increasing order
+// Each search starts from the nodes the previous one stopped at instead of
+// the head, so a sorted batch of keys is found in one pass.
+typedef struct {
+  Memtable *table;
+  Node *fingers[MAX_HEIGHT]; // Last node before the previous key per level
+} MemtableCursor;
 
 // Function declarations
-// Creates a new BST node with the given key and value
-Node *createNode(char *key, char *value);
-// Inserts a new key-value pair into the memtable
-void insertNodeIntoMemtable(char *key, char *value);
-// Searches for a key in the memtable and returns its node
-Node *searchMemtable(char *key);
-// Deletes a key from the memtable and returns 1 if successful
-int deleteMemtableKey(char *key);
-// Clears the entire memtable, freeing all nodes
-void clearMemtable();
+// Creates an empty memtable with a reference count of 1
+Memtable *createMemtable();
+// Takes a reference to a memtable
+void refMemtable(Memtable *table);
+// Drops a reference to a memtable, freeing it when none remain
+void unrefMemtable(Memtable *table);
+// Creates a new skiplist node in the memtable arena
+Node *createNode(Memtable *table, char *key, uint64_t sequence, char *value,
+                 int height);
+// Inserts a new entry for a key into the memtable, a NULL value records a
+// deletion. Older entries of the key stay for reads at older sequences.
+// Only one thread may insert or delete at a time
+void insertNodeIntoMemtable(Memtable *table, char *key, uint64_t sequence,
+                            char *value);
+// Starts filling an empty memtable in key order
+void initMemtableBuilder(MemtableBuilder *builder, Memtable *table);
+// Adds an entry after every entry added so far: a larger key, or the same
+// key with a lower sequence. A NULL value records a deletion. Key and value
+// need not be terminated. Returns 0 on failure
+int appendToMemtable(MemtableBuilder *builder, const char *key,
+                     size_t keyLength, uint64_t sequence, const char *value,
+                     size_t valueLength);
+// Searches for the newest entry of a key in the memtable and returns its
+// node, NULL if the key is absent or deleted
+// Safe to call from any thread while the writer is inserting
+Node *searchMemtable(Memtable *table, char *key);
+// Returns the newest node of a key numbered sequence or less, live or
+// deleted, or NULL if it has none
+Node *findMemtableEntry(Memtable *table, char *key, uint64_t sequence);
+// Starts a walk of lookups in increasing key order
+void initMemtableCursor(MemtableCursor *cursor, Memtable *table);
+// Like findMemtableEntry, for a key no smaller than the previous one of the
+// cursor
+Node *seekMemtableCursor(MemtableCursor *cursor, const char *key,
+                         uint64_t sequence);
+// Records the deletion of a key, returns 1 if it had a value in the memtable
+int deleteMemtableKey(Memtable *table, char *key, uint64_t sequence);
+// Returns the first node of the memtable in order, deletions and older
+// entries included
+Node *firstMemtableNode(Memtable *table);
+// Returns the node following the given node in order
+Node *nextMemtableNode(Node *node);
+// Returns the newest node of the first key >= key, or NULL
+Node *seekMemtableNode(Memtable *table, const char *key);
+// Returns the last node of the memtable in order, or NULL if empty
+Node *lastMemtableNode(Memtable *table);
+// Returns the node before the given node in order, or NULL
+Node *prevMemtableNode(Memtable *table, Node *node);
+// Returns the number of bytes the memtable arena has handed out
+size_t getMemtableMemoryUsage(Memtable *table);
 // Performs an inorder traversal of the memtable
-void inorderTraversalMemtable();
+void inorderTraversalMemtable(Memtable *table);
 // Prints an inorder traversal of the memtable and its memory usage
-void printMemtable();
+void printMemtable(Memtable *table);
 // Prints the current memory usage of the memtable
-void printMemoryUsage();
+void printMemoryUsage(Memtable *table);
 
 #endif // MEMTABLE_H
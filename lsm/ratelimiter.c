@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ratelimiter.h"
+
+/*
+ * static uint64_t nowNanos()
+ *   Reads the monotonic clock.
+ * @return: The time in nanoseconds
+ */
+static uint64_t nowNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+ * static void refill(RateLimiter *limiter)
+ *   Adds the tokens earned since the last refill, up to the burst size.
+ *   Must be called with the limiter mutex held.
+ */
+static void refill(RateLimiter *limiter) {
+  uint64_t now = nowNanos();
+  double burst = (double)limiter->bytesPerSecond / RATE_LIMITER_BURST_DIVISOR;
+  limiter->tokens +=
+      (double)(now - limiter->lastRefill) * limiter->bytesPerSecond / 1e9;
+  if (limiter->tokens > burst) {
+    limiter->tokens = burst;
+  }
+  limiter->lastRefill = now;
+}
+
+/*
+ * RateLimiter *createRateLimiter(int64_t bytesPerSecond)
+ *   Public function to create a token bucket, starting full.
+ * @param bytesPerSecond: The refill rate, 0 for no limit
+ * @return: The new rate limiter
+ */
+RateLimiter *createRateLimiter(int64_t bytesPerSecond) {
+  RateLimiter *limiter = calloc(1, sizeof(RateLimiter));
+  if (limiter == NULL) {
+    perror("Failed to allocate memory for rate limiter");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutex_init(&limiter->mutex, NULL);
+  limiter->bytesPerSecond = bytesPerSecond > 0 ? bytesPerSecond : 0;
+  limiter->tokens =
+      (double)limiter->bytesPerSecond / RATE_LIMITER_BURST_DIVISOR;
+  limiter->lastRefill = nowNanos();
+  return limiter;
+}
+
+/*
+ * void freeRateLimiter(RateLimiter *limiter)
+ *   Public function to free a rate limiter.
+ * @param limiter: The rate limiter to free, no thread may be waiting on it
+ */
+void freeRateLimiter(RateLimiter *limiter) {
+  pthread_mutex_destroy(&limiter->mutex);
+  free(limiter);
+}
+
+/*
+ * void setRateLimit(RateLimiter *limiter, int64_t bytesPerSecond)
+ *   Public function to change the refill rate. Tokens already earned are
+ *   kept, a debt is forgiven so waiters are not held to the old rate.
+ * @param limiter: The rate limiter
+ * @param bytesPerSecond: The new rate, 0 for no limit
+ */
+void setRateLimit(RateLimiter *limiter, int64_t bytesPerSecond) {
+  pthread_mutex_lock(&limiter->mutex);
+  refill(limiter);
+  limiter->bytesPerSecond = bytesPerSecond > 0 ? bytesPerSecond : 0;
+  if (limiter->tokens < 0) {
+    limiter->tokens = 0;
+  }
+  pthread_mutex_unlock(&limiter->mutex);
+}
+
+/*
+ * void requestBytes(RateLimiter *limiter, int64_t bytes)
+ *   Public function to pay for bytes about to be written. If the bucket
+ *   holds too few tokens the request takes them on credit and sleeps until
+ *   the refill covers its share, without holding the mutex, so concurrent
+ *   requests each wait behind the debt left before them.
+ * @param limiter: The rate limiter, or NULL for no limit
+ * @param bytes: The number of bytes
+ */
+void requestBytes(RateLimiter *limiter, int64_t bytes) {
+  if (limiter == NULL || bytes <= 0) {
+    return;
+  }
+  pthread_mutex_lock(&limiter->mutex);
+  if (limiter->bytesPerSecond == 0) {
+    pthread_mutex_unlock(&limiter->mutex);
+    return;
+  }
+  refill(limiter);
+  limiter->tokens -= bytes;
+  double debt = -limiter->tokens;
+  int64_t rate = limiter->bytesPerSecond;
+  if (debt > 0) {
+    limiter->throttled++;
+  }
+  pthread_mutex_unlock(&limiter->mutex);
+
+  if (debt > 0) {
+    uint64_t wait = (uint64_t)(debt * 1e9 / rate);
+    struct timespec duration = {wait / 1000000000ULL, wait % 1000000000ULL};
+    nanosleep(&duration, NULL);
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+// Rate limiter macros
+// Share of a second of tokens that can be spent at once after an idle period
+#define RATE_LIMITER_BURST_DIVISOR 10 // 100ms
+
+// A token bucket shared by the threads it slows down
+// Tokens are bytes, refilled at bytesPerSecond up to a small burst. A
+// request larger than what is left borrows the difference and sleeps until
+// the refill has paid it back, so later requests queue behind it.
+typedef struct {
+  pthread_mutex_t mutex;
+  int64_t bytesPerSecond; // 0 for no limit
+  double tokens;          // Negative while requests are paying back a debt
+  uint64_t lastRefill;    // Monotonic clock in nanoseconds
+  long throttled;         // Requests that had to wait
+} RateLimiter;
+
+// Function declarations
+// Creates a rate limiter, 0 bytes per second lets everything through
+RateLimiter *createRateLimiter(int64_t bytesPerSecond);
+// Frees a rate limiter no thread is waiting on
+void freeRateLimiter(RateLimiter *limiter);
+// Changes the rate of a limiter
+void setRateLimit(RateLimiter *limiter, int64_t bytesPerSecond);
+// Takes bytes from the bucket, sleeping first if it is empty
+void requestBytes(RateLimiter *limiter, int64_t bytes);
+
+#endif // RATELIMITER_H
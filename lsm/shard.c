@@ -0,0 +1,736 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+
+#include "batch.h"
+#include "cache.h"
+#include "compaction.h"
+#include "iterator.h"
+#include "lsm.h"
+#include "shard.h"
+#include "tablecache.h"
+#include "version.h"
+
+struct ShardedDB {
+  DB **shards;
+  int count;
+};
+
+/*
+ * static uint32_t hashShardKey(const char *key)
+ *   FNV-1a hash of a key. Kept apart from bloomHash, so the keys of one
+ *   shard still spread over every bit of its filters. Keys are found in
+ *   the shard they were written to, so changing it moves every key.
+ * @param key: The key, terminated
+ * @return: The 32-bit hash
+ */
+static uint32_t hashShardKey(const char *key) {
+  uint32_t hash = 2166136261u;
+  for (; *key != '\0'; key++) {
+    hash ^= (unsigned char)*key;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/*
+ * static int shardIndex(const ShardedDB *db, const char *key)
+ *   Picks the shard of a key.
+ * @return: The index of the shard
+ */
+static int shardIndex(const ShardedDB *db, const char *key) {
+  return db->count == 1 ? 0 : (int)(hashShardKey(key) % db->count);
+}
+
+/*
+ * static const Snapshot *shardSnapshot(const Snapshot *snapshot, int shard)
+ *   Finds the part of a snapshot that belongs to one shard. A database of a
+ *   single shard hands out the snapshots of that shard as they are.
+ * @return: The snapshot of the shard, or NULL for the newest data
+ */
+static const Snapshot *shardSnapshot(const Snapshot *snapshot, int shard) {
+  if (snapshot == NULL || snapshot->shards == NULL) {
+    return snapshot;
+  }
+  return snapshot->shards[shard];
+}
+
+/*
+ * static int checkShardCount(const char *directory, int count)
+ *   Makes sure a directory holds a database of count shards, or nothing
+ *   yet, since a key is only found in its shard with the count it was
+ *   written with. A directory without SHARD_COUNT_FILE holds a single
+ *   database once it has a manifest. The count of a new sharded database
+ *   is recorded, a single one is left like an unsharded database.
+ * @return: 1 if the database may be opened with count shards, 0 otherwise
+ */
+static int checkShardCount(const char *directory, int count) {
+  char path[MAX_PATH_LENGTH];
+  int recorded = 0;
+  snprintf(path, sizeof(path), "%s/" SHARD_COUNT_FILE, directory);
+  FILE *file = fopen(path, "r");
+  if (file != NULL) {
+    int ok = fscanf(file, "%d", &recorded) == 1 && recorded > 0;
+    fclose(file);
+    if (!ok) {
+      fprintf(stderr, "Corrupt shard count file: %s\n", path);
+      return 0;
+    }
+  } else {
+    char manifestPath[MAX_PATH_LENGTH];
+    struct stat st;
+    snprintf(manifestPath, sizeof(manifestPath), "%s/" MANIFEST_FILE,
+             directory);
+    recorded = stat(manifestPath, &st) == 0;
+  }
+
+  if (recorded == 0 && count > 1) {
+    file = fopen(path, "w");
+    if (file == NULL) {
+      perror("Failed to create shard count file");
+      return 0;
+    }
+    int ok = fprintf(file, "%d\n", count) > 0;
+    if (fclose(file) != 0 || !ok) {
+      perror("Failed to write shard count file");
+      return 0;
+    }
+  } else if (recorded != 0 && recorded != count) {
+    fprintf(stderr, "%s holds a database of %d shards, not %d\n", directory,
+            recorded, count);
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * ShardedDB *openShardedDB(const char *directory, int count, int pinThreads)
+ *   Public function to open a database split into shards. Each shard is
+ *   opened with openDB in a directory of its own, or in the directory itself
+ *   for a single shard, and gets an even part of the block cache, open file
+ *   and compaction write budgets. Pinned, the threads of shard i run on CPU
+ *   i modulo the CPU count.
+ * @param directory: The directory holding the database
+ * @param count: The number of shards, from 1 to MAX_SHARDS
+ * @param pinThreads: 1 to pin the threads of every shard to a CPU
+ * @return: The database, or NULL if it could not be opened
+ */
+ShardedDB *openShardedDB(const char *directory, int count, int pinThreads) {
+  if (count < 1 || count > MAX_SHARDS) {
+    fprintf(stderr, "Shard count must be between 1 and %d\n", MAX_SHARDS);
+    return NULL;
+  }
+  if (strlen(directory) > MAX_DIRECTORY_LENGTH) {
+    fprintf(stderr, "Database directory path is too long: %s\n", directory);
+    return NULL;
+  }
+  struct stat st = {0};
+  if (stat(directory, &st) == -1) {
+    mkdir(directory, 0700);
+  }
+  if (!checkShardCount(directory, count)) {
+    return NULL;
+  }
+
+  ShardedDB *db = malloc(sizeof(ShardedDB));
+  if (db != NULL) {
+    db->shards = calloc(count, sizeof(DB *));
+  }
+  if (db == NULL || db->shards == NULL) {
+    perror("Failed to allocate memory for sharded database");
+    exit(EXIT_FAILURE);
+  }
+  db->count = 0;
+  int cpus = get_nprocs();
+  for (int i = 0; i < count; i++) {
+    char path[MAX_PATH_LENGTH];
+    if (count == 1) {
+      snprintf(path, sizeof(path), "%s", directory);
+    } else {
+      snprintf(path, sizeof(path), SHARD_DIRECTORY_FORMAT, directory, i);
+    }
+    DB *shard = openDB(path);
+    if (shard == NULL) {
+      closeShardedDB(db);
+      return NULL;
+    }
+    db->shards[db->count++] = shard;
+    if (count > 1) {
+      dbSetBlockCacheSize(shard, (BLOCK_CACHE_CAPACITY) / count);
+      dbSetMaxOpenFiles(shard, MAX_OPEN_FILES / count > 0
+                                   ? MAX_OPEN_FILES / count
+                                   : 1);
+      dbSetCompactionRateLimit(shard, COMPACTION_RATE_LIMIT / count);
+    }
+    if (pinThreads && !dbSetThreadAffinity(shard, i % cpus)) {
+      fprintf(stderr, "Failed to pin the threads of shard %d\n", i);
+    }
+  }
+  return db;
+}
+
+/*
+ * void closeShardedDB(ShardedDB *db)
+ *   Public function to close every shard of a database, see closeDB.
+ * @param db: The database, not used afterwards
+ */
+void closeShardedDB(ShardedDB *db) {
+  for (int i = 0; i < db->count; i++) {
+    closeDB(db->shards[i]);
+  }
+  free(db->shards);
+  free(db);
+}
+
+/*
+ * int shardCount(const ShardedDB *db)
+ *   Public function to get the number of shards of a database.
+ * @return: The number of shards
+ */
+int shardCount(const ShardedDB *db) { return db->count; }
+
+/*
+ * DB *shardForKey(const ShardedDB *db, const char *key)
+ *   Public function to get the shard a key is written to and read from.
+ * @param key: The key
+ * @return: The shard
+ */
+DB *shardForKey(const ShardedDB *db, const char *key) {
+  return db->shards[shardIndex(db, key)];
+}
+
+/*
+ * void shardedWriteMemtableToSSTable(ShardedDB *db)
+ *   Public function to flush the active memtable of every shard.
+ */
+void shardedWriteMemtableToSSTable(ShardedDB *db) {
+  for (int i = 0; i < db->count; i++) {
+    dbWriteMemtableToSSTable(db->shards[i]);
+  }
+}
+
+/*
+ * int shardedWrite(ShardedDB *db, char *key, char *value)
+ *   Public function to write a key-value pair to the shard of the key.
+ * @param key: The key to write
+ * @param value: The value to write
+ * @return: 1 once the write is committed, 0 otherwise, see dbWrite
+ */
+int shardedWrite(ShardedDB *db, char *key, char *value) {
+  return dbWrite(shardForKey(db, key), key, value);
+}
+
+/*
+ * char *shardedRead(ShardedDB *db, char *key)
+ *   Public function to read the newest value of a key from its shard.
+ * @param key: The key to read
+ * @return: A malloc'd copy of the value, or NULL if not found
+ */
+char *shardedRead(ShardedDB *db, char *key) {
+  return dbRead(shardForKey(db, key), key);
+}
+
+/*
+ * char *shardedReadAt(ShardedDB *db, char *key, const Snapshot *snapshot)
+ *   Public function to read a key from its shard as of a snapshot.
+ * @param key: The key to read
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @return: A malloc'd copy of the value, or NULL if not found
+ */
+char *shardedReadAt(ShardedDB *db, char *key, const Snapshot *snapshot) {
+  int shard = shardIndex(db, key);
+  return dbReadAt(db->shards[shard], key, shardSnapshot(snapshot, shard));
+}
+
+/*
+ * int shardedMultiGet(ShardedDB *db, char **keys, int count, char **values)
+ *   Public function to read the newest values of many keys at once. See
+ *   shardedMultiGetAt.
+ * @return: The number of keys found
+ */
+int shardedMultiGet(ShardedDB *db, char **keys, int count, char **values) {
+  return shardedMultiGetAt(db, keys, count, NULL, values);
+}
+
+/*
+ * int shardedMultiGetAt(ShardedDB *db, char **keys, int count,
+ *                       const Snapshot *snapshot, char **values)
+ *   Public function to read many keys at once as of a snapshot. The keys
+ *   are grouped by shard with a counting sort, then every shard holding
+ *   some of them answers all of its keys with one dbMultiGetAt.
+ * @param keys: The keys to read
+ * @param count: The number of keys
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @param values: Set to a malloc'd copy of the value of each key, or NULL
+ * @return: The number of keys found
+ */
+int shardedMultiGetAt(ShardedDB *db, char **keys, int count,
+                      const Snapshot *snapshot, char **values) {
+  if (db->count == 1) {
+    return dbMultiGetAt(db->shards[0], keys, count,
+                        shardSnapshot(snapshot, 0), values);
+  }
+  if (count <= 0) {
+    return 0;
+  }
+  int *shards = malloc(count * sizeof(int));  // Shard of every key
+  int *order = malloc(count * sizeof(int));   // Keys grouped by shard
+  char **shardKeys = malloc(count * sizeof(char *));
+  char **shardValues = malloc(count * sizeof(char *));
+  if (shards == NULL || order == NULL || shardKeys == NULL ||
+      shardValues == NULL) {
+    perror("Failed to allocate memory for sharded multiGet");
+    exit(EXIT_FAILURE);
+  }
+  int starts[MAX_SHARDS + 1] = {0};
+  for (int i = 0; i < count; i++) {
+    shards[i] = shardIndex(db, keys[i]);
+    starts[shards[i] + 1]++;
+  }
+  for (int s = 0; s < db->count; s++) {
+    starts[s + 1] += starts[s];
+  }
+  int next[MAX_SHARDS];
+  memcpy(next, starts, sizeof(next));
+  for (int i = 0; i < count; i++) {
+    order[next[shards[i]]++] = i;
+  }
+  for (int i = 0; i < count; i++) {
+    shardKeys[i] = keys[order[i]];
+  }
+
+  int found = 0;
+  for (int s = 0; s < db->count; s++) {
+    int keyCount = starts[s + 1] - starts[s];
+    if (keyCount > 0) {
+      found += dbMultiGetAt(db->shards[s], shardKeys + starts[s], keyCount,
+                            shardSnapshot(snapshot, s),
+                            shardValues + starts[s]);
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    values[order[i]] = shardValues[i];
+  }
+  free(shards);
+  free(order);
+  free(shardKeys);
+  free(shardValues);
+  return found;
+}
+
+/*
+ * int shardedReadPinned(ShardedDB *db, char *key, PinnedValue *pinned)
+ *   Public function to read the newest value of a key from its shard
+ *   without copying it.
+ * @param key: The key to read
+ * @param pinned: Set to the value when found, must be released either way
+ * @return: 1 if the key was found, 0 otherwise
+ */
+int shardedReadPinned(ShardedDB *db, char *key, PinnedValue *pinned) {
+  return dbReadPinned(shardForKey(db, key), key, pinned);
+}
+
+/*
+ * int shardedReadPinnedAt(ShardedDB *db, char *key, const Snapshot *snapshot,
+ *                         PinnedValue *pinned)
+ *   Public function to read a key from its shard as of a snapshot without
+ *   copying its value.
+ * @param key: The key to read
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @param pinned: Set to the value when found, must be released either way
+ * @return: 1 if the key was found, 0 otherwise
+ */
+int shardedReadPinnedAt(ShardedDB *db, char *key, const Snapshot *snapshot,
+                        PinnedValue *pinned) {
+  int shard = shardIndex(db, key);
+  return dbReadPinnedAt(db->shards[shard], key,
+                        shardSnapshot(snapshot, shard), pinned);
+}
+
+/*
+ * int shardedDelete(ShardedDB *db, char *key)
+ *   Public function to delete a key from its shard.
+ * @param key: The key to delete
+ * @return: 1 once the deletion is committed, 0 otherwise, see dbDelete
+ */
+int shardedDelete(ShardedDB *db, char *key) {
+  return dbDelete(shardForKey(db, key), key);
+}
+
+/*
+ * int shardedApplyWriteBatch(ShardedDB *db, WriteBatch *batch)
+ *   Public function to apply every write and deletion of a batch. The
+ *   entries are copied into a batch per shard, in their order, and each of
+ *   those is applied atomically. Readers may see the part of one shard
+ *   before the part of another.
+ * @param batch: The batch to apply, left unchanged
+ * @return: 1 once every part is committed, 0 if the part of some shard
+ *   could not be logged, in which case the parts of other shards may still
+ *   be applied
+ */
+int shardedApplyWriteBatch(ShardedDB *db, WriteBatch *batch) {
+  if (db->count == 1) {
+    return dbApplyWriteBatch(db->shards[0], batch);
+  }
+  if (batch == NULL || batch->count == 0) {
+    return 1;
+  }
+  WriteBatch *batches[MAX_SHARDS] = {NULL};
+  char key[MAX_KEY_LENGTH + 1];
+  char value[MAX_VALUE_LENGTH + 1];
+  const char *ptr = batch->data;
+  const char *limit = batch->data + batch->size;
+  BatchEntry entry;
+  // Batches only take keys and values that fit the buffers
+  while (ptr < limit && decodeBatchEntry(&ptr, limit, &entry)) {
+    memcpy(key, entry.key, entry.keyLength);
+    key[entry.keyLength] = '\0';
+    int shard = shardIndex(db, key);
+    if (batches[shard] == NULL) {
+      batches[shard] = createWriteBatch();
+    }
+    if (entry.value != NULL) {
+      memcpy(value, entry.value, entry.valueLength);
+      value[entry.valueLength] = '\0';
+      addToWriteBatch(batches[shard], key, value);
+    } else {
+      addToWriteBatch(batches[shard], key, NULL);
+    }
+  }
+  int ok = 1;
+  for (int s = 0; s < db->count; s++) {
+    if (batches[s] != NULL) {
+      ok = dbApplyWriteBatch(db->shards[s], batches[s]) && ok;
+      freeWriteBatch(batches[s]);
+    }
+  }
+  return ok;
+}
+
+/*
+ * Iterator *shardedCreateIterator(ShardedDB *db, const Snapshot *snapshot)
+ *   Public function to create an iterator over the keys of every shard as
+ *   of a snapshot. See shardedCreatePrefixIterator.
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @return: The iterator, freed with freeIterator
+ */
+Iterator *shardedCreateIterator(ShardedDB *db, const Snapshot *snapshot) {
+  return shardedCreatePrefixIterator(db, NULL, snapshot);
+}
+
+/*
+ * Iterator *shardedCreatePrefixIterator(ShardedDB *db, const char *prefix,
+ *                                       const Snapshot *snapshot)
+ *   Public function to create an iterator over the keys starting with a
+ *   prefix in every shard. Every shard gets an iterator of its own, and
+ *   createShardIterator merges them back into key order.
+ * @param prefix: The prefix of the keys, or NULL for every key
+ * @param snapshot: The snapshot to read at, or NULL for the newest data
+ * @return: The iterator, freed with freeIterator
+ */
+Iterator *shardedCreatePrefixIterator(ShardedDB *db, const char *prefix,
+                                      const Snapshot *snapshot) {
+  if (db->count == 1) {
+    return dbCreatePrefixIterator(db->shards[0], prefix, snapshot);
+  }
+  Iterator *shards[MAX_SHARDS];
+  for (int i = 0; i < db->count; i++) {
+    shards[i] = dbCreatePrefixIterator(db->shards[i], prefix,
+                                       shardSnapshot(snapshot, i));
+  }
+  return createShardIterator(shards, db->count);
+}
+
+/*
+ * const Snapshot *shardedGetSnapshot(ShardedDB *db)
+ *   Public function to take a snapshot of every shard, one after the other.
+ *   Its sequence is the sum of theirs, like shardedGetLastSequence.
+ * @return: The snapshot, released with shardedReleaseSnapshot
+ */
+const Snapshot *shardedGetSnapshot(ShardedDB *db) {
+  if (db->count == 1) {
+    return dbGetSnapshot(db->shards[0]);
+  }
+  Snapshot *snapshot = calloc(1, sizeof(Snapshot));
+  const Snapshot **shards = malloc(db->count * sizeof(Snapshot *));
+  if (snapshot == NULL || shards == NULL) {
+    perror("Failed to allocate memory for snapshot");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < db->count; i++) {
+    shards[i] = dbGetSnapshot(db->shards[i]);
+    snapshot->sequence += shards[i]->sequence;
+  }
+  snapshot->shards = shards;
+  return snapshot;
+}
+
+/*
+ * void shardedReleaseSnapshot(ShardedDB *db, const Snapshot *snapshot)
+ *   Public function to release the snapshot of every shard.
+ * @param snapshot: The snapshot to release, not used afterwards
+ */
+void shardedReleaseSnapshot(ShardedDB *db, const Snapshot *snapshot) {
+  if (snapshot->shards == NULL) {
+    dbReleaseSnapshot(db->shards[0], snapshot);
+    return;
+  }
+  for (int i = 0; i < db->count; i++) {
+    dbReleaseSnapshot(db->shards[i], snapshot->shards[i]);
+  }
+  free(snapshot->shards);
+  free((Snapshot *)snapshot);
+}
+
+/*
+ * uint64_t shardedGetLastSequence(ShardedDB *db)
+ *   Public function to count the writes committed to every shard. Each
+ *   shard numbers its own writes, so the sum grows by one per write.
+ * @return: The sum of the last sequence numbers of the shards
+ */
+uint64_t shardedGetLastSequence(ShardedDB *db) {
+  uint64_t sequence = 0;
+  for (int i = 0; i < db->count; i++) {
+    sequence += dbGetLastSequence(db->shards[i]);
+  }
+  return sequence;
+}
+
+/*
+ * void shardedCompactSSTables(ShardedDB *db)
+ *   Public function to compact the SSTables of every shard now.
+ */
+void shardedCompactSSTables(ShardedDB *db) {
+  for (int i = 0; i < db->count; i++) {
+    dbCompactSSTables(db->shards[i]);
+  }
+}
+
+/*
+ * void shardedClearSSTables(ShardedDB *db)
+ *   Public function to clear the SSTables of every shard.
+ */
+void shardedClearSSTables(ShardedDB *db) {
+  for (int i = 0; i < db->count; i++) {
+    dbClearSSTables(db->shards[i]);
+  }
+}
+
+/*
+ * void shardedSetBloomBitsPerKey(ShardedDB *db, int bitsPerKey)
+ *   Public function to set the Bloom filter size of new SSTables.
+ * @param bitsPerKey: Filter bits per key, 0 disables filters
+ */
+void shardedSetBloomBitsPerKey(ShardedDB *db, int bitsPerKey) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetBloomBitsPerKey(db->shards[i], bitsPerKey);
+  }
+}
+
+/*
+ * void shardedSetPrefixLength(ShardedDB *db, int length)
+ *   Public function to set the prefix extractor of new SSTables.
+ * @param length: Prefix length in bytes, 0 disables prefix filters
+ */
+void shardedSetPrefixLength(ShardedDB *db, int length) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetPrefixLength(db->shards[i], length);
+  }
+}
+
+/*
+ * void shardedSetBlockCacheSize(ShardedDB *db, size_t bytes)
+ *   Public function to change the byte budget of the block caches.
+ * @param bytes: The bytes of data blocks kept by all shards together
+ */
+void shardedSetBlockCacheSize(ShardedDB *db, size_t bytes) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetBlockCacheSize(db->shards[i], bytes / db->count);
+  }
+}
+
+/*
+ * void shardedSetMaxOpenFiles(ShardedDB *db, int maxOpenFiles)
+ *   Public function to change how many SSTables the table caches keep open.
+ * @param maxOpenFiles: The open SSTables of all shards together, at least
+ *    one per shard
+ */
+void shardedSetMaxOpenFiles(ShardedDB *db, int maxOpenFiles) {
+  int perShard = maxOpenFiles / db->count > 0 ? maxOpenFiles / db->count : 1;
+  for (int i = 0; i < db->count; i++) {
+    dbSetMaxOpenFiles(db->shards[i], perShard);
+  }
+}
+
+/*
+ * void shardedSetLevelSizeTargets(ShardedDB *db, size_t level1MaxBytes,
+ *                                 int sizeRatio)
+ *   Public function to change the byte budgets of the levels of every
+ *   shard.
+ * @param level1MaxBytes: The byte budget of level 1 of each shard
+ * @param sizeRatio: How many times larger each level is than the last
+ */
+void shardedSetLevelSizeTargets(ShardedDB *db, size_t level1MaxBytes,
+                                int sizeRatio) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetLevelSizeTargets(db->shards[i], level1MaxBytes, sizeRatio);
+  }
+}
+
+/*
+ * void shardedSetCompactionStyle(ShardedDB *db, int style)
+ *   Public function to choose how the SSTables of every shard are compacted.
+ * @param style: COMPACTION_LEVELED or COMPACTION_TIERED
+ */
+void shardedSetCompactionStyle(ShardedDB *db, int style) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetCompactionStyle(db->shards[i], style);
+  }
+}
+
+/*
+ * void shardedSetTieredOptions(ShardedDB *db, int runTrigger, int sizeRatio)
+ *   Public function to change when the tiered style merges runs.
+ * @param runTrigger: The number of sorted runs that needs a merge
+ * @param sizeRatio: The percent a run may outgrow the newer runs it is
+ *    merged with
+ */
+void shardedSetTieredOptions(ShardedDB *db, int runTrigger, int sizeRatio) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetTieredOptions(db->shards[i], runTrigger, sizeRatio);
+  }
+}
+
+/*
+ * void shardedSetCompactionRateLimit(ShardedDB *db, int64_t bytesPerSecond)
+ *   Public function to change how fast compactions may write.
+ * @param bytesPerSecond: The write rate of all shards together, 0 for no
+ *    limit
+ */
+void shardedSetCompactionRateLimit(ShardedDB *db, int64_t bytesPerSecond) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetCompactionRateLimit(db->shards[i], bytesPerSecond / db->count);
+  }
+}
+
+/*
+ * void shardedSetMaxSubcompactions(ShardedDB *db, int count)
+ *   Public function to change how many key ranges a large compaction may be
+ *   split into.
+ * @param count: The most key ranges per compaction, 1 merges on one thread
+ */
+void shardedSetMaxSubcompactions(ShardedDB *db, int count) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetMaxSubcompactions(db->shards[i], count);
+  }
+}
+
+/*
+ * void shardedSetLogSyncMode(ShardedDB *db, int mode, int intervalMs)
+ *   Public function to choose when the logs of every shard are synced.
+ * @param mode: WAL_SYNC_ALWAYS, WAL_SYNC_INTERVAL or WAL_SYNC_NEVER
+ * @param intervalMs: The time between syncs in WAL_SYNC_INTERVAL mode
+ */
+void shardedSetLogSyncMode(ShardedDB *db, int mode, int intervalMs) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetLogSyncMode(db->shards[i], mode, intervalMs);
+  }
+}
+
+/*
+ * void shardedSetMmapReads(ShardedDB *db, int enabled)
+ *   Public function to choose how the SSTables of every shard are read.
+ * @param enabled: 1 to map SSTables, 0 to read them
+ */
+void shardedSetMmapReads(ShardedDB *db, int enabled) {
+  for (int i = 0; i < db->count; i++) {
+    dbSetMmapReads(db->shards[i], enabled);
+  }
+}
+
+/*
+ * void shardedGetLogStats(ShardedDB *db, long *records, long *commits,
+ *                         long *syncs)
+ *   Public function to read the write-ahead log counters of every shard.
+ * @param records: Set to the records logged
+ * @param commits: Set to the appends, one per group of writers
+ * @param syncs: Set to the times a log was forced to disk
+ */
+void shardedGetLogStats(ShardedDB *db, long *records, long *commits,
+                        long *syncs) {
+  *records = *commits = *syncs = 0;
+  for (int i = 0; i < db->count; i++) {
+    long shardRecords, shardCommits, shardSyncs;
+    dbGetLogStats(db->shards[i], &shardRecords, &shardCommits, &shardSyncs);
+    *records += shardRecords;
+    *commits += shardCommits;
+    *syncs += shardSyncs;
+  }
+}
+
+/*
+ * void shardedGetWriteStats(ShardedDB *db, uint64_t *flushed,
+ *                           uint64_t *compacted)
+ *   Public function to read the SSTable bytes written by every shard.
+ * @param flushed: Set to the bytes written by flushes
+ * @param compacted: Set to the bytes written by compactions
+ */
+void shardedGetWriteStats(ShardedDB *db, uint64_t *flushed,
+                          uint64_t *compacted) {
+  *flushed = *compacted = 0;
+  for (int i = 0; i < db->count; i++) {
+    uint64_t shardFlushed, shardCompacted;
+    dbGetWriteStats(db->shards[i], &shardFlushed, &shardCompacted);
+    *flushed += shardFlushed;
+    *compacted += shardCompacted;
+  }
+}
+
+/*
+ * int shardedGetLevelFileCount(ShardedDB *db, int level)
+ *   Public function to count the SSTables of a level in every shard.
+ * @param level: The level
+ * @return: The number of SSTables
+ */
+int shardedGetLevelFileCount(ShardedDB *db, int level) {
+  int count = 0;
+  for (int i = 0; i < db->count; i++) {
+    count += dbGetLevelFileCount(db->shards[i], level);
+  }
+  return count;
+}
+
+/*
+ * void shardedPrintStats(ShardedDB *db)
+ *   Public function to print the stats of every shard, see dbPrintStats.
+ */
+void shardedPrintStats(ShardedDB *db) {
+  for (int i = 0; i < db->count; i++) {
+    if (db->count > 1) {
+      printf("Shard %d of %d:\n", i, db->count);
+    }
+    dbPrintStats(db->shards[i]);
+  }
+}
+
+/*
+ * void shardedClearMemtable(ShardedDB *db)
+ *   Public function to discard the active memtable of every shard.
+ */
+void shardedClearMemtable(ShardedDB *db) {
+  for (int i = 0; i < db->count; i++) {
+    dbClearMemtable(db->shards[i]);
+  }
+}
+
+/*
+ * Memtable *shardedGetActiveMemtable(ShardedDB *db)
+ *   Public function to get the memtable taking writes in the first shard,
+ *   the only one of an unsharded database.
+ * @return: The active memtable of the first shard
+ */
+Memtable *shardedGetActiveMemtable(ShardedDB *db) {
+  return dbGetActiveMemtable(db->shards[0]);
+}
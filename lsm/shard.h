@@ -0,0 +1,105 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "lsm.h"
+
+// Shard macros
+#define MAX_SHARDS 64
+// Directory of a shard within the directory of a sharded database
+#define SHARD_DIRECTORY_FORMAT "%s/shard_%d"
+// Records the shard count of a sharded database, keys only find their shard
+// again with the same count
+#define SHARD_COUNT_FILE "SHARDS"
+
+// A database split into shards by key hash
+// Every shard is a database of its own, with its memtables, write-ahead log,
+// SSTables and threads, so writers to different shards never wait on each
+// other. A single shard is the database in the directory itself, laid out
+// as an unsharded one.
+// Reads of one key go to its shard, reads of many keys and iterators visit
+// every shard. A batch is only atomic within each shard, and a snapshot is
+// taken shard by shard, so it holds every write committed before it began
+// but may hold writes to some shards committed while it was taken.
+typedef struct ShardedDB ShardedDB;
+
+// Function declarations
+// Opens a database split into count shards in a directory, creating it if
+// needed. pinThreads pins the threads of every shard to a CPU of its own.
+// Returns NULL if a shard cannot be opened or the directory holds a database
+// with another shard count
+ShardedDB *openShardedDB(const char *directory, int count, int pinThreads);
+// Closes every shard and frees the handle
+void closeShardedDB(ShardedDB *db);
+// Returns the number of shards
+int shardCount(const ShardedDB *db);
+// Returns the shard holding a key
+DB *shardForKey(const ShardedDB *db, const char *key);
+// Writes the active memtable of every shard to an SSTable and starts empty
+// ones
+void shardedWriteMemtableToSSTable(ShardedDB *db);
+// Writes an entry to the shard of its key, returns 1 once committed
+int shardedWrite(ShardedDB *db, char *key, char *value);
+// Reads a value from the shard of its key, the copy is owned by the caller
+char *shardedRead(ShardedDB *db, char *key);
+// Reads a value as of a snapshot, NULL reads the newest data
+char *shardedReadAt(ShardedDB *db, char *key, const Snapshot *snapshot);
+// Reads many keys at once, one multiGet per shard holding some of them
+int shardedMultiGet(ShardedDB *db, char **keys, int count, char **values);
+// Reads many keys at once as of a snapshot, NULL reads the newest data
+int shardedMultiGetAt(ShardedDB *db, char **keys, int count,
+                      const Snapshot *snapshot, char **values);
+// Reads a value without copying it, see dbReadPinned
+int shardedReadPinned(ShardedDB *db, char *key, PinnedValue *pinned);
+// Reads a value as of a snapshot without copying it, see dbReadPinned
+int shardedReadPinnedAt(ShardedDB *db, char *key, const Snapshot *snapshot,
+                        PinnedValue *pinned);
+// Deletes a key from its shard, returns 1 once committed
+int shardedDelete(ShardedDB *db, char *key);
+// Applies a batch, split into one batch per shard
+// Returns 1 once every part is committed, 0 if some part could not be
+int shardedApplyWriteBatch(ShardedDB *db, WriteBatch *batch);
+// Creates an iterator over the keys of every shard in order
+Iterator *shardedCreateIterator(ShardedDB *db, const Snapshot *snapshot);
+// Creates an iterator over the keys starting with prefix in every shard
+Iterator *shardedCreatePrefixIterator(ShardedDB *db, const char *prefix,
+                                      const Snapshot *snapshot);
+// Takes a snapshot of every shard
+const Snapshot *shardedGetSnapshot(ShardedDB *db);
+// Releases a snapshot taken by shardedGetSnapshot
+void shardedReleaseSnapshot(ShardedDB *db, const Snapshot *snapshot);
+// Returns the sum of the last sequence numbers of the shards, which grows by
+// one per write
+uint64_t shardedGetLastSequence(ShardedDB *db);
+// Runs compactions in every shard until none is needed
+void shardedCompactSSTables(ShardedDB *db);
+// Clears the SSTables of every shard
+void shardedClearSSTables(ShardedDB *db);
+// Settings of every shard, see their db counterparts
+// The byte budgets of the block caches, open files and compaction writes
+// are the totals of all shards, split evenly between them
+void shardedSetBloomBitsPerKey(ShardedDB *db, int bitsPerKey);
+void shardedSetPrefixLength(ShardedDB *db, int length);
+void shardedSetBlockCacheSize(ShardedDB *db, size_t bytes);
+void shardedSetMaxOpenFiles(ShardedDB *db, int maxOpenFiles);
+void shardedSetLevelSizeTargets(ShardedDB *db, size_t level1MaxBytes,
+                                int sizeRatio);
+void shardedSetCompactionStyle(ShardedDB *db, int style);
+void shardedSetTieredOptions(ShardedDB *db, int runTrigger, int sizeRatio);
+void shardedSetCompactionRateLimit(ShardedDB *db, int64_t bytesPerSecond);
+void shardedSetMaxSubcompactions(ShardedDB *db, int count);
+void shardedSetLogSyncMode(ShardedDB *db, int mode, int intervalMs);
+void shardedSetMmapReads(ShardedDB *db, int enabled);
+// Counters summed over every shard
+void shardedGetLogStats(ShardedDB *db, long *records, long *commits,
+                        long *syncs);
+void shardedGetWriteStats(ShardedDB *db, uint64_t *flushed,
+                          uint64_t *compacted);
+int shardedGetLevelFileCount(ShardedDB *db, int level);
+// Prints the stats of every shard
+void shardedPrintStats(ShardedDB *db);
+// Discards the active memtable of every shard
+void shardedClearMemtable(ShardedDB *db);
+// Returns the memtable taking writes in the first shard
+Memtable *shardedGetActiveMemtable(ShardedDB *db);
+
+#endif // SHARD_H
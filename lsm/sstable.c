@@ -0,0 +1,1245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "coding.h"
+#include "sstable.h"
+
+/*
+ * ######################
+ * SSTable writing
+ * ######################
+ */
+
+/*
+ * SSTableBuilder *createSSTableBuilder(const char *filepath, int bitsPerKey,
+ *                                      int prefixLength)
+ *   Creates the file for a new SSTable and prepares an empty data block.
+ * @param filepath: The path of the file to create
+ * @param bitsPerKey: Bloom filter bits per key, 0 to write no filter
+ * @param prefixLength: Length of the key prefixes put in the prefix filter,
+ *   0 to write no prefix filter. The prefix filter uses bitsPerKey bits per
+ *   prefix, or BLOOM_BITS_PER_KEY if key filters are off.
+ * @return: The builder, or NULL if the file could not be created
+ */
+SSTableBuilder *createSSTableBuilder(const char *filepath, int bitsPerKey,
+                                     int prefixLength) {
+  SSTableBuilder *builder = calloc(1, sizeof(SSTableBuilder));
+  if (builder == NULL) {
+    perror("Failed to allocate memory for SSTable builder");
+    return NULL;
+  }
+
+  builder->file = fopen(filepath, "wb");
+  if (builder->file == NULL) {
+    perror("Failed to open SSTable file for writing");
+    free(builder);
+    return NULL;
+  }
+
+  builder->blockCapacity = SSTABLE_BLOCK_SIZE + SSTABLE_MAX_ENTRY_SIZE;
+  builder->block = malloc(builder->blockCapacity);
+  builder->handleCapacity = 16; // Initial capacity
+  builder->handles = malloc(builder->handleCapacity * sizeof(BlockHandle));
+  builder->restartCapacity = 16; // Initial capacity
+  builder->restarts = malloc(builder->restartCapacity * sizeof(uint32_t));
+  builder->bitsPerKey = bitsPerKey;
+  builder->prefixLength = prefixLength > 0 ? prefixLength : 0;
+  if (builder->block == NULL || builder->handles == NULL ||
+      builder->restarts == NULL) {
+    perror("Failed to allocate memory for SSTable builder");
+    exit(EXIT_FAILURE);
+  }
+  return builder;
+}
+
+/*
+ * static int writeBytes(SSTableBuilder *builder, const char *data,
+ *                       size_t size)
+ *   Appends raw bytes to the file and advances the offset.
+ * @return: 1 on success, 0 on a write error
+ */
+static int writeBytes(SSTableBuilder *builder, const char *data, size_t size) {
+  if (size > 0 && fwrite(data, 1, size, builder->file) != size) {
+    perror("Failed to write SSTable file");
+    return 0;
+  }
+  builder->offset += size;
+  return 1;
+}
+
+/*
+ * static void reserveBlockSpace(SSTableBuilder *builder, size_t size)
+ *   Makes sure the current data block can take size more bytes. The initial
+ *   capacity already covers a full block plus one maximum sized entry, so
+ *   this only grows for oversized entries, large restart arrays and keys
+ *   with many entries, which a block keeps together.
+ */
+static void reserveBlockSpace(SSTableBuilder *builder, size_t size) {
+  if (builder->blockSize + size <= builder->blockCapacity) {
+    return;
+  }
+  builder->blockCapacity = (builder->blockSize + size) * 2;
+  char *temp = realloc(builder->block, builder->blockCapacity);
+  if (temp == NULL) {
+    perror("Failed to reallocate memory for SSTable block");
+    exit(EXIT_FAILURE);
+  }
+  builder->block = temp;
+}
+
+/*
+ * static void addRestart(SSTableBuilder *builder)
+ *   Marks the next entry of the block as a restart point.
+ *   If the array of restarts is full, double it.
+ */
+static void addRestart(SSTableBuilder *builder) {
+  if (builder->restartCount >= builder->restartCapacity) {
+    builder->restartCapacity *= 2;
+    uint32_t *temp = realloc(builder->restarts,
+                             builder->restartCapacity * sizeof(uint32_t));
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for SSTable restarts");
+      exit(EXIT_FAILURE);
+    }
+    builder->restarts = temp;
+  }
+  builder->restarts[builder->restartCount++] = builder->blockSize;
+  builder->entriesSinceRestart = 0;
+}
+
+/*
+ * static int flushBlock(SSTableBuilder *builder)
+ *   Appends the restart array to the current data block, writes the block to
+ *   the file and records its index entry.
+ *   If the array of index entries is full, double it.
+ * @return: 1 on success, 0 on a write error
+ */
+static int flushBlock(SSTableBuilder *builder) {
+  if (builder->blockSize == 0) {
+    return 1;
+  }
+
+  reserveBlockSpace(builder, (builder->restartCount + 1) * 4);
+  for (int i = 0; i < builder->restartCount; i++) {
+    encodeFixed32(builder->block + builder->blockSize, builder->restarts[i]);
+    builder->blockSize += 4;
+  }
+  encodeFixed32(builder->block + builder->blockSize, builder->restartCount);
+  builder->blockSize += 4;
+
+  if (builder->blockCount >= builder->handleCapacity) {
+    builder->handleCapacity *= 2;
+    BlockHandle *temp = realloc(builder->handles,
+                                builder->handleCapacity * sizeof(BlockHandle));
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for SSTable index");
+      exit(EXIT_FAILURE);
+    }
+    builder->handles = temp;
+  }
+
+  BlockHandle *handle = &builder->handles[builder->blockCount++];
+  handle->lastKey = strdup(builder->lastKey);
+  handle->offset = builder->offset;
+  handle->size = builder->blockSize;
+
+  int ok = writeBytes(builder, builder->block, builder->blockSize);
+  builder->blockSize = 0;
+  builder->restartCount = 0;
+  return ok;
+}
+
+/*
+ * static void addHash(uint32_t **hashes, long *count, long *capacity,
+ *                     const char *key, uint32_t keyLength)
+ *   Remembers the Bloom hash of a key or prefix for a filter written at the
+ *   end.
+ *   If the array is full, double it.
+ */
+static void addHash(uint32_t **hashes, long *count, long *capacity,
+                    const char *key, uint32_t keyLength) {
+  if (*count >= *capacity) {
+    *capacity = *capacity == 0 ? 1024 : *capacity * 2;
+    uint32_t *temp = realloc(*hashes, *capacity * sizeof(uint32_t));
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for Bloom filter keys");
+      exit(EXIT_FAILURE);
+    }
+    *hashes = temp;
+  }
+  (*hashes)[(*count)++] = bloomHash(key, keyLength);
+}
+
+/*
+ * int addToSSTable(SSTableBuilder *builder, const char *key,
+ *                  uint64_t sequence, const char *value)
+ *   Appends an entry to the current data block. Keys must be added in
+ *   increasing order, the entries of a key newest first. A block that
+ *   reached SSTABLE_BLOCK_SIZE is flushed before the first entry of the next
+ *   key, so the entries of a key stay in one block.
+ *   The key is stored as the bytes it does not share with the previous key,
+ *   except at restart points where it is stored in full.
+ * @param builder: The SSTable being written
+ * @param key: The key of the entry
+ * @param sequence: The sequence number of the entry
+ * @param value: The value of the entry, NULL for a deletion record
+ * @return: 1 on success, 0 on a write error
+ */
+int addToSSTable(SSTableBuilder *builder, const char *key, uint64_t sequence,
+                 const char *value) {
+  uint32_t keyLength = strlen(key);
+  uint32_t valueLength = value != NULL ? strlen(value) : 0;
+  int newKey = builder->entryCount == 0 || strcmp(key, builder->lastKey) != 0;
+
+  // The restart array is part of the block too
+  if (newKey && builder->blockSize + (builder->restartCount + 1) * 4 >=
+                    SSTABLE_BLOCK_SIZE) {
+    if (!flushBlock(builder)) {
+      return 0;
+    }
+  }
+
+  uint32_t shared = 0;
+  if (builder->blockSize == 0 ||
+      builder->entriesSinceRestart >= SSTABLE_RESTART_INTERVAL) {
+    addRestart(builder);
+  } else {
+    // Count the leading bytes shared with the previous key
+    while (shared < keyLength && builder->lastKey[shared] == key[shared]) {
+      shared++;
+    }
+  }
+  uint32_t unshared = keyLength - shared;
+
+  char header[24];
+  int headerLength = encodeVarint32(header, shared);
+  headerLength += encodeVarint32(header + headerLength, unshared);
+  headerLength += encodeVarint32(header + headerLength, valueLength);
+  header[headerLength++] =
+      value != NULL ? SSTABLE_TYPE_VALUE : SSTABLE_TYPE_DELETION;
+  encodeFixed64(header + headerLength, sequence);
+  headerLength += 8;
+
+  reserveBlockSpace(builder, headerLength + unshared + valueLength);
+  char *dst = builder->block + builder->blockSize;
+  memcpy(dst, header, headerLength);
+  memcpy(dst + headerLength, key + shared, unshared);
+  if (value != NULL) {
+    memcpy(dst + headerLength + unshared, value, valueLength);
+  }
+  builder->blockSize += headerLength + unshared + valueLength;
+  builder->entriesSinceRestart++;
+
+  if (builder->entryCount == 0) {
+    snprintf(builder->firstKey, sizeof(builder->firstKey), "%s", key);
+  }
+  if (newKey) {
+    // Keys come in order, so the keys sharing a prefix are next to each other
+    uint32_t prefixLength = builder->prefixLength;
+    if (prefixLength > 0 && keyLength >= prefixLength &&
+        (builder->entryCount == 0 ||
+         strncmp(key, builder->lastKey, prefixLength) != 0)) {
+      addHash(&builder->prefixHashes, &builder->prefixCount,
+              &builder->prefixCapacity, key, prefixLength);
+    }
+    snprintf(builder->lastKey, sizeof(builder->lastKey), "%s", key);
+    if (builder->bitsPerKey > 0) {
+      addHash(&builder->keyHashes, &builder->hashCount,
+              &builder->hashCapacity, key, keyLength);
+    }
+  }
+  if (sequence > builder->largestSequence) {
+    builder->largestSequence = sequence;
+  }
+  builder->entryCount++;
+  return 1;
+}
+
+/*
+ * static void freeHandles(BlockHandle *handles, int count)
+ *   Frees an array of index entries and their keys.
+ */
+static void freeHandles(BlockHandle *handles, int count) {
+  for (int i = 0; i < count; i++) {
+    free(handles[i].lastKey);
+  }
+  free(handles);
+}
+
+/*
+ * static int writeFilter(SSTableBuilder *builder, const uint32_t *hashes,
+ *                        long count, int bitsPerKey, size_t *size)
+ *   Builds a Bloom filter from hashes and writes it at the current offset.
+ * @param bitsPerKey: Bits of the filter per hash
+ * @param size: Set to the size of the filter
+ * @return: 1 on success, 0 on a write error
+ */
+static int writeFilter(SSTableBuilder *builder, const uint32_t *hashes,
+                       long count, int bitsPerKey, size_t *size) {
+  char *filter = createBloomFilter(hashes, count, bitsPerKey, size);
+  int ok = writeBytes(builder, filter, *size);
+  free(filter);
+  return ok;
+}
+
+/*
+ * static int writeMetaBlocks(SSTableBuilder *builder)
+ *   Writes the filter blocks and the index block followed by the fixed size
+ *   footer that locates them.
+ * @return: 1 on success, 0 on a write error
+ */
+static int writeMetaBlocks(SSTableBuilder *builder) {
+  // Filter blocks
+  uint64_t filterOffset = builder->offset;
+  size_t filterSize = 0;
+  if (builder->bitsPerKey > 0 &&
+      !writeFilter(builder, builder->keyHashes, builder->hashCount,
+                   builder->bitsPerKey, &filterSize)) {
+    return 0;
+  }
+  uint64_t prefixFilterOffset = builder->offset;
+  size_t prefixFilterSize = 0;
+  // Prefix filters do not depend on key filters being on
+  int prefixBitsPerKey =
+      builder->bitsPerKey > 0 ? builder->bitsPerKey : BLOOM_BITS_PER_KEY;
+  if (builder->prefixLength > 0 &&
+      !writeFilter(builder, builder->prefixHashes, builder->prefixCount,
+                   prefixBitsPerKey, &prefixFilterSize)) {
+    return 0;
+  }
+
+  // Index block
+  uint64_t indexOffset = builder->offset;
+  char buffer[MAX_KEY_LENGTH + 32];
+
+  for (int i = 0; i < builder->blockCount; i++) {
+    BlockHandle *handle = &builder->handles[i];
+    uint32_t keyLength = strlen(handle->lastKey);
+    int length = encodeVarint32(buffer, keyLength);
+    memcpy(buffer + length, handle->lastKey, keyLength);
+    length += keyLength;
+    encodeFixed64(buffer + length, handle->offset);
+    encodeFixed32(buffer + length + 8, handle->size);
+    if (!writeBytes(builder, buffer, length + 12)) {
+      return 0;
+    }
+  }
+
+  char footer[SSTABLE_FOOTER_SIZE];
+  encodeFixed64(footer, indexOffset);
+  encodeFixed32(footer + 8, (uint32_t)(builder->offset - indexOffset));
+  encodeFixed32(footer + 12, builder->blockCount);
+  encodeFixed64(footer + 16, filterOffset);
+  encodeFixed32(footer + 24, (uint32_t)filterSize);
+  encodeFixed64(footer + 28, prefixFilterOffset);
+  encodeFixed32(footer + 36, (uint32_t)prefixFilterSize);
+  encodeFixed32(footer + 40, builder->prefixLength);
+  encodeFixed64(footer + 44, SSTABLE_MAGIC);
+  return writeBytes(builder, footer, SSTABLE_FOOTER_SIZE);
+}
+
+/*
+ * int finishSSTable(SSTableBuilder *builder, SSTableInfo *info)
+ *   Flushes the last data block, writes the index block and footer, syncs
+ *   the file to disk, closes it and frees the builder. The caller still
+ *   has to sync the directory once the file is renamed into place.
+ * @param builder: The SSTable being written
+ * @param info: Filled with the size and key range of the table, or NULL
+ * @return: 1 on success, 0 if any write failed
+ */
+int finishSSTable(SSTableBuilder *builder, SSTableInfo *info) {
+  int ok = flushBlock(builder) && writeMetaBlocks(builder);
+  if (ok && (fflush(builder->file) != 0 || fsync(fileno(builder->file)) != 0)) {
+    perror("Failed to sync SSTable file");
+    ok = 0;
+  }
+  if (fclose(builder->file) != 0) {
+    perror("Failed to close SSTable file");
+    ok = 0;
+  }
+  if (info != NULL) {
+    info->fileSize = builder->offset;
+    info->entryCount = builder->entryCount;
+    info->largestSequence = builder->largestSequence;
+    snprintf(info->smallestKey, sizeof(info->smallestKey), "%s",
+             builder->entryCount > 0 ? builder->firstKey : "");
+    snprintf(info->largestKey, sizeof(info->largestKey), "%s",
+             builder->entryCount > 0 ? builder->lastKey : "");
+  }
+  freeHandles(builder->handles, builder->blockCount);
+  free(builder->restarts);
+  free(builder->keyHashes);
+  free(builder->prefixHashes);
+  free(builder->block);
+  free(builder);
+  return ok;
+}
+
+/*
+ * ######################
+ * SSTable reading
+ * ######################
+ */
+
+/*
+ * static const char *readRegion(SSTableReader *reader, uint64_t offset,
+ *                               uint32_t size, char **buffer)
+ *   Returns size bytes of the file at the given offset. A mapped file hands
+ *   out a pointer into the mapping, otherwise the bytes are read with pread,
+ *   which is safe for readers shared between threads, into a new buffer.
+ * @param buffer: Set to the malloc'd buffer the caller must free, or NULL
+ * @return: The bytes, or NULL if the region is outside the file or on a read
+ *   error
+ */
+static const char *readRegion(SSTableReader *reader, uint64_t offset,
+                              uint32_t size, char **buffer) {
+  *buffer = NULL;
+  if (offset > reader->fileSize || size > reader->fileSize - offset) {
+    return NULL;
+  }
+  if (reader->map != NULL) {
+    return reader->map + offset;
+  }
+  *buffer = malloc(size > 0 ? size : 1);
+  if (*buffer == NULL) {
+    perror("Failed to allocate memory for SSTable block");
+    return NULL;
+  }
+  if (pread(reader->fd, *buffer, size, (off_t)offset) != (ssize_t)size) {
+    free(*buffer);
+    *buffer = NULL;
+    return NULL;
+  }
+  return *buffer;
+}
+
+/*
+ * static int parseIndex(SSTableReader *reader, const char *index,
+ *                       uint32_t size)
+ *   Decodes the index block into the reader's block handles.
+ * @return: 1 on success, 0 if the index is corrupt
+ */
+static int parseIndex(SSTableReader *reader, const char *index, uint32_t size) {
+  const char *ptr = index;
+  const char *limit = index + size;
+  for (int i = 0; i < reader->blockCount; i++) {
+    uint32_t keyLength;
+    ptr = decodeVarint32(ptr, limit, &keyLength);
+    if (ptr == NULL || keyLength > (uint32_t)(limit - ptr) ||
+        limit - ptr - keyLength < 12) {
+      return 0;
+    }
+    BlockHandle *handle = &reader->handles[i];
+    handle->lastKey = strndup(ptr, keyLength);
+    ptr += keyLength;
+    handle->offset = decodeFixed64(ptr);
+    handle->size = decodeFixed32(ptr + 8);
+    ptr += 12;
+  }
+  return 1;
+}
+
+/*
+ * static uint64_t getFileId(const struct stat *st)
+ *   Derives an identity for the contents of an SSTable file. SSTables are
+ *   never modified in place, a rewrite renames a new file over the old one,
+ *   so the inode and modification time only match blocks of the same file.
+ * @return: The identity, used as the block cache key of the file
+ */
+static uint64_t getFileId(const struct stat *st) {
+  uint64_t id = (uint64_t)st->st_dev * 0x9E3779B97F4A7C15ULL;
+  id = (id ^ (uint64_t)st->st_ino) * 0xFF51AFD7ED558CCDULL;
+  id = (id ^ (uint64_t)st->st_mtim.tv_sec) * 0xC4CEB9FE1A85EC53ULL;
+  id = (id ^ (uint64_t)st->st_mtim.tv_nsec) * 0x9E3779B97F4A7C15ULL;
+  return id ^ (uint64_t)st->st_size;
+}
+
+/*
+ * static int parseRestarts(const char *block, uint32_t size,
+ *                          const char **restarts, uint32_t *restartCount)
+ *   Locates the restart array at the end of a data block.
+ * @param restarts: Set to the first encoded restart offset
+ * @param restartCount: Set to the number of restart points
+ * @return: 1 on success, 0 if the block is corrupt
+ */
+static int parseRestarts(const char *block, uint32_t size,
+                         const char **restarts, uint32_t *restartCount) {
+  if (size < 4) {
+    return 0;
+  }
+  *restartCount = decodeFixed32(block + size - 4);
+  if (*restartCount == 0 || *restartCount > (size - 4) / 4) {
+    return 0;
+  }
+  *restarts = block + size - 4 - *restartCount * 4;
+  return 1;
+}
+
+/*
+ * static const char *decodeEntry(const char *ptr, const char *limit,
+ *                                char *key, uint32_t *keyLength,
+ *                                uint64_t *sequence, uint8_t *type,
+ *                                const char **value, uint32_t *valueLength)
+ *   Decodes one data block entry. key holds the previous key of the block on
+ *   entry and the decoded key, terminated, on return.
+ * @param keyLength: Length of the previous key on entry, of the new one after
+ * @param sequence: Set to the sequence number of the entry
+ * @param type: Set to SSTABLE_TYPE_VALUE or SSTABLE_TYPE_DELETION
+ * @return: A pointer past the entry, or NULL if it is corrupt
+ */
+static const char *decodeEntry(const char *ptr, const char *limit, char *key,
+                               uint32_t *keyLength, uint64_t *sequence,
+                               uint8_t *type, const char **value,
+                               uint32_t *valueLength) {
+  uint32_t shared, unshared;
+  if ((ptr = decodeVarint32(ptr, limit, &shared)) == NULL ||
+      (ptr = decodeVarint32(ptr, limit, &unshared)) == NULL ||
+      (ptr = decodeVarint32(ptr, limit, valueLength)) == NULL ||
+      limit - ptr < 9) {
+    return NULL;
+  }
+  *type = (uint8_t)*ptr++;
+  *sequence = decodeFixed64(ptr);
+  ptr += 8;
+  if (shared > *keyLength || (uint64_t)shared + unshared > MAX_KEY_LENGTH ||
+      (uint64_t)unshared + *valueLength > (uint64_t)(limit - ptr) ||
+      *type > SSTABLE_TYPE_VALUE) {
+    return NULL;
+  }
+  memcpy(key + shared, ptr, unshared);
+  *keyLength = shared + unshared;
+  key[*keyLength] = '\0';
+  *value = ptr + unshared;
+  return ptr + unshared + *valueLength;
+}
+
+/*
+ * static int loadKeyRange(SSTableReader *reader)
+ *   Sets the smallest and largest key of the table. The largest is the last
+ *   key of the last block, the smallest is the first entry of the first
+ *   block, which is a restart point holding its key in full.
+ * @return: 1 on success, 0 if the first block is corrupt
+ */
+static int loadKeyRange(SSTableReader *reader) {
+  if (reader->blockCount == 0) {
+    return 1; // Empty table, no range
+  }
+  BlockHandle *first = &reader->handles[0];
+  char *buffer;
+  const char *block = readRegion(reader, first->offset, first->size, &buffer);
+  const char *restarts;
+  uint32_t restartCount;
+  char key[MAX_KEY_LENGTH + 1];
+  uint32_t keyLength = 0;
+  uint64_t sequence;
+  uint8_t type;
+  const char *value;
+  uint32_t valueLength;
+  int ok = block != NULL &&
+           parseRestarts(block, first->size, &restarts, &restartCount) &&
+           decodeEntry(block, restarts, key, &keyLength, &sequence, &type,
+                       &value, &valueLength) != NULL;
+  free(buffer);
+  if (ok) {
+    reader->smallestKey = strdup(key);
+    reader->largestKey = strdup(reader->handles[reader->blockCount - 1].lastKey);
+  }
+  return ok;
+}
+
+/*
+ * SSTableReader *openSSTableReader(const char *filepath, int useMmap)
+ *   Opens an SSTable, checks its footer and loads the index, filter and key
+ *   range. Data blocks are only read on demand.
+ *   A mapped table needs no file descriptor and no copies, its blocks are
+ *   searched in place and served by the page cache.
+ * @param filepath: The path of the SSTable
+ * @param useMmap: 1 to map the whole file, 0 to read blocks with pread
+ * @return: The reader, or NULL if the file is missing or not an SSTable
+ */
+SSTableReader *openSSTableReader(const char *filepath, int useMmap) {
+  int fd = open(filepath, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < SSTABLE_FOOTER_SIZE) {
+    fprintf(stderr, "Not a valid SSTable: %s\n", filepath);
+    close(fd);
+    return NULL;
+  }
+
+  SSTableReader *reader = calloc(1, sizeof(SSTableReader));
+  if (reader == NULL) {
+    perror("Failed to allocate memory for SSTable reader");
+    exit(EXIT_FAILURE);
+  }
+  reader->fd = fd;
+  reader->fileSize = st.st_size;
+  reader->fileId = getFileId(&st);
+  if (useMmap) {
+    void *map = mmap(NULL, reader->fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (map != MAP_FAILED) {
+      // The mapping stays valid once the descriptor is closed
+      reader->map = map;
+      close(fd);
+      reader->fd = -1;
+    } else {
+      perror("Failed to map SSTable file, reading it instead");
+    }
+  }
+
+  // Read the footer from the end of the file
+  char *buffer;
+  const char *footer = readRegion(
+      reader, reader->fileSize - SSTABLE_FOOTER_SIZE, SSTABLE_FOOTER_SIZE,
+      &buffer);
+  if (footer == NULL || decodeFixed64(footer + 44) != SSTABLE_MAGIC) {
+    fprintf(stderr, "Not a valid SSTable: %s\n", filepath);
+    free(buffer);
+    closeSSTableReader(reader);
+    return NULL;
+  }
+  uint64_t indexOffset = decodeFixed64(footer);
+  uint32_t indexSize = decodeFixed32(footer + 8);
+  uint64_t filterOffset = decodeFixed64(footer + 16);
+  uint32_t filterSize = decodeFixed32(footer + 24);
+  uint32_t blockCount = decodeFixed32(footer + 12);
+  uint64_t prefixFilterOffset = decodeFixed64(footer + 28);
+  uint32_t prefixFilterSize = decodeFixed32(footer + 36);
+  uint32_t prefixLength = decodeFixed32(footer + 40);
+  free(buffer);
+
+  if (blockCount > indexSize) {
+    // Every index entry takes more than a byte
+    fprintf(stderr, "Corrupt SSTable index: %s\n", filepath);
+    closeSSTableReader(reader);
+    return NULL;
+  }
+  reader->handles = calloc(blockCount + 1, sizeof(BlockHandle));
+  if (reader->handles == NULL) {
+    perror("Failed to allocate memory for SSTable index");
+    exit(EXIT_FAILURE);
+  }
+  reader->blockCount = blockCount;
+  if (filterSize > 0) {
+    // A missing filter only costs speed, so a bad one is simply dropped
+    reader->filter = readRegion(reader, filterOffset, filterSize,
+                                &reader->filterBuffer);
+    reader->filterSize = reader->filter != NULL ? filterSize : 0;
+  }
+  if (prefixFilterSize > 0 && prefixLength > 0 &&
+      prefixLength <= MAX_KEY_LENGTH) {
+    reader->prefixFilter = readRegion(reader, prefixFilterOffset,
+                                      prefixFilterSize,
+                                      &reader->prefixFilterBuffer);
+    if (reader->prefixFilter != NULL) {
+      reader->prefixFilterSize = prefixFilterSize;
+      reader->prefixLength = prefixLength;
+    }
+  }
+
+  const char *index = readRegion(reader, indexOffset, indexSize, &buffer);
+  if (index == NULL || !parseIndex(reader, index, indexSize) ||
+      !loadKeyRange(reader)) {
+    fprintf(stderr, "Corrupt SSTable index: %s\n", filepath);
+    free(buffer);
+    closeSSTableReader(reader);
+    return NULL;
+  }
+  free(buffer);
+  return reader;
+}
+
+/*
+ * void closeSSTableReader(SSTableReader *reader)
+ *   Unmaps or closes the file and frees the index.
+ * @param reader: The reader to close
+ */
+void closeSSTableReader(SSTableReader *reader) {
+  if (reader->map != NULL) {
+    munmap((void *)reader->map, reader->fileSize);
+  } else {
+    close(reader->fd);
+  }
+  if (reader->handles != NULL) {
+    freeHandles(reader->handles, reader->blockCount);
+  }
+  free(reader->filterBuffer);
+  free(reader->prefixFilterBuffer);
+  free(reader->smallestKey);
+  free(reader->largestKey);
+  free(reader);
+}
+
+/*
+ * void setSSTableBlockCache(SSTableReader *reader, BlockCache *cache)
+ *   Makes searches on the reader keep the data blocks they read in a cache
+ *   shared with other readers, and look there before reading the file.
+ *   Iterators read around the cache so a full scan does not evict hot blocks.
+ *   Mapped readers ignore the cache.
+ * @param reader: The reader to attach the cache to
+ * @param cache: The block cache, or NULL to read every block from disk
+ */
+void setSSTableBlockCache(SSTableReader *reader, BlockCache *cache) {
+  if (reader->map != NULL) {
+    return; // Mapped blocks are read in place, copying them gains nothing
+  }
+  reader->cache = cache;
+}
+
+/*
+ * static int findBlock(SSTableReader *reader, const char *key)
+ *   Binary searches the index for the first block whose last key is >= key,
+ *   which is the only block that can hold the key, with all of its entries.
+ * @return: The block index, or blockCount if the key is past the last block
+ */
+static int findBlock(SSTableReader *reader, const char *key) {
+  int low = 0;
+  int high = reader->blockCount;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (strcmp(reader->handles[mid].lastKey, key) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+/*
+ * int sstableMayContain(SSTableReader *reader, const char *key)
+ *   Checks the table's Bloom filter without touching any data block.
+ * @param reader: The SSTable to check
+ * @param key: The key to look up
+ * @return: 0 if the key is definitely not in the table, 1 otherwise
+ */
+int sstableMayContain(SSTableReader *reader, const char *key) {
+  return bloomMayContain(reader->filter, reader->filterSize, key, strlen(key));
+}
+
+/*
+ * int sstablePrefixMayMatch(SSTableReader *reader, const char *prefix,
+ *                           size_t length)
+ *   Checks the table's prefix filter without touching any data block. Every
+ *   key starting with a prefix at least as long as the one the filter was
+ *   built with shares its first prefixLength bytes, so those are looked up;
+ *   a shorter prefix cannot be checked.
+ * @param reader: The SSTable to check
+ * @param prefix: The prefix, not terminated
+ * @param length: The length of the prefix
+ * @return: 0 if no key of the table starts with the prefix, 1 otherwise
+ */
+int sstablePrefixMayMatch(SSTableReader *reader, const char *prefix,
+                          size_t length) {
+  if (reader->prefixFilter == NULL || length < (size_t)reader->prefixLength) {
+    return 1;
+  }
+  return bloomMayContain(reader->prefixFilter, reader->prefixFilterSize,
+                         prefix, reader->prefixLength);
+}
+
+/*
+ * static int restartKeyCompare(const char *entries, const char *limit,
+ *                              uint32_t offset, const char *key, int *cmp)
+ *   Compares the full key stored at a restart point with the search key.
+ * @param cmp: Set to < 0, 0 or > 0 like strcmp(restartKey, key)
+ * @return: 1 on success, 0 if the restart entry is corrupt
+ */
+static int restartKeyCompare(const char *entries, const char *limit,
+                             uint32_t offset, const char *key, int *cmp) {
+  if (offset >= (uint32_t)(limit - entries)) {
+    return 0;
+  }
+  char restartKey[MAX_KEY_LENGTH + 1];
+  uint32_t keyLength = 0; // Restart entries share nothing
+  uint64_t sequence;
+  uint8_t type;
+  const char *value;
+  uint32_t valueLength;
+  if (decodeEntry(entries + offset, limit, restartKey, &keyLength, &sequence,
+                  &type, &value, &valueLength) == NULL) {
+    return 0;
+  }
+  *cmp = strcmp(restartKey, key);
+  return 1;
+}
+
+/*
+ * static int searchBlock(const char *block, uint32_t size, const char *key,
+ *                        uint64_t sequence, const char **value,
+ *                        uint32_t *valueLength)
+ *   Binary searches the restart points for the last one whose key is < key,
+ *   then scans forward from there, at most SSTABLE_RESTART_INTERVAL entries
+ *   plus the entries of the key newer than the sequence.
+ * @param sequence: The sequence number of the read
+ * @param value: Set to the value inside the block, not terminated
+ * @param valueLength: Set to the length of the value
+ * @return: LOOKUP_FOUND, LOOKUP_DELETED if the entry the read sees is a
+ *   deletion record, or LOOKUP_NOT_FOUND
+ */
+static int searchBlock(const char *block, uint32_t size, const char *key,
+                       uint64_t sequence, const char **value,
+                       uint32_t *valueLength) {
+  const char *restarts;
+  uint32_t restartCount;
+  if (!parseRestarts(block, size, &restarts, &restartCount)) {
+    fprintf(stderr, "Corrupt SSTable block restart array\n");
+    return LOOKUP_NOT_FOUND;
+  }
+
+  uint32_t low = 0;
+  uint32_t high = restartCount - 1;
+  while (low < high) {
+    uint32_t mid = low + (high - low + 1) / 2;
+    int cmp;
+    if (!restartKeyCompare(block, restarts, decodeFixed32(restarts + mid * 4),
+                           key, &cmp)) {
+      fprintf(stderr, "Corrupt SSTable block restart entry\n");
+      return LOOKUP_NOT_FOUND;
+    }
+    if (cmp < 0) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+
+  char entryKey[MAX_KEY_LENGTH + 1];
+  uint32_t keyLength = 0;
+  uint32_t offset = decodeFixed32(restarts + low * 4);
+  if (offset >= (uint32_t)(restarts - block)) {
+    return LOOKUP_NOT_FOUND;
+  }
+  const char *ptr = block + offset;
+  while (ptr < restarts) {
+    uint64_t entrySequence;
+    uint8_t type;
+    ptr = decodeEntry(ptr, restarts, entryKey, &keyLength, &entrySequence,
+                      &type, value, valueLength);
+    if (ptr == NULL) {
+      fprintf(stderr, "Corrupt SSTable block entry\n");
+      return LOOKUP_NOT_FOUND;
+    }
+    int cmp = strcmp(entryKey, key);
+    if (cmp == 0 && entrySequence <= sequence) {
+      // The newest entry the read may see
+      return type == SSTABLE_TYPE_DELETION ? LOOKUP_DELETED : LOOKUP_FOUND;
+    }
+    if (cmp > 0) {
+      break; // Entries are sorted, the key is not here
+    }
+  }
+  return LOOKUP_NOT_FOUND;
+}
+
+/*
+ * static const char *loadBlock(SSTableReader *reader, int blockIndex,
+ *                              SSTableValue *pin)
+ *   Gets a data block from the mapped file, the block cache or disk. A block
+ *   read from disk goes into the cache if the reader has one.
+ * @param reader: The SSTable
+ * @param blockIndex: The block to load
+ * @param pin: Set to what holds the block, released with releaseSSTableValue
+ * @return: The contents of the block, or NULL if it could not be read
+ */
+static const char *loadBlock(SSTableReader *reader, int blockIndex,
+                             SSTableValue *pin) {
+  BlockHandle *handle = &reader->handles[blockIndex];
+  if (reader->cache != NULL) {
+    pin->block =
+        lookupBlockCache(reader->cache, reader->fileId, handle->offset);
+    if (pin->block != NULL) {
+      return pin->block->data;
+    }
+  }
+  const char *block =
+      readRegion(reader, handle->offset, handle->size, &pin->buffer);
+  if (block == NULL) {
+    perror("Failed to read SSTable block");
+    return NULL;
+  }
+  if (reader->cache != NULL && pin->buffer != NULL) {
+    // The cache owns the block from here on, the pin keeps it there
+    pin->block = insertBlockCache(reader->cache, reader->fileId,
+                                  handle->offset, pin->buffer, handle->size);
+    pin->buffer = NULL;
+  }
+  return block;
+}
+
+/*
+ * int getSSTableValue(SSTableReader *reader, const char *key,
+ *                     uint64_t sequence, SSTableValue *value)
+ *   Looks up a key by checking the Bloom filter, then binary searching the
+ *   index and the restart points of the single data block that can contain
+ *   it. Entries of the key newer than the sequence are skipped. The value is
+ *   not copied: it points into the mapped file, or into the block, which
+ *   stays pinned in the block cache (or in a private buffer without a cache)
+ *   until the value is released.
+ * @param reader: The SSTable to search, which must stay open while the value
+ *    is in use
+ * @param key: The key to look up
+ * @param sequence: The sequence number of the read, MAX_SEQUENCE for the
+ *    newest entry
+ * @param value: Set to the value when found
+ * @return: LOOKUP_FOUND, LOOKUP_DELETED if the entry the read sees is a
+ *   deletion record, or LOOKUP_NOT_FOUND. Only a found value must be
+ *   released.
+ */
+int getSSTableValue(SSTableReader *reader, const char *key, uint64_t sequence,
+                    SSTableValue *value) {
+  memset(value, 0, sizeof(SSTableValue));
+  if (reader->blockCount == 0 || strcmp(key, reader->smallestKey) < 0 ||
+      !sstableMayContain(reader, key)) {
+    return LOOKUP_NOT_FOUND;
+  }
+  int blockIndex = findBlock(reader, key);
+  if (blockIndex >= reader->blockCount) {
+    return LOOKUP_NOT_FOUND; // Key is larger than every key in the table
+  }
+  const char *block = loadBlock(reader, blockIndex, value);
+  if (block == NULL) {
+    return LOOKUP_NOT_FOUND;
+  }
+
+  uint32_t valueLength;
+  int result = searchBlock(block, reader->handles[blockIndex].size, key,
+                           sequence, &value->data, &valueLength);
+  if (result != LOOKUP_FOUND) {
+    releaseSSTableValue(reader, value);
+    return result;
+  }
+  value->size = valueLength;
+  return LOOKUP_FOUND;
+}
+
+/*
+ * void getSSTableValues(SSTableReader *reader, char **keys, int count,
+ *                       uint64_t sequence, int *results, char **values)
+ *   Looks up keys given in increasing order, like getSSTableValue, with one
+ *   pass over the table. The Bloom filter is checked for every key first,
+ *   then the keys that pass are matched to their blocks in index order, and
+ *   each block is loaded once for all the keys it may hold.
+ * @param reader: The SSTable to search
+ * @param keys: The keys to look up, sorted, duplicates allowed
+ * @param count: The number of keys
+ * @param sequence: The sequence number of the read
+ * @param results: Set to LOOKUP_FOUND, LOOKUP_DELETED or LOOKUP_NOT_FOUND
+ *   for every key
+ * @param values: Set to a malloc'd copy of the value of every key found
+ */
+void getSSTableValues(SSTableReader *reader, char **keys, int count,
+                      uint64_t sequence, int *results, char **values) {
+  int *blocks = malloc(count * sizeof(int));
+  if (blocks == NULL) {
+    perror("Failed to allocate memory for SSTable lookups");
+    exit(EXIT_FAILURE);
+  }
+  // Filter checks first, the block of a key is only searched if it passes
+  int blockIndex = 0;
+  for (int i = 0; i < count; i++) {
+    results[i] = LOOKUP_NOT_FOUND;
+    blocks[i] = reader->blockCount;
+    if (reader->blockCount == 0 || strcmp(keys[i], reader->smallestKey) < 0 ||
+        !sstableMayContain(reader, keys[i])) {
+      continue;
+    }
+    // Sorted keys only move forward through the index
+    if (blockIndex < reader->blockCount &&
+        strcmp(reader->handles[blockIndex].lastKey, keys[i]) < 0) {
+      blockIndex = findBlock(reader, keys[i]);
+    }
+    blocks[i] = blockIndex;
+  }
+
+  for (int i = 0; i < count;) {
+    if (blocks[i] >= reader->blockCount) {
+      i++;
+      continue;
+    }
+    SSTableValue pin;
+    memset(&pin, 0, sizeof(SSTableValue));
+    const char *block = loadBlock(reader, blocks[i], &pin);
+    uint32_t size = reader->handles[blocks[i]].size;
+    int j = i;
+    for (; j < count && blocks[j] == blocks[i]; j++) {
+      const char *data;
+      uint32_t valueLength;
+      if (block == NULL) {
+        continue;
+      }
+      results[j] = searchBlock(block, size, keys[j], sequence, &data,
+                               &valueLength);
+      if (results[j] == LOOKUP_FOUND) {
+        values[j] = strndup(data, valueLength);
+        if (values[j] == NULL) {
+          perror("Failed to allocate memory for value");
+          exit(EXIT_FAILURE);
+        }
+      }
+    }
+    releaseSSTableValue(reader, &pin);
+    i = j;
+  }
+  free(blocks);
+}
+
+/*
+ * void releaseSSTableValue(SSTableReader *reader, SSTableValue *value)
+ *   Unpins the block holding a value. The value must not be used afterwards.
+ * @param reader: The SSTable the value came from
+ * @param value: The value to release
+ */
+void releaseSSTableValue(SSTableReader *reader, SSTableValue *value) {
+  if (value->block != NULL) {
+    releaseBlockCache(reader->cache, value->block);
+  }
+  free(value->buffer);
+  memset(value, 0, sizeof(SSTableValue));
+}
+
+/*
+ * char *searchSSTable(SSTableReader *reader, const char *key)
+ *   Looks up the newest entry of a key, see getSSTableValue, and copies its
+ *   value. A deleted key is not found.
+ * @param reader: The SSTable to search
+ * @param key: The key to look up
+ * @return: A malloc'd copy of the value, or NULL if not found
+ */
+char *searchSSTable(SSTableReader *reader, const char *key) {
+  SSTableValue value;
+  if (getSSTableValue(reader, key, MAX_SEQUENCE, &value) != LOOKUP_FOUND) {
+    return NULL;
+  }
+  char *foundValue = strndup(value.data, value.size);
+  releaseSSTableValue(reader, &value);
+  return foundValue;
+}
+
+/*
+ * static int readIteratorBlock(SSTableIterator *iterator)
+ *   Reads the block at iterator->blockIndex and its restart array, freeing
+ *   the previous block.
+ * @return: 1 on success, 0 if the block could not be read or is corrupt
+ */
+static int readIteratorBlock(SSTableIterator *iterator) {
+  free(iterator->buffer);
+  iterator->buffer = NULL;
+  SSTableReader *reader = iterator->reader;
+  BlockHandle *handle = &reader->handles[iterator->blockIndex];
+  iterator->block =
+      readRegion(reader, handle->offset, handle->size, &iterator->buffer);
+  if (iterator->block != NULL &&
+      parseRestarts(iterator->block, handle->size, &iterator->limit,
+                    &iterator->restartCount)) {
+    iterator->next = iterator->block;
+    return 1;
+  }
+  fprintf(stderr, "Failed to read SSTable block at offset %llu\n",
+          (unsigned long long)handle->offset);
+  free(iterator->buffer);
+  iterator->buffer = NULL;
+  return 0;
+}
+
+/*
+ * static void loadIteratorBlock(SSTableIterator *iterator)
+ *   Loads the block at iterator->blockIndex, skipping unreadable blocks.
+ *   Marks the iterator invalid past the last block.
+ */
+static void loadIteratorBlock(SSTableIterator *iterator) {
+  while (iterator->blockIndex < iterator->reader->blockCount) {
+    if (readIteratorBlock(iterator)) {
+      return;
+    }
+    iterator->blockIndex++;
+  }
+  iterator->valid = 0;
+}
+
+/*
+ * static void loadPrevIteratorBlock(SSTableIterator *iterator)
+ *   Loads the block at iterator->blockIndex, skipping unreadable blocks
+ *   towards the start of the table. Marks the iterator invalid before the
+ *   first block.
+ */
+static void loadPrevIteratorBlock(SSTableIterator *iterator) {
+  while (iterator->blockIndex >= 0) {
+    if (readIteratorBlock(iterator)) {
+      return;
+    }
+    iterator->blockIndex--;
+  }
+  iterator->valid = 0;
+}
+
+/*
+ * static void scanToEntryBefore(SSTableIterator *iterator,
+ *                               const char *target)
+ *   Positions an iterator at the entry of its block that ends at target,
+ *   decoding forward from the last restart point before it, since entries
+ *   can only be decoded front to back.
+ * @param target: An entry of the current block, or its limit for the last
+ *   entry, other than the first entry
+ */
+static void scanToEntryBefore(SSTableIterator *iterator, const char *target) {
+  uint32_t offset = target - iterator->block;
+  const char *restarts = iterator->limit;
+  // Binary search for the last restart point before the target
+  uint32_t low = 0;
+  uint32_t high = iterator->restartCount - 1;
+  while (low < high) {
+    uint32_t mid = low + (high - low + 1) / 2;
+    if (decodeFixed32(restarts + mid * 4) < offset) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+  uint32_t restart = decodeFixed32(restarts + low * 4);
+  if (restart >= offset) {
+    iterator->valid = 0;
+    return;
+  }
+  iterator->next = iterator->block + restart;
+  uint32_t keyLength = 0;
+  while (iterator->next < target) {
+    iterator->current = iterator->next;
+    iterator->next = decodeEntry(
+        iterator->current, iterator->limit, iterator->key, &keyLength,
+        &iterator->sequence, &iterator->type, &iterator->value,
+        &iterator->valueLength);
+    if (iterator->next == NULL) {
+      fprintf(stderr, "Corrupt SSTable block, stopping backward scan\n");
+      iterator->valid = 0;
+      return;
+    }
+  }
+}
+
+/*
+ * void initSSTableIterator(SSTableIterator *iterator, SSTableReader *reader)
+ *   Positions an iterator at the first entry of the SSTable.
+ * @param iterator: The iterator to initialize
+ * @param reader: The SSTable to walk
+ */
+void initSSTableIterator(SSTableIterator *iterator, SSTableReader *reader) {
+  memset(iterator, 0, sizeof(SSTableIterator));
+  iterator->reader = reader;
+  iterator->valid = 1;
+  loadIteratorBlock(iterator);
+  nextSSTableIterator(iterator);
+}
+
+/*
+ * void seekSSTableIterator(SSTableIterator *iterator, SSTableReader *reader,
+ *                          const char *key)
+ *   Positions an iterator at the newest entry of the first key >= key. The
+ *   index gives the only block that can hold it, which is then scanned.
+ * @param iterator: The iterator to initialize
+ * @param reader: The SSTable to walk
+ * @param key: The key to start at
+ */
+void seekSSTableIterator(SSTableIterator *iterator, SSTableReader *reader,
+                         const char *key) {
+  memset(iterator, 0, sizeof(SSTableIterator));
+  iterator->reader = reader;
+  iterator->valid = 1;
+  iterator->blockIndex = findBlock(reader, key);
+  loadIteratorBlock(iterator);
+  nextSSTableIterator(iterator);
+  while (iterator->valid && strcmp(iterator->key, key) < 0) {
+    nextSSTableIterator(iterator);
+  }
+}
+
+/*
+ * void seekSSTableIteratorToLast(SSTableIterator *iterator,
+ *                                SSTableReader *reader)
+ *   Positions an iterator at the last entry of the SSTable, the oldest entry
+ *   of its largest key.
+ * @param iterator: The iterator to initialize
+ * @param reader: The SSTable to walk
+ */
+void seekSSTableIteratorToLast(SSTableIterator *iterator,
+                               SSTableReader *reader) {
+  memset(iterator, 0, sizeof(SSTableIterator));
+  iterator->reader = reader;
+  iterator->valid = 1;
+  iterator->blockIndex = reader->blockCount - 1;
+  loadPrevIteratorBlock(iterator);
+  if (iterator->valid) {
+    scanToEntryBefore(iterator, iterator->limit);
+  }
+}
+
+/*
+ * void nextSSTableIterator(SSTableIterator *iterator)
+ *   Decodes the next entry into iterator->key and iterator->value, moving to
+ *   the next block when the current one is used up.
+ * @param iterator: The iterator to advance
+ */
+void nextSSTableIterator(SSTableIterator *iterator) {
+  while (iterator->valid) {
+    if (iterator->next < iterator->limit) {
+      // The previous key of the block is still in iterator->key
+      uint32_t keyLength =
+          iterator->next == iterator->block ? 0 : strlen(iterator->key);
+      iterator->current = iterator->next;
+      const char *ptr = decodeEntry(
+          iterator->next, iterator->limit, iterator->key, &keyLength,
+          &iterator->sequence, &iterator->type, &iterator->value,
+          &iterator->valueLength);
+      if (ptr != NULL) {
+        iterator->next = ptr;
+        return;
+      }
+      fprintf(stderr, "Corrupt SSTable block, skipping rest of block\n");
+    }
+    // Current block is done, move to the next one
+    iterator->blockIndex++;
+    loadIteratorBlock(iterator);
+  }
+}
+
+/*
+ * void prevSSTableIterator(SSTableIterator *iterator)
+ *   Moves the iterator to the previous entry, in the previous block if it
+ *   was at the first entry of its block. Marks it invalid before the first
+ *   entry of the table.
+ * @param iterator: The iterator to move back
+ */
+void prevSSTableIterator(SSTableIterator *iterator) {
+  if (!iterator->valid) {
+    return;
+  }
+  const char *target = iterator->current;
+  if (target == iterator->block) {
+    iterator->blockIndex--;
+    loadPrevIteratorBlock(iterator);
+    if (!iterator->valid) {
+      return;
+    }
+    target = iterator->limit;
+  }
+  scanToEntryBefore(iterator, target);
+}
+
+/*
+ * void freeSSTableIterator(SSTableIterator *iterator)
+ *   Releases the block held by an iterator. The reader stays open.
+ * @param iterator: The iterator to free
+ */
+void freeSSTableIterator(SSTableIterator *iterator) {
+  free(iterator->buffer);
+  iterator->buffer = NULL;
+  iterator->block = NULL;
+  iterator->valid = 0;
+}
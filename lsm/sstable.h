@@ -0,0 +1,196 @@
+#ifndef SSTABLE_FORMAT_H
+#define SSTABLE_FORMAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bloom.h"
+#include "cache.h"
+#include "memtable.h"
+
+// SSTable file layout
+//   [data block 0] ... [data block n-1] [filter block] [prefix filter block]
+//   [index block] [footer]
+// Data block: entries in key order, the entries of a key newest first, cut
+//   once the block reaches SSTABLE_BLOCK_SIZE, followed by the restart array
+//   The entries of a key are never split across blocks, so the block the
+//   index gives for a key holds every entry of it
+//   Entry: [varint shared][varint unshared][varint valueLength][byte type]
+//     [fixed64 sequence][unshared key bytes][value], where shared is the
+//     number of leading bytes the key has in common with the previous key of
+//     the block, type tells a value from a deletion record, which has no
+//     value, and sequence is the sequence number of the write
+//   Every SSTABLE_RESTART_INTERVAL entries a restart entry stores its key in
+//     full (shared = 0), so lookups can binary search the restarts
+//   Restart array: [fixed32 restart offset]... [fixed32 restartCount]
+// Index block: one entry per data block of
+//   [varint keyLength][last key of block][fixed64 offset][fixed32 size]
+// Filter block: a Bloom filter over every distinct key of the table, deleted
+//   keys included (see bloom.h)
+// Prefix filter block: a Bloom filter over the first prefixLength bytes of
+//   every key at least that long, empty if the table was written without a
+//   prefix length
+// Footer: [fixed64 indexOffset][fixed32 indexSize][fixed32 blockCount]
+//   [fixed64 filterOffset][fixed32 filterSize][fixed64 prefixFilterOffset]
+//   [fixed32 prefixFilterSize][fixed32 prefixLength][fixed64 SSTABLE_MAGIC]
+#define SSTABLE_BLOCK_SIZE 4 * 1024 // 4KB
+#define SSTABLE_FOOTER_SIZE 52
+#define SSTABLE_MAGIC 0x4c534d5353543036ULL // "LSMSST06"
+#define SSTABLE_RESTART_INTERVAL 16 // Entries between full keys in a block
+// Largest encoded entry: three 5 byte varints, the type and the sequence plus
+// the key and value
+#define SSTABLE_MAX_ENTRY_SIZE (24 + MAX_KEY_LENGTH + MAX_VALUE_LENGTH)
+// Entry types
+#define SSTABLE_TYPE_DELETION 0
+#define SSTABLE_TYPE_VALUE 1
+
+// One index entry: the last key of a data block and where the block lives
+typedef struct {
+  char *lastKey;
+  uint64_t offset;
+  uint32_t size;
+} BlockHandle;
+
+// Writes a new SSTable. Entries must be added in increasing key order, the
+// entries of a key newest first.
+typedef struct {
+  FILE *file;
+  char *block;                       // Data block being filled
+  size_t blockSize;                  // Bytes used in the current data block
+  size_t blockCapacity;              // Bytes allocated for the data block
+  uint64_t offset;                   // Bytes written to the file so far
+  char firstKey[MAX_KEY_LENGTH + 1]; // First key of the table
+  char lastKey[MAX_KEY_LENGTH + 1];  // Last key added, closes the block
+  uint32_t *restarts;                // Restart offsets of the current block
+  int restartCount;
+  int restartCapacity;
+  int entriesSinceRestart;           // Entries since the last restart point
+  BlockHandle *handles;              // Index entries of the finished blocks
+  int blockCount;
+  int handleCapacity;
+  long entryCount;
+  uint64_t largestSequence;          // Newest entry added
+  uint32_t *keyHashes;               // Bloom hash of every distinct key
+  long hashCount;
+  long hashCapacity;
+  int bitsPerKey;                    // Bloom filter bits per key, 0 for none
+  uint32_t *prefixHashes;            // Bloom hash of every distinct prefix
+  long prefixCount;
+  long prefixCapacity;
+  int prefixLength;                  // Bytes of a key's prefix, 0 for none
+} SSTableBuilder;
+
+// Summary of a finished SSTable, filled in by finishSSTable
+typedef struct {
+  uint64_t fileSize;
+  long entryCount;
+  uint64_t largestSequence; // Sequence number of the newest entry
+  char smallestKey[MAX_KEY_LENGTH + 1]; // Empty if the table has no entries
+  char largestKey[MAX_KEY_LENGTH + 1];
+} SSTableInfo;
+
+// An open SSTable with its index, Bloom filter and key range in memory
+typedef struct {
+  int fd;           // -1 once the file is mapped
+  const char *map;  // The whole file when mapped, NULL otherwise
+  uint64_t fileSize;
+  BlockHandle *handles;
+  int blockCount;
+  const char *filter; // NULL if the table has no filter
+  size_t filterSize;
+  char *filterBuffer; // Holds the filter when the file is not mapped
+  const char *prefixFilter; // NULL if the table has no prefix filter
+  size_t prefixFilterSize;
+  char *prefixFilterBuffer;
+  int prefixLength;   // Prefix length the prefix filter was built with
+  char *smallestKey;  // Key range of the table, NULL if it is empty
+  char *largestKey;
+  BlockCache *cache; // Where lookups keep data blocks, NULL for none
+  uint64_t fileId;   // Identity of the file contents, keys its cached blocks
+} SSTableReader;
+
+// A value found in an SSTable, not copied
+// It points into the mapped file, or into its data block, which stays pinned
+// in the block cache or held in buffer until the value is released.
+typedef struct {
+  const char *data; // Not terminated
+  size_t size;
+  CacheEntry *block; // Pinned cached block, or NULL
+  char *buffer;      // Block read without a cache, or NULL
+} SSTableValue;
+
+// Walks the entries of an SSTable in order, forward or backward, one block in
+// memory at a time
+typedef struct {
+  SSTableReader *reader;
+  int blockIndex;         // Block currently loaded
+  const char *block;      // Contents of the current block
+  char *buffer;           // Holds the block when the file is not mapped
+  const char *limit;      // End of the entries, where the restart array begins
+  uint32_t restartCount;  // Restart points of the current block
+  const char *current;    // Entry the iterator is at
+  const char *next;       // Next entry to decode in the block
+  int valid;              // 0 once the iterator moved past either end
+  char key[MAX_KEY_LENGTH + 1]; // Rebuilt from the previous key and the delta
+  uint64_t sequence;      // Sequence number of the entry
+  uint8_t type;           // SSTABLE_TYPE_VALUE or SSTABLE_TYPE_DELETION
+  const char *value;      // Points into the current block, not terminated
+  uint32_t valueLength;
+} SSTableIterator;
+
+// Function declarations
+// Starts a new SSTable at the given path with a Bloom filter of bitsPerKey
+// and, if prefixLength is not 0, a Bloom filter of the key prefixes
+SSTableBuilder *createSSTableBuilder(const char *filepath, int bitsPerKey,
+                                     int prefixLength);
+// Appends an entry, a NULL value writes a deletion record
+// Returns 0 on a write error
+int addToSSTable(SSTableBuilder *builder, const char *key, uint64_t sequence,
+                 const char *value);
+// Writes the index and footer and closes the file, returns 0 on error
+// If info is not NULL it is filled with the size and key range of the table
+int finishSSTable(SSTableBuilder *builder, SSTableInfo *info);
+// Opens an SSTable, mapped or read with pread, and loads its index
+// Returns NULL if it is not valid
+SSTableReader *openSSTableReader(const char *filepath, int useMmap);
+// Closes an SSTable opened with openSSTableReader
+void closeSSTableReader(SSTableReader *reader);
+// Makes lookups on the reader go through a shared block cache
+void setSSTableBlockCache(SSTableReader *reader, BlockCache *cache);
+// Returns 0 if the table's Bloom filter rules the key out, 1 otherwise
+int sstableMayContain(SSTableReader *reader, const char *key);
+// Returns 0 if the table's prefix filter rules out every key starting with
+// prefix, 1 otherwise
+int sstablePrefixMayMatch(SSTableReader *reader, const char *prefix,
+                          size_t length);
+// Looks up the newest entry of a key numbered sequence or less, reading at
+// most one data block from disk or the cache
+// Returns LOOKUP_FOUND with a pinned value, LOOKUP_DELETED if that entry is
+// a deletion record, or LOOKUP_NOT_FOUND
+int getSSTableValue(SSTableReader *reader, const char *key, uint64_t sequence,
+                    SSTableValue *value);
+// Looks up keys in increasing order, reading each data block at most once
+// for all of them. Found values are copied into values
+void getSSTableValues(SSTableReader *reader, char **keys, int count,
+                      uint64_t sequence, int *results, char **values);
+// Unpins a value returned by getSSTableValue
+void releaseSSTableValue(SSTableReader *reader, SSTableValue *value);
+// Looks up the newest entry of a key like getSSTableValue
+// Returns a malloc'd copy of the value, or NULL if not found or deleted
+char *searchSSTable(SSTableReader *reader, const char *key);
+// Positions an iterator at the first entry of the SSTable
+void initSSTableIterator(SSTableIterator *iterator, SSTableReader *reader);
+// Positions an iterator at the newest entry of the first key >= key
+void seekSSTableIterator(SSTableIterator *iterator, SSTableReader *reader,
+                         const char *key);
+// Positions an iterator at the last entry of the SSTable
+void seekSSTableIteratorToLast(SSTableIterator *iterator,
+                               SSTableReader *reader);
+// Moves the iterator to the next entry
+void nextSSTableIterator(SSTableIterator *iterator);
+// Moves the iterator to the previous entry
+void prevSSTableIterator(SSTableIterator *iterator);
+// Releases the block held by an iterator
+void freeSSTableIterator(SSTableIterator *iterator);
+
+#endif // SSTABLE_FORMAT_H
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bloom.h"
+#include "tablecache.h"
+
+/*
+ * static TableHandle **findSlot(TableCache *cache, const char *filepath,
+ *                               uint32_t hash)
+ *   Finds the bucket pointer that points at the table for a path.
+ * @return: The slot, which holds NULL if the table is not open
+ */
+static TableHandle **findSlot(TableCache *cache, const char *filepath,
+                              uint32_t hash) {
+  TableHandle **slot = &cache->buckets[hash & (cache->bucketCount - 1)];
+  while (*slot != NULL && strcmp((*slot)->filepath, filepath) != 0) {
+    slot = &(*slot)->hashNext;
+  }
+  return slot;
+}
+
+/*
+ * static void growBuckets(TableCache *cache)
+ *   Doubles the number of buckets and rehashes every table.
+ */
+static void growBuckets(TableCache *cache) {
+  int newCount = cache->bucketCount * 2;
+  TableHandle **newBuckets = calloc(newCount, sizeof(TableHandle *));
+  if (newBuckets == NULL) {
+    perror("Failed to reallocate memory for table cache buckets");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < cache->bucketCount; i++) {
+    TableHandle *handle = cache->buckets[i];
+    while (handle != NULL) {
+      TableHandle *next = handle->hashNext;
+      TableHandle **bucket = &newBuckets[handle->hash & (newCount - 1)];
+      handle->hashNext = *bucket;
+      *bucket = handle;
+      handle = next;
+    }
+  }
+  free(cache->buckets);
+  cache->buckets = newBuckets;
+  cache->bucketCount = newCount;
+}
+
+/*
+ * static void lruRemove(TableHandle *handle)
+ *   Unlinks a table from the LRU list.
+ */
+static void lruRemove(TableHandle *handle) {
+  handle->prev->next = handle->next;
+  handle->next->prev = handle->prev;
+}
+
+/*
+ * static void lruPushFront(TableCache *cache, TableHandle *handle)
+ *   Links a table as the most recently used.
+ */
+static void lruPushFront(TableCache *cache, TableHandle *handle) {
+  handle->next = cache->lru.next;
+  handle->prev = &cache->lru;
+  handle->next->prev = handle;
+  cache->lru.next = handle;
+}
+
+/*
+ * static void unrefTable(TableHandle *handle)
+ *   Drops a reference, closing the table with the last one.
+ *   Must be called with the cache mutex held.
+ */
+static void unrefTable(TableHandle *handle) {
+  if (--handle->refs == 0) {
+    closeSSTableReader(handle->reader);
+    free(handle->filepath);
+    free(handle);
+  }
+}
+
+/*
+ * static void removeTable(TableCache *cache, TableHandle **slot)
+ *   Takes the table in a slot out of the cache and drops the cache's
+ *   reference. Tables still in use stay open until they are released.
+ */
+static void removeTable(TableCache *cache, TableHandle **slot) {
+  TableHandle *handle = *slot;
+  *slot = handle->hashNext;
+  lruRemove(handle);
+  cache->tableCount--;
+  unrefTable(handle);
+}
+
+/*
+ * static void evictTables(TableCache *cache)
+ *   Closes least recently used tables until the cache is within capacity.
+ */
+static void evictTables(TableCache *cache) {
+  while (cache->tableCount > cache->maxOpenFiles &&
+         cache->lru.prev != &cache->lru) {
+    TableHandle *oldest = cache->lru.prev;
+    removeTable(cache, findSlot(cache, oldest->filepath, oldest->hash));
+  }
+}
+
+/*
+ * TableCache *createTableCache(int maxOpenFiles, int useMmap,
+ *                              BlockCache *blockCache)
+ *   Creates an empty table cache.
+ * @param maxOpenFiles: The maximum number of tables to keep open
+ * @param useMmap: 1 to map tables, 0 to read their blocks with pread
+ * @param blockCache: The block cache for tables that are not mapped, or NULL
+ * @return: A pointer to the new cache
+ */
+TableCache *createTableCache(int maxOpenFiles, int useMmap,
+                             BlockCache *blockCache) {
+  TableCache *cache = calloc(1, sizeof(TableCache));
+  if (cache == NULL) {
+    perror("Failed to allocate memory for table cache");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutex_init(&cache->mutex, NULL);
+  cache->bucketCount = 16; // Initial capacity
+  cache->buckets = calloc(cache->bucketCount, sizeof(TableHandle *));
+  if (cache->buckets == NULL) {
+    perror("Failed to allocate memory for table cache buckets");
+    exit(EXIT_FAILURE);
+  }
+  cache->lru.next = &cache->lru;
+  cache->lru.prev = &cache->lru;
+  cache->maxOpenFiles = maxOpenFiles > 0 ? maxOpenFiles : 1;
+  cache->useMmap = useMmap;
+  cache->blockCache = blockCache;
+  return cache;
+}
+
+/*
+ * void freeTableCache(TableCache *cache)
+ *   Closes every table and frees the cache.
+ * @param cache: The cache to free, no table may still be in use
+ */
+void freeTableCache(TableCache *cache) {
+  evictAllTables(cache);
+  free(cache->buckets);
+  pthread_mutex_destroy(&cache->mutex);
+  free(cache);
+}
+
+/*
+ * void setTableCacheCapacity(TableCache *cache, int maxOpenFiles)
+ *   Changes the number of tables kept open.
+ * @param cache: The cache to resize
+ * @param maxOpenFiles: The new maximum number of open tables
+ */
+void setTableCacheCapacity(TableCache *cache, int maxOpenFiles) {
+  pthread_mutex_lock(&cache->mutex);
+  cache->maxOpenFiles = maxOpenFiles > 0 ? maxOpenFiles : 1;
+  evictTables(cache);
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+/*
+ * TableHandle *findTable(TableCache *cache, const char *filepath)
+ *   Returns the open table for a path and marks it as the most recently
+ *   used. On a miss the table is opened and added, closing the least
+ *   recently used one if the cache is full. The open happens under the
+ *   mutex, which is fine since it only happens once per table.
+ *   If the array of buckets is full, double it.
+ * @param cache: The cache to search
+ * @param filepath: The path of the SSTable
+ * @return: The table, or NULL if it could not be opened
+ */
+TableHandle *findTable(TableCache *cache, const char *filepath) {
+  uint32_t hash = bloomHash(filepath, strlen(filepath));
+  pthread_mutex_lock(&cache->mutex);
+  TableHandle **slot = findSlot(cache, filepath, hash);
+  TableHandle *handle = *slot;
+  if (handle != NULL) {
+    lruRemove(handle);
+    lruPushFront(cache, handle);
+    handle->refs++;
+    pthread_mutex_unlock(&cache->mutex);
+    return handle;
+  }
+
+  SSTableReader *reader = openSSTableReader(filepath, cache->useMmap);
+  if (reader == NULL) {
+    pthread_mutex_unlock(&cache->mutex);
+    return NULL;
+  }
+  setSSTableBlockCache(reader, cache->blockCache);
+
+  handle = malloc(sizeof(TableHandle));
+  if (handle == NULL) {
+    perror("Failed to allocate memory for table cache entry");
+    exit(EXIT_FAILURE);
+  }
+  handle->filepath = strdup(filepath);
+  handle->reader = reader;
+  handle->hash = hash;
+  handle->refs = 2; // One for the cache, one for the caller
+  handle->hashNext = NULL;
+  *slot = handle;
+  lruPushFront(cache, handle);
+  cache->tableCount++;
+  if (cache->tableCount > cache->bucketCount) {
+    growBuckets(cache);
+  }
+  evictTables(cache);
+  pthread_mutex_unlock(&cache->mutex);
+  return handle;
+}
+
+/*
+ * void releaseTable(TableCache *cache, TableHandle *handle)
+ *   Releases a table. Its reader must not be used afterwards.
+ * @param cache: The cache the table came from
+ * @param handle: The table to release
+ */
+void releaseTable(TableCache *cache, TableHandle *handle) {
+  pthread_mutex_lock(&cache->mutex);
+  unrefTable(handle);
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+/*
+ * void evictTable(TableCache *cache, const char *filepath)
+ *   Drops a table whose file was deleted or replaced.
+ * @param cache: The cache to remove from
+ * @param filepath: The path of the SSTable
+ */
+void evictTable(TableCache *cache, const char *filepath) {
+  uint32_t hash = bloomHash(filepath, strlen(filepath));
+  pthread_mutex_lock(&cache->mutex);
+  TableHandle **slot = findSlot(cache, filepath, hash);
+  if (*slot != NULL) {
+    removeTable(cache, slot);
+  }
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+/*
+ * void evictAllTables(TableCache *cache)
+ *   Drops every table, used when all SSTables are cleared.
+ * @param cache: The cache to empty
+ */
+void evictAllTables(TableCache *cache) {
+  pthread_mutex_lock(&cache->mutex);
+  while (cache->lru.next != &cache->lru) {
+    TableHandle *handle = cache->lru.next;
+    removeTable(cache, findSlot(cache, handle->filepath, handle->hash));
+  }
+  pthread_mutex_unlock(&cache->mutex);
+}
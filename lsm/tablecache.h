@@ -0,0 +1,60 @@
+#ifndef TABLECACHE_H
+#define TABLECACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "sstable.h"
+
+// Table cache macros
+// Default number of SSTables kept open at once
+#define MAX_OPEN_FILES 500
+
+// An open SSTable in the table cache, keyed by its path
+// The cache holds one reference while the table is in its list, every
+// findTable hands out another that must be released. An evicted table is
+// closed once the last reference is released.
+typedef struct TableHandle {
+  char *filepath;
+  SSTableReader *reader;
+  uint32_t hash;
+  int refs;                     // Guarded by the cache mutex
+  struct TableHandle *hashNext; // Next table in the same bucket
+  struct TableHandle *prev;     // LRU list neighbors, most recent first
+  struct TableHandle *next;
+} TableHandle;
+
+// Keeps recently used SSTables open with their index and filter parsed, so
+// a lookup does not open or parse anything
+typedef struct {
+  pthread_mutex_t mutex;
+  TableHandle **buckets;
+  int bucketCount; // Always a power of two
+  int tableCount;
+  int maxOpenFiles;
+  TableHandle lru; // Sentinel, lru.next is the most recently used table
+  int useMmap;     // Whether new tables are mapped or read with pread
+  // Shared by the tables that are not mapped, or NULL
+  BlockCache *blockCache;
+} TableCache;
+
+// Function declarations
+// Creates an empty table cache keeping up to maxOpenFiles tables open
+TableCache *createTableCache(int maxOpenFiles, int useMmap,
+                             BlockCache *blockCache);
+// Closes every table and frees the cache, no table may still be in use
+void freeTableCache(TableCache *cache);
+// Changes the number of open tables, closing the least recently used ones
+void setTableCacheCapacity(TableCache *cache, int maxOpenFiles);
+// Returns the open table for a path, opening it on a miss
+// Returns NULL if the file is missing or not an SSTable
+TableHandle *findTable(TableCache *cache, const char *filepath);
+// Releases a table returned by findTable
+void releaseTable(TableCache *cache, TableHandle *handle);
+// Drops a table that was deleted or rewritten, the next find reopens it
+void evictTable(TableCache *cache, const char *filepath);
+// Drops every table
+void evictAllTables(TableCache *cache);
+
+#endif // TABLECACHE_H
@@ -1,11 +1,18 @@
 #include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "cache.h"
 #include "memtable.h"
 #include "lsm.h"
+#include "ratelimiter.h"
+#include "shard.h"
+#include "sstable.h"
+#include "tablecache.h"
 #include "test.h"
 
 /*
@@ -20,6 +27,7 @@
  * @param iterations: The number of iterations to run the test
  */
 void testMemtableInsertAndSearch(int iterations) {
+  Memtable *table = createMemtable();
   char key[MAX_KEY_LENGTH];
   char value[MAX_VALUE_LENGTH];
 
@@ -29,16 +37,16 @@ void testMemtableInsertAndSearch(int iterations) {
   for (int i = 0; i < iterations; i++) {
     sprintf(key, "key%d", i);
     sprintf(value, "value%d", i);
-    insertNodeIntoMemtable(key, value);
-    Node *found = searchMemtable(key);
+    insertNodeIntoMemtable(table, key, i + 1, value);
+    Node *found = searchMemtable(table, key);
     assert(found != NULL);
     assert(strcmp(found->value, value) == 0);
   }
 
-  printMemoryUsage();
+  printMemoryUsage(table);
   clock_t end = clock();
   double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
-  clearMemtable();
+  unrefMemtable(table);
   printf("testMemtableInsertAndSearch completed in %.2f seconds.\n", timeTaken);
 }
 
@@ -48,6 +56,7 @@ void testMemtableInsertAndSearch(int iterations) {
  * @param iterations: The number of iterations to run the test
  */
 void testMemtableRandomInsertAndSearch(int iterations) {
+  Memtable *table = createMemtable();
   char key[MAX_KEY_LENGTH];
   char value[MAX_VALUE_LENGTH];
   srand((unsigned)time(NULL));
@@ -59,16 +68,16 @@ void testMemtableRandomInsertAndSearch(int iterations) {
     int randKey = rand() % 1000;
     sprintf(key, "key%d", randKey);
     sprintf(value, "value%d", randKey);
-    insertNodeIntoMemtable(key, value);
-    Node *found = searchMemtable(key);
+    insertNodeIntoMemtable(table, key, i + 1, value);
+    Node *found = searchMemtable(table, key);
     assert(found != NULL);
     assert(strcmp(found->value, value) == 0);
   }
 
-  printMemoryUsage();
+  printMemoryUsage(table);
   clock_t end = clock();
   double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
-  clearMemtable();
+  unrefMemtable(table);
   printf("testMemtableRandomInsertAndSearch completed in %.2f seconds.\n",
          timeTaken);
 }
@@ -79,6 +88,7 @@ void testMemtableRandomInsertAndSearch(int iterations) {
  * @param iterations: The number of iterations to run the test
  */
 void testMemtableRandomDeletion(int iterations) {
+  Memtable *table = createMemtable();
   char key[MAX_KEY_LENGTH];
   int *keys = malloc(iterations * sizeof(int));
 
@@ -90,26 +100,26 @@ void testMemtableRandomDeletion(int iterations) {
   for (int i = 0; i < iterations; i++) {
     keys[i] = rand() % 1000;
     sprintf(key, "key%d", keys[i]);
-    insertNodeIntoMemtable(key, "value");
+    insertNodeIntoMemtable(table, key, i + 1, "value");
   }
 
   // Deleting a subset of nodes randomly
   for (int i = 0; i < (iterations / 2); i++) {
     int randIndex = rand() % 100;
     sprintf(key, "key%d", keys[randIndex]);
-    deleteMemtableKey(key);
+    deleteMemtableKey(table, key, iterations + i + 1);
 
-    Node *result = searchMemtable(key);
+    Node *result = searchMemtable(table, key);
     assert(result == NULL);
   }
 
   // print2DMemtable();
 
-  printMemoryUsage();
+  printMemoryUsage(table);
   clock_t end = clock();
   double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
 
-  // clearMemtable();
+  unrefMemtable(table);
   printf("testMemtableRandomDeletion completed in %.2f seconds.\n", timeTaken);
 }
 
@@ -119,6 +129,259 @@ void testMemtableRandomDeletion(int iterations) {
  * ##########################
  */
 
+/*
+ * ######################
+ * SSTable test functions
+ * ######################
+ */
+
+/*
+ * void testSSTableWriteAndSearch(int iterations)
+ *   Tests the SSTable format by writing sorted entries, looking each one up
+ *   through the index and restart points and walking the whole table with an
+ *   iterator
+ * @param iterations: The number of entries to write
+ */
+void testSSTableWriteAndSearch(int iterations) {
+  const char *filepath = DIR_NAME "/test_sstable" TEMP_SUFFIX;
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+
+  clock_t start = clock();
+
+  // Zero padded keys are already in sorted order
+  SSTableBuilder *builder =
+      createSSTableBuilder(filepath, BLOOM_BITS_PER_KEY, 0);
+  assert(builder != NULL);
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "key%08d", i);
+    sprintf(value, "value%d", i);
+    assert(addToSSTable(builder, key, i + 1, value));
+  }
+  assert(finishSSTable(builder, NULL));
+
+  // Check both read paths, mapped and pread
+  for (int useMmap = 0; useMmap <= 1; useMmap++) {
+    SSTableReader *reader = openSSTableReader(filepath, useMmap);
+    assert(reader != NULL);
+    assert(useMmap == (reader->map != NULL));
+    assert(strcmp(reader->smallestKey, "key00000000") == 0);
+
+    // Every key is found, missing keys are not
+    for (int i = 0; i < iterations; i++) {
+      sprintf(key, "key%08d", i);
+      sprintf(value, "value%d", i);
+      char *result = searchSSTable(reader, key);
+      assert(result != NULL && strcmp(result, value) == 0);
+      free(result);
+    }
+    assert(searchSSTable(reader, "key") == NULL);
+    assert(searchSSTable(reader, "zzz") == NULL);
+    // Keys that sort between stored keys land inside a restart run
+    for (int i = 0; i < iterations; i += 7) {
+      sprintf(key, "key%08d~", i);
+      assert(searchSSTable(reader, key) == NULL);
+    }
+
+    // The iterator returns every entry in order
+    SSTableIterator iterator;
+    int count = 0;
+    for (initSSTableIterator(&iterator, reader); iterator.valid;
+         nextSSTableIterator(&iterator)) {
+      sprintf(key, "key%08d", count);
+      assert(strcmp(iterator.key, key) == 0);
+      count++;
+    }
+    freeSSTableIterator(&iterator);
+    assert(count == iterations);
+
+    if (useMmap) {
+      // Missing keys are mostly rejected by the Bloom filter alone
+      int falsePositives = 0;
+      for (int i = 0; i < iterations; i++) {
+        sprintf(key, "missing%d", i);
+        falsePositives += sstableMayContain(reader, key);
+      }
+      printf("Bloom filter false positives: %d of %d\n", falsePositives,
+             iterations);
+      printf("SSTable with %d entries has %d blocks, %llu bytes\n",
+             iterations, reader->blockCount,
+             (unsigned long long)reader->fileSize);
+    }
+    closeSSTableReader(reader);
+  }
+  remove(filepath);
+
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testSSTableWriteAndSearch completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * void testBlockCache(int iterations)
+ *   Tests the block cache by inserting more blocks than fit, checking that
+ *   recent blocks hit, old ones were evicted and pinned ones stay readable
+ * @param iterations: The number of blocks to insert
+ */
+void testBlockCache(int iterations) {
+  const size_t blockSize = 1024;
+  // Room for a quarter of the blocks
+  size_t capacity = (size_t)iterations / 4 * blockSize;
+  BlockCache *cache = createBlockCache(capacity);
+
+  clock_t start = clock();
+
+  // Keep the first block pinned through all the evictions
+  char *first = malloc(blockSize);
+  memset(first, 'x', blockSize);
+  CacheEntry *pinned = insertBlockCache(cache, 1, 0, first, blockSize);
+
+  for (int i = 1; i < iterations; i++) {
+    char *block = malloc(blockSize);
+    memset(block, 'a' + i % 26, blockSize);
+    releaseBlockCache(cache, insertBlockCache(cache, 1, i * blockSize, block,
+                                              blockSize));
+  }
+
+  long hits, misses;
+  size_t usage;
+  getBlockCacheStats(cache, &hits, &misses, &usage);
+  assert(usage <= capacity);
+  assert(pinned->data[blockSize - 1] == 'x');
+  releaseBlockCache(cache, pinned);
+
+  // The most recent blocks are still there, the oldest are gone
+  int recentHits = 0;
+  for (int i = iterations - iterations / 8; i < iterations; i++) {
+    CacheEntry *entry = lookupBlockCache(cache, 1, i * blockSize);
+    if (entry != NULL) {
+      assert(entry->data[0] == 'a' + i % 26);
+      recentHits++;
+      releaseBlockCache(cache, entry);
+    }
+  }
+  for (int i = 1; i < iterations / 8; i++) {
+    assert(lookupBlockCache(cache, 1, i * blockSize) == NULL);
+  }
+  // The same offset in another file is a different block
+  assert(lookupBlockCache(cache, 2, (iterations - 1) * blockSize) == NULL);
+
+  getBlockCacheStats(cache, &hits, &misses, &usage);
+  printf("Block cache kept %d of the %d most recent blocks, %ld hits, %ld "
+         "misses\n",
+         recentHits, iterations / 8, hits, misses);
+  freeBlockCache(cache);
+
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testBlockCache completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * void testRateLimiter(int iterations)
+ *   Tests the token bucket by requesting more bytes than its rate allows in
+ *   the time the requests take, and checking they were slowed down to it
+ * @param iterations: The number of 4KB requests
+ */
+void testRateLimiter(int iterations) {
+  int64_t bytesPerSecond = 16 * 1024 * 1024;
+  int64_t requestSize = 4 * 1024;
+  RateLimiter *limiter = createRateLimiter(bytesPerSecond);
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < iterations; i++) {
+    requestBytes(limiter, requestSize);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double timeTaken =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  // The bucket starts with one burst, the rest is paid at the rate
+  double burst = (double)bytesPerSecond / RATE_LIMITER_BURST_DIVISOR;
+  double expected =
+      ((double)iterations * requestSize - burst) / bytesPerSecond;
+  assert(timeTaken >= expected * 0.9);
+  freeRateLimiter(limiter);
+
+  printf("testRateLimiter completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * void testTableCache(int iterations)
+ *   Tests the table cache by writing more SSTables than it keeps open,
+ *   checking that every table is found, the oldest are closed and tables in
+ *   use stay readable
+ * @param iterations: The number of SSTables to write
+ */
+void testTableCache(int iterations) {
+  char filepath[MAX_PATH_LENGTH];
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  int maxOpenFiles = iterations / 4 > 0 ? iterations / 4 : 1;
+
+  clock_t start = clock();
+
+  // One single entry table per iteration
+  for (int i = 0; i < iterations; i++) {
+    snprintf(filepath, sizeof(filepath), DIR_NAME "/test_table_%d" TEMP_SUFFIX,
+             i);
+    SSTableBuilder *builder = createSSTableBuilder(filepath, 0, 0);
+    assert(builder != NULL);
+    sprintf(key, "key%d", i);
+    sprintf(value, "value%d", i);
+    assert(addToSSTable(builder, key, 1, value));
+    assert(finishSSTable(builder, NULL));
+  }
+
+  TableCache *cache = createTableCache(maxOpenFiles, 1, NULL);
+  snprintf(filepath, sizeof(filepath), DIR_NAME "/test_table_0" TEMP_SUFFIX);
+  TableHandle *pinned = findTable(cache, filepath);
+  assert(pinned != NULL);
+
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < iterations; i++) {
+      snprintf(filepath, sizeof(filepath),
+               DIR_NAME "/test_table_%d" TEMP_SUFFIX, i);
+      TableHandle *table = findTable(cache, filepath);
+      assert(table != NULL);
+      sprintf(key, "key%d", i);
+      sprintf(value, "value%d", i);
+      char *result = searchSSTable(table->reader, key);
+      assert(result != NULL && strcmp(result, value) == 0);
+      free(result);
+      releaseTable(cache, table);
+      assert(cache->tableCount <= maxOpenFiles);
+    }
+  }
+
+  // The pinned table was evicted but is still open for its user
+  char *result = searchSSTable(pinned->reader, "key0");
+  assert(result != NULL && strcmp(result, "value0") == 0);
+  free(result);
+  releaseTable(cache, pinned);
+  assert(findTable(cache, DIR_NAME "/missing_table" TEMP_SUFFIX) == NULL);
+
+  printf("Table cache kept %d of %d SSTables open\n", cache->tableCount,
+         iterations);
+  freeTableCache(cache);
+  for (int i = 0; i < iterations; i++) {
+    snprintf(filepath, sizeof(filepath), DIR_NAME "/test_table_%d" TEMP_SUFFIX,
+             i);
+    remove(filepath);
+  }
+
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testTableCache completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * ##########################
+ * END SSTable test functions
+ * ##########################
+ */
+
 /*
  * #############################
  * LSM system test functions
@@ -142,9 +405,10 @@ void testLSMInsertAndSearch(int iterations) {
     write(key, value);
     char *result = read(key);
     assert(strcmp(result, value) == 0);
+    free(result);
   }
 
-  printMemoryUsage();
+  printMemoryUsage(getActiveMemtable());
   clock_t end = clock();
   double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
 
@@ -173,7 +437,7 @@ void testLSMRandomInsert(int iterations) {
     write(key, value);
   }
 
-  printMemoryUsage();
+  printMemoryUsage(getActiveMemtable());
   clock_t end = clock();
   double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
 
@@ -201,9 +465,10 @@ void testLSMRandomSearch(int iterations) {
     sprintf(value, "value%d", randKey);
     char *result = read(key);
     assert(strcmp(result, value) == 0);
+    free(result);
   }
 
-  printMemoryUsage();
+  printMemoryUsage(getActiveMemtable());
   clock_t end = clock();
   double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
 
@@ -220,7 +485,8 @@ void testLSMRandomDeletion(int iterations) {
   printf("Starting LSM read test with %d iterations...\n", iterations);
   char key[MAX_KEY_LENGTH];
   char value[MAX_VALUE_LENGTH];
-  srand((unsigned)time(NULL)); // Seed random number generator
+  unsigned seed = (unsigned)time(NULL);
+  srand(seed); // Seed random number generator
 
   clock_t start = clock();
 
@@ -230,11 +496,20 @@ void testLSMRandomDeletion(int iterations) {
     sprintf(key, "key%d", randKey);
     sprintf(value, "value%d", randKey);
     delete (key);
-    // char *result = read(key);
-    // assert(result == NULL);
+    char *result = read(key);
+    assert(result == NULL);
+  }
+
+  // The deletions must still hide the keys once flushed to an SSTable
+  writeMemtableToSSTable();
+  srand(seed);
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "key%d", rand() % iterations);
+    char *result = read(key);
+    assert(result == NULL);
   }
 
-  printMemoryUsage();
+  printMemoryUsage(getActiveMemtable());
   clock_t end = clock();
   double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
 
@@ -242,6 +517,1561 @@ void testLSMRandomDeletion(int iterations) {
   printf("testLSMRandomDeletion completed in %.2f seconds.\n", timeTaken);
 }
 
+/*
+ * void testLSMReopen(int iterations)
+ *   Tests that flushed SSTables survive a restart by writing keys, flushing
+ *   them, then closing and reopening the system so the live SSTables are
+ *   rebuilt from the manifest, and that an SSTable the manifest does not
+ *   list is deleted at startup
+ * @param iterations: The number of keys to write
+ */
+void testLSMReopen(int iterations) {
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+
+  clock_t start = clock();
+
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "reopen%d", i);
+    sprintf(value, "value%d", i);
+    write(key, value);
+  }
+  // Reads after the restart must come from the SSTables
+  writeMemtableToSSTable();
+  closeSSTable();
+  initializeSSTable();
+
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "reopen%d", i);
+    sprintf(value, "value%d", i);
+    char *result = read(key);
+    assert(result != NULL && strcmp(result, value) == 0);
+    free(result);
+  }
+
+  // A table the manifest does not list, like the output of a compaction cut
+  // short, must be deleted rather than read as the newest table
+  char filepath[MAX_PATH_LENGTH];
+  tableFilePath(filepath, sizeof(filepath), DIR_NAME, 1000000000);
+  SSTableBuilder *builder = createSSTableBuilder(filepath, 0, 0);
+  assert(builder != NULL);
+  assert(addToSSTable(builder, "reopen0", 1, "stale"));
+  assert(finishSSTable(builder, NULL));
+  closeSSTable();
+  initializeSSTable();
+  char *result = read("reopen0");
+  assert(result != NULL && strcmp(result, "value0") == 0);
+  free(result);
+  assert(fopen(filepath, "rb") == NULL);
+
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMReopen completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * void testLSMRecovery(int iterations)
+ *   Tests that writes still in the memtable when the system stops are
+ *   replayed from the write-ahead log on the next start, with the newest
+ *   write of every key winning, even when the log ends in a torn record
+ * @param iterations: The number of keys to write
+ */
+void testLSMRecovery(int iterations) {
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+
+  clock_t start = clock();
+
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "recover%d", i);
+    sprintf(value, "value%d", i);
+    write(key, value);
+  }
+  // Newer writes of the same keys in the same log
+  for (int i = 0; i < iterations; i += 3) {
+    sprintf(key, "recover%d", i);
+    sprintf(value, "new%d", i);
+    write(key, value);
+  }
+  for (int i = 0; i < iterations; i += 5) {
+    sprintf(key, "recover%d", i);
+    delete (key);
+  }
+  closeSSTable();
+
+  // A record cut short by a crash at the end of the newest log
+  DIR *dir = opendir(DIR_NAME);
+  assert(dir != NULL);
+  long long newest = -1;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    long long number;
+    if (sscanf(entry->d_name, LOG_PREFIX "%lld", &number) == 1 &&
+        number > newest) {
+      newest = number;
+    }
+  }
+  closedir(dir);
+  assert(newest >= 0);
+  char filepath[MAX_PATH_LENGTH];
+  logFilePath(filepath, sizeof(filepath), DIR_NAME, newest);
+  FILE *file = fopen(filepath, "ab");
+  assert(file != NULL);
+  fwrite("\x12\x34\x56\x78\x40\x00", 1, 6, file);
+  fclose(file);
+
+  struct timespec openStart, openEnd;
+  clock_gettime(CLOCK_MONOTONIC, &openStart);
+  initializeSSTable();
+  clock_gettime(CLOCK_MONOTONIC, &openEnd);
+
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "recover%d", i);
+    char *result = read(key);
+    if (i % 5 == 0) {
+      assert(result == NULL);
+      continue;
+    }
+    if (i % 3 == 0) {
+      sprintf(value, "new%d", i);
+    } else {
+      sprintf(value, "value%d", i);
+    }
+    assert(result != NULL && strcmp(result, value) == 0);
+    free(result);
+  }
+
+  printf("Reopened in %.3f seconds\n",
+         (openEnd.tv_sec - openStart.tv_sec) +
+             (openEnd.tv_nsec - openStart.tv_nsec) / 1e9);
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMRecovery completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * static double compactionWorkload(const char *prefix, int iterations)
+ *   Writes every key over several rounds of small flushed tables, compacting
+ *   after each round, then deletes some keys and compacts again, and checks
+ *   that only the newest value of each key is left
+ * @param prefix: Prefix of the keys, so each run has its own
+ * @param iterations: The number of keys to write
+ * @return: The write amplification of the workload
+ */
+static double compactionWorkload(const char *prefix, int iterations) {
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  int rounds = 4;
+  uint64_t flushedBefore, compactedBefore, flushed, compacted;
+  getWriteStats(&flushedBefore, &compactedBefore);
+
+  // Round r rewrites every key divisible by r + 1, in small tables
+  for (int r = 0; r < rounds; r++) {
+    int written = 0;
+    for (int i = 0; i < iterations; i += r + 1) {
+      sprintf(key, "%s%d", prefix, i);
+      sprintf(value, "value%d_%d", r, i);
+      write(key, value);
+      if (++written % 2000 == 0) {
+        writeMemtableToSSTable();
+      }
+    }
+    writeMemtableToSSTable();
+    compactSSTables();
+  }
+  for (int i = 0; i < iterations; i += 7) {
+    sprintf(key, "%s%d", prefix, i);
+    delete (key);
+  }
+  writeMemtableToSSTable();
+  compactSSTables();
+
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "%s%d", prefix, i);
+    char *result = read(key);
+    if (i % 7 == 0) {
+      assert(result == NULL);
+      continue;
+    }
+    int r = rounds - 1;
+    while (i % (r + 1) != 0) {
+      r--;
+    }
+    sprintf(value, "value%d_%d", r, i);
+    assert(result != NULL && strcmp(result, value) == 0);
+    free(result);
+  }
+
+  getWriteStats(&flushed, &compacted);
+  flushed -= flushedBefore;
+  compacted -= compactedBefore;
+  return flushed > 0 ? (double)(flushed + compacted) / flushed : 0.0;
+}
+
+/*
+ * void testLSMCompaction(int iterations)
+ *   Tests that compaction keeps only the newest value of each key, with
+ *   small levels so the data spreads over several of them, then with the
+ *   tiered style, and prints the write amplification of both. Then checks
+ *   that flushes get level 0 compacted in the background
+ * @param iterations: The number of keys to write
+ */
+void testLSMCompaction(int iterations) {
+  clock_t start = clock();
+
+  setLevelSizeTargets(64 * 1024, 2);
+  double leveled = compactionWorkload("leveled", iterations);
+  assert(getLevelFileCount(0) < L0_COMPACTION_TRIGGER);
+  setLevelSizeTargets(LEVEL1_MAX_BYTES, LEVEL_SIZE_RATIO);
+
+  setCompactionStyle(COMPACTION_TIERED);
+  double tiered = compactionWorkload("tiered", iterations);
+  setCompactionStyle(COMPACTION_LEVELED);
+
+  // Flushes alone must get level 0 compacted by the background workers
+  char key[MAX_KEY_LENGTH];
+  for (int t = 0; t < 2 * L0_COMPACTION_TRIGGER; t++) {
+    sprintf(key, "background%d", t);
+    write(key, "value");
+    writeMemtableToSSTable();
+  }
+  struct timespec pause = {0, 10 * 1000 * 1000};
+  for (int wait = 0;
+       wait < 500 && getLevelFileCount(0) >= L0_COMPACTION_TRIGGER; wait++) {
+    nanosleep(&pause, NULL);
+  }
+  assert(getLevelFileCount(0) < L0_COMPACTION_TRIGGER);
+
+  printf("Write amplification: %.2f leveled, %.2f tiered\n", leveled, tiered);
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMCompaction completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * void testLSMSubcompaction(int iterations)
+ *   Tests that a merge split into key ranges keeps the same data as one
+ *   merged on a single thread, and compares how long both take
+ * @param iterations: The number of keys to write
+ */
+void testLSMSubcompaction(int iterations) {
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  int settings[2] = {1, MAX_SUBCOMPACTIONS};
+  double seconds[2];
+
+  clock_t start = clock();
+
+  setCompactionRateLimit(0);
+  for (int pass = 0; pass < 2; pass++) {
+    setMaxSubcompactions(settings[pass]);
+    clearSSTables();
+    clearMemtable();
+    // Every table spans the whole key range, so no split is a trivial one
+    for (int t = 0; t < L0_COMPACTION_TRIGGER - 1; t++) {
+      for (int i = t; i < iterations; i += L0_COMPACTION_TRIGGER - 1) {
+        sprintf(key, "subcompaction%d", i);
+        sprintf(value, "value%d_%d", pass, i);
+        write(key, value);
+      }
+      writeMemtableToSSTable();
+    }
+    for (int i = 0; i < iterations; i += 7) {
+      sprintf(key, "subcompaction%d", i);
+      delete (key);
+    }
+
+    // The last flush reaches the level 0 trigger
+    struct timespec mergeStart, mergeEnd;
+    clock_gettime(CLOCK_MONOTONIC, &mergeStart);
+    writeMemtableToSSTable();
+    compactSSTables();
+    clock_gettime(CLOCK_MONOTONIC, &mergeEnd);
+    seconds[pass] = (mergeEnd.tv_sec - mergeStart.tv_sec) +
+                    (mergeEnd.tv_nsec - mergeStart.tv_nsec) / 1e9;
+    assert(getLevelFileCount(0) < L0_COMPACTION_TRIGGER);
+
+    for (int i = 0; i < iterations; i++) {
+      sprintf(key, "subcompaction%d", i);
+      char *result = read(key);
+      if (i % 7 == 0) {
+        assert(result == NULL);
+        continue;
+      }
+      sprintf(value, "value%d_%d", pass, i);
+      assert(result != NULL && strcmp(result, value) == 0);
+      free(result);
+    }
+  }
+  setMaxSubcompactions(MAX_SUBCOMPACTIONS);
+  setCompactionRateLimit(COMPACTION_RATE_LIMIT);
+
+  printf("Merge took %.3f seconds on one thread, %.3f seconds split into up "
+         "to %d key ranges\n",
+         seconds[0], seconds[1], MAX_SUBCOMPACTIONS);
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMSubcompaction completed in %.2f seconds.\n", timeTaken);
+}
+
+// Keys written by one thread of testLSMWriteAheadLog
+typedef struct {
+  const char *prefix;
+  int thread;
+  int count;
+} LogWriterArgs;
+
+/*
+ * static void *logWriter(void *arg)
+ *   Writes count keys of its own, queued with the other writer threads
+ * @param arg: The LogWriterArgs of the thread
+ */
+static void *logWriter(void *arg) {
+  LogWriterArgs *args = arg;
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  for (int i = 0; i < args->count; i++) {
+    sprintf(key, "%s%d_%d", args->prefix, args->thread, i);
+    sprintf(value, "value%d", i);
+    assert(write(key, value));
+  }
+  return NULL;
+}
+
+/*
+ * void testLSMWriteAheadLog(int iterations)
+ *   Tests concurrent writers under every log sync mode: each write must be
+ *   committed, logged once and readable afterwards, and writers arriving
+ *   together must share group commits. Prints the time and group size of
+ *   each mode
+ * @param iterations: The number of keys to write per mode
+ */
+void testLSMWriteAheadLog(int iterations) {
+  const int threadCount = 8;
+  int modes[3] = {WAL_SYNC_ALWAYS, WAL_SYNC_INTERVAL, WAL_SYNC_NEVER};
+  const char *prefixes[3] = {"walalways", "walinterval", "walnever"};
+  pthread_t threads[threadCount];
+  LogWriterArgs args[threadCount];
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+
+  clock_t start = clock();
+
+  for (int m = 0; m < 3; m++) {
+    setLogSyncMode(modes[m], WAL_SYNC_INTERVAL_MS);
+    long recordsBefore, commitsBefore, syncsBefore;
+    getLogStats(&recordsBefore, &commitsBefore, &syncsBefore);
+    struct timespec writeStart, writeEnd;
+    clock_gettime(CLOCK_MONOTONIC, &writeStart);
+    for (int t = 0; t < threadCount; t++) {
+      args[t].prefix = prefixes[m];
+      args[t].thread = t;
+      args[t].count = iterations / threadCount;
+      assert(pthread_create(&threads[t], NULL, logWriter, &args[t]) == 0);
+    }
+    for (int t = 0; t < threadCount; t++) {
+      pthread_join(threads[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &writeEnd);
+    long records, commits, syncs;
+    getLogStats(&records, &commits, &syncs);
+    records -= recordsBefore;
+    commits -= commitsBefore;
+    syncs -= syncsBefore;
+
+    assert(records == (long)threadCount * (iterations / threadCount));
+    assert(commits > 0 && commits <= records);
+    if (modes[m] == WAL_SYNC_ALWAYS) {
+      // Frozen memtables may add a sync of their own
+      assert(syncs >= commits);
+    } else if (modes[m] == WAL_SYNC_NEVER) {
+      assert(syncs == 0);
+    }
+    for (int t = 0; t < threadCount; t++) {
+      for (int i = 0; i < iterations / threadCount; i++) {
+        sprintf(key, "%s%d_%d", prefixes[m], t, i);
+        sprintf(value, "value%d", i);
+        char *result = read(key);
+        assert(result != NULL && strcmp(result, value) == 0);
+        free(result);
+      }
+    }
+    double seconds = (writeEnd.tv_sec - writeStart.tv_sec) +
+                     (writeEnd.tv_nsec - writeStart.tv_nsec) / 1e9;
+    printf("Sync %s: %ld writes in %.3f seconds, %.1f writes per group "
+           "commit, %ld syncs\n",
+           prefixes[m] + 3, records, seconds, (double)records / commits,
+           syncs);
+  }
+  setLogSyncMode(WAL_SYNC_INTERVAL, WAL_SYNC_INTERVAL_MS);
+
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMWriteAheadLog completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * void testLSMPinnedRead(int iterations)
+ *   Tests reading values in place from the memtable, mapped SSTables and
+ *   the block cache, and that a pinned value outlives the tables being
+ *   closed
+ * @param iterations: The number of keys to write
+ */
+void testLSMPinnedRead(int iterations) {
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  PinnedValue pinned;
+
+  clock_t start = clock();
+
+  // The first half ends up in an SSTable, the second half in the memtable
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "pinned%d", i);
+    sprintf(value, "value%d", i);
+    write(key, value);
+    if (i == iterations / 2) {
+      writeMemtableToSSTable();
+    }
+  }
+
+  // Check both read paths, pread through the block cache and mapped
+  for (int useMmap = 0; useMmap <= 1; useMmap++) {
+    setMmapReads(useMmap);
+    for (int i = 0; i < iterations; i++) {
+      sprintf(key, "pinned%d", i);
+      sprintf(value, "value%d", i);
+      assert(readPinned(key, &pinned));
+      assert(pinned.size == strlen(value));
+      assert(memcmp(pinned.data, value, pinned.size) == 0);
+      releasePinnedValue(&pinned);
+    }
+  }
+  assert(!readPinned("pinned~", &pinned));
+  releasePinnedValue(&pinned);
+
+  // Closing every table does not invalidate a value still pinned
+  assert(readPinned("pinned0", &pinned));
+  setMmapReads(1);
+  assert(pinned.size == strlen("value0"));
+  assert(memcmp(pinned.data, "value0", pinned.size) == 0);
+  releasePinnedValue(&pinned);
+
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMPinnedRead completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * static void *snapshotWriter(void *arg)
+ *   Overwrites every key written by testLSMSnapshot, deleting every fifth,
+ *   then compacts, while the test reads through its snapshot.
+ * @param arg: The number of keys
+ */
+static void *snapshotWriter(void *arg) {
+  int count = *(int *)arg;
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  for (int i = 0; i < count; i++) {
+    sprintf(key, "snap%d", i);
+    if (i % 5 == 0) {
+      delete (key);
+    } else {
+      sprintf(value, "new%d", i);
+      write(key, value);
+    }
+  }
+  compactSSTables();
+  return NULL;
+}
+
+/*
+ * static void checkSnapshotReads(const Snapshot *snapshot, int count,
+ *                                int latest)
+ *   Reads every key written by testLSMSnapshot through a snapshot, which
+ *   must see the first values, or without one, which must see the
+ *   overwrites and deletions if latest is set.
+ */
+static void checkSnapshotReads(const Snapshot *snapshot, int count,
+                               int latest) {
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  for (int i = 0; i < count; i++) {
+    sprintf(key, "snap%d", i);
+    char *result = readAt(key, snapshot);
+    if (latest && i % 5 == 0) {
+      assert(result == NULL);
+      continue;
+    }
+    sprintf(value, latest ? "new%d" : "old%d", i);
+    assert(result != NULL && strcmp(result, value) == 0);
+    free(result);
+  }
+}
+
+/*
+ * void testLSMSnapshot(int iterations)
+ *   Tests that a snapshot keeps seeing the values written before it while
+ *   another thread overwrites and deletes them, through memtable flushes and
+ *   compactions, and that newer reads see the new values
+ * @param iterations: The number of keys to write
+ */
+void testLSMSnapshot(int iterations) {
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+
+  clock_t start = clock();
+
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "snap%d", i);
+    sprintf(value, "old%d", i);
+    write(key, value);
+  }
+  const Snapshot *snapshot = getSnapshot();
+  uint64_t sequence = getLastSequence();
+  assert(snapshot->sequence == sequence);
+
+  // Reads through the snapshot neither wait for the writer nor see it
+  pthread_t writer;
+  assert(pthread_create(&writer, NULL, snapshotWriter, &iterations) == 0);
+  checkSnapshotReads(snapshot, iterations, 0);
+  pthread_join(writer, NULL);
+  assert(getLastSequence() == sequence + iterations);
+  checkSnapshotReads(snapshot, iterations, 0);
+  checkSnapshotReads(NULL, iterations, 1);
+
+  // Every version the snapshot needs survives a flush and compaction
+  writeMemtableToSSTable();
+  compactSSTables();
+  checkSnapshotReads(snapshot, iterations, 0);
+  checkSnapshotReads(NULL, iterations, 1);
+
+  // Once released, compactions drop the old values
+  releaseSnapshot(snapshot);
+  compactSSTables();
+  checkSnapshotReads(NULL, iterations, 1);
+
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMSnapshot completed in %.2f seconds.\n", timeTaken);
+}
+
+// Keys written together by every batch of testLSMWriteBatch
+#define TEST_BATCH_KEYS 100
+
+// Set once testLSMWriteBatch has applied its last batch
+static atomic_int batchWritesDone = 0;
+
+/*
+ * static void *batchReader(void *arg)
+ *   Reads the keys of testLSMWriteBatch through snapshots while batches are
+ *   applied, and checks every snapshot sees all of a batch or none of it.
+ * @param arg: Unused
+ */
+static void *batchReader(void *arg) {
+  char key[MAX_KEY_LENGTH];
+  while (!atomic_load(&batchWritesDone)) {
+    const Snapshot *snapshot = getSnapshot();
+    char *first = readAt("batch0", snapshot);
+    for (int i = 1; i < TEST_BATCH_KEYS; i++) {
+      sprintf(key, "batch%d", i);
+      char *result = readAt(key, snapshot);
+      assert((first == NULL) == (result == NULL));
+      assert(first == NULL || strcmp(first, result) == 0);
+      free(result);
+    }
+    free(first);
+    releaseSnapshot(snapshot);
+  }
+  return NULL;
+}
+
+/*
+ * void testLSMWriteBatch(int iterations)
+ *   Tests that batches are applied atomically while another thread reads
+ *   them, survive a restart through the log, and compares writing keys one
+ *   at a time with writing them in batches
+ * @param iterations: The number of keys to write
+ */
+void testLSMWriteBatch(int iterations) {
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  int rounds = iterations / TEST_BATCH_KEYS;
+
+  clock_t start = clock();
+
+  // Every batch overwrites the same keys, readers must never mix two
+  WriteBatch *batch = createWriteBatch();
+  pthread_t reader;
+  atomic_store(&batchWritesDone, 0);
+  assert(pthread_create(&reader, NULL, batchReader, NULL) == 0);
+  for (int round = 0; round < rounds; round++) {
+    clearWriteBatch(batch);
+    sprintf(value, "round%d", round);
+    for (int i = 0; i < TEST_BATCH_KEYS; i++) {
+      sprintf(key, "batch%d", i);
+      assert(addToWriteBatch(batch, key, value));
+    }
+    assert(applyWriteBatch(batch));
+  }
+  atomic_store(&batchWritesDone, 1);
+  pthread_join(reader, NULL);
+
+  // A later entry of a key wins over an earlier one of the same batch
+  clearWriteBatch(batch);
+  assert(addToWriteBatch(batch, "batch0", "first"));
+  assert(addToWriteBatch(batch, "batch0", NULL));
+  assert(addToWriteBatch(batch, "batch1", NULL));
+  assert(addToWriteBatch(batch, "batch1", "last"));
+  assert(!addToWriteBatch(batch, NULL, "rejected"));
+  assert(batch->count == 4);
+  uint64_t sequence = getLastSequence();
+  assert(applyWriteBatch(batch));
+  assert(getLastSequence() == sequence + 4);
+
+  // The batch is replayed from the log after a restart
+  closeSSTable();
+  initializeSSTable();
+  assert(read("batch0") == NULL);
+  char *result = read("batch1");
+  assert(result != NULL && strcmp(result, "last") == 0);
+  free(result);
+  sprintf(value, "round%d", rounds - 1);
+  for (int i = 2; rounds > 0 && i < TEST_BATCH_KEYS; i++) {
+    sprintf(key, "batch%d", i);
+    result = read(key);
+    assert(result != NULL && strcmp(result, value) == 0);
+    free(result);
+  }
+
+  // The same keys written one at a time, then in batches
+  struct timespec single, batched, end;
+  clock_gettime(CLOCK_MONOTONIC, &single);
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "single%d", i);
+    sprintf(value, "value%d", i);
+    write(key, value);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &batched);
+  clearWriteBatch(batch);
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "batched%d", i);
+    sprintf(value, "value%d", i);
+    assert(addToWriteBatch(batch, key, value));
+    if (batch->count == TEST_BATCH_KEYS || i == iterations - 1) {
+      applyWriteBatch(batch);
+      clearWriteBatch(batch);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "batched%d", i);
+    sprintf(value, "value%d", i);
+    result = read(key);
+    assert(result != NULL && strcmp(result, value) == 0);
+    free(result);
+  }
+  freeWriteBatch(batch);
+
+  printf("Wrote %d keys one at a time in %.3f seconds, in batches of %d in "
+         "%.3f seconds\n",
+         iterations,
+         (batched.tv_sec - single.tv_sec) +
+             (batched.tv_nsec - single.tv_nsec) / 1e9,
+         TEST_BATCH_KEYS,
+         (end.tv_sec - batched.tv_sec) + (end.tv_nsec - batched.tv_nsec) / 1e9);
+  clock_t stop = clock();
+  double timeTaken = ((double)(stop - start)) / CLOCKS_PER_SEC;
+  printf("testLSMWriteBatch completed in %.2f seconds.\n", timeTaken);
+}
+
+// Keys read together by every multiGet of testLSMMultiGet
+#define TEST_MULTIGET_KEYS 100
+
+/*
+ * static void checkMultiGet(char **keys, int count, const Snapshot *snapshot)
+ *   Reads keys with multiGetAt and checks every value matches readAt.
+ */
+static void checkMultiGet(char **keys, int count, const Snapshot *snapshot) {
+  char **values = malloc(count * sizeof(char *));
+  assert(values != NULL);
+  int found = multiGetAt(keys, count, snapshot, values);
+  for (int i = 0; i < count; i++) {
+    char *expected = readAt(keys[i], snapshot);
+    assert((expected == NULL) == (values[i] == NULL));
+    assert(expected == NULL || strcmp(expected, values[i]) == 0);
+    found -= expected != NULL;
+    free(expected);
+    free(values[i]);
+  }
+  assert(found == 0);
+  free(values);
+}
+
+/*
+ * void testLSMMultiGet(int iterations)
+ *   Tests that multiGet returns the same values as read for keys in random
+ *   order, spread over the memtable and the SSTables, deleted, missing or
+ *   repeated, also at a snapshot, and compares its speed with single reads
+ * @param iterations: The number of keys to write
+ */
+void testLSMMultiGet(int iterations) {
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+
+  srand(time(NULL));
+
+  clock_t start = clock();
+
+  // Older values in SSTables, newer ones and deletions in the memtable
+  for (int i = 0; i < iterations; i++) {
+    sprintf(key, "multi%d", i);
+    sprintf(value, "old%d", i);
+    write(key, value);
+  }
+  writeMemtableToSSTable();
+  compactSSTables();
+  for (int i = 0; i < iterations; i += 3) {
+    sprintf(key, "multi%d", i);
+    sprintf(value, "new%d", i);
+    write(key, value);
+  }
+  for (int i = 0; i < iterations; i += 7) {
+    sprintf(key, "multi%d", i);
+    delete (key);
+  }
+
+  // Keys in random order, some never written, some asked for twice
+  char **keys = malloc(iterations * sizeof(char *));
+  assert(keys != NULL);
+  for (int i = 0; i < iterations; i++) {
+    keys[i] = malloc(MAX_KEY_LENGTH);
+    assert(keys[i] != NULL);
+    sprintf(keys[i], "multi%d", rand() % (iterations + iterations / 10));
+  }
+  for (int i = 0; i < iterations; i += TEST_MULTIGET_KEYS) {
+    int count = iterations - i < TEST_MULTIGET_KEYS ? iterations - i
+                                                    : TEST_MULTIGET_KEYS;
+    checkMultiGet(keys + i, count, NULL);
+  }
+
+  // A snapshot keeps its values while the keys are overwritten
+  const Snapshot *snapshot = getSnapshot();
+  for (int i = 0; i < iterations; i += 2) {
+    sprintf(key, "multi%d", i);
+    sprintf(value, "newer%d", i);
+    write(key, value);
+  }
+  checkMultiGet(keys, iterations, snapshot);
+  checkMultiGet(keys, iterations, NULL);
+  releaseSnapshot(snapshot);
+
+  // The same keys read one at a time, then in batches
+  struct timespec single, batched, end;
+  clock_gettime(CLOCK_MONOTONIC, &single);
+  for (int i = 0; i < iterations; i++) {
+    free(read(keys[i]));
+  }
+  clock_gettime(CLOCK_MONOTONIC, &batched);
+  char *values[TEST_MULTIGET_KEYS];
+  for (int i = 0; i < iterations; i += TEST_MULTIGET_KEYS) {
+    int count = iterations - i < TEST_MULTIGET_KEYS ? iterations - i
+                                                    : TEST_MULTIGET_KEYS;
+    multiGet(keys + i, count, values);
+    for (int j = 0; j < count; j++) {
+      free(values[j]);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  for (int i = 0; i < iterations; i++) {
+    free(keys[i]);
+  }
+  free(keys);
+  printf("Read %d keys one at a time in %.3f seconds, in batches of %d in "
+         "%.3f seconds\n",
+         iterations,
+         (batched.tv_sec - single.tv_sec) +
+             (batched.tv_nsec - single.tv_nsec) / 1e9,
+         TEST_MULTIGET_KEYS,
+         (end.tv_sec - batched.tv_sec) + (end.tv_nsec - batched.tv_nsec) / 1e9);
+  clock_t stop = clock();
+  double timeTaken = ((double)(stop - start)) / CLOCKS_PER_SEC;
+  printf("testLSMMultiGet completed in %.2f seconds.\n", timeTaken);
+}
+
+/*
+ * static int atIteratorKey(Iterator *iterator)
+ *   Checks an iterator is at one of the keys of testLSMIterator rather than
+ *   past them, at keys of other tests.
+ */
+static int atIteratorKey(Iterator *iterator) {
+  return iteratorValid(iterator) &&
+         strncmp(iteratorKey(iterator), "iter", 4) == 0;
+}
+
+/*
+ * static void checkIteratorAt(Iterator *iterator, char **expected,
+ *                             int count, int index)
+ *   Checks an iterator is at the key index of testLSMIterator with its
+ *   expected value, or past the end if index is out of range.
+ */
+static void checkIteratorAt(Iterator *iterator, char **expected, int count,
+                            int index) {
+  char key[MAX_KEY_LENGTH];
+  if (index < 0 || index >= count) {
+    assert(!atIteratorKey(iterator));
+    return;
+  }
+  assert(atIteratorKey(iterator));
+  sprintf(key, "iter%06d", index);
+  assert(strcmp(iteratorKey(iterator), key) == 0);
+  size_t size;
+  const char *value = iteratorValue(iterator, &size);
+  assert(size == strlen(expected[index]) &&
+         memcmp(value, expected[index], size) == 0);
+}
+
+/*
+ * static void checkIterator(Iterator *iterator, char **expected, int count)
+ *   Scans every key of testLSMIterator forward and backward, seeks to random
+ *   keys and takes random steps, checking each position against the
+ *   expected values, NULL for the deleted keys.
+ */
+static void checkIterator(Iterator *iterator, char **expected, int count) {
+  char key[MAX_KEY_LENGTH];
+  // Live key after or at each index, and before or at it
+  int *nextLive = malloc((count + 1) * sizeof(int));
+  int *prevLive = malloc((count + 1) * sizeof(int));
+  assert(nextLive != NULL && prevLive != NULL);
+  nextLive[count] = count;
+  for (int i = count - 1; i >= 0; i--) {
+    nextLive[i] = expected[i] != NULL ? i : nextLive[i + 1];
+  }
+  for (int i = 0; i < count; i++) {
+    prevLive[i] = expected[i] != NULL ? i : (i > 0 ? prevLive[i - 1] : -1);
+  }
+
+  int index = nextLive[0];
+  for (seekIterator(iterator, "iter"); atIteratorKey(iterator);
+       nextIterator(iterator)) {
+    checkIteratorAt(iterator, expected, count, index);
+    index = nextLive[index + 1];
+  }
+  assert(index == count);
+  // Every key of the test sorts before "iter:", the last one is before it
+  seekIterator(iterator, "iter:");
+  if (iteratorValid(iterator)) {
+    prevIterator(iterator);
+  } else {
+    seekIteratorToLast(iterator);
+  }
+  index = count > 0 ? prevLive[count - 1] : -1;
+  for (; atIteratorKey(iterator); prevIterator(iterator)) {
+    checkIteratorAt(iterator, expected, count, index);
+    index = index > 0 ? prevLive[index - 1] : -1;
+  }
+  assert(index == -1);
+
+  // Seeks followed by steps both ways, turning around at random
+  for (int i = 0; i < 100; i++) {
+    int target = rand() % (count + 1);
+    sprintf(key, "iter%06d", target);
+    seekIterator(iterator, key);
+    index = target < count ? nextLive[target] : count;
+    checkIteratorAt(iterator, expected, count, index);
+    for (int step = 0; step < 20 && atIteratorKey(iterator); step++) {
+      if (rand() % 2 == 0) {
+        nextIterator(iterator);
+        index = nextLive[index + 1];
+      } else {
+        prevIterator(iterator);
+        index = index > 0 ? prevLive[index - 1] : -1;
+      }
+      checkIteratorAt(iterator, expected, count, index);
+    }
+  }
+  free(nextLive);
+  free(prevLive);
+}
+
+/*
+ * static void setIteratorKey(char **expected, int index, const char *value)
+ *   Writes or deletes a key of testLSMIterator and records what a scan must
+ *   see.
+ */
+static void setIteratorKey(char **expected, int index, const char *value) {
+  char key[MAX_KEY_LENGTH];
+  sprintf(key, "iter%06d", index);
+  free(expected[index]);
+  if (value != NULL) {
+    write(key, (char *)value);
+    expected[index] = strdup(value);
+  } else {
+    delete (key);
+    expected[index] = NULL;
+  }
+}
+
+/*
+ * void testLSMIterator(int iterations)
+ *   Tests iterators over keys whose versions are spread over deeper levels,
+ *   level 0 and the memtable, with deletions hiding older values: full
+ *   scans both ways, seeks and random steps must match the expected data,
+ *   and an iterator at a snapshot keeps seeing the data as of the snapshot
+ * @param iterations: The number of keys to write
+ */
+void testLSMIterator(int iterations) {
+  char value[MAX_VALUE_LENGTH];
+  char **expected = calloc(iterations, sizeof(char *));
+  char **before = malloc(iterations * sizeof(char *));
+  assert(expected != NULL && before != NULL);
+
+  srand(time(NULL));
+
+  clock_t start = clock();
+
+  // Keys left by an earlier run would show up in the scans
+  Iterator *iterator = createIterator(NULL);
+  for (seekIterator(iterator, "iter"); atIteratorKey(iterator);
+       nextIterator(iterator)) {
+    delete ((char *)iteratorKey(iterator));
+  }
+  freeIterator(iterator);
+
+  // Oldest versions compacted into the deeper levels
+  for (int i = 0; i < iterations; i++) {
+    sprintf(value, "old%d", i);
+    setIteratorKey(expected, i, value);
+  }
+  writeMemtableToSSTable();
+  compactSSTables();
+  // Newer versions and deletions in level 0
+  for (int i = 0; i < iterations; i += 3) {
+    sprintf(value, "level0-%d", i);
+    setIteratorKey(expected, i, value);
+  }
+  for (int i = 0; i < iterations; i += 5) {
+    setIteratorKey(expected, i, NULL);
+  }
+  writeMemtableToSSTable();
+  // Newest ones in the memtable, some bringing deleted keys back
+  for (int i = 0; i < iterations; i += 4) {
+    sprintf(value, "memtable%d", i);
+    setIteratorKey(expected, i, value);
+  }
+  for (int i = 0; i < iterations; i += 11) {
+    setIteratorKey(expected, i, NULL);
+  }
+
+  iterator = createIterator(NULL);
+  checkIterator(iterator, expected, iterations);
+
+  // Neither the iterator nor a snapshot see writes made after them
+  const Snapshot *snapshot = getSnapshot();
+  for (int i = 0; i < iterations; i++) {
+    before[i] = expected[i] != NULL ? strdup(expected[i]) : NULL;
+  }
+  for (int i = 0; i < iterations; i += 2) {
+    sprintf(value, "newest%d", i);
+    setIteratorKey(expected, i, value);
+  }
+  for (int i = 1; i < iterations; i += 6) {
+    setIteratorKey(expected, i, NULL);
+  }
+  writeMemtableToSSTable();
+  compactSSTables();
+  checkIterator(iterator, before, iterations);
+  freeIterator(iterator);
+  iterator = createIterator(snapshot);
+  checkIterator(iterator, before, iterations);
+  freeIterator(iterator);
+  releaseSnapshot(snapshot);
+  iterator = createIterator(NULL);
+  checkIterator(iterator, expected, iterations);
+  freeIterator(iterator);
+  // Blocks read with pread rather than mapped
+  setMmapReads(0);
+  iterator = createIterator(NULL);
+  checkIterator(iterator, expected, iterations);
+  freeIterator(iterator);
+  setMmapReads(1);
+
+  // A full scan streams every key in order
+  struct timespec scanStart, scanEnd;
+  clock_gettime(CLOCK_MONOTONIC, &scanStart);
+  long scanned = 0;
+  iterator = createIterator(NULL);
+  for (seekIteratorToFirst(iterator); iteratorValid(iterator);
+       nextIterator(iterator)) {
+    scanned++;
+  }
+  freeIterator(iterator);
+  clock_gettime(CLOCK_MONOTONIC, &scanEnd);
+
+  for (int i = 0; i < iterations; i++) {
+    free(expected[i]);
+    free(before[i]);
+  }
+  free(expected);
+  free(before);
+  printf("Scanned %ld keys in %.3f seconds\n", scanned,
+         (scanEnd.tv_sec - scanStart.tv_sec) +
+             (scanEnd.tv_nsec - scanStart.tv_nsec) / 1e9);
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMIterator completed in %.2f seconds.\n", timeTaken);
+}
+
+// Prefixes the keys of testLSMPrefixScan are spread over
+#define TEST_PREFIX_GROUPS 100
+
+/*
+ * static void checkPrefixScan(Iterator *iterator, char **expected, int count,
+ *                             int group)
+ *   Checks that a prefix iterator returns exactly the live keys of a group
+ *   of testLSMPrefixScan with their values, forward and backward.
+ */
+static void checkPrefixScan(Iterator *iterator, char **expected, int count,
+                            int group) {
+  char key[MAX_KEY_LENGTH];
+  size_t size;
+
+  int index = group;
+  for (seekIteratorToFirst(iterator); iteratorValid(iterator);
+       nextIterator(iterator)) {
+    while (index < count && expected[index] == NULL) {
+      index += TEST_PREFIX_GROUPS;
+    }
+    assert(index < count);
+    sprintf(key, "pfx%03d:%06d", group, index);
+    const char *value = iteratorValue(iterator, &size);
+    assert(strcmp(iteratorKey(iterator), key) == 0);
+    assert(size == strlen(expected[index]) &&
+           memcmp(value, expected[index], size) == 0);
+    index += TEST_PREFIX_GROUPS;
+  }
+  while (index < count && expected[index] == NULL) {
+    index += TEST_PREFIX_GROUPS;
+  }
+  assert(index >= count);
+
+  // Last index of the group
+  index = group + (count - 1 - group) / TEST_PREFIX_GROUPS *
+                      TEST_PREFIX_GROUPS;
+  for (seekIteratorToLast(iterator); iteratorValid(iterator);
+       prevIterator(iterator)) {
+    while (index >= 0 && expected[index] == NULL) {
+      index -= TEST_PREFIX_GROUPS;
+    }
+    assert(index >= 0);
+    sprintf(key, "pfx%03d:%06d", group, index);
+    assert(strcmp(iteratorKey(iterator), key) == 0);
+    index -= TEST_PREFIX_GROUPS;
+  }
+  while (index >= 0 && expected[index] == NULL) {
+    index -= TEST_PREFIX_GROUPS;
+  }
+  assert(index < 0);
+}
+
+/*
+ * void testLSMPrefixScan(int iterations)
+ *   Tests prefix iterators over keys spread over TEST_PREFIX_GROUPS
+ *   prefixes, in deeper levels, level 0 and the memtable: each must return
+ *   exactly the live keys of its prefix, and the prefix filter of an SSTable
+ *   must keep every prefix it holds and rule out most others
+ * @param iterations: The number of keys to write
+ */
+void testLSMPrefixScan(int iterations) {
+  const char *filepath = DIR_NAME "/test_prefix" TEMP_SUFFIX;
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  char prefix[MAX_KEY_LENGTH];
+  char **expected = calloc(iterations, sizeof(char *));
+  assert(expected != NULL);
+
+  clock_t start = clock();
+
+  // "pfx" and three digits
+  setPrefixLength(6);
+
+  // Keys left by an earlier run would show up in the scans
+  Iterator *iterator = createPrefixIterator("pfx", NULL);
+  for (seekIteratorToFirst(iterator); iteratorValid(iterator);
+       nextIterator(iterator)) {
+    delete ((char *)iteratorKey(iterator));
+  }
+  freeIterator(iterator);
+
+  // The first half of the prefixes compacted into the deeper levels, the
+  // other half in level 0, deletions and newer values in the memtable
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < iterations; i++) {
+      int group = i % TEST_PREFIX_GROUPS;
+      if ((group < TEST_PREFIX_GROUPS / 2) == (pass == 0)) {
+        sprintf(key, "pfx%03d:%06d", group, i);
+        sprintf(value, "value%d", i);
+        write(key, value);
+        expected[i] = strdup(value);
+      }
+    }
+    writeMemtableToSSTable();
+    if (pass == 0) {
+      compactSSTables();
+    }
+  }
+  for (int i = 0; i < iterations; i += 7) {
+    sprintf(key, "pfx%03d:%06d", i % TEST_PREFIX_GROUPS, i);
+    delete (key);
+    free(expected[i]);
+    expected[i] = NULL;
+  }
+  for (int i = 0; i < iterations; i += 5) {
+    sprintf(key, "pfx%03d:%06d", i % TEST_PREFIX_GROUPS, i);
+    sprintf(value, "newer%d", i);
+    write(key, value);
+    free(expected[i]);
+    expected[i] = strdup(value);
+  }
+
+  for (int useMmap = 1; useMmap >= 0; useMmap--) {
+    setMmapReads(useMmap);
+    for (int group = 0; group < TEST_PREFIX_GROUPS; group++) {
+      sprintf(prefix, "pfx%03d", group);
+      iterator = createPrefixIterator(prefix, NULL);
+      checkPrefixScan(iterator, expected, iterations, group);
+      // Keys before the prefix seek to its first key, keys past it to none
+      seekIterator(iterator, "pfx");
+      assert(!iteratorValid(iterator) ||
+             strncmp(iteratorKey(iterator), prefix, 6) == 0);
+      seekIterator(iterator, "pfx~");
+      assert(!iteratorValid(iterator));
+      freeIterator(iterator);
+    }
+  }
+  setMmapReads(1);
+  // A prefix no key has, and one shorter than the filtered prefixes
+  iterator = createPrefixIterator("pfx999", NULL);
+  seekIteratorToFirst(iterator);
+  assert(!iteratorValid(iterator));
+  seekIteratorToLast(iterator);
+  assert(!iteratorValid(iterator));
+  freeIterator(iterator);
+  int live = 0;
+  for (int i = 0; i < iterations; i++) {
+    live += expected[i] != NULL;
+  }
+  iterator = createPrefixIterator("pfx", NULL);
+  for (seekIteratorToFirst(iterator); iteratorValid(iterator);
+       nextIterator(iterator)) {
+    live--;
+  }
+  freeIterator(iterator);
+  assert(live == 0);
+
+  // An SSTable holding the even prefixes only, with and without key filters
+  int bitsPerKey[2] = {BLOOM_BITS_PER_KEY, 0};
+  for (int b = 0; b < 2; b++) {
+    SSTableBuilder *builder = createSSTableBuilder(filepath, bitsPerKey[b], 6);
+    assert(builder != NULL);
+    for (int group = 0; group < TEST_PREFIX_GROUPS; group += 2) {
+      for (int i = 0; i < 10; i++) {
+        sprintf(key, "pfx%03d:%06d", group, i);
+        assert(addToSSTable(builder, key, i + 1, "value"));
+      }
+    }
+    assert(finishSSTable(builder, NULL));
+    SSTableReader *reader = openSSTableReader(filepath, 1);
+    assert(reader != NULL && reader->prefixLength == 6);
+    int falsePositives = 0;
+    for (int group = 0; group < TEST_PREFIX_GROUPS; group++) {
+      sprintf(prefix, "pfx%03d:", group);
+      int match = sstablePrefixMayMatch(reader, prefix, strlen(prefix));
+      if (group % 2 == 0) {
+        assert(match);
+      } else {
+        falsePositives += match;
+      }
+    }
+    // Too short to look up, every table may hold it
+    assert(sstablePrefixMayMatch(reader, "pfx", 3));
+    printf("Prefix filter false positives with %d key filter bits: %d of "
+           "%d\n",
+           bitsPerKey[b], falsePositives, TEST_PREFIX_GROUPS / 2);
+    closeSSTableReader(reader);
+    remove(filepath);
+  }
+
+  setPrefixLength(0);
+  for (int i = 0; i < iterations; i++) {
+    free(expected[i]);
+  }
+  free(expected);
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMPrefixScan completed in %.2f seconds.\n", timeTaken);
+}
+
+// Databases opened at once by testLSMMultipleDatabases
+#define TEST_DB_COUNT 2
+
+// Work of one thread of testLSMMultipleDatabases
+typedef struct {
+  DB *db;
+  int database; // Index of db, part of every value written to it
+  int thread;
+  int count;
+} DatabaseThreadArgs;
+
+/*
+ * static void *databaseWriter(void *arg)
+ *   Writes count keys of its own to one database, named by the thread and
+ *   valued by the database
+ * @param arg: The DatabaseThreadArgs of the thread
+ */
+static void *databaseWriter(void *arg) {
+  DatabaseThreadArgs *args = arg;
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  for (int i = 0; i < args->count; i++) {
+    sprintf(key, "multidb%d_%d", args->thread, i);
+    sprintf(value, "db%d_%d", args->database, i);
+    dbWrite(args->db, key, value);
+  }
+  return NULL;
+}
+
+/*
+ * static void *databaseReader(void *arg)
+ *   Reads the keys of a writer while it writes them, every value found must
+ *   be the one written to this database
+ * @param arg: The DatabaseThreadArgs of the thread
+ */
+static void *databaseReader(void *arg) {
+  DatabaseThreadArgs *args = arg;
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  for (int i = 0; i < args->count; i++) {
+    sprintf(key, "multidb%d_%d", args->thread, i);
+    sprintf(value, "db%d_%d", args->database, i);
+    char *result = dbRead(args->db, key);
+    assert(result == NULL || strcmp(result, value) == 0);
+    free(result);
+  }
+  return NULL;
+}
+
+/*
+ * static void removeDatabase(const char *directory)
+ *   Deletes the files of a closed database and the directories of its
+ *   shards, then its directory
+ * @param directory: The directory of the database
+ */
+static void removeDatabase(const char *directory) {
+  DIR *dir = opendir(directory);
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent *entry;
+  char filepath[MAX_PATH_LENGTH];
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    snprintf(filepath, sizeof(filepath), "%s/%s", directory, entry->d_name);
+    if (remove(filepath) != 0) {
+      removeDatabase(filepath); // A shard
+    }
+  }
+  closedir(dir);
+  remove(directory);
+}
+
+/*
+ * void testLSMMultipleDatabases(int iterations)
+ *   Tests databases open side by side in one process: writer and reader
+ *   threads use each of them at once, no write shows up in the other
+ *   database, every write survives a reopen, and a directory already open
+ *   cannot be opened twice
+ * @param iterations: The number of keys to write per database
+ */
+void testLSMMultipleDatabases(int iterations) {
+  const int threadCount = 4; // Writers, each with a reader behind it
+  char directories[TEST_DB_COUNT][64];
+  DB *databases[TEST_DB_COUNT];
+  pthread_t writers[TEST_DB_COUNT][threadCount];
+  pthread_t readers[TEST_DB_COUNT][threadCount];
+  DatabaseThreadArgs args[TEST_DB_COUNT][threadCount];
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  int count = iterations / threadCount;
+
+  clock_t start = clock();
+
+  for (int d = 0; d < TEST_DB_COUNT; d++) {
+    sprintf(directories[d], DIR_NAME "_test_db%d", d);
+    removeDatabase(directories[d]);
+    databases[d] = openDB(directories[d]);
+    assert(databases[d] != NULL);
+  }
+  // A directory holds one open database at a time
+  assert(openDB(directories[0]) == NULL);
+
+  for (int d = 0; d < TEST_DB_COUNT; d++) {
+    for (int t = 0; t < threadCount; t++) {
+      args[d][t] = (DatabaseThreadArgs){databases[d], d, t, count};
+      assert(pthread_create(&writers[d][t], NULL, databaseWriter,
+                            &args[d][t]) == 0);
+      assert(pthread_create(&readers[d][t], NULL, databaseReader,
+                            &args[d][t]) == 0);
+    }
+  }
+  for (int d = 0; d < TEST_DB_COUNT; d++) {
+    for (int t = 0; t < threadCount; t++) {
+      pthread_join(writers[d][t], NULL);
+      pthread_join(readers[d][t], NULL);
+    }
+  }
+
+  // Half of each database goes to SSTables, the rest stays in its log
+  for (int pass = 0; pass < 2; pass++) {
+    for (int d = 0; d < TEST_DB_COUNT; d++) {
+      for (int t = 0; t < threadCount; t++) {
+        for (int i = 0; i < count; i++) {
+          sprintf(key, "multidb%d_%d", t, i);
+          sprintf(value, "db%d_%d", d, i);
+          char *result = dbRead(databases[d], key);
+          assert(result != NULL && strcmp(result, value) == 0);
+          free(result);
+        }
+      }
+      if (pass == 0) {
+        dbWriteMemtableToSSTable(databases[d]);
+        sprintf(value, "db%d", d);
+        dbWrite(databases[d], "multidbunflushed", value);
+      }
+      closeDB(databases[d]);
+      databases[d] = openDB(directories[d]);
+      assert(databases[d] != NULL);
+      sprintf(value, "db%d", d);
+      char *result = dbRead(databases[d], "multidbunflushed");
+      assert(result != NULL && strcmp(result, value) == 0);
+      free(result);
+    }
+  }
+
+  for (int d = 0; d < TEST_DB_COUNT; d++) {
+    closeDB(databases[d]);
+    removeDatabase(directories[d]);
+  }
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMMultipleDatabases completed in %.2f seconds.\n", timeTaken);
+}
+
+// Shards of the database of testLSMSharding
+#define TEST_SHARD_COUNT 4
+
+// Work of one writer thread of testLSMSharding
+typedef struct {
+  ShardedDB *db;
+  int thread;
+  int count;
+} ShardWriterArgs;
+
+/*
+ * static void *shardWriter(void *arg)
+ *   Writes count keys of its own to a sharded database
+ * @param arg: The ShardWriterArgs of the thread
+ */
+static void *shardWriter(void *arg) {
+  ShardWriterArgs *args = arg;
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+  for (int i = 0; i < args->count; i++) {
+    sprintf(key, "shard%d_%06d", args->thread, i);
+    sprintf(value, "value%d", i);
+    shardedWrite(args->db, key, value);
+  }
+  return NULL;
+}
+
+/*
+ * static double writeSharded(ShardedDB *db, int threadCount, int count)
+ *   Writes count keys per thread from threadCount threads at once
+ * @return: The seconds the writes took
+ */
+static double writeSharded(ShardedDB *db, int threadCount, int count) {
+  pthread_t threads[threadCount];
+  ShardWriterArgs args[threadCount];
+  struct timespec writeStart, writeEnd;
+  clock_gettime(CLOCK_MONOTONIC, &writeStart);
+  for (int t = 0; t < threadCount; t++) {
+    args[t] = (ShardWriterArgs){db, t, count};
+    assert(pthread_create(&threads[t], NULL, shardWriter, &args[t]) == 0);
+  }
+  for (int t = 0; t < threadCount; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &writeEnd);
+  return (writeEnd.tv_sec - writeStart.tv_sec) +
+         (writeEnd.tv_nsec - writeStart.tv_nsec) / 1e9;
+}
+
+/*
+ * void testLSMSharding(int iterations)
+ *   Tests a database split into shards: concurrent writes land in the
+ *   shard of their key and read back, multiGet, batches, snapshots and
+ *   iterators work across every shard, and the shard count survives a
+ *   reopen and cannot be changed. Prints the write rate of one shard and
+ *   of TEST_SHARD_COUNT
+ * @param iterations: The number of keys to write
+ */
+void testLSMSharding(int iterations) {
+  const int threadCount = TEST_SHARD_COUNT;
+  int count = iterations / threadCount;
+  int total = count * threadCount;
+  char directory[64];
+  char key[MAX_KEY_LENGTH];
+  char value[MAX_VALUE_LENGTH];
+
+  clock_t start = clock();
+
+  // The same writes on one shard, then on every shard
+  double seconds[2];
+  ShardedDB *db = NULL;
+  for (int pass = 0; pass < 2; pass++) {
+    int shards = pass == 0 ? 1 : TEST_SHARD_COUNT;
+    sprintf(directory, DIR_NAME "_test_shards%d", shards);
+    removeDatabase(directory);
+    db = openShardedDB(directory, shards, 1);
+    assert(db != NULL && shardCount(db) == shards);
+    seconds[pass] = writeSharded(db, threadCount, count);
+    printf("Shard count %d: %.0f writes per second\n", shards,
+           total / seconds[pass]);
+    if (pass == 0) {
+      closeShardedDB(db);
+      removeDatabase(directory);
+    }
+  }
+  assert(shardedGetLastSequence(db) == (uint64_t)total);
+  long records, commits, syncs;
+  shardedGetLogStats(db, &records, &commits, &syncs);
+  assert(records == total);
+
+  // Every key reads back, from its own shard too
+  for (int t = 0; t < threadCount; t++) {
+    for (int i = 0; i < count; i++) {
+      sprintf(key, "shard%d_%06d", t, i);
+      sprintf(value, "value%d", i);
+      char *result = shardedRead(db, key);
+      assert(result != NULL && strcmp(result, value) == 0);
+      free(result);
+      result = dbRead(shardForKey(db, key), key);
+      assert(result != NULL);
+      free(result);
+    }
+  }
+
+  // multiGet spread over the shards, with keys never written
+  int getCount = count * 2;
+  char **keys = malloc(getCount * sizeof(char *));
+  char **values = malloc(getCount * sizeof(char *));
+  for (int i = 0; i < getCount; i++) {
+    keys[i] = malloc(MAX_KEY_LENGTH);
+    sprintf(keys[i], "shard%d_%06d", i % threadCount, i);
+  }
+  int found = shardedMultiGet(db, keys, getCount, values);
+  int expectedFound = 0;
+  for (int i = 0; i < getCount; i++) {
+    sprintf(value, "value%d", i);
+    if (i < count) {
+      assert(values[i] != NULL && strcmp(values[i], value) == 0);
+      expectedFound++;
+    } else {
+      assert(values[i] == NULL);
+    }
+    free(values[i]);
+    free(keys[i]);
+  }
+  assert(found == expectedFound);
+  free(keys);
+  free(values);
+
+  // A snapshot of every shard keeps the values a batch replaces
+  const Snapshot *snapshot = shardedGetSnapshot(db);
+  WriteBatch *batch = createWriteBatch();
+  for (int t = 0; t < threadCount; t++) {
+    sprintf(key, "shard%d_%06d", t, 0);
+    assert(addToWriteBatch(batch, key, t % 2 == 0 ? "batched" : NULL));
+  }
+  shardedApplyWriteBatch(db, batch);
+  freeWriteBatch(batch);
+  for (int t = 0; t < threadCount; t++) {
+    sprintf(key, "shard%d_%06d", t, 0);
+    char *result = shardedRead(db, key);
+    assert(t % 2 == 0 ? result != NULL && strcmp(result, "batched") == 0
+                      : result == NULL);
+    free(result);
+    result = shardedReadAt(db, key, snapshot);
+    assert(result != NULL && strcmp(result, "value0") == 0);
+    free(result);
+  }
+
+  // Iterators merge the shards back into key order
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator *iterator =
+        shardedCreateIterator(db, pass == 0 ? snapshot : NULL);
+    int seen = 0;
+    char previous[MAX_KEY_LENGTH + 1] = "";
+    for (seekIteratorToFirst(iterator); iteratorValid(iterator);
+         nextIterator(iterator)) {
+      assert(strcmp(iteratorKey(iterator), previous) > 0);
+      strcpy(previous, iteratorKey(iterator));
+      seen++;
+    }
+    int deleted = pass == 0 ? 0 : threadCount / 2;
+    assert(seen == total - deleted);
+    for (seekIteratorToLast(iterator); iteratorValid(iterator);
+         prevIterator(iterator)) {
+      seen--;
+    }
+    assert(seen == 0);
+    freeIterator(iterator);
+  }
+  Iterator *iterator = shardedCreatePrefixIterator(db, "shard1_", NULL);
+  int seen = 0;
+  for (seekIteratorToFirst(iterator); iteratorValid(iterator);
+       nextIterator(iterator)) {
+    assert(strncmp(iteratorKey(iterator), "shard1_", 7) == 0);
+    seen++;
+  }
+  assert(seen == count - 1); // shard1_000000 was deleted by the batch
+  freeIterator(iterator);
+  shardedReleaseSnapshot(db, snapshot);
+
+  // The shard count is kept with the data
+  shardedWriteMemtableToSSTable(db);
+  closeShardedDB(db);
+  assert(openShardedDB(directory, TEST_SHARD_COUNT / 2, 0) == NULL);
+  assert(openShardedDB(directory, 1, 0) == NULL);
+  db = openShardedDB(directory, TEST_SHARD_COUNT, 0);
+  assert(db != NULL);
+  for (int i = 1; i < count; i++) {
+    sprintf(key, "shard%d_%06d", threadCount - 1, i);
+    sprintf(value, "value%d", i);
+    char *result = shardedRead(db, key);
+    assert(result != NULL && strcmp(result, value) == 0);
+    free(result);
+  }
+  closeShardedDB(db);
+  removeDatabase(directory);
+
+  clock_t end = clock();
+  double timeTaken = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("testLSMSharding completed in %.2f seconds.\n", timeTaken);
+}
+
 /*
  * #################################
  * END LSM system test functions
@@ -253,10 +2083,27 @@ void runAllTests(int iterations) {
   // testMemtableInsertAndSearch(iterations);
   // testMemtableRandomInsertAndSearch(iterations);
   // testMemtableRandomDeletion(iterations);
+  // testSSTableWriteAndSearch(iterations);
+  // testBlockCache(iterations);
+  // testRateLimiter(iterations);
+  // testTableCache(iterations);
   // testLSMInsertAndSearch(iterations);
   // testLSMRandomInsert(iterations);
   // testLSMRandomSearch(iterations);
   // testLSMRandomDeletion(iterations);
+  // testLSMReopen(iterations);
+  // testLSMPinnedRead(iterations);
+  // testLSMCompaction(iterations);
+  // testLSMSubcompaction(iterations);
+  // testLSMWriteAheadLog(iterations);
+  // testLSMRecovery(iterations);
+  // testLSMSnapshot(iterations);
+  // testLSMWriteBatch(iterations);
+  // testLSMMultiGet(iterations);
+  // testLSMIterator(iterations);
+  // testLSMPrefixScan(iterations);
+  // testLSMMultipleDatabases(iterations);
+  // testLSMSharding(iterations);
   // print2DMemtable();
   // printf("All tests passed!\n");
 }
@@ -5,10 +5,27 @@
 void testMemtableInsertAndSearch(int iterations);
 void testMemtableRandomInsertAndSearch(int iterations);
 void testMemtableRandomDeletion(int iterations);
+void testSSTableWriteAndSearch(int iterations);
+void testBlockCache(int iterations);
+void testRateLimiter(int iterations);
+void testTableCache(int iterations);
 void testLSMInsertAndSearch(int iterations);
 void testLSMRandomInsert(int iterations);
 void testLSMRandomSearch(int iterations);
 void testLSMRandomDeletion(int iterations);
+void testLSMReopen(int iterations);
+void testLSMPinnedRead(int iterations);
+void testLSMCompaction(int iterations);
+void testLSMSubcompaction(int iterations);
+void testLSMWriteAheadLog(int iterations);
+void testLSMRecovery(int iterations);
+void testLSMSnapshot(int iterations);
+void testLSMWriteBatch(int iterations);
+void testLSMMultiGet(int iterations);
+void testLSMIterator(int iterations);
+void testLSMPrefixScan(int iterations);
+void testLSMMultipleDatabases(int iterations);
+void testLSMSharding(int iterations);
 void runAllTests(int iterations);
 
 #endif // TEST_H
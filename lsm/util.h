@@ -2,20 +2,6 @@
 
 // Utility functions
 
-/*
- * static int filenameComparator(const void *a, const void *b)
- *   Function to compare two filenames in descending order
- *   This expects files like: memtable_1705177288571309000.dat
- * @param a: pointer to the first filename
- * @param b: pointer to the second filename
- */
-static int filenameComparator(const void *a, const void *b) {
-  const char *filenameA = *(const char **)a;
-  const char *filenameB = *(const char **)b;
-  // printf("Comparing %s and %s\n", filenameA, filenameB);
-  return strcmp(filenameB, filenameA);
-}
-
 /*
  * static int directoryExists(const char *path)
  *   Function to check if a directory exists
@@ -0,0 +1,936 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "coding.h"
+#include "version.h"
+
+/*
+ * ######################
+ * Files and versions
+ * ######################
+ */
+
+/*
+ * void tableFilePath(char *buffer, size_t size, const char *directory,
+ *                    uint64_t number)
+ *   Formats the path of an SSTable from its number.
+ * @param buffer: Where to write the path
+ * @param size: The size of the buffer
+ * @param directory: The directory of the database
+ * @param number: The number of the SSTable
+ */
+void tableFilePath(char *buffer, size_t size, const char *directory,
+                   uint64_t number) {
+  snprintf(buffer, size, FILENAME_FORMAT, directory, (long long)number);
+}
+
+/*
+ * void logFilePath(char *buffer, size_t size, const char *directory,
+ *                  uint64_t number)
+ *   Formats the path of a write-ahead log from its number.
+ * @param buffer: Where to write the path
+ * @param size: The size of the buffer
+ * @param directory: The directory of the database
+ * @param number: The number of the log
+ */
+void logFilePath(char *buffer, size_t size, const char *directory,
+                 uint64_t number) {
+  snprintf(buffer, size, LOG_FILENAME_FORMAT, directory, (long long)number);
+}
+
+/*
+ * int syncDirectory(const char *directory)
+ *   Syncs the entries of a directory, so a file renamed or removed in it
+ *   stays that way after a power loss.
+ * @param directory: The directory of the database
+ * @return: 1 on success, 0 if the directory could not be synced
+ */
+int syncDirectory(const char *directory) {
+  int fd = open(directory, O_RDONLY);
+  if (fd < 0) {
+    perror("Failed to open data directory for syncing");
+    return 0;
+  }
+  int ok = fsync(fd) == 0;
+  if (!ok) {
+    perror("Failed to sync data directory");
+  }
+  close(fd);
+  return ok;
+}
+
+/*
+ * int lockDirectory(const char *directory)
+ *   Takes an exclusive lock on the lock file of a directory, created if
+ *   missing. The lock belongs to the open file, so a second open of the same
+ *   directory fails whether it comes from this process or another one, and
+ *   the lock goes away with the process.
+ * @param directory: The directory of the database
+ * @return: The descriptor holding the lock, or -1 if the directory is
+ *   already locked or the lock file could not be opened
+ */
+int lockDirectory(const char *directory) {
+  char filepath[MAX_PATH_LENGTH];
+  snprintf(filepath, sizeof(filepath), "%s/" LOCK_FILE, directory);
+  int fd = open(filepath, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    perror("Failed to open lock file");
+    return -1;
+  }
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    fprintf(stderr, "Database directory already in use: %s\n", directory);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * void unlockDirectory(int fd)
+ *   Releases the lock of a directory by closing its lock file.
+ * @param fd: The descriptor returned by lockDirectory
+ */
+void unlockDirectory(int fd) {
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+/*
+ * static FileMetaData *createFileMetaData(const FileMetaData *description)
+ *   Creates a shared copy of a file description with no references.
+ */
+static FileMetaData *createFileMetaData(const FileMetaData *description) {
+  FileMetaData *file = malloc(sizeof(FileMetaData));
+  if (file == NULL) {
+    perror("Failed to allocate memory for file metadata");
+    exit(EXIT_FAILURE);
+  }
+  *file = *description;
+  file->smallestKey = strdup(description->smallestKey);
+  file->largestKey = strdup(description->largestKey);
+  file->refs = 0;
+  file->obsolete = 0;
+  file->beingCompacted = 0;
+  return file;
+}
+
+/*
+ * static void unrefFile(VersionSet *versions, FileMetaData *file)
+ *   Drops a version's reference to a file. Once no version holds an obsolete
+ *   file, no reader can reach it any more, so it is closed and deleted.
+ *   Must be called with the version set mutex held.
+ */
+static void unrefFile(VersionSet *versions, FileMetaData *file) {
+  if (--file->refs > 0) {
+    return;
+  }
+  if (file->obsolete) {
+    char filepath[MAX_PATH_LENGTH];
+    tableFilePath(filepath, sizeof(filepath), versions->directory,
+                  file->number);
+    if (versions->tableCache != NULL) {
+      evictTable(versions->tableCache, filepath);
+    }
+    remove(filepath);
+  }
+  free(file->smallestKey);
+  free(file->largestKey);
+  free(file);
+}
+
+/*
+ * static void addToLevel(FileList *level, FileMetaData *file)
+ *   Adds a file to a level and takes a reference to it.
+ *   If the array is full, double it.
+ */
+static void addToLevel(FileList *level, FileMetaData *file) {
+  if (level->count >= level->capacity) {
+    level->capacity = level->capacity == 0 ? 8 : level->capacity * 2;
+    FileMetaData **temp =
+        realloc(level->files, level->capacity * sizeof(FileMetaData *));
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for level");
+      exit(EXIT_FAILURE);
+    }
+    level->files = temp;
+  }
+  level->files[level->count++] = file;
+  file->refs++;
+}
+
+/*
+ * static int newestFirst(const void *a, const void *b)
+ *   Orders level 0 files by descending flush number, newest first. Tables
+ *   written by one merge share a flush number but not keys, their order
+ *   among themselves does not matter.
+ */
+static int newestFirst(const void *a, const void *b) {
+  const FileMetaData *fileA = *(FileMetaData *const *)a;
+  const FileMetaData *fileB = *(FileMetaData *const *)b;
+  if (fileA->flushNumber != fileB->flushNumber) {
+    return (fileA->flushNumber < fileB->flushNumber) -
+           (fileA->flushNumber > fileB->flushNumber);
+  }
+  return (fileA->number < fileB->number) - (fileA->number > fileB->number);
+}
+
+/*
+ * static int bySmallestKey(const void *a, const void *b)
+ *   Orders the files of a deeper level by their smallest key.
+ */
+static int bySmallestKey(const void *a, const void *b) {
+  const FileMetaData *fileA = *(FileMetaData *const *)a;
+  const FileMetaData *fileB = *(FileMetaData *const *)b;
+  return strcmp(fileA->smallestKey, fileB->smallestKey);
+}
+
+/*
+ * static Version *createVersion(VersionSet *versions)
+ *   Creates an empty version with no references.
+ */
+static Version *createVersion(VersionSet *versions) {
+  Version *version = calloc(1, sizeof(Version));
+  if (version == NULL) {
+    perror("Failed to allocate memory for version");
+    exit(EXIT_FAILURE);
+  }
+  version->set = versions;
+  return version;
+}
+
+/*
+ * static void unrefVersionLocked(Version *version)
+ *   Drops a reference, freeing the version and releasing its files with the
+ *   last one. Must be called with the version set mutex held.
+ */
+static void unrefVersionLocked(Version *version) {
+  if (--version->refs > 0) {
+    return;
+  }
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    FileList *files = &version->levels[level];
+    for (int i = 0; i < files->count; i++) {
+      unrefFile(version->set, files->files[i]);
+    }
+    free(files->files);
+  }
+  free(version);
+}
+
+/*
+ * static int isRemoved(const VersionEdit *edit, uint64_t number)
+ *   Checks if an edit removes the file with the given number.
+ */
+static int isRemoved(const VersionEdit *edit, uint64_t number) {
+  for (int i = 0; i < edit->removedCount; i++) {
+    if (edit->removed[i] == number) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * static int isAdded(const VersionEdit *edit, uint64_t number)
+ *   Checks if an edit adds a file with the given number. A file rewritten in
+ *   place is both removed and added.
+ */
+static int isAdded(const VersionEdit *edit, uint64_t number) {
+  for (int i = 0; i < edit->addedCount; i++) {
+    if (edit->added[i].number == number) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * static Version *buildVersion(VersionSet *versions, Version *base,
+ *                              const VersionEdit *edit)
+ *   Creates the version that results from applying an edit to a base.
+ *   Files the edit removes for good are marked obsolete, they are deleted
+ *   once the last version holding them is released.
+ *   Must be called with the version set mutex held.
+ */
+static Version *buildVersion(VersionSet *versions, Version *base,
+                             const VersionEdit *edit) {
+  Version *version = createVersion(versions);
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    FileList *files = &base->levels[level];
+    for (int i = 0; i < files->count; i++) {
+      FileMetaData *file = files->files[i];
+      if (!isRemoved(edit, file->number)) {
+        addToLevel(&version->levels[level], file);
+      } else if (!isAdded(edit, file->number)) {
+        file->obsolete = 1;
+      }
+    }
+  }
+  for (int i = 0; i < edit->addedCount; i++) {
+    FileMetaData *file = createFileMetaData(&edit->added[i]);
+    addToLevel(&version->levels[file->level], file);
+  }
+
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    FileList *files = &version->levels[level];
+    if (files->count > 1) {
+      qsort(files->files, files->count, sizeof(FileMetaData *),
+            level == 0 ? newestFirst : bySmallestKey);
+    }
+  }
+  return version;
+}
+
+/*
+ * static void installVersion(VersionSet *versions, Version *version)
+ *   Makes a version the current one and releases the previous one.
+ *   Must be called with the version set mutex held.
+ */
+static void installVersion(VersionSet *versions, Version *version) {
+  Version *old = versions->current;
+  version->refs++;
+  versions->current = version;
+  if (old != NULL) {
+    unrefVersionLocked(old);
+  }
+}
+
+/*
+ * Version *getCurrentVersion(VersionSet *versions)
+ *   Public function to pin the current version for a read or compaction.
+ * @param versions: The version set
+ * @return: The current version, which must be released with unrefVersion
+ */
+Version *getCurrentVersion(VersionSet *versions) {
+  pthread_mutex_lock(&versions->mutex);
+  Version *version = versions->current;
+  version->refs++;
+  pthread_mutex_unlock(&versions->mutex);
+  return version;
+}
+
+/*
+ * void unrefVersion(Version *version)
+ *   Public function to release a version returned by getCurrentVersion.
+ * @param version: The version to release
+ */
+void unrefVersion(Version *version) {
+  VersionSet *versions = version->set;
+  pthread_mutex_lock(&versions->mutex);
+  unrefVersionLocked(version);
+  pthread_mutex_unlock(&versions->mutex);
+}
+
+/*
+ * FileMetaData *findFileInLevel(const FileList *level, const char *key)
+ *   Binary searches a level 1+ for the only file whose range can hold key.
+ * @param level: The files of the level, sorted with disjoint ranges
+ * @param key: The key to look up
+ * @return: The file, or NULL if no file's range holds the key
+ */
+FileMetaData *findFileInLevel(const FileList *level, const char *key) {
+  int low = 0;
+  int high = level->count;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (strcmp(level->files[mid]->largestKey, key) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low < level->count && strcmp(level->files[low]->smallestKey, key) <= 0) {
+    return level->files[low];
+  }
+  return NULL;
+}
+
+/*
+ * int versionFileCount(const Version *version)
+ *   Counts the files of every level.
+ * @param version: The version to count
+ * @return: The number of live SSTables
+ */
+int versionFileCount(const Version *version) {
+  int count = 0;
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    count += version->levels[level].count;
+  }
+  return count;
+}
+
+/*
+ * void printVersion(const Version *version)
+ *   Prints the files of every non-empty level with their key ranges.
+ * @param version: The version to print
+ */
+void printVersion(const Version *version) {
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    const FileList *files = &version->levels[level];
+    if (files->count == 0) {
+      continue;
+    }
+    printf("Level %d: %d files\n", level, files->count);
+    for (int i = 0; i < files->count; i++) {
+      FileMetaData *file = files->files[i];
+      printf("  %lld [%s .. %s] %llu bytes\n", (long long)file->number,
+             file->smallestKey, file->largestKey,
+             (unsigned long long)file->fileSize);
+    }
+  }
+}
+
+/*
+ * ######################
+ * Version edits
+ * ######################
+ */
+
+/*
+ * void initVersionEdit(VersionEdit *edit)
+ *   Prepares an empty edit.
+ * @param edit: The edit to initialize
+ */
+void initVersionEdit(VersionEdit *edit) { memset(edit, 0, sizeof(VersionEdit)); }
+
+/*
+ * FileMetaData *addFileToEdit(VersionEdit *edit, uint64_t number, int level,
+ *                             uint64_t fileSize, const char *smallestKey,
+ *                             const char *largestKey)
+ *   Records a new file in an edit. Its flush number is its own number, as
+ *   for a freshly flushed table.
+ *   If the array is full, double it.
+ * @param edit: The edit to add to
+ * @param number: The number of the new SSTable
+ * @param level: The level the SSTable goes into
+ * @param fileSize: The size of the SSTable in bytes
+ * @param smallestKey: The first key of the SSTable
+ * @param largestKey: The last key of the SSTable
+ * @return: The description in the edit, valid until the next file is added
+ */
+FileMetaData *addFileToEdit(VersionEdit *edit, uint64_t number, int level,
+                            uint64_t fileSize, const char *smallestKey,
+                            const char *largestKey) {
+  if (edit->addedCount >= edit->addedCapacity) {
+    edit->addedCapacity = edit->addedCapacity == 0 ? 4 : edit->addedCapacity * 2;
+    FileMetaData *temp =
+        realloc(edit->added, edit->addedCapacity * sizeof(FileMetaData));
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for version edit");
+      exit(EXIT_FAILURE);
+    }
+    edit->added = temp;
+  }
+  FileMetaData *file = &edit->added[edit->addedCount++];
+  memset(file, 0, sizeof(FileMetaData));
+  file->number = number;
+  file->flushNumber = number;
+  file->level = level;
+  file->fileSize = fileSize;
+  file->smallestKey = strdup(smallestKey);
+  file->largestKey = strdup(largestKey);
+  return file;
+}
+
+/*
+ * void removeFileFromEdit(VersionEdit *edit, uint64_t number)
+ *   Records the removal of a file in an edit.
+ *   If the array is full, double it.
+ * @param edit: The edit to add to
+ * @param number: The number of the removed SSTable
+ */
+void removeFileFromEdit(VersionEdit *edit, uint64_t number) {
+  if (edit->removedCount >= edit->removedCapacity) {
+    edit->removedCapacity =
+        edit->removedCapacity == 0 ? 4 : edit->removedCapacity * 2;
+    uint64_t *temp =
+        realloc(edit->removed, edit->removedCapacity * sizeof(uint64_t));
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for version edit");
+      exit(EXIT_FAILURE);
+    }
+    edit->removed = temp;
+  }
+  edit->removed[edit->removedCount++] = number;
+}
+
+/*
+ * void freeVersionEdit(VersionEdit *edit)
+ *   Frees the contents of an edit, the edit can be reused after
+ *   initVersionEdit.
+ * @param edit: The edit to free
+ */
+void freeVersionEdit(VersionEdit *edit) {
+  for (int i = 0; i < edit->addedCount; i++) {
+    free(edit->added[i].smallestKey);
+    free(edit->added[i].largestKey);
+  }
+  free(edit->added);
+  free(edit->removed);
+  initVersionEdit(edit);
+}
+
+/*
+ * ######################
+ * Manifest
+ * ######################
+ */
+
+// A manifest record being encoded
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+} RecordBuffer;
+
+/*
+ * static char *reserveRecord(RecordBuffer *record, size_t size)
+ *   Makes room for size more bytes at the end of a record.
+ *   If the buffer is full, double it.
+ * @return: Where the bytes go
+ */
+static char *reserveRecord(RecordBuffer *record, size_t size) {
+  while (record->size + size > record->capacity) {
+    record->capacity = record->capacity == 0 ? 256 : record->capacity * 2;
+    char *temp = realloc(record->data, record->capacity);
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for manifest record");
+      exit(EXIT_FAILURE);
+    }
+    record->data = temp;
+  }
+  char *dst = record->data + record->size;
+  record->size += size;
+  return dst;
+}
+
+/*
+ * static void putVarint(RecordBuffer *record, uint32_t value)
+ *   Appends a varint to a record.
+ */
+static void putVarint(RecordBuffer *record, uint32_t value) {
+  char buffer[5];
+  int length = encodeVarint32(buffer, value);
+  memcpy(reserveRecord(record, length), buffer, length);
+}
+
+/*
+ * static void putFixed64(RecordBuffer *record, uint64_t value)
+ *   Appends a fixed width 64-bit integer to a record.
+ */
+static void putFixed64(RecordBuffer *record, uint64_t value) {
+  encodeFixed64(reserveRecord(record, 8), value);
+}
+
+/*
+ * static void putKey(RecordBuffer *record, const char *key)
+ *   Appends a length prefixed key to a record.
+ */
+static void putKey(RecordBuffer *record, const char *key) {
+  uint32_t length = strlen(key);
+  putVarint(record, length);
+  memcpy(reserveRecord(record, length), key, length);
+}
+
+/*
+ * static void encodeEdit(RecordBuffer *record, const VersionEdit *edit,
+ *                        uint64_t nextFileNumber, uint64_t lastSequence)
+ *   Encodes an edit, the next file number and the last sequence number as
+ *   one manifest record.
+ */
+static void encodeEdit(RecordBuffer *record, const VersionEdit *edit,
+                       uint64_t nextFileNumber, uint64_t lastSequence) {
+  // Leave room for the length, filled in once the payload is known
+  reserveRecord(record, 4);
+  putVarint(record, MANIFEST_NEXT_FILE);
+  putFixed64(record, nextFileNumber);
+  putVarint(record, MANIFEST_LAST_SEQUENCE);
+  putFixed64(record, lastSequence);
+  for (int i = 0; i < edit->removedCount; i++) {
+    putVarint(record, MANIFEST_REMOVE_FILE);
+    putFixed64(record, edit->removed[i]);
+  }
+  for (int i = 0; i < edit->addedCount; i++) {
+    const FileMetaData *file = &edit->added[i];
+    putVarint(record, MANIFEST_ADD_FILE);
+    putVarint(record, file->level);
+    putFixed64(record, file->number);
+    putFixed64(record, file->fileSize);
+    putFixed64(record, file->flushNumber);
+    putKey(record, file->smallestKey);
+    putKey(record, file->largestKey);
+  }
+  encodeFixed32(record->data, (uint32_t)(record->size - 4));
+}
+
+/*
+ * static const char *getKey(const char *ptr, const char *limit, char **key)
+ *   Decodes a length prefixed key into a malloc'd string.
+ * @return: A pointer past the key, or NULL if it is corrupt
+ */
+static const char *getKey(const char *ptr, const char *limit, char **key) {
+  uint32_t length;
+  ptr = decodeVarint32(ptr, limit, &length);
+  if (ptr == NULL || length > MAX_KEY_LENGTH ||
+      length > (uint32_t)(limit - ptr)) {
+    return NULL;
+  }
+  *key = strndup(ptr, length);
+  return ptr + length;
+}
+
+/*
+ * static int decodeEdit(const char *payload, uint32_t size,
+ *                       VersionEdit *edit, uint64_t *nextFileNumber)
+ *   Decodes a manifest record into an edit.
+ * @return: 1 on success, 0 if the record is corrupt
+ */
+static int decodeEdit(const char *payload, uint32_t size, VersionEdit *edit,
+                      uint64_t *nextFileNumber) {
+  const char *ptr = payload;
+  const char *limit = payload + size;
+  while (ptr < limit) {
+    uint32_t tag;
+    ptr = decodeVarint32(ptr, limit, &tag);
+    if (ptr == NULL) {
+      return 0;
+    }
+    if (tag == MANIFEST_NEXT_FILE && limit - ptr >= 8) {
+      *nextFileNumber = decodeFixed64(ptr);
+      ptr += 8;
+    } else if (tag == MANIFEST_LAST_SEQUENCE && limit - ptr >= 8) {
+      edit->lastSequence = decodeFixed64(ptr);
+      ptr += 8;
+    } else if (tag == MANIFEST_REMOVE_FILE && limit - ptr >= 8) {
+      removeFileFromEdit(edit, decodeFixed64(ptr));
+      ptr += 8;
+    } else if (tag == MANIFEST_ADD_FILE) {
+      uint32_t level;
+      ptr = decodeVarint32(ptr, limit, &level);
+      if (ptr == NULL || level >= NUM_LEVELS || limit - ptr < 24) {
+        return 0;
+      }
+      uint64_t number = decodeFixed64(ptr);
+      uint64_t fileSize = decodeFixed64(ptr + 8);
+      uint64_t flushNumber = decodeFixed64(ptr + 16);
+      char *smallestKey = NULL;
+      char *largestKey = NULL;
+      ptr = getKey(ptr + 24, limit, &smallestKey);
+      if (ptr != NULL) {
+        ptr = getKey(ptr, limit, &largestKey);
+      }
+      if (ptr != NULL) {
+        addFileToEdit(edit, number, level, fileSize, smallestKey, largestKey)
+            ->flushNumber = flushNumber;
+      }
+      free(smallestKey);
+      free(largestKey);
+      if (ptr == NULL) {
+        return 0;
+      }
+    } else {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * static int writeRecord(FILE *file, const RecordBuffer *record)
+ *   Appends a record to a manifest and syncs it to disk.
+ * @return: 1 on success, 0 on a write error
+ */
+static int writeRecord(FILE *file, const RecordBuffer *record) {
+  if (fwrite(record->data, 1, record->size, file) != record->size ||
+      fflush(file) != 0 || fsync(fileno(file)) != 0) {
+    perror("Failed to write manifest");
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * int applyVersionEdit(VersionSet *versions, VersionEdit *edit)
+ *   Public function to change the live SSTables. The edit is logged to the
+ *   manifest first, so a crash either keeps all of it or none, then the new
+ *   version is installed for the next readers.
+ * @param versions: The version set
+ * @param edit: The files added and removed
+ * @return: 1 on success, 0 if the manifest could not be written
+ */
+int applyVersionEdit(VersionSet *versions, VersionEdit *edit) {
+  pthread_mutex_lock(&versions->mutex);
+  uint64_t lastSequence = edit->lastSequence > versions->lastSequence
+                              ? edit->lastSequence
+                              : versions->lastSequence;
+  RecordBuffer record = {0};
+  encodeEdit(&record, edit, versions->nextFileNumber, lastSequence);
+  int ok = writeRecord(versions->manifest, &record);
+  free(record.data);
+  if (ok) {
+    versions->lastSequence = lastSequence;
+    installVersion(versions,
+                   buildVersion(versions, versions->current, edit));
+  }
+  pthread_mutex_unlock(&versions->mutex);
+  return ok;
+}
+
+/*
+ * uint64_t newFileNumber(VersionSet *versions)
+ *   Public function to reserve the number of a new SSTable.
+ * @param versions: The version set
+ * @return: A number no other SSTable had
+ */
+uint64_t newFileNumber(VersionSet *versions) {
+  pthread_mutex_lock(&versions->mutex);
+  uint64_t number = versions->nextFileNumber++;
+  pthread_mutex_unlock(&versions->mutex);
+  return number;
+}
+
+/*
+ * void markFileNumberUsed(VersionSet *versions, uint64_t number)
+ *   Public function to make sure a number found on disk is never handed out
+ *   again, such as the number of a log written after the last manifest
+ *   record.
+ * @param versions: The version set
+ * @param number: The number in use
+ */
+void markFileNumberUsed(VersionSet *versions, uint64_t number) {
+  pthread_mutex_lock(&versions->mutex);
+  if (number >= versions->nextFileNumber) {
+    versions->nextFileNumber = number + 1;
+  }
+  pthread_mutex_unlock(&versions->mutex);
+}
+
+/*
+ * static void replayManifest(VersionSet *versions, FILE *file)
+ *   Rebuilds the current version by applying every record of a manifest.
+ *   Stops at the first record that is cut short or corrupt.
+ */
+static void replayManifest(VersionSet *versions, FILE *file) {
+  char header[4];
+  while (fread(header, 1, 4, file) == 4) {
+    uint32_t size = decodeFixed32(header);
+    char *payload = malloc(size > 0 ? size : 1);
+    if (payload == NULL) {
+      perror("Failed to allocate memory for manifest record");
+      exit(EXIT_FAILURE);
+    }
+    VersionEdit edit;
+    initVersionEdit(&edit);
+    int ok = fread(payload, 1, size, file) == size &&
+             decodeEdit(payload, size, &edit, &versions->nextFileNumber);
+    if (ok) {
+      installVersion(versions,
+                     buildVersion(versions, versions->current, &edit));
+      if (edit.lastSequence > versions->lastSequence) {
+        versions->lastSequence = edit.lastSequence;
+      }
+    } else {
+      fprintf(stderr, "Ignoring incomplete manifest record\n");
+    }
+    freeVersionEdit(&edit);
+    free(payload);
+    if (!ok) {
+      break;
+    }
+  }
+}
+
+/*
+ * static int versionHasFile(const Version *version, uint64_t number)
+ *   Checks if a version includes the file with the given number.
+ */
+static int versionHasFile(const Version *version, uint64_t number) {
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    const FileList *files = &version->levels[level];
+    for (int i = 0; i < files->count; i++) {
+      if (files->files[i]->number == number) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+ * static void adoptUnlistedTables(VersionSet *versions, int adopt)
+ *   Handles the SSTables found in the data directory but missing from the
+ *   version. Without a manifest they are the tables of a data directory
+ *   written before the manifest existed, and are added to level 0. With
+ *   one they were renamed into place by a flush or compaction whose edit
+ *   never reached the manifest, and are deleted: adopted as the newest
+ *   level 0 tables they would bring back values and keys their compaction
+ *   replaced, and a flush cut short keeps its log until its edit is
+ *   applied. Leftover temporary files are removed.
+ * @param adopt: 1 to add the unlisted tables, 0 to delete them
+ */
+static void adoptUnlistedTables(VersionSet *versions, int adopt) {
+  DIR *dir = opendir(versions->directory);
+  if (dir == NULL) {
+    perror("Failed to open data directory for reading");
+    return;
+  }
+
+  VersionEdit edit;
+  initVersionEdit(&edit);
+  struct dirent *entry;
+  char filepath[MAX_PATH_LENGTH], expected[MAX_PATH_LENGTH];
+  while ((entry = readdir(dir)) != NULL) {
+    snprintf(filepath, sizeof(filepath), "%s/%s", versions->directory,
+             entry->d_name);
+    size_t length = strlen(entry->d_name);
+    if (length > strlen(TEMP_SUFFIX) &&
+        strcmp(entry->d_name + length - strlen(TEMP_SUFFIX), TEMP_SUFFIX) ==
+            0) {
+      remove(filepath);
+      continue;
+    }
+
+    long long number;
+    if (sscanf(entry->d_name, SSTABLE_PREFIX "%lld", &number) != 1) {
+      continue;
+    }
+    tableFilePath(expected, sizeof(expected), versions->directory, number);
+    if (strcmp(filepath, expected) != 0 ||
+        versionHasFile(versions->current, number)) {
+      continue;
+    }
+
+    if ((uint64_t)number >= versions->nextFileNumber) {
+      versions->nextFileNumber = number + 1;
+    }
+    if (!adopt) {
+      remove(filepath);
+      printf("Removed unlisted SSTable file: %s\n", filepath);
+      continue;
+    }
+    SSTableReader *reader = openSSTableReader(filepath, 1);
+    if (reader == NULL) {
+      continue;
+    }
+    if (reader->blockCount > 0) {
+      addFileToEdit(&edit, number, 0, reader->fileSize, reader->smallestKey,
+                    reader->largestKey);
+      printf("Adopted SSTable file: %s\n", filepath);
+    }
+    closeSSTableReader(reader);
+  }
+  closedir(dir);
+
+  if (edit.addedCount > 0) {
+    installVersion(versions, buildVersion(versions, versions->current, &edit));
+  }
+  freeVersionEdit(&edit);
+}
+
+/*
+ * static FILE *writeSnapshot(VersionSet *versions)
+ *   Starts a new manifest holding a single record with the current version,
+ *   so the log does not grow across restarts. The snapshot is written under
+ *   a temporary name and renamed over the old manifest.
+ * @return: The new manifest opened for appending, or NULL on error
+ */
+static FILE *writeSnapshot(VersionSet *versions) {
+  VersionEdit edit;
+  initVersionEdit(&edit);
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    FileList *files = &versions->current->levels[level];
+    for (int i = 0; i < files->count; i++) {
+      FileMetaData *file = files->files[i];
+      addFileToEdit(&edit, file->number, level, file->fileSize,
+                    file->smallestKey, file->largestKey)
+          ->flushNumber = file->flushNumber;
+    }
+  }
+  RecordBuffer record = {0};
+  encodeEdit(&record, &edit, versions->nextFileNumber, versions->lastSequence);
+  freeVersionEdit(&edit);
+
+  char manifestPath[MAX_PATH_LENGTH];
+  char tempPath[sizeof(manifestPath) + sizeof(TEMP_SUFFIX)];
+  snprintf(manifestPath, sizeof(manifestPath), "%s/" MANIFEST_FILE,
+           versions->directory);
+  snprintf(tempPath, sizeof(tempPath), "%s" TEMP_SUFFIX, manifestPath);
+  FILE *file = fopen(tempPath, "wb");
+  if (file == NULL) {
+    perror("Failed to create manifest");
+    free(record.data);
+    return NULL;
+  }
+  int ok = writeRecord(file, &record);
+  free(record.data);
+  fclose(file);
+  if (!ok || rename(tempPath, manifestPath) != 0 ||
+      !syncDirectory(versions->directory)) {
+    perror("Failed to install manifest");
+    return NULL;
+  }
+  return fopen(manifestPath, "ab");
+}
+
+/*
+ * VersionSet *openVersionSet(const char *directory, TableCache *tableCache)
+ *   Public function to load the live SSTables of a directory. Replays the
+ *   manifest and deletes any SSTable it does not know about, or adopts every
+ *   SSTable found if there is no manifest yet, then starts a fresh manifest
+ *   for the edits to come.
+ * @param directory: The directory of the database, which must exist
+ * @param tableCache: The table cache obsolete files are evicted from
+ * @return: The version set, or NULL if the manifest could not be written
+ */
+VersionSet *openVersionSet(const char *directory, TableCache *tableCache) {
+  VersionSet *versions = calloc(1, sizeof(VersionSet));
+  if (versions == NULL || (versions->directory = strdup(directory)) == NULL) {
+    perror("Failed to allocate memory for version set");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutex_init(&versions->mutex, NULL);
+  versions->tableCache = tableCache;
+  versions->nextFileNumber = 1;
+
+  pthread_mutex_lock(&versions->mutex);
+  installVersion(versions, createVersion(versions));
+  char manifestPath[MAX_PATH_LENGTH];
+  snprintf(manifestPath, sizeof(manifestPath), "%s/" MANIFEST_FILE,
+           directory);
+  FILE *file = fopen(manifestPath, "rb");
+  if (file != NULL) {
+    replayManifest(versions, file);
+    fclose(file);
+  }
+  adoptUnlistedTables(versions, file == NULL);
+
+  versions->manifest = writeSnapshot(versions);
+  pthread_mutex_unlock(&versions->mutex);
+  if (versions->manifest == NULL) {
+    closeVersionSet(versions);
+    return NULL;
+  }
+  return versions;
+}
+
+/*
+ * void closeVersionSet(VersionSet *versions)
+ *   Public function to release the current version and close the manifest.
+ * @param versions: The version set to close, no version may still be in use
+ */
+void closeVersionSet(VersionSet *versions) {
+  pthread_mutex_lock(&versions->mutex);
+  unrefVersionLocked(versions->current);
+  if (versions->manifest != NULL) {
+    fclose(versions->manifest);
+  }
+  pthread_mutex_unlock(&versions->mutex);
+  pthread_mutex_destroy(&versions->mutex);
+  free(versions->directory);
+  free(versions);
+}
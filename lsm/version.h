@@ -0,0 +1,160 @@
+#ifndef VERSION_H
+#define VERSION_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tablecache.h"
+
+// Directory of the default database, every database keeps its SSTables,
+// logs and manifest in a directory of its own
+#define DIR_NAME "data"
+
+// File name macros, formatted with the directory and the number
+#define SSTABLE_PREFIX "sstable_"
+#define SSTABLE_SUFFIX ".dat"
+#define FILENAME_FORMAT "%s/" SSTABLE_PREFIX "%lld" SSTABLE_SUFFIX
+// Write-ahead log of a memtable, numbered like the SSTables
+#define LOG_PREFIX "wal_"
+#define LOG_SUFFIX ".log"
+#define LOG_FILENAME_FORMAT "%s/" LOG_PREFIX "%lld" LOG_SUFFIX
+// Suffix of an SSTable that is still being written
+#define TEMP_SUFFIX ".tmp"
+// Log of the SSTables added and removed
+#define MANIFEST_FILE "MANIFEST"
+// Locked by the process that has the directory open
+#define LOCK_FILE "LOCK"
+// Size of the buffers holding the path of a file of a database
+#define MAX_PATH_LENGTH 512
+// Longest directory a database may live in, so the path of any of its files,
+// shard subdirectories included, fits in MAX_PATH_LENGTH
+#define MAX_DIRECTORY_LENGTH (MAX_PATH_LENGTH - 64)
+
+// Version macros
+// Number of levels an SSTable can live in
+#define NUM_LEVELS 7
+
+// Manifest layout
+// A log of records, each [fixed32 length][payload], where the payload is a
+// list of tagged fields:
+//   MANIFEST_NEXT_FILE [fixed64 next file number]
+//   MANIFEST_ADD_FILE [varint level][fixed64 number][fixed64 size]
+//     [fixed64 flush number][varint length][smallest key][varint length]
+//     [largest key]
+//   MANIFEST_REMOVE_FILE [fixed64 number]
+//   MANIFEST_LAST_SEQUENCE [fixed64 sequence of the newest flushed entry]
+// Replaying the records in order rebuilds the set of live SSTables. A record
+// cut short by a crash is ignored.
+#define MANIFEST_NEXT_FILE 1
+#define MANIFEST_ADD_FILE 2
+#define MANIFEST_REMOVE_FILE 3
+#define MANIFEST_LAST_SEQUENCE 4
+
+// A live SSTable, shared by every version that includes it
+typedef struct {
+  uint64_t number;      // Names the file, see FILENAME_FORMAT
+  uint64_t flushNumber; // Newest flushed table whose entries it holds
+  int level;
+  uint64_t fileSize;
+  char *smallestKey;
+  char *largestKey;
+  int refs;           // Versions holding the file, guarded by the version
+                      // set mutex
+  int obsolete;       // Set once the file left the current version for good
+  int beingCompacted; // Set while a compaction reads it, guarded by the
+                      // compaction scheduler
+} FileMetaData;
+
+// The files of one level
+typedef struct {
+  FileMetaData **files;
+  int count;
+  int capacity;
+} FileList;
+
+// An immutable snapshot of the live SSTables
+// Level 0 holds flushed tables, which may overlap, newest first by flush
+// number, so a merged table keeps the place of the tables it replaced. Deeper
+// levels hold tables with disjoint key ranges, sorted by smallest key.
+// Readers hold a reference while they search, so a compaction can install a
+// new version without waiting for them, and no file a reader may still open
+// is deleted.
+typedef struct Version {
+  FileList levels[NUM_LEVELS];
+  int refs; // Guarded by the version set mutex
+  struct VersionSet *set;
+} Version;
+
+// A change to the live SSTables, applied as a whole
+typedef struct {
+  FileMetaData *added; // Descriptions of the new files, copied when applied
+  int addedCount;
+  int addedCapacity;
+  uint64_t *removed; // Numbers of the removed files
+  int removedCount;
+  int removedCapacity;
+  uint64_t lastSequence; // Newest entry of the added files, 0 if unchanged
+} VersionEdit;
+
+// The current version plus the manifest that makes it durable
+typedef struct VersionSet {
+  pthread_mutex_t mutex;
+  char *directory; // Holds the SSTables and the manifest
+  Version *current;
+  FILE *manifest; // Open for appending edits
+  uint64_t nextFileNumber;
+  uint64_t lastSequence;  // Newest entry ever written to an SSTable
+  TableCache *tableCache; // Obsolete files are evicted from it
+} VersionSet;
+
+// Function declarations
+// Loads the live SSTables of a directory from its manifest, or from the
+// directory itself if there is no manifest yet, and starts a fresh manifest
+// Returns NULL if the manifest could not be written
+VersionSet *openVersionSet(const char *directory, TableCache *tableCache);
+// Releases the current version and closes the manifest
+void closeVersionSet(VersionSet *versions);
+// Returns a number for a new SSTable, never used before
+uint64_t newFileNumber(VersionSet *versions);
+// Keeps newFileNumber from returning a number already found on disk
+void markFileNumberUsed(VersionSet *versions, uint64_t number);
+// Returns the current version with a reference the caller must drop
+Version *getCurrentVersion(VersionSet *versions);
+// Drops a reference to a version
+void unrefVersion(Version *version);
+// Returns the file of a level 1+ whose key range holds key, or NULL
+FileMetaData *findFileInLevel(const FileList *level, const char *key);
+// Returns the number of files in a version
+int versionFileCount(const Version *version);
+// Prints the files of every level of a version
+void printVersion(const Version *version);
+// Prepares an empty edit
+void initVersionEdit(VersionEdit *edit);
+// Records a new file in an edit, holding the entries of its own flush
+// Returns the description, so the caller can change its flush number
+FileMetaData *addFileToEdit(VersionEdit *edit, uint64_t number, int level,
+                   uint64_t fileSize, const char *smallestKey,
+                   const char *largestKey);
+// Records the removal of a file in an edit
+void removeFileFromEdit(VersionEdit *edit, uint64_t number);
+// Frees the contents of an edit
+void freeVersionEdit(VersionEdit *edit);
+// Logs an edit to the manifest and installs the resulting version
+// Returns 0 if the manifest could not be written
+int applyVersionEdit(VersionSet *versions, VersionEdit *edit);
+// Formats the path of an SSTable from its directory and number
+void tableFilePath(char *buffer, size_t size, const char *directory,
+                   uint64_t number);
+// Formats the path of a write-ahead log from its directory and number
+void logFilePath(char *buffer, size_t size, const char *directory,
+                 uint64_t number);
+// Syncs the entries of a directory, returns 0 on error
+int syncDirectory(const char *directory);
+// Takes the lock of a directory, so no other open database uses it
+// Returns the descriptor holding the lock, or -1 if it is taken
+int lockDirectory(const char *directory);
+// Releases a lock taken by lockDirectory
+void unlockDirectory(int fd);
+
+#endif // VERSION_H
@@ -0,0 +1,345 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "coding.h"
+#include "wal.h"
+
+// Lookup table of the CRC-32 polynomial, built on first use
+static uint32_t crcTable[256];
+static pthread_once_t crcTableOnce = PTHREAD_ONCE_INIT;
+
+/*
+ * static void buildCrcTable()
+ *   Fills the CRC-32 lookup table for the reflected polynomial 0xEDB88320.
+ */
+static void buildCrcTable() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320U : crc >> 1;
+    }
+    crcTable[i] = crc;
+  }
+}
+
+/*
+ * uint32_t logChecksum(const char *data, size_t size)
+ *   Public function to compute the checksum of a log record payload.
+ * @param data: The bytes to check
+ * @param size: The number of bytes
+ * @return: The CRC-32 of the bytes
+ */
+uint32_t logChecksum(const char *data, size_t size) {
+  pthread_once(&crcTableOnce, buildCrcTable);
+  uint32_t crc = 0xFFFFFFFFU;
+  for (size_t i = 0; i < size; i++) {
+    crc = crcTable[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFFU;
+}
+
+/*
+ * WriteAheadLog *createWriteAheadLog(const char *filepath, uint64_t number)
+ *   Public function to start the log of a new memtable.
+ * @param filepath: The file to create, emptied if it exists
+ * @param number: The number of the log
+ * @return: The new log, or NULL if the file could not be created
+ */
+WriteAheadLog *createWriteAheadLog(const char *filepath, uint64_t number) {
+  int fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    perror("Failed to create write-ahead log");
+    return NULL;
+  }
+  WriteAheadLog *log = calloc(1, sizeof(WriteAheadLog));
+  if (log == NULL) {
+    perror("Failed to allocate memory for write-ahead log");
+    exit(EXIT_FAILURE);
+  }
+  log->fd = fd;
+  log->number = number;
+  return log;
+}
+
+/*
+ * static char *reserveLogRecord(WriteAheadLog *log, size_t payloadSize)
+ *   Makes room for a record at the end of the buffer of a log.
+ *   If the buffer is full, double it.
+ * @param log: The log
+ * @param payloadSize: The largest the payload of the record may be
+ * @return: Where the payload of the record goes
+ */
+static char *reserveLogRecord(WriteAheadLog *log, size_t payloadSize) {
+  size_t needed = WAL_HEADER_SIZE + payloadSize;
+  if (log->bufferSize + needed > log->bufferCapacity) {
+    size_t capacity = log->bufferCapacity == 0 ? 4096 : log->bufferCapacity;
+    while (log->bufferSize + needed > capacity) {
+      capacity *= 2;
+    }
+    char *temp = realloc(log->buffer, capacity);
+    if (temp == NULL) {
+      perror("Failed to reallocate memory for write-ahead log buffer");
+      exit(EXIT_FAILURE);
+    }
+    log->buffer = temp;
+    log->bufferCapacity = capacity;
+  }
+  return log->buffer + log->bufferSize + WAL_HEADER_SIZE;
+}
+
+/*
+ * static void sealLogRecord(WriteAheadLog *log, uint32_t payloadSize)
+ *   Writes the header of the record reserved last and adds it to the buffer.
+ * @param log: The log
+ * @param payloadSize: The size of the encoded payload
+ */
+static void sealLogRecord(WriteAheadLog *log, uint32_t payloadSize) {
+  char *record = log->buffer + log->bufferSize;
+  char *payload = record + WAL_HEADER_SIZE;
+  encodeFixed32(record, logChecksum(payload, payloadSize));
+  encodeFixed32(record + 4, payloadSize);
+  log->bufferSize += WAL_HEADER_SIZE + payloadSize;
+}
+
+/*
+ * void addLogRecord(WriteAheadLog *log, uint64_t sequence, const char *key,
+ *                   const char *value)
+ *   Public function to encode a record of a single write into the buffer of
+ *   a log. Nothing is written until commitLog.
+ * @param log: The log
+ * @param sequence: The sequence number of the write
+ * @param key: The key written or deleted
+ * @param value: The value, or NULL for a deletion
+ */
+void addLogRecord(WriteAheadLog *log, uint64_t sequence, const char *key,
+                  const char *value) {
+  uint32_t keyLength = strlen(key);
+  uint32_t valueLength = value != NULL ? strlen(value) : 0;
+  char *payload = reserveLogRecord(log, WAL_BATCH_HEADER_SIZE +
+                                            BATCH_ENTRY_OVERHEAD + keyLength +
+                                            valueLength);
+  encodeFixed64(payload, sequence);
+  encodeFixed32(payload + 8, 1);
+  size_t entrySize = encodeBatchEntry(payload + WAL_BATCH_HEADER_SIZE, key,
+                                      keyLength, value, valueLength);
+  sealLogRecord(log, WAL_BATCH_HEADER_SIZE + entrySize);
+}
+
+/*
+ * void addLogBatch(WriteAheadLog *log, uint64_t sequence,
+ *                  const WriteBatch *batch)
+ *   Public function to encode a record of a whole batch into the buffer of
+ *   a log. The batch is already in the layout of the entries of a record,
+ *   so it is copied as is.
+ * @param log: The log
+ * @param sequence: The sequence number of the first entry of the batch
+ * @param batch: The batch
+ */
+void addLogBatch(WriteAheadLog *log, uint64_t sequence,
+                 const WriteBatch *batch) {
+  char *payload = reserveLogRecord(log, WAL_BATCH_HEADER_SIZE + batch->size);
+  encodeFixed64(payload, sequence);
+  encodeFixed32(payload + 8, batch->count);
+  if (batch->size > 0) {
+    memcpy(payload + WAL_BATCH_HEADER_SIZE, batch->data, batch->size);
+  }
+  sealLogRecord(log, WAL_BATCH_HEADER_SIZE + batch->size);
+}
+
+/*
+ * int commitLog(WriteAheadLog *log, int sync)
+ *   Public function to append the buffered records to the log file with a
+ *   single pwrite at the end of the log, retried until every byte is out,
+ *   then sync them. pwrite rather than write, which the LSM itself exports.
+ * @param log: The log
+ * @param sync: Set to force the records to disk before returning
+ * @return: 1 on success, 0 on a write error
+ */
+int commitLog(WriteAheadLog *log, int sync) {
+  size_t written = 0;
+  while (written < log->bufferSize) {
+    ssize_t result = pwrite(log->fd, log->buffer + written,
+                            log->bufferSize - written, log->size + written);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      perror("Failed to append to write-ahead log");
+      log->bufferSize = 0;
+      return 0;
+    }
+    written += result;
+  }
+  log->size += written;
+  log->bufferSize = 0;
+  return !sync || syncLog(log);
+}
+
+/*
+ * int syncLog(WriteAheadLog *log)
+ *   Public function to force the appended records of a log to disk. Does
+ *   nothing if no record was appended since the last sync.
+ * @param log: The log
+ * @return: 1 on success, 0 if the sync failed
+ */
+int syncLog(WriteAheadLog *log) {
+  if (log->syncedSize == log->size) {
+    return 1;
+  }
+  if (fdatasync(log->fd) != 0) {
+    perror("Failed to sync write-ahead log");
+    return 0;
+  }
+  log->syncedSize = log->size;
+  return 1;
+}
+
+/*
+ * void closeWriteAheadLog(WriteAheadLog *log)
+ *   Public function to close a log. Records still buffered are dropped and
+ *   appended ones are not synced, the file stays on disk.
+ * @param log: The log to close
+ */
+void closeWriteAheadLog(WriteAheadLog *log) {
+  close(log->fd);
+  free(log->buffer);
+  free(log);
+}
+
+/*
+ * int openLogReader(LogReader *reader, const char *filepath)
+ *   Public function to map a log left by an earlier run. The records are
+ *   decoded in place, straight from the page cache.
+ * @param reader: The reader to initialize
+ * @param filepath: The log to replay
+ * @return: 1 on success, 0 if the file could not be opened or mapped
+ */
+int openLogReader(LogReader *reader, const char *filepath) {
+  memset(reader, 0, sizeof(LogReader));
+  int fd = open(filepath, O_RDONLY);
+  if (fd < 0) {
+    perror("Failed to open write-ahead log");
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    perror("Failed to stat write-ahead log");
+    close(fd);
+    return 0;
+  }
+  reader->size = st.st_size;
+  if (reader->size > 0) {
+    void *map = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      perror("Failed to map write-ahead log");
+      close(fd);
+      return 0;
+    }
+    // Read front to back, once
+    madvise(map, reader->size, MADV_SEQUENTIAL);
+    reader->map = map;
+  }
+  // The mapping stays valid without the descriptor
+  close(fd);
+  return 1;
+}
+
+/*
+ * static int nextLogBatch(LogReader *reader)
+ *   Moves a reader to the next record of its log. A record whose header or
+ *   payload runs past the end of the file, whose payload fails its
+ *   checksum, or whose entries do not decode, was being written when the
+ *   process stopped: the walk ends there and reader->corrupt is set. Every
+ *   entry is checked before the first is returned, so a batch is replayed
+ *   whole or not at all.
+ * @param reader: The reader
+ * @return: 1 if a record was loaded, 0 at the end of the log
+ */
+static int nextLogBatch(LogReader *reader) {
+  size_t left = reader->size - reader->offset;
+  if (left == 0) {
+    return 0;
+  }
+  const char *header = reader->map + reader->offset;
+  if (left < WAL_HEADER_SIZE ||
+      decodeFixed32(header + 4) > left - WAL_HEADER_SIZE) {
+    reader->corrupt = 1;
+    return 0;
+  }
+  uint32_t payloadSize = decodeFixed32(header + 4);
+  const char *payload = header + WAL_HEADER_SIZE;
+  const char *limit = payload + payloadSize;
+  if (payloadSize < WAL_BATCH_HEADER_SIZE ||
+      logChecksum(payload, payloadSize) != decodeFixed32(header)) {
+    reader->corrupt = 1;
+    return 0;
+  }
+  uint32_t count = decodeFixed32(payload + 8);
+  const char *ptr = payload + WAL_BATCH_HEADER_SIZE;
+  BatchEntry entry;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!decodeBatchEntry(&ptr, limit, &entry)) {
+      reader->corrupt = 1;
+      return 0;
+    }
+  }
+  if (ptr != limit) {
+    reader->corrupt = 1;
+    return 0;
+  }
+
+  reader->sequence = decodeFixed64(payload);
+  reader->entry = payload + WAL_BATCH_HEADER_SIZE;
+  reader->limit = limit;
+  reader->entriesLeft = count;
+  reader->offset += WAL_HEADER_SIZE + payloadSize;
+  return 1;
+}
+
+/*
+ * int nextLogRecord(LogReader *reader, LogRecord *record)
+ *   Public function to decode the next write of a mapped log, moving on to
+ *   the next record once every entry of the current one is decoded. The
+ *   walk ends at the first torn or corrupt record, see nextLogBatch.
+ * @param reader: The reader
+ * @param record: Set to the write, its key and value point into the map
+ * @return: 1 if a write was decoded, 0 at the end of the log
+ */
+int nextLogRecord(LogReader *reader, LogRecord *record) {
+  while (reader->entriesLeft == 0) {
+    if (!nextLogBatch(reader)) {
+      return 0;
+    }
+  }
+  BatchEntry entry;
+  // Checked by nextLogBatch
+  decodeBatchEntry(&reader->entry, reader->limit, &entry);
+  record->sequence = reader->sequence++;
+  record->type = entry.type;
+  record->key = entry.key;
+  record->keyLength = entry.keyLength;
+  record->value = entry.value;
+  record->valueLength = entry.valueLength;
+  reader->entriesLeft--;
+  return 1;
+}
+
+/*
+ * void closeLogReader(LogReader *reader)
+ *   Public function to unmap a log opened with openLogReader. Records
+ *   decoded from it must no longer be used.
+ * @param reader: The reader to close
+ */
+void closeLogReader(LogReader *reader) {
+  if (reader->map != NULL) {
+    munmap((void *)reader->map, reader->size);
+  }
+  memset(reader, 0, sizeof(LogReader));
+}
@@ -0,0 +1,91 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "batch.h"
+
+// Log layout
+// A sequence of records, each
+//   [fixed32 checksum][fixed32 length][payload]
+// where the checksum is the CRC-32 of the payload, and the payload is
+//   [fixed64 sequence][fixed32 count][entries]
+// holding count entries in the layout of a write batch (see batch.h), the
+// first numbered sequence and the others after it. A single write is a
+// record of one entry. A record cut short or corrupted by a crash fails its
+// checksum, and so does everything after it, so a batch is replayed whole or
+// not at all.
+#define WAL_HEADER_SIZE 8
+#define WAL_BATCH_HEADER_SIZE 12 // Sequence and count
+
+// When appended records are forced to disk
+#define WAL_SYNC_ALWAYS 0   // Before a write returns
+#define WAL_SYNC_INTERVAL 1 // By a background thread every syncInterval ms
+#define WAL_SYNC_NEVER 2    // Whenever the OS writes them back
+#define WAL_SYNC_INTERVAL_MS 100
+
+// The log of one memtable
+// Records are encoded into buffer, then appended together by commitLog with
+// a single write, so a group of writers pays for one system call and at most
+// one sync. Only one thread may add to or commit a log at a time.
+typedef struct {
+  int fd;
+  uint64_t number;     // Names the file, see LOG_FILENAME_FORMAT
+  uint64_t size;       // Bytes appended to the file
+  uint64_t syncedSize; // Bytes known to be on disk
+  char *buffer;        // Records waiting to be appended
+  size_t bufferSize;
+  size_t bufferCapacity;
+} WriteAheadLog;
+
+// A write decoded by nextLogRecord, pointing into the mapped log
+typedef struct {
+  uint64_t sequence;   // Sequence number of the write
+  uint8_t type;        // BATCH_TYPE_VALUE or BATCH_TYPE_DELETION
+  const char *key;     // Not terminated
+  uint32_t keyLength;
+  const char *value;   // Not terminated, NULL for a deletion
+  uint32_t valueLength;
+} LogRecord;
+
+// Walks the writes of a log file mapped into memory, nothing is copied
+typedef struct {
+  const char *map;      // The whole file, NULL if it is empty
+  size_t size;
+  size_t offset;        // Next record to decode
+  int corrupt;          // Set if the walk stopped at a torn or corrupt record
+  const char *entry;    // Next entry of the current record
+  const char *limit;    // End of the current record
+  uint32_t entriesLeft; // Entries of the current record not yet decoded
+  uint64_t sequence;    // Sequence number of the next entry
+} LogReader;
+
+// Function declarations
+// Creates an empty log file, returns NULL if it could not be created
+WriteAheadLog *createWriteAheadLog(const char *filepath, uint64_t number);
+// Encodes a record of a single write into the buffer of the log, a NULL
+// value is a deletion
+void addLogRecord(WriteAheadLog *log, uint64_t sequence, const char *key,
+                  const char *value);
+// Encodes a record of every entry of a batch, numbered from sequence on
+void addLogBatch(WriteAheadLog *log, uint64_t sequence,
+                 const WriteBatch *batch);
+// Appends the buffered records to the file, then syncs it if sync is set
+// Returns 0 on a write error, in which case the records are dropped
+int commitLog(WriteAheadLog *log, int sync);
+// Forces every appended record to disk, returns 0 on error
+int syncLog(WriteAheadLog *log);
+// Closes the file and frees the log, leaving the file on disk
+void closeWriteAheadLog(WriteAheadLog *log);
+// Maps a log file for replay, returns 0 if it could not be opened
+int openLogReader(LogReader *reader, const char *filepath);
+// Decodes the next write, returns 0 at the end of the log or at the first
+// record that fails its checksum
+int nextLogRecord(LogReader *reader, LogRecord *record);
+// Unmaps a log opened with openLogReader
+void closeLogReader(LogReader *reader);
+// Computes the CRC-32 of a buffer
+uint32_t logChecksum(const char *data, size_t size);
+
+#endif // WAL_H